@@ -0,0 +1,280 @@
+#include "AccessPointRegistry.h"
+
+AccessPointRegistry::AccessPointRegistry()
+{
+  memset(index, ACCESS_POINT_NONE, sizeof(index));
+}
+
+void AccessPointRegistry::setup(Settings* settings, Debug* debug)
+{
+  this->settings = settings;
+  this->debug = debug;
+}
+
+void AccessPointRegistry::load()
+{
+  StoredAccessPoints storedAccessPoints;
+  if (!settings->getAccessPoints(&storedAccessPoints)) {
+    return;
+  }
+
+  for (byte storedIndex = 0; storedIndex < storedAccessPoints.count; storedIndex++) {
+    StoredAccessPoint* storedAccessPoint = &storedAccessPoints.list[storedIndex];
+    storedAccessPoint->ssid[32] = 0;
+    storedAccessPoint->psk[64] = 0;
+
+    uint32_t ssidHash = hashSsid(storedAccessPoint->ssid, strlen(storedAccessPoint->ssid));
+    byte accessPointIndex = find(ssidHash);
+    if (accessPointIndex == ACCESS_POINT_NONE) {
+      if (count >= ACCESS_POINT_REGISTRY_SIZE) {
+        debug->error(F("The access point registry is full, dropping stored AP ") + String(storedAccessPoint->ssid));
+        continue;
+      }
+
+      accessPointIndex = count++;
+      list[accessPointIndex] = AccessPoint();
+      list[accessPointIndex].ssidHash = ssidHash;
+      insertIndex(accessPointIndex);
+    }
+
+    // the stored one overrides the one from the sketch, as that's the more recent
+    AccessPoint* accessPoint = &list[accessPointIndex];
+    memcpy(accessPoint->ssid, storedAccessPoint->ssid, sizeof(accessPoint->ssid));
+    memcpy(accessPoint->psk, storedAccessPoint->psk, sizeof(accessPoint->psk));
+    accessPoint->priority = storedAccessPoint->priority;
+    accessPoint->stored = true;
+  }
+
+  debug->info(F("Loaded ") + String(storedAccessPoints.count) + F(" stored access points."));
+}
+
+bool AccessPointRegistry::add(String ssid, String psk, byte priority, bool store)
+{
+  if (ssid.length() == 0) {
+    debug->error(F("The ssid is empty!"));
+    return false;
+  }
+
+  if (ssid.length() > 32 || psk.length() > 64) {
+    debug->error(F("Too long ssid or psk!"));
+    return false;
+  }
+
+  uint32_t ssidHash = hashSsid(ssid.c_str(), ssid.length());
+  byte accessPointIndex = find(ssidHash);
+  if (accessPointIndex == ACCESS_POINT_NONE) {
+    if (count >= ACCESS_POINT_REGISTRY_SIZE) {
+      debug->error(F("The access point registry is full!"));
+      return false;
+    }
+
+    accessPointIndex = count++;
+    list[accessPointIndex] = AccessPoint();
+    list[accessPointIndex].ssidHash = ssidHash;
+    insertIndex(accessPointIndex);
+  }
+  else if (ssid != list[accessPointIndex].ssid) {
+    debug->error(F("The ssid hash collides with ") + String(list[accessPointIndex].ssid) + "!");
+    return false;
+  }
+
+  AccessPoint* accessPoint = &list[accessPointIndex];
+  ssid.toCharArray(accessPoint->ssid, sizeof(accessPoint->ssid));
+  psk.toCharArray(accessPoint->psk, sizeof(accessPoint->psk));
+  accessPoint->priority = priority;
+
+  if (store) {
+    accessPoint->stored = true;
+    this->store();
+  }
+
+  return true;
+}
+
+bool AccessPointRegistry::remove(String ssid, byte* trackedIndex)
+{
+  byte accessPointIndex = find(hashSsid(ssid.c_str(), ssid.length()));
+  if (accessPointIndex == ACCESS_POINT_NONE || ssid != list[accessPointIndex].ssid) {
+    return false;
+  }
+
+  bool stored = list[accessPointIndex].stored;
+
+  // keep the list packed, and the index pointing to the right places
+  count--;
+  list[accessPointIndex] = list[count];
+  rebuildIndex();
+
+  if (trackedIndex) {
+    if (*trackedIndex == accessPointIndex) {
+      *trackedIndex = ACCESS_POINT_NONE;
+    }
+    else if (*trackedIndex == count) {
+      *trackedIndex = accessPointIndex;
+    }
+  }
+
+  if (stored) {
+    store();
+  }
+
+  return true;
+}
+
+byte AccessPointRegistry::find(uint32_t ssidHash)
+{
+  for (byte probe = 0; probe < ACCESS_POINT_INDEX_SIZE; probe++) {
+    byte accessPointIndex = index[(ssidHash + probe) & (ACCESS_POINT_INDEX_SIZE - 1)];
+    if (accessPointIndex == ACCESS_POINT_NONE) {
+      return ACCESS_POINT_NONE;
+    }
+
+    if (list[accessPointIndex].ssidHash == ssidHash) {
+      return accessPointIndex;
+    }
+  }
+
+  return ACCESS_POINT_NONE;
+}
+
+void AccessPointRegistry::resetScan()
+{
+  for (byte accessPointIndex = 0; accessPointIndex < count; accessPointIndex++) {
+    list[accessPointIndex].found = false;
+    list[accessPointIndex].signalStrength = -1000;
+  }
+}
+
+bool AccessPointRegistry::matchScanResult(const char* ssid, byte ssidLength, int rssi)
+{
+  byte accessPointIndex = find(hashSsid(ssid, ssidLength));
+  if (accessPointIndex == ACCESS_POINT_NONE) {
+    return false;
+  }
+
+  // rule out hash collisions
+  AccessPoint* accessPoint = &list[accessPointIndex];
+  if (strlen(accessPoint->ssid) != ssidLength || memcmp(accessPoint->ssid, ssid, ssidLength) != 0) {
+    return false;
+  }
+
+  accessPoint->found = true;
+
+  // same ssid can be used by multiple APs, and we wan't to store the strongest signal
+  if (rssi > accessPoint->signalStrength) {
+    accessPoint->signalStrength = rssi;
+  }
+
+  return true;
+}
+
+byte AccessPointRegistry::select()
+{
+  byte selectedIndex = ACCESS_POINT_NONE;
+  for (byte accessPointIndex = 0; accessPointIndex < count; accessPointIndex++) {
+    // If the stored network cannot be found, drop it.
+    if (!list[accessPointIndex].found) {
+      continue;
+    }
+
+    if (selectedIndex == ACCESS_POINT_NONE || isBetter(&list[accessPointIndex], &list[selectedIndex])) {
+      selectedIndex = accessPointIndex;
+    }
+  }
+
+  return selectedIndex;
+}
+
+bool AccessPointRegistry::isBetter(AccessPoint* candidate, AccessPoint* selected)
+{
+  if (candidate->priority != selected->priority) {
+    return candidate->priority < selected->priority;
+  }
+
+  int signalDifference = candidate->signalStrength - selected->signalStrength;
+  if (abs(signalDifference) > ACCESS_POINT_RSSI_HYSTERESIS) {
+    return signalDifference > 0;
+  }
+
+  if (candidate->lastSuccess != selected->lastSuccess) {
+    return candidate->lastSuccess > selected->lastSuccess;
+  }
+
+  return signalDifference > 0;
+}
+
+void AccessPointRegistry::markSuccess(byte accessPointIndex)
+{
+  if (accessPointIndex >= count) {
+    return;
+  }
+
+  list[accessPointIndex].lastSuccess = ++successCounter;
+}
+
+String AccessPointRegistry::toString()
+{
+  String data = "";
+  for (byte accessPointIndex = 0; accessPointIndex < count; accessPointIndex++) {
+    AccessPoint* accessPoint = &list[accessPointIndex];
+    data +=
+      F("ssid: ") + String(accessPoint->ssid) +
+      F(", priority: ") + String(accessPoint->priority) +
+      F(", rssi: ") + String(accessPoint->signalStrength) +
+      F(", found: ") + String(accessPoint->found, DEC) +
+      F(", stored: ") + String(accessPoint->stored, DEC) +
+      "\r\n";
+  }
+
+  return data;
+}
+
+uint32_t AccessPointRegistry::hashSsid(const char* ssid, size_t length)
+{
+  uint32_t hash = 2166136261UL;
+  for (size_t position = 0; position < length; position++) {
+    hash ^= (byte)ssid[position];
+    hash *= 16777619UL;
+  }
+
+  return hash;
+}
+
+void AccessPointRegistry::rebuildIndex()
+{
+  memset(index, ACCESS_POINT_NONE, sizeof(index));
+  for (byte accessPointIndex = 0; accessPointIndex < count; accessPointIndex++) {
+    insertIndex(accessPointIndex);
+  }
+}
+
+void AccessPointRegistry::insertIndex(byte accessPointIndex)
+{
+  uint32_t ssidHash = list[accessPointIndex].ssidHash;
+  for (byte probe = 0; probe < ACCESS_POINT_INDEX_SIZE; probe++) {
+    byte slot = (ssidHash + probe) & (ACCESS_POINT_INDEX_SIZE - 1);
+    if (index[slot] == ACCESS_POINT_NONE) {
+      index[slot] = accessPointIndex;
+      return;
+    }
+  }
+}
+
+void AccessPointRegistry::store()
+{
+  StoredAccessPoints storedAccessPoints;
+  memset(storedAccessPoints.list, 0, sizeof(storedAccessPoints.list));
+
+  for (byte accessPointIndex = 0; accessPointIndex < count; accessPointIndex++) {
+    if (!list[accessPointIndex].stored) {
+      continue;
+    }
+
+    StoredAccessPoint* storedAccessPoint = &storedAccessPoints.list[storedAccessPoints.count++];
+    memcpy(storedAccessPoint->ssid, list[accessPointIndex].ssid, sizeof(storedAccessPoint->ssid));
+    memcpy(storedAccessPoint->psk, list[accessPointIndex].psk, sizeof(storedAccessPoint->psk));
+    storedAccessPoint->priority = list[accessPointIndex].priority;
+  }
+
+  settings->storeAccessPoints(&storedAccessPoints);
+}
@@ -0,0 +1,128 @@
+#ifndef ACCESS_POINT_REGISTRY_H
+#define ACCESS_POINT_REGISTRY_H
+
+#include <ESP8266WiFi.h>
+#include <Arduino.h>
+
+#include "Settings.h"
+#include "Debug.h"
+
+// Slots of the hash index, a power of two at least twice the size of the registry, so probes stay short.
+#define ACCESS_POINT_INDEX_SIZE 16
+#define ACCESS_POINT_NONE 255
+
+// Signal strength difference in dBm under which two APs of the same priority are considered equal,
+// and the one connected to more recently wins.
+#define ACCESS_POINT_RSSI_HYSTERESIS 6
+
+#if ACCESS_POINT_INDEX_SIZE < 2 * ACCESS_POINT_REGISTRY_SIZE
+  #error ACCESS_POINT_INDEX_SIZE must be at least twice ACCESS_POINT_REGISTRY_SIZE
+#endif
+
+struct AccessPoint {
+  uint32_t ssidHash = 0;
+  char ssid[33];
+  char psk[65];
+  byte priority = 255;
+
+  // Whether it was added over the http interface and is stored in the EEPROM.
+  bool stored = false;
+
+  // Updated by every scan.
+  int signalStrength = -1000;
+  bool found = false;
+
+  // Value of the success counter at the last successful connection, the higher the more recent. 0 if never.
+  uint32_t lastSuccess = 0;
+};
+
+class AccessPointRegistry
+{
+  public:
+    Settings* settings;
+    Debug* debug;
+
+    AccessPoint list[ACCESS_POINT_REGISTRY_SIZE];
+    byte count = 0;
+
+    AccessPointRegistry();
+
+    void setup(Settings* settings, Debug* debug);
+
+    /**
+     * Adds the stored access points from the EEPROM.
+     */
+    void load();
+
+    /**
+     * Adds an access point, or updates it if there's one with the same ssid already.
+     * @param  String   ssid     SSID of the AP.
+     * @param  String   psk      WPA-PSK for the AP.
+     * @param  byte     priority The lower the number, higher the priority. Range is 0 to 255.
+     * @param  bool     store    Whether to store it in the EEPROM.
+     * @return bool              False if the ssid is empty, the ssid or psk is too long, or the registry is full.
+     */
+    bool add(String ssid, String psk, byte priority = 255, bool store = false);
+
+    /**
+     * Removes an access point, and from the EEPROM too if it was stored.
+     * The last access point of the list is moved into its place.
+     * @param  String ssid
+     * @param  byte*  trackedIndex An index into the list to keep pointing to the same access point,
+     *                             set to ACCESS_POINT_NONE if it is the one removed.
+     * @return bool                False if there's no such access point.
+     */
+    bool remove(String ssid, byte* trackedIndex = nullptr);
+
+    /**
+     * Finds the access point by the hash of its ssid with a single probe of the hash index.
+     * @param  ssidHash
+     * @return byte     Index in the list or ACCESS_POINT_NONE.
+     */
+    byte find(uint32_t ssidHash);
+
+    /**
+     * Forgets the results of the previous scan.
+     */
+    void resetScan();
+
+    /**
+     * Matches a scan result against the registry, and stores the strongest signal for the matching access point.
+     * @param  ssid       Not null terminated.
+     * @param  ssidLength
+     * @param  rssi
+     * @return bool       Whether it matched an access point.
+     */
+    bool matchScanResult(const char* ssid, byte ssidLength, int rssi);
+
+    /**
+     * Selects the best access point found by the last scan.
+     * The lowest priority number wins, then the stronger signal, and if the signals
+     * are within ACCESS_POINT_RSSI_HYSTERESIS, the one connected to more recently.
+     * @return byte Index in the list or ACCESS_POINT_NONE.
+     */
+    byte select();
+
+    void markSuccess(byte accessPointIndex);
+
+    String toString();
+
+    /**
+     * FNV-1a hash of the ssid, the key of the hash index and of the cached AP in the EEPROM.
+     * @param  ssid
+     * @param  length
+     * @return uint32_t
+     */
+    static uint32_t hashSsid(const char* ssid, size_t length);
+
+  private:
+    byte index[ACCESS_POINT_INDEX_SIZE];
+    uint32_t successCounter = 0;
+
+    void rebuildIndex();
+    void insertIndex(byte accessPointIndex);
+    bool isBetter(AccessPoint* candidate, AccessPoint* selected);
+    void store();
+};
+
+#endif
@@ -0,0 +1,456 @@
+#include "ActionSchedule.h"
+
+ActionSchedule* ActionSchedule::instance = nullptr;
+
+void ActionSchedule::setup(Debug* debug, Pins* pins, Scheduler* scheduler)
+{
+  this->debug = debug;
+  this->pins = pins;
+  this->scheduler = scheduler;
+}
+
+void ActionSchedule::restore()
+{
+  if (!enabled) {
+    return;
+  }
+
+  entries = new (std::nothrow) ScheduleEntry[SCHEDULE_MAX_ENTRIES];
+  if (!entries || !wheel.begin(SCHEDULE_MAX_ENTRIES, 0)) {
+    debug->error(F("Not enough memory for the schedule."));
+    return;
+  }
+
+  for (uint16_t index = 0; index < SCHEDULE_MAX_ENTRIES; index++) {
+    entries[index].used = false;
+    entries[index].uptime = false;
+    entries[index].pulseTimerId = TIMER_WHEEL_INVALID_ID;
+  }
+
+  rebuildFreeList();
+
+  instance = this;
+  lastTickMillis = millis();
+  ready = true;
+
+  configTime(timezone, ntpServer);
+
+  if (!LittleFS.begin()) {
+    debug->error(F("Could not mount LittleFS, the schedule is not stored."));
+    return;
+  }
+
+  File file = LittleFS.open(SCHEDULE_FILE, "r");
+  if (!file) {
+    return;
+  }
+
+  byte magic = 0;
+  file.read(&magic, 1);
+  if (magic != SCHEDULE_MAGIC) {
+    debug->error(F("The stored schedule is invalid."));
+    file.close();
+    return;
+  }
+
+  uint16_t count = 0;
+  StoredScheduleEntry definition;
+  while (file.read((uint8_t*)&definition, sizeof(StoredScheduleEntry)) == sizeof(StoredScheduleEntry)) {
+    if (definition.id >= SCHEDULE_MAX_ENTRIES || entries[definition.id].used) {
+      continue;
+    }
+
+    entries[definition.id].definition = definition;
+    entries[definition.id].used = true;
+    count++;
+  }
+  file.close();
+  rebuildFreeList();
+
+  // the wall-clock deadlines are armed once the clock is set
+  checkClock();
+
+  debug->info(F("Loaded ") + String(count) + F(" scheduled actions."));
+}
+
+uint16_t ActionSchedule::add(StoredScheduleEntry* definition, bool relative)
+{
+  if (!ready) {
+    error = F("The schedule is not enabled.");
+    return SCHEDULE_NONE;
+  }
+
+  if (
+    definition->pin > 15 ||
+    !pins->settings->isPinInitalized(definition->pin) ||
+    !pins->isOutput(definition->pin)
+  ) {
+    error = F("Only initialized output pins can be scheduled.");
+    return SCHEDULE_NONE;
+  }
+
+  if (definition->action > RULE_ACTION_PULSE) {
+    error = F("Bad action.");
+    return SCHEDULE_NONE;
+  }
+
+  if (definition->action == RULE_ACTION_PULSE && definition->durationMillis == 0) {
+    error = F("The pulse needs a duration.");
+    return SCHEDULE_NONE;
+  }
+
+  if (!relative && !clockSet) {
+    error = F("The clock is not set yet, only relative deadlines can be used.");
+    return SCHEDULE_NONE;
+  }
+
+  uint16_t index = freeHead;
+  if (index == SCHEDULE_NONE) {
+    error = F("There are ") + String(SCHEDULE_MAX_ENTRIES) + F(" scheduled actions already.");
+    return SCHEDULE_NONE;
+  }
+
+  ScheduleEntry* entry = &entries[index];
+  freeHead = entry->nextFree;
+  entry->definition = *definition;
+  entry->definition.id = index;
+  entry->used = true;
+
+  // before the clock is set, the relative deadline is kept in the ticks of the wheel until it can be converted
+  entry->uptime = relative && !clockSet;
+  if (relative) {
+    entry->definition.runAt += wheel.getTick() + (entry->uptime ? 0 : clockOffset);
+  }
+
+  arm(index);
+  markDirty();
+
+  return index;
+}
+
+bool ActionSchedule::remove(uint16_t id)
+{
+  if (!ready || id >= SCHEDULE_MAX_ENTRIES || !entries[id].used) {
+    return false;
+  }
+
+  wheel.remove(id);
+  release(id);
+  markDirty();
+  return true;
+}
+
+void ActionSchedule::clear()
+{
+  if (!ready) {
+    return;
+  }
+
+  for (uint16_t index = 0; index < SCHEDULE_MAX_ENTRIES; index++) {
+    wheel.remove(index);
+    entries[index].used = false;
+  }
+  rebuildFreeList();
+
+  markDirty();
+}
+
+void ActionSchedule::loop()
+{
+  if (!ready) {
+    return;
+  }
+
+  checkClock();
+
+  // the due entries of a tick run before the wheel moves on, a late loop catches up tick by tick
+  while (scheduler->hasBudget()) {
+    uint16_t index = wheel.popExpired();
+    if (index != SCHEDULE_WHEEL_NONE) {
+      fire(index);
+      continue;
+    }
+
+    if (millis() - lastTickMillis < 1000) {
+      break;
+    }
+
+    lastTickMillis += 1000;
+    wheel.advance();
+  }
+
+  if (dirty && millis() - dirtyMillis >= SCHEDULE_STORE_DELAY_MS) {
+    store();
+  }
+}
+
+bool ActionSchedule::isClockSet()
+{
+  return clockSet;
+}
+
+uint32_t ActionSchedule::parseTime(String strTime)
+{
+  if (strTime.indexOf(':') < 0) {
+    long unixTime = strTime.toInt();
+    if (String(unixTime) != strTime || (uint32_t)unixTime < SCHEDULE_MIN_VALID_TIME) {
+      return 0;
+    }
+
+    return unixTime;
+  }
+
+  int hour = 0;
+  int minute = 0;
+  int second = 0;
+  if (
+    sscanf(strTime.c_str(), "%d:%d:%d", &hour, &minute, &second) < 2 ||
+    hour < 0 || hour > 23 || minute < 0 || minute > 59 || second < 0 || second > 59
+  ) {
+    return 0;
+  }
+
+  // today if it is still ahead, tomorrow otherwise, mktime() handles the end of the month and the daylight saving
+  time_t now = time(nullptr);
+  struct tm local;
+  localtime_r(&now, &local);
+  local.tm_hour = hour;
+  local.tm_min = minute;
+  local.tm_sec = second;
+  local.tm_isdst = -1;
+  time_t runAt = mktime(&local);
+  if (runAt <= now) {
+    local.tm_mday++;
+    local.tm_isdst = -1;
+    runAt = mktime(&local);
+  }
+
+  return runAt;
+}
+
+String ActionSchedule::toString()
+{
+  if (!ready) {
+    return "";
+  }
+
+  uint32_t now = clockOffset + wheel.getTick();
+  String report =
+    F("clock: ") + (clockSet ? String(now) + " (" + formatTime(now) + ")" : String(F("not set"))) + "\r\n" +
+    F("armed: ") + String(wheel.getArmedCount()) + "\r\n" +
+    F("fired: ") + String(fired) + "\r\n";
+
+  for (uint16_t index = 0; index < SCHEDULE_MAX_ENTRIES; index++) {
+    ScheduleEntry* entry = &entries[index];
+    if (!entry->used) {
+      continue;
+    }
+
+    StoredScheduleEntry* definition = &entry->definition;
+    String next = "?";
+    if (wheel.isArmed(index)) {
+      uint32_t deadline = wheel.getDeadline(index);
+      int32_t remaining = deadline - wheel.getTick();
+      next = (entry->uptime ? String(F("uptime ")) + String(deadline) : formatTime(deadline + clockOffset)) +
+        F(", in: ") + String(max(remaining, (int32_t)0));
+    }
+
+    report +=
+      "id: " + String(index) +
+      F(", pin: ") + String(definition->pin) +
+      F(", action: ") + RuleEngine::getActionName(definition->action) +
+      F(", next: ") + next +
+      (definition->periodSeconds > 0 ? F(", every: ") + String(definition->periodSeconds) : "") +
+      (definition->action == RULE_ACTION_PULSE ? F(", duration: ") + String(definition->durationMillis) : "") +
+      "\r\n";
+  }
+
+  return report;
+}
+
+void ActionSchedule::arm(uint16_t index)
+{
+  ScheduleEntry* entry = &entries[index];
+  if (!entry->uptime && !clockSet) {
+    return;
+  }
+
+  // the recurring entries continue with their first run after now, a one-shot one due already runs right away
+  uint32_t base = entry->uptime ? 0 : clockOffset;
+  uint32_t now = base + wheel.getTick();
+  uint32_t runAt = entry->definition.runAt;
+  uint32_t period = entry->definition.periodSeconds;
+  if (period > 0 && (int32_t)(now - runAt) >= 0) {
+    runAt += ((now - runAt) / period + 1) * period;
+  }
+
+  wheel.insert(index, runAt - base);
+}
+
+void ActionSchedule::fire(uint16_t index)
+{
+  ScheduleEntry* entry = &entries[index];
+  StoredScheduleEntry* definition = &entry->definition;
+  fired++;
+
+  debug->info(F("Running scheduled action ") + String(index));
+
+  switch (definition->action) {
+    case RULE_ACTION_LOW:
+      writePin(definition->pin, LOW);
+      break;
+    case RULE_ACTION_HIGH:
+      writePin(definition->pin, HIGH);
+      break;
+    case RULE_ACTION_TOGGLE:
+      writePin(definition->pin, pins->getState(definition->pin) ? LOW : HIGH);
+      break;
+    case RULE_ACTION_PULSE:
+      if (!writePin(definition->pin, HIGH)) {
+        break;
+      }
+
+      // a running pulse is extended, or ended first if it is of the pin the entry had before it was reused
+      if (scheduler->timers.isActive(entry->pulseTimerId)) {
+        scheduler->clearTimeout(entry->pulseTimerId);
+        if (entry->pulsePin != definition->pin) {
+          writePin(entry->pulsePin, LOW);
+        }
+      }
+
+      // the index is the context, the timer resets the id, so a stale id can't cancel the timer reusing it
+      entry->pulsePin = definition->pin;
+      entry->pulseTimerId = scheduler->setTimeout(definition->durationMillis, ActionSchedule::onPulseEnd, (void*)(uintptr_t)index);
+      if (entry->pulseTimerId == TIMER_WHEEL_INVALID_ID) {
+        debug->error(F("No timer is free, the pulse ended right away."));
+        writePin(definition->pin, LOW);
+      }
+      break;
+  }
+
+  if (definition->periodSeconds > 0) {
+    arm(index);
+    return;
+  }
+
+  release(index);
+  markDirty();
+}
+
+bool ActionSchedule::writePin(byte digitalPinNumber, byte state)
+{
+  if (!pins->isOutput(digitalPinNumber) || pins->settings->isPinLocked(digitalPinNumber)) {
+    return false;
+  }
+
+  pins->gpio->write(pins->digital2gpio(digitalPinNumber), state);
+  pins->settings->writeByteSet(pins->settings->pinStates, digitalPinNumber, state);
+  return true;
+}
+
+void ActionSchedule::release(uint16_t index)
+{
+  entries[index].used = false;
+  entries[index].nextFree = freeHead;
+  freeHead = index;
+}
+
+void ActionSchedule::rebuildFreeList()
+{
+  freeHead = SCHEDULE_NONE;
+  for (uint16_t index = SCHEDULE_MAX_ENTRIES; index > 0; index--) {
+    if (!entries[index - 1].used) {
+      release(index - 1);
+    }
+  }
+}
+
+void ActionSchedule::checkClock()
+{
+  unsigned long nowMillis = millis();
+  if (clockSet && nowMillis - lastClockCheckMillis < SCHEDULE_CLOCK_CHECK_MS) {
+    return;
+  }
+  lastClockCheckMillis = nowMillis;
+
+  time_t now = time(nullptr);
+  if ((uint32_t)now < SCHEDULE_MIN_VALID_TIME) {
+    return;
+  }
+
+  uint32_t offset = (uint32_t)now - wheel.getTick();
+  int32_t step = offset - clockOffset;
+  if (clockSet && abs(step) <= SCHEDULE_MAX_CLOCK_DRIFT_S) {
+    return;
+  }
+
+  debug->info(clockSet ? F("The clock was stepped, rearming the schedule.") : F("The clock is set, arming the schedule."));
+
+  clockSet = true;
+  clockOffset = offset;
+
+  for (uint16_t index = 0; index < SCHEDULE_MAX_ENTRIES; index++) {
+    ScheduleEntry* entry = &entries[index];
+    if (!entry->used) {
+      continue;
+    }
+
+    if (entry->uptime) {
+      entry->definition.runAt += clockOffset;
+      entry->uptime = false;
+      markDirty();
+    }
+
+    arm(index);
+  }
+}
+
+void ActionSchedule::markDirty()
+{
+  dirty = true;
+  dirtyMillis = millis();
+}
+
+void ActionSchedule::store()
+{
+  dirty = false;
+
+  // written aside and renamed, so a reset while writing leaves the previous file
+  File file = LittleFS.open(SCHEDULE_TEMP_FILE, "w");
+  if (!file) {
+    debug->error(F("Could not store the schedule."));
+    return;
+  }
+
+  byte magic = SCHEDULE_MAGIC;
+  file.write(&magic, 1);
+
+  // the ones still counting the uptime are meaningless after a reset
+  for (uint16_t index = 0; index < SCHEDULE_MAX_ENTRIES; index++) {
+    if (entries[index].used && !entries[index].uptime) {
+      file.write((const uint8_t*)&entries[index].definition, sizeof(StoredScheduleEntry));
+    }
+  }
+  file.close();
+
+  LittleFS.remove(SCHEDULE_FILE);
+  LittleFS.rename(SCHEDULE_TEMP_FILE, SCHEDULE_FILE);
+}
+
+String ActionSchedule::formatTime(uint32_t unixTime)
+{
+  time_t time = unixTime;
+  struct tm local;
+  localtime_r(&time, &local);
+
+  char formatted[20];
+  strftime(formatted, sizeof(formatted), "%Y-%m-%d %H:%M:%S", &local);
+  return formatted;
+}
+
+void ActionSchedule::onPulseEnd(void* context)
+{
+  ScheduleEntry* entry = &instance->entries[(uintptr_t)context];
+  entry->pulseTimerId = TIMER_WHEEL_INVALID_ID;
+  instance->writePin(entry->pulsePin, LOW);
+}
@@ -0,0 +1,177 @@
+#ifndef ACTION_SCHEDULE_H
+#define ACTION_SCHEDULE_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <time.h>
+#include <new>
+
+#include "Debug.h"
+#include "Pins.h"
+#include "Scheduler.h"
+#include "RuleEngine.h"
+#include "ScheduleWheel.h"
+
+// Every entry takes about 30 bytes of RAM, allocated when the schedule is enabled.
+#ifndef SCHEDULE_MAX_ENTRIES
+#define SCHEDULE_MAX_ENTRIES 128
+#endif
+
+#if SCHEDULE_MAX_ENTRIES >= 0xFFFF
+  #error SCHEDULE_MAX_ENTRIES must be less than 65535
+#endif
+
+#define SCHEDULE_NONE 0xFFFF
+
+#define SCHEDULE_FILE "/schedule.bin"
+#define SCHEDULE_TEMP_FILE "/schedule.tmp"
+#define SCHEDULE_MAGIC 0xAB
+
+#define SCHEDULE_DEFAULT_TIMEZONE "UTC0"
+#define SCHEDULE_DEFAULT_NTP_SERVER "pool.ntp.org"
+
+// Unix times before this are taken as the clock not being set yet.
+#define SCHEDULE_MIN_VALID_TIME 1600000000UL
+// Once set, the clock is compared to the uptime this often, the entries are armed again if it was stepped.
+#define SCHEDULE_CLOCK_CHECK_MS 60000
+#define SCHEDULE_MAX_CLOCK_DRIFT_S 2
+
+// The changes are written to the file once they settled for this long, so a burst of them is a single write.
+#define SCHEDULE_STORE_DELAY_MS 2000
+
+/**
+ * An action of the schedule, as stored in the file.
+ */
+struct __attribute__((packed)) StoredScheduleEntry {
+  uint16_t id;
+  byte pin;
+  // One of the RuleAction values.
+  byte action;
+  // Unix time of the run, the first one of the recurring entries.
+  uint32_t runAt;
+  // 0 runs it once.
+  uint32_t periodSeconds;
+  // Length of the pulse action.
+  uint32_t durationMillis;
+};
+
+struct ScheduleEntry {
+  StoredScheduleEntry definition;
+  // Of the pulse started by the entry, it is reset when the pulse ends.
+  uint16_t pulseTimerId;
+  // The pin of that pulse, it still ends if the entry is removed or reused meanwhile.
+  byte pulsePin;
+  // The free entries are linked by it, from freeHead.
+  uint16_t nextFree;
+  bool used;
+  // Whether runAt is in seconds of uptime, for the entries added with a relative deadline before the clock was set.
+  bool uptime;
+};
+
+/**
+ * Sets, toggles or pulses the output pins at given times, once or periodically, without a controller.
+ * The entries are kept in a hierarchical timer wheel turning once a second with the uptime, the wall-clock
+ * deadlines are converted once the clock is set by NTP. The entries are stored on LittleFS, the ones due
+ * while the node was off run right after the clock is set, the recurring ones continue with their next run.
+ */
+class ActionSchedule
+{
+  public:
+    Debug* debug;
+    Pins* pins;
+    Scheduler* scheduler;
+
+    bool enabled = false;
+    // POSIX TZ string of the times of day, e.g. "CET-1CEST,M3.5.0,M10.5.0/3".
+    const char* timezone = SCHEDULE_DEFAULT_TIMEZONE;
+    const char* ntpServer = SCHEDULE_DEFAULT_NTP_SERVER;
+
+    uint32_t fired = 0;
+
+    // Set when the last operation failed, for the http response.
+    String error;
+
+    void setup(Debug* debug, Pins* pins, Scheduler* scheduler);
+
+    /**
+     * Starts the clock sync, loads the stored entries and arms them,
+     * must be called after the pin modes are restored.
+     */
+    void restore();
+
+    /**
+     * Adds an entry and stores the entries.
+     * @param  definition runAt is a unix time, or seconds from now if relative.
+     * @param  relative
+     * @return uint16_t   Id of the entry, or SCHEDULE_NONE if the entry is invalid or there are too many, see error.
+     */
+    uint16_t add(StoredScheduleEntry* definition, bool relative);
+
+    /**
+     * Removes an entry and stores the entries, a pulse it started still ends.
+     * @param  id
+     * @return bool False if there's no such entry.
+     */
+    bool remove(uint16_t id);
+
+    void clear();
+
+    /**
+     * Runs the due actions as long as the task has budget, and stores the changes. Must be called from the main loop.
+     */
+    void loop();
+
+    bool isClockSet();
+
+    /**
+     * Converts a time from the http interface.
+     * @param  strTime   "HH:MM[:SS]" for the next such local time, or a unix time.
+     * @return uint32_t  Unix time, or 0 if invalid.
+     */
+    uint32_t parseTime(String strTime);
+
+    String toString();
+
+  private:
+    ScheduleEntry* entries = nullptr;
+    uint16_t freeHead = SCHEDULE_NONE;
+    ScheduleWheel wheel;
+    bool ready = false;
+
+    bool clockSet = false;
+    // Unix time at tick 0 of the wheel.
+    uint32_t clockOffset = 0;
+    unsigned long lastTickMillis = 0;
+    unsigned long lastClockCheckMillis = 0;
+
+    bool dirty = false;
+    unsigned long dirtyMillis = 0;
+
+    void arm(uint16_t index);
+    void fire(uint16_t index);
+
+    /**
+     * Sets an output pin, the state is only kept in RAM like the states set by the rules,
+     * so the periodic entries don't wear the flash.
+     * @param  digitalPinNumber
+     * @param  state
+     * @return bool             False if the pin is not an output, or it is locked.
+     */
+    bool writePin(byte digitalPinNumber, byte state);
+    void release(uint16_t index);
+
+    /**
+     * Links every free entry, the lowest id first, after the stored entries are loaded.
+     */
+    void rebuildFreeList();
+    void checkClock();
+    void markDirty();
+    void store();
+
+    static String formatTime(uint32_t unixTime);
+
+    static ActionSchedule* instance;
+    static void onPulseEnd(void* context);
+};
+
+#endif
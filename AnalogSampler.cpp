@@ -0,0 +1,129 @@
+#include "AnalogSampler.h"
+
+void AnalogSampler::setup(Debug* debug)
+{
+  this->debug = debug;
+}
+
+bool AnalogSampler::start(uint16_t rate)
+{
+  if (rate < 1 || rate > ANALOG_SAMPLER_MAX_RATE) {
+    debug->error(F("The sampling rate is out of range."));
+    return false;
+  }
+
+  stop();
+
+  uint32_t periodMillis = (1000 + rate / 2) / rate;
+  periodMicros = periodMillis * 1000;
+  this->rate = 1000 / periodMillis;
+
+  sampleCounter = 0;
+  minimum = 0;
+  maximum = 0;
+  sum = 0;
+  ewma = 0;
+  missedSamples = 0;
+  lastSampleMicros = micros();
+
+  debug->info(F("Sampling A0 every ") + String(periodMillis) + "ms");
+
+  ticker.attach_ms(periodMillis, AnalogSampler::tick, this);
+  return true;
+}
+
+void AnalogSampler::stop()
+{
+  ticker.detach();
+  rate = 0;
+}
+
+bool AnalogSampler::isRunning()
+{
+  return rate > 0;
+}
+
+void AnalogSampler::sample()
+{
+  unsigned long now = micros();
+  unsigned long elapsed = now - lastSampleMicros;
+  lastSampleMicros = now;
+  if (sampleCounter > 0 && elapsed > periodMicros + periodMicros / 2) {
+    missedSamples += (elapsed - periodMicros / 2) / periodMicros;
+  }
+
+  uint16_t value = analogRead(A0);
+  buffer[sampleCounter % ANALOG_SAMPLER_BUFFER_SIZE] = value;
+
+  if (sampleCounter == 0) {
+    minimum = value;
+    maximum = value;
+    ewma = (int32_t)value << 8;
+  }
+
+  if (value < minimum) {
+    minimum = value;
+  }
+
+  if (value > maximum) {
+    maximum = value;
+  }
+
+  sum += value;
+  ewma += (((int32_t)value << 8) - ewma) >> ANALOG_SAMPLER_EWMA_SHIFT;
+  sampleCounter++;
+}
+
+void AnalogSampler::tick(AnalogSampler* analogSampler)
+{
+  analogSampler->sample();
+}
+
+String AnalogSampler::getAggregates()
+{
+  String mean = "?";
+  if (sampleCounter > 0) {
+    mean = String((float)sum / sampleCounter, 2);
+  }
+
+  return
+    F("rate: ") + String(rate) + "\r\n" +
+    F("samples: ") + String(sampleCounter) + "\r\n" +
+    F("missed: ") + String(missedSamples) + "\r\n" +
+    F("min: ") + String(minimum) + "\r\n" +
+    F("max: ") + String(maximum) + "\r\n" +
+    F("mean: ") + mean + "\r\n" +
+    F("ewma: ") + String(ewma / 256.0, 2) + "\r\n";
+}
+
+String AnalogSampler::getWindow(uint16_t count, uint16_t decimate)
+{
+  if (decimate < 1) {
+    decimate = 1;
+  }
+
+  // the ticker runs from the system task, not from an interrupt, so the buffer doesn't change while this runs
+  uint32_t available = min(sampleCounter, (uint32_t)ANALOG_SAMPLER_BUFFER_SIZE);
+  uint32_t values = min((uint32_t)count, available / decimate);
+  uint32_t position = sampleCounter - values * decimate;
+
+  String window;
+  // up to 4 digits and a comma per value
+  window.reserve(values * 5);
+
+  for (uint32_t valueIndex = 0; valueIndex < values; valueIndex++) {
+    uint32_t valueSum = 0;
+    for (uint16_t sampleIndex = 0; sampleIndex < decimate; sampleIndex++) {
+      valueSum += buffer[position % ANALOG_SAMPLER_BUFFER_SIZE];
+      position++;
+    }
+
+    if (valueIndex > 0) {
+      window += ',';
+    }
+
+    window += String((valueSum + decimate / 2) / decimate);
+  }
+
+  return window;
+}
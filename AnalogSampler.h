@@ -0,0 +1,79 @@
+#ifndef ANALOG_SAMPLER_H
+#define ANALOG_SAMPLER_H
+
+#include <ESP8266WiFi.h>
+#include <Arduino.h>
+#include <Ticker.h>
+
+#include "Debug.h"
+
+// Number of samples kept, the newest ones overwrite the oldest ones.
+#ifndef ANALOG_SAMPLER_BUFFER_SIZE
+#define ANALOG_SAMPLER_BUFFER_SIZE 512
+#endif
+
+#define ANALOG_SAMPLER_MAX_RATE 1000
+
+// Weight of the newest sample in the exponentially weighted moving average is 1 / 2^ANALOG_SAMPLER_EWMA_SHIFT.
+#define ANALOG_SAMPLER_EWMA_SHIFT 4
+
+class AnalogSampler
+{
+  public:
+    Debug* debug;
+
+    uint16_t buffer[ANALOG_SAMPLER_BUFFER_SIZE];
+    // Number of samples taken since start, the next sample goes to sampleCounter % ANALOG_SAMPLER_BUFFER_SIZE.
+    uint32_t sampleCounter = 0;
+
+    // Samples per second, 0 if not running.
+    uint16_t rate = 0;
+
+    // Aggregates since start, updated with every sample.
+    uint16_t minimum = 0;
+    uint16_t maximum = 0;
+    uint64_t sum = 0;
+    // The average in 24.8 fixed point, so small changes are not lost.
+    int32_t ewma = 0;
+    // Ticks that came later than one and a half period, because the main loop was busy.
+    uint32_t missedSamples = 0;
+
+    void setup(Debug* debug);
+
+    /**
+     * Starts sampling A0, and resets the buffer and the aggregates.
+     * The ticker only has millisecond resolution, so the period is rounded to the closest millisecond.
+     * @param  rate Samples per second, 1 to ANALOG_SAMPLER_MAX_RATE.
+     * @return bool False if the rate is out of range.
+     */
+    bool start(uint16_t rate);
+
+    void stop();
+
+    bool isRunning();
+
+    /**
+     * Returns the aggregates as "name: value" lines.
+     * @return String
+     */
+    String getAggregates();
+
+    /**
+     * Returns the newest samples in a single comma separated line, oldest first.
+     * With decimation every value is the average of that many consecutive samples.
+     * @param  count    Number of values to return, limited by the samples in the buffer.
+     * @param  decimate Number of samples averaged into one value.
+     * @return String
+     */
+    String getWindow(uint16_t count, uint16_t decimate = 1);
+
+  private:
+    Ticker ticker;
+    unsigned long periodMicros = 0;
+    unsigned long lastSampleMicros = 0;
+
+    void sample();
+    static void tick(AnalogSampler* analogSampler);
+};
+
+#endif
@@ -0,0 +1,53 @@
+#include "BootTimer.h"
+
+void BootTimer::mark(BootPhase phase)
+{
+  phaseMillis[phase] = millis();
+}
+
+bool BootTimer::isMarked(BootPhase phase)
+{
+  return phaseMillis[phase] > 0;
+}
+
+String BootTimer::toString()
+{
+  String report = "";
+  unsigned long previousMillis = 0;
+  for (byte phase = 0; phase < BOOT_PHASE_COUNT; phase++) {
+    if (!isMarked((BootPhase)phase)) {
+      report += getPhaseName((BootPhase)phase) + F(": ?\r\n");
+      continue;
+    }
+
+    report +=
+      getPhaseName((BootPhase)phase) + ": " +
+      String(phaseMillis[phase]) + F("ms (+") +
+      String(phaseMillis[phase] - previousMillis) + F("ms)\r\n");
+
+    previousMillis = phaseMillis[phase];
+  }
+
+  report += F("fastConnect: ") + String(fastConnect, DEC) + "\r\n";
+  report += F("warmStart: ") + String(warmStart, DEC) + "\r\n";
+  report += F("settingsMicros: ") + String(settingsMicros) + "\r\n";
+  return report;
+}
+
+String BootTimer::getPhaseName(BootPhase phase)
+{
+  switch (phase) {
+    case BOOT_PHASE_SETUP:
+      return F("setup");
+    case BOOT_PHASE_SETTINGS:
+      return F("settings");
+    case BOOT_PHASE_PINS:
+      return F("pins");
+    case BOOT_PHASE_WIFI_STARTED:
+      return F("wifiStarted");
+    case BOOT_PHASE_WIFI_CONNECTED:
+      return F("wifiConnected");
+    default:
+      return "";
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef BOOT_TIMER_H
+#define BOOT_TIMER_H
+
+#include <Arduino.h>
+
+enum BootPhase {
+  BOOT_PHASE_SETUP,
+  BOOT_PHASE_SETTINGS,
+  BOOT_PHASE_PINS,
+  BOOT_PHASE_WIFI_STARTED,
+  BOOT_PHASE_WIFI_CONNECTED,
+  BOOT_PHASE_COUNT
+};
+
+class BootTimer
+{
+  public:
+    // Milliseconds since the reset at the end of each phase, 0 if the phase hasn't been reached yet.
+    unsigned long phaseMillis[BOOT_PHASE_COUNT] = {0};
+
+    // Whether the wifi was connected with the cached parameters, without scanning.
+    bool fastConnect = false;
+
+    // Whether the settings were restored from the warm state after a deep sleep, and how long restoring them took.
+    bool warmStart = false;
+    unsigned long settingsMicros = 0;
+
+    void mark(BootPhase phase);
+    bool isMarked(BootPhase phase);
+
+    /**
+     * Returns the time each phase ended at, and how long it took.
+     * @return String
+     */
+    String toString();
+
+    static String getPhaseName(BootPhase phase);
+};
+
+#endif
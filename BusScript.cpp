@@ -0,0 +1,339 @@
+#include "BusScript.h"
+
+void BusScript::setup(Settings* settings, Debug* debug, Pins* pins)
+{
+  this->settings = settings;
+  this->debug = debug;
+  this->pins = pins;
+}
+
+bool BusScript::runI2c(String script, byte address, uint32_t frequency, String* result)
+{
+  if (!parse(script, false) || !checkPins(BUS_I2C_PIN_MASK)) {
+    return false;
+  }
+
+  if (!i2cStarted) {
+    Wire.begin();
+    i2cStarted = true;
+    pins->reservedMask |= BUS_I2C_PIN_MASK;
+  }
+  Wire.setClock(frequency);
+
+  for (byte operationIndex = 0; operationIndex < operationCount; operationIndex++) {
+    BusOperation* operation = &operations[operationIndex];
+
+    switch (operation->type) {
+      case BUS_OPERATION_ADDRESS:
+        address = operation->value;
+        break;
+
+      case BUS_OPERATION_WRITE: {
+        Wire.beginTransmission(address);
+        Wire.write(&buffer[operation->offset], operation->length);
+        byte status = Wire.endTransmission(!operation->noStop);
+        if (status != 0) {
+          return fail(F("Operation ") + String(operationIndex) + F(": writing to 0x") + String(address, HEX) + F(" failed, status: ") + String(status));
+        }
+        break;
+      }
+
+      case BUS_OPERATION_READ: {
+        size_t received = Wire.requestFrom(address, (size_t)operation->length, !operation->noStop);
+        if (received != operation->length) {
+          return fail(F("Operation ") + String(operationIndex) + ": 0x" + String(address, HEX) + F(" sent ") + String(received) + F(" bytes instead of ") + String(operation->length));
+        }
+
+        for (uint16_t index = 0; index < operation->length; index++) {
+          buffer[operation->offset + index] = Wire.read();
+        }
+        break;
+      }
+
+      case BUS_OPERATION_DELAY:
+        delay(operation->value);
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  *result = getResult();
+  return true;
+}
+
+bool BusScript::runSpi(String script, byte csPinNumber, uint32_t frequency, byte mode, String* result)
+{
+  if (!parse(script, true) || !checkPins(BUS_SPI_PIN_MASK)) {
+    return false;
+  }
+
+  byte csGpioNumber = 255;
+  if (csPinNumber != 255) {
+    if (
+      csPinNumber > 15 ||
+      bitRead(BUS_SPI_PIN_MASK, csPinNumber) ||
+      !settings->isPinInitalized(csPinNumber) ||
+      !pins->isOutput(csPinNumber) ||
+      settings->isPinLocked(csPinNumber)
+    ) {
+      return fail(F("The chip select must be an initialized, unlocked output pin, other than the pins of the bus."));
+    }
+
+    csGpioNumber = pins->digital2gpio(csPinNumber);
+  }
+
+  static const byte modes[4] PROGMEM = {SPI_MODE0, SPI_MODE1, SPI_MODE2, SPI_MODE3};
+  if (mode > 3) {
+    return fail(F("The mode must be 0-3."));
+  }
+
+  if (!spiStarted) {
+    SPI.begin();
+    spiStarted = true;
+    pins->reservedMask |= BUS_SPI_PIN_MASK;
+  }
+
+  SPI.beginTransaction(SPISettings(frequency, MSBFIRST, pgm_read_byte(&modes[mode])));
+  if (csGpioNumber != 255) {
+    pins->gpio->write(csGpioNumber, LOW);
+  }
+
+  for (byte operationIndex = 0; operationIndex < operationCount; operationIndex++) {
+    BusOperation* operation = &operations[operationIndex];
+
+    switch (operation->type) {
+      case BUS_OPERATION_WRITE:
+      case BUS_OPERATION_READ:
+      case BUS_OPERATION_TRANSFER:
+        // in place, the bytes read replace the bytes written, zeros for a read
+        SPI.transfer(&buffer[operation->offset], operation->length);
+        break;
+
+      case BUS_OPERATION_RESTART:
+        if (csGpioNumber != 255) {
+          pins->gpio->write(csGpioNumber, HIGH);
+          delayMicroseconds(1);
+          pins->gpio->write(csGpioNumber, LOW);
+        }
+        break;
+
+      case BUS_OPERATION_DELAY:
+        delay(operation->value);
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  if (csGpioNumber != 255) {
+    pins->gpio->write(csGpioNumber, HIGH);
+  }
+  SPI.endTransaction();
+
+  *result = getResult();
+  return true;
+}
+
+bool BusScript::parse(String script, bool spi)
+{
+  operationCount = 0;
+  error = "";
+
+  uint16_t bufferUsed = 0;
+  uint32_t delayMillis = 0;
+
+  int lineStart = 0;
+  while (lineStart < (int)script.length()) {
+    int lineEnd = script.indexOf('\n', lineStart);
+    if (lineEnd < 0) {
+      lineEnd = script.length();
+    }
+
+    String line = script.substring(lineStart, lineEnd);
+    lineStart = lineEnd + 1;
+
+    line.trim();
+    if (line.length() == 0) {
+      continue;
+    }
+
+    if (operationCount >= BUS_MAX_OPERATIONS) {
+      return fail(F("Too many operations, the maximum is ") + String(BUS_MAX_OPERATIONS));
+    }
+
+    int delimIndex = line.indexOf(' ');
+    String name = delimIndex < 0 ? line : line.substring(0, delimIndex);
+    name.toLowerCase();
+
+    BusOperation* operation = &operations[operationCount];
+    operation->noStop = false;
+    operation->offset = bufferUsed;
+    operation->length = 0;
+    operation->value = 0;
+
+    if (name == "address" && !spi) {
+      operation->type = BUS_OPERATION_ADDRESS;
+    }
+    else if (name == "write") {
+      operation->type = BUS_OPERATION_WRITE;
+    }
+    else if (name == "read") {
+      operation->type = BUS_OPERATION_READ;
+    }
+    else if (name == "transfer" && spi) {
+      operation->type = BUS_OPERATION_TRANSFER;
+    }
+    else if (name == "restart") {
+      operation->type = BUS_OPERATION_RESTART;
+    }
+    else if (name == "delay") {
+      operation->type = BUS_OPERATION_DELAY;
+    }
+    else {
+      return fail(F("Unknown operation: ") + line);
+    }
+
+    // the arguments
+    const char* cursor = line.c_str() + (delimIndex < 0 ? line.length() : delimIndex);
+    byte argumentCount = 0;
+    while (true) {
+      char* end;
+      uint32_t argument = strtoul(cursor, &end, 0);
+      if (end == cursor) {
+        break;
+      }
+      cursor = end;
+      argumentCount++;
+
+      if (operation->type == BUS_OPERATION_WRITE || operation->type == BUS_OPERATION_TRANSFER) {
+        if (argument > 0xFF) {
+          return fail(F("Not a byte: ") + line);
+        }
+
+        if (bufferUsed >= BUS_BUFFER_SIZE) {
+          return fail(F("The script does not fit in the buffer of ") + String(BUS_BUFFER_SIZE) + F(" bytes."));
+        }
+
+        buffer[bufferUsed++] = argument;
+        operation->length++;
+        continue;
+      }
+
+      if (argumentCount > 1 || argument > 0xFFFF) {
+        return fail(F("Invalid operation: ") + line);
+      }
+
+      operation->value = argument;
+    }
+
+    while (*cursor == ' ' || *cursor == '\t') {
+      cursor++;
+    }
+    if (*cursor != 0) {
+      return fail(F("Invalid operation: ") + line);
+    }
+
+    switch (operation->type) {
+      case BUS_OPERATION_ADDRESS:
+        if (argumentCount != 1 || operation->value > 0x7F) {
+          return fail(F("The address must be 7 bits: ") + line);
+        }
+        break;
+
+      case BUS_OPERATION_WRITE:
+      case BUS_OPERATION_TRANSFER:
+        if (operation->length == 0) {
+          return fail(F("Nothing to write: ") + line);
+        }
+
+        if (!spi && operation->length > BUS_I2C_MAX_LENGTH) {
+          return fail(F("An I2C transaction can't be longer than ") + String(BUS_I2C_MAX_LENGTH) + F(" bytes: ") + line);
+        }
+        break;
+
+      case BUS_OPERATION_READ:
+        if (argumentCount != 1 || operation->value == 0 || (!spi && operation->value > BUS_I2C_MAX_LENGTH)) {
+          return fail(F("Invalid count: ") + line);
+        }
+
+        if (bufferUsed + operation->value > BUS_BUFFER_SIZE) {
+          return fail(F("The script does not fit in the buffer of ") + String(BUS_BUFFER_SIZE) + F(" bytes."));
+        }
+
+        // spi reads by writing zeros
+        memset(&buffer[bufferUsed], 0, operation->value);
+        operation->length = operation->value;
+        bufferUsed += operation->value;
+        break;
+
+      case BUS_OPERATION_RESTART:
+        if (argumentCount != 0 || operationCount == 0) {
+          return fail(F("A restart must follow an operation: ") + line);
+        }
+        operations[operationCount - 1].noStop = true;
+        break;
+
+      case BUS_OPERATION_DELAY:
+        delayMillis += operation->value;
+        if (argumentCount != 1 || delayMillis > BUS_MAX_DELAY_MS) {
+          return fail(F("The delays of a script can't be more than ") + String(BUS_MAX_DELAY_MS) + F("ms in total."));
+        }
+        break;
+    }
+
+    operationCount++;
+  }
+
+  if (operationCount == 0) {
+    return fail(F("The script is empty."));
+  }
+
+  // the last transaction would be left open, without a stop on I2C
+  if (operations[operationCount - 1].type == BUS_OPERATION_RESTART) {
+    return fail(F("A restart must be followed by an operation."));
+  }
+
+  return true;
+}
+
+bool BusScript::checkPins(uint16_t pinMask)
+{
+  for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+    if (bitRead(pinMask, digitalPinNumber) && settings->isPinInitalized(digitalPinNumber)) {
+      return fail("Pin " + String(digitalPinNumber) + F(" of the bus is initialized as gpio, delete it first."));
+    }
+  }
+
+  return true;
+}
+
+String BusScript::getResult()
+{
+  String result = "";
+  for (byte operationIndex = 0; operationIndex < operationCount; operationIndex++) {
+    BusOperation* operation = &operations[operationIndex];
+    if (operation->type != BUS_OPERATION_READ && operation->type != BUS_OPERATION_TRANSFER) {
+      continue;
+    }
+
+    result += String(operationIndex) + ":";
+    for (uint16_t index = 0; index < operation->length; index++) {
+      byte value = buffer[operation->offset + index];
+      result += (value < 0x10 ? " 0" : " ") + String(value, HEX);
+    }
+    result += "\r\n";
+  }
+
+  return result;
+}
+
+bool BusScript::fail(String error)
+{
+  operationCount = 0;
+  this->error = error;
+  debug->error(error);
+  return false;
+}
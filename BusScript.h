@@ -0,0 +1,111 @@
+#ifndef BUS_SCRIPT_H
+#define BUS_SCRIPT_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <SPI.h>
+
+#include "Settings.h"
+#include "Debug.h"
+#include "Pins.h"
+
+// Holds the bytes to write and the bytes read by a script, reused by every script.
+#ifndef BUS_BUFFER_SIZE
+#define BUS_BUFFER_SIZE 256
+#endif
+
+#define BUS_MAX_OPERATIONS 32
+
+// Size of the buffer of the Wire library, the limit of a single I2C write or read.
+#define BUS_I2C_MAX_LENGTH 128
+
+// The delays of a script block the loop, they count against the budget of the connection task answering the request.
+#define BUS_MAX_DELAY_MS 10
+
+// The digital pins used by the buses. A bus is only started if none of its pins are initialized as gpio,
+// then they are reserved in Pins until the restart, so they can't be initialized.
+// I2C: D1 SCL, D2 SDA. SPI: D5 SCK, D6 MISO, D7 MOSI.
+#define BUS_I2C_PIN_MASK 0x0006
+#define BUS_SPI_PIN_MASK 0x00E0
+
+#define BUS_DEFAULT_I2C_FREQUENCY 100000
+#define BUS_DEFAULT_SPI_FREQUENCY 1000000
+
+enum BusOperationType {
+  BUS_OPERATION_ADDRESS,
+  BUS_OPERATION_WRITE,
+  BUS_OPERATION_READ,
+  BUS_OPERATION_TRANSFER,
+  BUS_OPERATION_RESTART,
+  BUS_OPERATION_DELAY
+};
+
+struct BusOperation {
+  byte type;
+  // The next operation is a restart: no stop condition on I2C.
+  bool noStop;
+  // The data of the operation in the buffer.
+  uint16_t offset;
+  uint16_t length;
+  // The address or the delay.
+  uint16_t value;
+};
+
+/**
+ * Runs a script of I2C or SPI transactions in one go, one operation per line:
+ *   address {address}   I2C only, the device of the following operations.
+ *   write {byte}...     Writes the bytes.
+ *   read {count}        Reads the bytes.
+ *   transfer {byte}...  SPI only, writes the bytes and reads as many at the same time.
+ *   restart             I2C: the previous operation ends without a stop, so the next one is a repeated start.
+ *                       SPI: releases and selects the chip again.
+ *   delay {millis}
+ * The numbers are decimal or 0x prefixed hex.
+ */
+class BusScript
+{
+  public:
+    Settings* settings;
+    Debug* debug;
+    Pins* pins;
+
+    String error;
+
+    void setup(Settings* settings, Debug* debug, Pins* pins);
+
+    /**
+     * Runs the script on the I2C bus.
+     * @param  script
+     * @param  address   Address of the device, until an address operation changes it.
+     * @param  frequency
+     * @param  result    Filled with the bytes read, a "{operationIndex}: {bytes}" line for every read operation.
+     * @return bool      False if the script is invalid, or a device did not acknowledge, see error.
+     */
+    bool runI2c(String script, byte address, uint32_t frequency, String* result);
+
+    /**
+     * Runs the script on the SPI bus.
+     * @param  script
+     * @param  csPinNumber Digital pin of the chip select, held low during the script, 255 for none.
+     * @param  frequency
+     * @param  mode        SPI mode 0-3.
+     * @param  result      Filled with the bytes read, a "{operationIndex}: {bytes}" line for every read and transfer operation.
+     * @return bool        False if the script is invalid, see error.
+     */
+    bool runSpi(String script, byte csPinNumber, uint32_t frequency, byte mode, String* result);
+
+  private:
+    byte buffer[BUS_BUFFER_SIZE];
+    BusOperation operations[BUS_MAX_OPERATIONS];
+    byte operationCount = 0;
+
+    bool i2cStarted = false;
+    bool spiStarted = false;
+
+    bool parse(String script, bool spi);
+    bool checkPins(uint16_t pinMask);
+    String getResult();
+    bool fail(String error);
+};
+
+#endif
@@ -1,5 +1,5 @@
 #include "Debug.h"
-#include "HttpServerAdvanced.h"
+#include "version.h"
 
 void Debug::log(String data)
 {
@@ -10,10 +10,16 @@ void Debug::log(String data)
   if (serial) {
     String trail = "";
     if (data.indexOf('\n') >= 0) {
-      trail = "\n---------------------";
+      trail = F("\n---------------------");
     }
 
-    Serial.println(String(HTTP_SERVER_ADVANCED_NAME) + String(": ") + data + trail);
+    String line = String(HTTP_SERVER_ADVANCED_NAME) + String(": ") + data + trail;
+    if (serialQueue) {
+      serialQueue->println(line);
+    }
+    else {
+      Serial.println(line);
+    }
   }
 
   if (store) {
@@ -27,21 +33,21 @@ void Debug::log(String data)
 void Debug::info(String data)
 {
   if (infoLogs) {
-    log("[INFO] " + data);
+    log(F("[INFO] ") + data);
   }
 }
 
 void Debug::warn(String data)
 {
   if (warningLogs) {
-    log("[WARNING] " + data);
+    log(F("[WARNING] ") + data);
   }
 }
 
 void Debug::error(String data)
 {
   if (errorLogs) {
-    log("[ERROR] " + data);
+    log(F("[ERROR] ") + data);
   }
 }
 
@@ -51,17 +57,3 @@ String Debug::get()
   this->data = "";
   return data;
 }
-
-void Debug::waiting()
-{
-  if (enabled) {
-    Serial.print(".");
-  }
-}
-
-void Debug::waitingFinished()
-{
-  if (enabled) {
-    Serial.println("|");
-  }
-}
@@ -3,6 +3,8 @@
 
 #include <Arduino.h>
 
+#include "SerialQueue.h"
+
 class Debug
 {
   public:
@@ -11,6 +13,9 @@ class Debug
     bool store = false;
     String data;
 
+    // Once set, the serial logs go through the queue instead of waiting for the uart.
+    SerialQueue* serialQueue = nullptr;
+
     bool infoLogs = true;
     bool warningLogs = true;
     bool errorLogs = true;
@@ -20,8 +25,6 @@ class Debug
     void warn(String data);
     void error(String data);
     String get();
-    void waiting();
-    void waitingFinished();
 };
 
 #endif
@@ -0,0 +1,89 @@
+#include "EspPlatform.h"
+
+bool EspGpio::hasPin(byte gpioNumber)
+{
+  return gpioNumber <= 16;
+}
+
+void EspGpio::setMode(byte gpioNumber, byte mode)
+{
+  pinMode(gpioNumber, mode);
+}
+
+void EspGpio::write(byte gpioNumber, byte level)
+{
+  digitalWrite(gpioNumber, level);
+}
+
+byte EspGpio::read(byte gpioNumber)
+{
+  return digitalRead(gpioNumber);
+}
+
+bool EepromStore::begin(size_t size)
+{
+  EEPROM.begin(size);
+  return true;
+}
+
+byte EepromStore::read(int address)
+{
+  return EEPROM.read(address);
+}
+
+void EepromStore::write(int address, byte value)
+{
+  EEPROM.write(address, value);
+}
+
+bool EepromStore::commit()
+{
+  return EEPROM.commit();
+}
+
+bool EepromStore::readWarmState(byte* bytes, size_t length)
+{
+  // any other reset can follow a change of the flash the RTC memory doesn't know about, e.g. an upload
+  if (ESP.getResetInfoPtr()->reason != REASON_DEEP_SLEEP_AWAKE) {
+    return false;
+  }
+
+  uint32_t blocks[EEPROM_STORE_WARM_STATE_BLOCKS];
+  if (length > sizeof(blocks) || !ESP.rtcUserMemoryRead(EEPROM_STORE_WARM_STATE_OFFSET, blocks, (length + 3) & ~3)) {
+    return false;
+  }
+
+  memcpy(bytes, blocks, length);
+  return true;
+}
+
+void EepromStore::writeWarmState(const byte* bytes, size_t length)
+{
+  uint32_t blocks[EEPROM_STORE_WARM_STATE_BLOCKS];
+  if (length > sizeof(blocks)) {
+    return;
+  }
+
+  memcpy(blocks, bytes, length);
+  ESP.rtcUserMemoryWrite(EEPROM_STORE_WARM_STATE_OFFSET, blocks, (length + 3) & ~3);
+}
+
+int UartSerialPort::available()
+{
+  return Serial.available();
+}
+
+int UartSerialPort::read()
+{
+  return Serial.read();
+}
+
+int UartSerialPort::availableForWrite()
+{
+  return Serial.availableForWrite();
+}
+
+size_t UartSerialPort::write(const uint8_t* data, size_t length)
+{
+  return Serial.write(data, length);
+}
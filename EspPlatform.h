@@ -0,0 +1,49 @@
+#ifndef ESP_PLATFORM_H
+#define ESP_PLATFORM_H
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#include "Platform.h"
+
+class EspGpio : public GpioDriver
+{
+  public:
+    bool hasPin(byte gpioNumber);
+    void setMode(byte gpioNumber, byte mode);
+    void write(byte gpioNumber, byte level);
+    byte read(byte gpioNumber);
+};
+
+// Of the warm state in the RTC user memory, in 4 byte blocks. The first 128 bytes are used by eboot for the OTA updates.
+#define EEPROM_STORE_WARM_STATE_OFFSET 32
+#define EEPROM_STORE_WARM_STATE_BLOCKS 96
+
+/**
+ * The emulated EEPROM, a sector of the flash.
+ * The warm state is kept in the RTC user memory, it is only read after a wake from deep sleep.
+ */
+class EepromStore : public SettingsStore
+{
+  public:
+    bool begin(size_t size);
+    byte read(int address);
+    void write(int address, byte value);
+    bool commit();
+    bool readWarmState(byte* bytes, size_t length);
+    void writeWarmState(const byte* bytes, size_t length);
+};
+
+/**
+ * UART0, the same port the serial logs are written to.
+ */
+class UartSerialPort : public SerialPort
+{
+  public:
+    int available();
+    int read();
+    int availableForWrite();
+    size_t write(const uint8_t* data, size_t length);
+};
+
+#endif
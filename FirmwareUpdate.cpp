@@ -0,0 +1,221 @@
+#include "FirmwareUpdate.h"
+
+#include <Updater.h>
+
+// Found in the images built for this board, with its terminating zero, so a board whose name starts with this one doesn't match.
+static const char boardMarker[] PROGMEM = FIRMWARE_UPDATE_BOARD_MARKER ARDUINO_BOARD;
+
+void FirmwareUpdate::setup(Debug* debug, Scheduler* scheduler, Settings* settings)
+{
+  this->debug = debug;
+  this->scheduler = scheduler;
+  this->settings = settings;
+}
+
+bool FirmwareUpdate::begin(HttpRequest* request, WiFiClient* client)
+{
+  if (!enabled || request->uri != FIRMWARE_UPDATE_URI || request->method != "post") {
+    return false;
+  }
+
+  if (state == FIRMWARE_UPDATE_RECEIVING || state == FIRMWARE_UPDATE_DONE) {
+    client->print(HttpResponse::Unacceptable(F("An update is in progress already.")).toString());
+    client->stop();
+    return true;
+  }
+
+  String strSize = request->getHeader("Content-Length");
+  long size = strSize.toInt();
+  if (String(size) != strSize || size <= 0) {
+    client->print(HttpResponse::BadRequest(F("The Content-Length of the image is required.")).toString());
+    client->stop();
+    return true;
+  }
+
+  String md5 = request->getQueryParameter("md5");
+  if (md5.length() != 32) {
+    client->print(HttpResponse::BadRequest(F("The md5 of the image is required, as 32 hex digits.")).toString());
+    client->stop();
+    return true;
+  }
+
+  // the updater checks the size against the free space of the flash
+  if (!Update.begin(size) || !Update.setMD5(md5.c_str())) {
+    String reason = Update.getErrorString();
+    Update.end(false);
+    client->print(HttpResponse::Unacceptable(F("The update can't be started: ") + reason).toString());
+    client->stop();
+    return true;
+  }
+
+  this->client = *client;
+  this->size = size;
+  written = 0;
+  force = request->getQueryParameter("force", "0") == "1";
+  markerIndex = 0;
+  markerFound = false;
+  boardMatched = false;
+  error = "";
+  startMillis = millis();
+  lastDataMillis = startMillis;
+  state = FIRMWARE_UPDATE_RECEIVING;
+
+  // curl waits for this before sending a large body
+  if (request->getHeader("Expect").equalsIgnoreCase("100-continue")) {
+    this->client.print(F("HTTP/1.1 100 Continue\r\n\r\n"));
+  }
+
+  debug->info(F("Receiving a firmware image of ") + String(size) + F(" bytes."));
+  return true;
+}
+
+void FirmwareUpdate::loop()
+{
+  if (state != FIRMWARE_UPDATE_RECEIVING) {
+    return;
+  }
+
+  uint8_t chunk[FIRMWARE_UPDATE_CHUNK_SIZE];
+  while (written < size && scheduler->hasBudget()) {
+    int available = client.available();
+    if (available <= 0) {
+      if (!client.connected()) {
+        fail(F("The client disconnected after ") + String(written) + F(" bytes."));
+      }
+      else if (millis() - lastDataMillis > FIRMWARE_UPDATE_TIMEOUT_MS) {
+        fail(F("No data received within the timeout period."));
+      }
+      return;
+    }
+
+    size_t length = client.read(chunk, min((uint32_t)available, min((uint32_t)FIRMWARE_UPDATE_CHUNK_SIZE, size - written)));
+    if (length == 0) {
+      return;
+    }
+    lastDataMillis = millis();
+
+    // the updater makes the image the one to boot once it has it whole, so the last chunk is held back from a wrong image
+    findBoard(chunk, length);
+    if (written + length == size && !boardMatched && !force) {
+      fail(markerFound
+        ? F("The image is built for another board, this one is " ARDUINO_BOARD ".")
+        : F("The image is not built with this library, or it is compressed. force=1 writes it anyway.")
+      );
+      return;
+    }
+
+    if (Update.write(chunk, length) != length) {
+      fail(F("Writing the flash failed: ") + Update.getErrorString());
+      return;
+    }
+
+    written += length;
+  }
+
+  if (written == size) {
+    finish();
+  }
+}
+
+bool FirmwareUpdate::isReceiving()
+{
+  return state == FIRMWARE_UPDATE_RECEIVING;
+}
+
+String FirmwareUpdate::getStatus()
+{
+  unsigned long elapsedMillis = (state == FIRMWARE_UPDATE_RECEIVING ? millis() : endMillis) - startMillis;
+  String rate = "?";
+  if (state != FIRMWARE_UPDATE_IDLE && elapsedMillis > 0) {
+    rate = String((uint32_t)((uint64_t)written * 1000 / elapsedMillis));
+  }
+
+  return
+    F("state: ") + getStateName() + "\r\n" +
+    F("board: ") + String(FPSTR(boardMarker + sizeof(FIRMWARE_UPDATE_BOARD_MARKER) - 1)) + "\r\n" +
+    F("size: ") + String(size) + "\r\n" +
+    F("written: ") + String(written) + "\r\n" +
+    F("progress: ") + String(size > 0 ? written * 100.0 / size : 0, 1) + "\r\n" +
+    F("elapsed: ") + String(state == FIRMWARE_UPDATE_IDLE ? 0 : elapsedMillis) + "\r\n" +
+    F("rate: ") + rate + "\r\n" +
+    F("freeSpace: ") + String(ESP.getFreeSketchSpace()) + "\r\n" +
+    F("error: ") + error + "\r\n";
+}
+
+String FirmwareUpdate::getStateName()
+{
+  switch (state) {
+    case FIRMWARE_UPDATE_IDLE:
+      return F("idle");
+    case FIRMWARE_UPDATE_RECEIVING:
+      return F("receiving");
+    case FIRMWARE_UPDATE_DONE:
+      return F("done");
+    case FIRMWARE_UPDATE_FAILED:
+      return F("failed");
+  }
+
+  return "";
+}
+
+void FirmwareUpdate::findBoard(const uint8_t* data, size_t length)
+{
+  for (size_t index = 0; index < length && !boardMatched; index++) {
+    if (data[index] == pgm_read_byte(boardMarker + markerIndex)) {
+      markerIndex++;
+      boardMatched = markerIndex == sizeof(boardMarker);
+      continue;
+    }
+
+    if (markerIndex >= sizeof(FIRMWARE_UPDATE_BOARD_MARKER) - 1) {
+      markerFound = true;
+    }
+    markerIndex = data[index] == pgm_read_byte(boardMarker) ? 1 : 0;
+  }
+}
+
+void FirmwareUpdate::finish()
+{
+  // checks the md5 and the header of the image, and only then makes it the one to boot
+  if (!Update.end()) {
+    fail(F("The image is invalid: ") + Update.getErrorString());
+    return;
+  }
+
+  state = FIRMWARE_UPDATE_DONE;
+  endMillis = millis();
+  debug->info(F("Firmware updated, restarting."));
+
+  respond(HttpResponse(getStatus()));
+  scheduler->setTimeout(FIRMWARE_UPDATE_RESTART_DELAY_MS, FirmwareUpdate::restart, this);
+}
+
+void FirmwareUpdate::respond(HttpResponse response)
+{
+  client.print(response.toString());
+  client.stop();
+  client = WiFiClient();
+}
+
+bool FirmwareUpdate::fail(String error)
+{
+  this->error = error;
+  state = FIRMWARE_UPDATE_FAILED;
+  endMillis = millis();
+  debug->error(error);
+
+  // drops what is written, the running firmware stays the one to boot
+  if (Update.isRunning()) {
+    Update.end(false);
+  }
+
+  respond(HttpResponse::Unacceptable(error));
+  return false;
+}
+
+void FirmwareUpdate::restart(void* context)
+{
+  // the deferred commits would be lost with the restart
+  ((FirmwareUpdate*)context)->settings->flush();
+  ESP.restart();
+}
@@ -0,0 +1,103 @@
+#ifndef FIRMWARE_UPDATE_H
+#define FIRMWARE_UPDATE_H
+
+#include <ESP8266WiFi.h>
+#include <Arduino.h>
+
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "Scheduler.h"
+#include "Settings.h"
+#include "Debug.h"
+
+#define FIRMWARE_UPDATE_URI "/update"
+
+// Size of the buffer the image is read from the socket through, on the stack of the task.
+#define FIRMWARE_UPDATE_CHUNK_SIZE 1024
+
+// The update is aborted if the client sends nothing for this long.
+#define FIRMWARE_UPDATE_TIMEOUT_MS 10000
+
+// Time for the response to reach the client before the restart into the new firmware.
+#define FIRMWARE_UPDATE_RESTART_DELAY_MS 1000
+
+// Built into every firmware with the library, followed by the board it is built for.
+#define FIRMWARE_UPDATE_BOARD_MARKER "HSA-BOARD:"
+
+#ifndef ARDUINO_BOARD
+#define ARDUINO_BOARD "unknown"
+#endif
+
+enum FirmwareUpdateState {
+  FIRMWARE_UPDATE_IDLE,
+  FIRMWARE_UPDATE_RECEIVING,
+  FIRMWARE_UPDATE_DONE,
+  FIRMWARE_UPDATE_FAILED
+};
+
+/**
+ * Writes a firmware image posted to FIRMWARE_UPDATE_URI into the update partition of the flash, as it arrives.
+ * loop() reads the socket a chunk at a time, as long as the task has budget, so the other clients are still served,
+ * and the RAM it takes is the chunk and the flash sector buffer of the updater, however large the image is.
+ * The MD5 of the image is calculated as it is written, and checked before the image is made the one to boot.
+ */
+class FirmwareUpdate
+{
+  public:
+    Debug* debug;
+    Scheduler* scheduler;
+    Settings* settings;
+
+    bool enabled = false;
+
+    FirmwareUpdateState state = FIRMWARE_UPDATE_IDLE;
+    String error = "";
+
+    void setup(Debug* debug, Scheduler* scheduler, Settings* settings);
+
+    /**
+     * Starts receiving the image of the request, only its head is read yet. Answers the request itself,
+     * once the image is written, or right away if it can't be written.
+     * @param  request
+     * @param  client
+     * @return bool    False if the request is not an update.
+     */
+    bool begin(HttpRequest* request, WiFiClient* client);
+
+    /**
+     * Writes the chunks arrived, as long as the task has budget. Verifies the image once it is whole.
+     */
+    void loop();
+
+    bool isReceiving();
+
+    /**
+     * Returns the state and the progress of the update as "name: value" lines.
+     * @return String
+     */
+    String getStatus();
+
+  private:
+    WiFiClient client;
+    uint32_t size = 0;
+    uint32_t written = 0;
+    unsigned long startMillis = 0;
+    unsigned long lastDataMillis = 0;
+    unsigned long endMillis = 0;
+    bool force = false;
+
+    // Of the search for the board marker in the image.
+    byte markerIndex = 0;
+    bool markerFound = false;
+    bool boardMatched = false;
+
+    String getStateName();
+    void findBoard(const uint8_t* data, size_t length);
+    void finish();
+    void respond(HttpResponse response);
+    bool fail(String error);
+
+    static void restart(void* context);
+};
+
+#endif
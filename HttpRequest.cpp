@@ -1,29 +1,32 @@
 #include "HttpRequest.h"
 
-HttpRequest::HttpRequest(StatusLed* statusLed)
+#ifdef ARDUINO_ARCH_ESP8266
+void HttpRequest::readClient(WiFiClient* client)
 {
-  this->statusLed = statusLed;
+  readHead(client);
+  readData(client);
 }
 
-void HttpRequest::readClient(WiFiClient* client)
+void HttpRequest::readHead(WiFiClient* client)
 {
-  String request = "";
-  int counter = 0;
-  while (client->available()) {
-    request += char(client->read());
-
-    counter ++;
-    if (counter > 10) {
-      statusLed->turnOn();
-    }
-    if (counter > 20) {
-      statusLed->turnOff();
-      counter = 0;
-    }
+  String head = "";
+  while (client->available() && !head.endsWith("\r\n\r\n")) {
+    head += char(client->read());
   }
 
-  statusLed->turnOn();
+  parse(head);
+}
+
+void HttpRequest::readData(WiFiClient* client)
+{
+  while (client->available()) {
+    data += char(client->read());
+  }
+}
+#endif
 
+void HttpRequest::parse(String request)
+{
   int delimIndex = request.indexOf(' ');
   method = request.substring(0, delimIndex);
   method.toLowerCase();
@@ -32,8 +35,17 @@ void HttpRequest::readClient(WiFiClient* client)
   delimIndex = request.indexOf(' ');
   uri = request.substring(0, delimIndex);
   uri.toLowerCase();
+  originalUri = request.substring(0, delimIndex);
   request.remove(0, delimIndex + 1);
 
+  // the routes match on the path only
+  int queryIndex = uri.indexOf('?');
+  if (queryIndex >= 0) {
+    query = uri.substring(queryIndex + 1);
+    uri.remove(queryIndex);
+    originalUri.remove(queryIndex);
+  }
+
   delimIndex = request.indexOf('\n');
   protocol = request.substring(0, delimIndex);
   protocol.toLowerCase();
@@ -44,3 +56,81 @@ void HttpRequest::readClient(WiFiClient* client)
 
   data = request.substring(delimIndex + 4);
 }
+
+String HttpRequest::getDataField(String name, String defaultValue)
+{
+  int lineStart = 0;
+  while (lineStart < (int)data.length()) {
+    int lineEnd = data.indexOf('\n', lineStart);
+    if (lineEnd < 0) {
+      lineEnd = data.length();
+    }
+
+    int delimIndex = data.indexOf(':', lineStart);
+    if (delimIndex > lineStart && delimIndex < lineEnd) {
+      String fieldName = data.substring(lineStart, delimIndex);
+      fieldName.trim();
+
+      if (fieldName == name) {
+        String value = data.substring(delimIndex + 1, lineEnd);
+        value.trim();
+        return value;
+      }
+    }
+
+    lineStart = lineEnd + 1;
+  }
+
+  return defaultValue;
+}
+
+String HttpRequest::getQueryParameter(String name, String defaultValue)
+{
+  int parameterStart = 0;
+  while (parameterStart < (int)query.length()) {
+    int parameterEnd = query.indexOf('&', parameterStart);
+    if (parameterEnd < 0) {
+      parameterEnd = query.length();
+    }
+
+    int delimIndex = query.indexOf('=', parameterStart);
+    if (delimIndex < 0 || delimIndex > parameterEnd) {
+      delimIndex = parameterEnd;
+    }
+
+    if (query.substring(parameterStart, delimIndex) == name) {
+      return delimIndex < parameterEnd ? query.substring(delimIndex + 1, parameterEnd) : "";
+    }
+
+    parameterStart = parameterEnd + 1;
+  }
+
+  return defaultValue;
+}
+
+String HttpRequest::getHeader(String name, String defaultValue)
+{
+  int lineStart = 0;
+  while (lineStart < (int)headers.length()) {
+    int lineEnd = headers.indexOf('\n', lineStart);
+    if (lineEnd < 0) {
+      lineEnd = headers.length();
+    }
+
+    int delimIndex = headers.indexOf(':', lineStart);
+    if (delimIndex > lineStart && delimIndex < lineEnd) {
+      String headerName = headers.substring(lineStart, delimIndex);
+      headerName.trim();
+
+      if (headerName.equalsIgnoreCase(name)) {
+        String value = headers.substring(delimIndex + 1, lineEnd);
+        value.trim();
+        return value;
+      }
+    }
+
+    lineStart = lineEnd + 1;
+  }
+
+  return defaultValue;
+}
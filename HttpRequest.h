@@ -1,24 +1,70 @@
 #ifndef HTTP_REQUEST_H
 #define HTTP_REQUEST_H
 
+#ifdef ARDUINO_ARCH_ESP8266
 #include <ESP8266WiFi.h>
+#endif
 #include <Arduino.h>
 
-#include "StatusLed.h"
-
 class HttpRequest
 {
   public:
-    StatusLed* statusLed;
-
     String method = "";
+    // Lowercased for the routes.
     String uri = "";
+    // The uri in its original case, without the query, for the file names.
+    String originalUri = "";
+    String query = "";
     String protocol = "";
     String headers = "";
     String data = "";
 
-    HttpRequest(StatusLed* statusLed);
+#ifdef ARDUINO_ARCH_ESP8266
     void readClient(WiFiClient* client);
+
+    /**
+     * Reads and parses the request line and the headers only, the data is left in the client,
+     * for the requests whose data is streamed instead, see readData().
+     * @param client
+     */
+    void readHead(WiFiClient* client);
+
+    /**
+     * Reads the data arrived after the head into data.
+     * @param client
+     */
+    void readData(WiFiClient* client);
+#endif
+
+    /**
+     * Parses the request line, the headers and the data from the raw request.
+     * @param request
+     */
+    void parse(String request);
+
+    /**
+     * Returns the value of a field from the data, where the data consists of "name: value" lines.
+     * @param  name
+     * @param  defaultValue Returned if the field is not present.
+     * @return String
+     */
+    String getDataField(String name, String defaultValue = "");
+
+    /**
+     * Returns the value of a parameter from the query string of the uri.
+     * @param  name
+     * @param  defaultValue Returned if the parameter is not present.
+     * @return String
+     */
+    String getQueryParameter(String name, String defaultValue = "");
+
+    /**
+     * Returns the value of a header, the name is case insensitive.
+     * @param  name
+     * @param  defaultValue Returned if the header is not present.
+     * @return String
+     */
+    String getHeader(String name, String defaultValue = "");
 };
 
 #endif
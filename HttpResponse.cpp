@@ -27,31 +27,41 @@ String HttpResponse::toString()
   return 
     protocol + " " + String(code) + " " + 
     status + "\r\n" +
-    "Content-Type: " + contentType + "\r\n" +
-    "Access-Control-Allow-Headers: *\r\n" +
-    "Access-Control-Allow-Origin: *\r\n" +
-    "Access-Control-Allow-Methods: GET, POST, PUT, DELETE\r\n" + 
-    "Access-Control-Expose-Headers: HSA-Version\r\n" +
-    "HSA-Version: " + String(HTTP_SERVER_ADVANCED_VERSION) + "\r\n" +
+    F("Content-Type: ") + contentType + "\r\n" +
+    F("Access-Control-Allow-Headers: *\r\n") +
+    F("Access-Control-Allow-Origin: *\r\n") +
+    F("Access-Control-Allow-Methods: GET, POST, PUT, DELETE\r\n") + 
+    F("Access-Control-Expose-Headers: HSA-Version, Retry-After\r\n") +
+    F("HSA-Version: ") + String(HTTP_SERVER_ADVANCED_VERSION) + "\r\n" +
+    F("Content-Length: ") + String(data.length() + 2) + "\r\n" +
+    F("Connection: ") + (keepAlive ? F("keep-alive") : F("close")) + "\r\n" +
+    headers +
     "\r\n" + data + "\r\n";
 }
 
 HttpResponse HttpResponse::BadRequest(String data)
 {
-  return HttpResponse(400, "Bad Request", data);
+  return HttpResponse(400, F("Bad Request"), data);
 }
 
 HttpResponse HttpResponse::NotFound(String data)
 {
-  return HttpResponse(404, "Not Found", data);
+  return HttpResponse(404, F("Not Found"), data);
 }
 
 HttpResponse HttpResponse::Unacceptable(String data)
 {
-  return HttpResponse(406, "Not Acceptable", data);
+  return HttpResponse(406, F("Not Acceptable"), data);
 }
 
 HttpResponse HttpResponse::InternalError(String data)
 {
-  return HttpResponse(500, "Internal Server Error", data);
+  return HttpResponse(500, F("Internal Server Error"), data);
+}
+
+HttpResponse HttpResponse::TooManyRequests(uint32_t retryAfterSeconds)
+{
+  HttpResponse response(429, F("Too Many Requests"), F("Too many requests, retry after ") + String(retryAfterSeconds) + F(" seconds."));
+  response.headers = F("Retry-After: ") + String(retryAfterSeconds) + "\r\n";
+  return response;
 }
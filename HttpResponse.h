@@ -1,7 +1,6 @@
 #ifndef HTTP_RESPONSE_H
 #define HTTP_RESPONSE_H
 
-#include <ESP8266WiFi.h>
 #include <Arduino.h>
 
 #include "version.h"
@@ -15,6 +14,12 @@ class HttpResponse
     String contentType = "text/plain";
     String data;
 
+    // Additional header lines, each ending with "\r\n".
+    String headers = "";
+
+    // Whether the connection stays open for the next request, the ESP8266 closes it after every response.
+    bool keepAlive = false;
+
     HttpResponse(int code, String status);
     HttpResponse(String data);
     HttpResponse(int code, String status, String data);
@@ -25,6 +30,13 @@ class HttpResponse
     static HttpResponse NotFound(String data = "");
     static HttpResponse Unacceptable(String data = "");
     static HttpResponse InternalError(String data = "");
+
+    /**
+     * 429, for the clients over the rate limit.
+     * @param  retryAfterSeconds Sent in the Retry-After header.
+     * @return HttpResponse
+     */
+    static HttpResponse TooManyRequests(uint32_t retryAfterSeconds);
 };
 
 #endif
@@ -1,7 +1,17 @@
 #include "HttpServerAdvanced.h"
 
+// The numeric fields of the rules and the schedule entries, in the order of their values.
+static const char ruleFields[4][9] PROGMEM = {"pin", "target", "period", "duration"};
+static const char scheduleFields[4][9] PROGMEM = {"pin", "in", "every", "duration"};
+
 HttpServerAdvanced::HttpServerAdvanced(const char* ssid, const char* sskey, int port, int ledPinNumber)
 {
+  wifi.setup(&debug, &statusLed, &settings);
+
+  for (byte slotIndex = 0; slotIndex < HTTP_CLIENT_SLOTS; slotIndex++) {
+    clientSlots[slotIndex].server = this;
+  }
+
   if (ssid) {
     addAccessPoint(ssid, sskey);
   }
@@ -25,250 +35,411 @@ void HttpServerAdvanced::setServerPort(int port)
   this->port = port;
 }
 
-bool HttpServerAdvanced::addAccessPoint(String ssid, String psk, byte priority)
+void HttpServerAdvanced::setRateLimit(uint16_t rate, uint16_t burst)
 {
-  if (ssid.length() > 32 || psk.length() > 64) {
-    debug.error("Too long ssid or psk!");
-    return false;
-  }
-
-  AccessPoint accessPoint;
-  accessPoint.priority = priority;
-  ssid.toCharArray(accessPoint.ssid, 32);
-  psk.toCharArray(accessPoint.psk, 64);
-
-  AccessPoint* accessPointListNew = new AccessPoint[accessPointCounter + 1];
-  for (size_t accessPointIndex = 0; accessPointIndex < accessPointCounter; accessPointIndex++) {
-    accessPointListNew[accessPointIndex] = accessPointList[accessPointIndex];
-  }
-
-  accessPointListNew[accessPointCounter] = accessPoint;
+  rateLimiter.setup(rate, burst);
+}
 
-  delete accessPointList;
-  accessPointList = accessPointListNew;
-  accessPointCounter++;
+bool HttpServerAdvanced::addAccessPoint(String ssid, String psk, byte priority)
+{
+  return wifi.accessPoints.add(ssid, psk, priority);
 }
 
 void HttpServerAdvanced::setup()
 {
-  if (debug.enabled) {
-    delay(500);
-  }
-
-  debug.info("Version " + String(HTTP_SERVER_ADVANCED_VERSION));
-
-  delay(10);
-
-  pins.setup(&settings, &debug);
+  bootTimer.mark(BOOT_PHASE_SETUP);
+
+  debug.info(F("Version ") + String(HTTP_SERVER_ADVANCED_VERSION));
+
+  setupPlatform(&espGpio, &eepromStore, &uartSerialPort);
+  analogSampler.setup(&debug);
+  sequencePlayer.setup(&settings, &debug, &pins);
+  pwm.setup(&settings, &debug, &pins);
+  pulseCounter.setup(&settings, &debug, &pins);
+  udpControl.setup(&settings, &debug, &pins);
+  rules.setup(&settings, &debug, &pins, &scheduler);
+  pinHistory.setup(&settings, &debug, &pins);
+  staticFiles.setup(&debug, &scheduler);
+  busScript.setup(&settings, &debug, &pins);
+  loopPacer.setup(&debug, &scheduler);
+  firmwareUpdate.setup(&debug, &scheduler, &settings);
+  mdns.setup(&settings, &debug);
+  schedule.setup(&debug, &pins, &scheduler);
 
   statusLed.setup();
 
+  unsigned long settingsStartMicros = micros();
   settings.setup();
+  bootTimer.settingsMicros = micros() - settingsStartMicros;
+  bootTimer.warmStart = settings.warmStart;
+  bootTimer.mark(BOOT_PHASE_SETTINGS);
+
   if (settings.hasDataRestored()) {
     pins.restorePinModesAndStates();
+    pulseCounter.restore();
+    pwm.restore();
+    rules.restore();
+  }
+  schedule.restore();
+  pinHistory.begin();
+  staticFiles.begin();
+  bootTimer.mark(BOOT_PHASE_PINS);
+
+  String nodeName = settings.getNodeName();
+  if (nodeName.length() == 0) {
+    settings.setNodeName("DomNode");
   }
 
+  nodeName = settings.getNodeName();
+  debug.info(F("nodeName: ") + nodeName);
+
+  loopPacer.begin();
+
   if (!setupWifi()) {
-    debug.error("Setup incomplete.");
+    debug.error(F("Setup incomplete."));
     statusLed.turnOff();
     return;
   }
+  bootTimer.mark(BOOT_PHASE_WIFI_STARTED);
 
+  // the server can listen before the connection is made, it starts accepting once there's an IP
   server = new WiFiServer(port);
   server->begin();
+  mdns.port = port;
+
+  addTasks();
+
+  // from here on nothing may wait for the uart or the flash, the scheduler writes them out in the background
+  debug.serialQueue = &serialQueue;
+  settings.deferCommits = true;
 
   setupComplete = true;
-  debug.info("Setup complete.");
+  debug.info(F("Setup complete."));
 }
 
 bool HttpServerAdvanced::setupWifi()
 {
-  int numberOfNetworks = WiFi.scanNetworks();
-  if (numberOfNetworks == 0) {
-    debug.error("No networks found!");
-    return false;
+  return wifi.begin();
+}
+
+void HttpServerAdvanced::loop()
+{
+  if (!setupComplete) {
+    statusLed.turnOff();
+    return;
   }
 
-  for (int scanIndex = 0; scanIndex < numberOfNetworks; scanIndex++) {
-    debug.info(
-      "Found AP: '" + WiFi.SSID(scanIndex) + "' rssi: " + WiFi.RSSI(scanIndex)
-    );
+  scheduler.run();
+  loopPacer.pace(isBusy());
+}
 
-    for (size_t accessPointIndex = 0; accessPointIndex < accessPointCounter; accessPointIndex++) {
-      if (
-        String(
-          accessPointList[accessPointIndex].ssid
-        ).compareTo(
-          WiFi.SSID(scanIndex)
-        ) == 0
-      ) {
-        accessPointList[accessPointIndex].found = true;
-
-        // same ssid can be used by multiple APs, and we wan't to store the strongest signal
-        int rssi = WiFi.RSSI(scanIndex);
-        if (rssi > accessPointList[accessPointIndex].signalStrength) {
-          accessPointList[accessPointIndex].signalStrength = rssi;
-        }
-      }
+bool HttpServerAdvanced::isBusy()
+{
+  if (!serialQueue.isEmpty() || staticFiles.isServing() || firmwareUpdate.isReceiving()) {
+    return true;
+  }
+
+  for (byte slotIndex = 0; slotIndex < HTTP_CLIENT_SLOTS; slotIndex++) {
+    if (clientSlots[slotIndex].used) {
+      return true;
     }
   }
 
-  AccessPoint selectedAccessPoint;
-  for (size_t accessPointIndex = 0; accessPointIndex < accessPointCounter; accessPointIndex++) {
-    // If the stored network cannot be found, drop it.
-    if (!accessPointList[accessPointIndex].found) {
+  return false;
+}
+
+void HttpServerAdvanced::addTasks()
+{
+  // in low power the polls run on every wake up instead of keeping the node awake with their periods
+  uint32_t pollPeriodMillis = loopPacer.enabled ? 0 : 10;
+
+  scheduler.addTask("wifi", HttpServerAdvanced::wifiTask, this, pollPeriodMillis, 5000);
+  scheduler.addTask("udp", HttpServerAdvanced::udpTask, this, 0, 2000);
+  scheduler.addTask("connection", HttpServerAdvanced::connectionTask, this, 0, 10000);
+  scheduler.addTask("serial", HttpServerAdvanced::serialTask, this, 0, 500);
+  scheduler.addTask("sequence", HttpServerAdvanced::sequenceTask, this, pollPeriodMillis, 500);
+  scheduler.addTask("rules", HttpServerAdvanced::rulesTask, this, pollPeriodMillis, 1000);
+  scheduler.addTask("history", HttpServerAdvanced::historyTask, this, 0, 1000);
+  if (schedule.enabled) {
+    scheduler.addTask("schedule", HttpServerAdvanced::scheduleTask, this, 100, 5000);
+  }
+  if (firmwareUpdate.enabled) {
+    // the chunks are written until the budget runs out, a single write can still overrun it by erasing a flash sector
+    updateTaskId = scheduler.addDeadlineTask("update", HttpServerAdvanced::updateTask, this, 20000);
+  }
+  // a commit can't be split, when it erases a flash sector it overruns the budget, and the overrun is counted
+  scheduler.addTask("settings", HttpServerAdvanced::settingsTask, this, 1000, 20000);
+}
+
+void HttpServerAdvanced::serviceConnection()
+{
+  if (!wifi.isConnected()) {
+    return;
+  }
+
+  // the file is sent in the background of the other requests
+  staticFiles.loop();
+
+  acceptClients();
+
+  // a single request per run, starting from the slot after the last one answered,
+  // so a client reconnecting in a tight loop can't keep the others waiting
+  for (byte offset = 0; offset < HTTP_CLIENT_SLOTS; offset++) {
+    byte slotIndex = (nextClientSlot + offset) % HTTP_CLIENT_SLOTS;
+    HttpClientSlot* slot = &clientSlots[slotIndex];
+    if (!slot->used) {
       continue;
     }
 
-    // If the priority is higher than the selected one's, use that.
-    if (accessPointList[accessPointIndex].priority < selectedAccessPoint.priority) {
-      selectedAccessPoint = accessPointList[accessPointIndex];
+    if (!slot->client.connected() && !slot->client.available()) {
+      debug.warn(F("The client disconnected before sending the request."));
+      releaseClientSlot(slot);
+      continue;
     }
 
-    // If the priority is the same, but the signalStrength is stronger than the selected one's, use that.
-    if (
-      accessPointList[accessPointIndex].priority == selectedAccessPoint.priority &&
-      accessPointList[accessPointIndex].signalStrength > selectedAccessPoint.signalStrength
-    ) {
-      selectedAccessPoint = accessPointList[accessPointIndex];
+    if (!slot->client.available()) {
+      continue;
     }
-  }
 
-  if (!selectedAccessPoint.found) {
-    debug.error("None of the stored networks are visible!");
-    return false;
+    nextClientSlot = (slotIndex + 1) % HTTP_CLIENT_SLOTS;
+    respond(slot);
+    return;
   }
+}
 
-  debug.info("Connecting to " + String(selectedAccessPoint.ssid));
+void HttpServerAdvanced::acceptClients()
+{
+  for (byte slotIndex = 0; slotIndex < HTTP_CLIENT_SLOTS; slotIndex++) {
+    HttpClientSlot* slot = &clientSlots[slotIndex];
+    if (slot->used) {
+      continue;
+    }
 
-  String nodeName = settings.getNodeName();
-  if (nodeName.length() == 0) {
-    settings.setNodeName("DomNode");
-  }
+    // Check if we have a new client
+    slot->client = server->available();
+    if (!slot->client) {
+      return;
+    }
 
-  nodeName = settings.getNodeName();
-  debug.info("nodeName: " + nodeName);
+    debug.info(F("Got request."));
+    statusLed.burst();
 
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(selectedAccessPoint.ssid, selectedAccessPoint.psk);
+    // refused before reading the request, it costs the same however long the request is
+    uint32_t retryAfterSeconds;
+    if (!rateLimiter.admit((uint32_t)slot->client.remoteIP(), &retryAfterSeconds)) {
+      slot->client.print(HttpResponse::TooManyRequests(retryAfterSeconds).toString());
+      slot->client.stop();
+      continue;
+    }
 
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(250);
-    statusLed.turnOff();
-    delay(250);
-    statusLed.turnOn();
-    debug.waiting();
+    slot->used = true;
+    slot->timeoutId = scheduler.setTimeout(HTTP_CLIENT_TIMEOUT_MS, HttpServerAdvanced::onClientTimeout, slot);
+    if (!slot->client.available()) {
+      debug.info(F("Waiting for the client to send data"));
+      statusLed.setPattern(STATUS_LED_FAST_BLINK);
+    }
   }
-
-  debug.waitingFinished();
-  debug.info("WiFi connected, local IP: " + WiFi.localIP().toString());
-  return true;
 }
 
-void HttpServerAdvanced::loop()
+void HttpServerAdvanced::respond(HttpClientSlot* slot)
 {
-  if (!setupComplete) {
-    statusLed.turnOff();
+  loopPacer.markActivity();
+
+  HttpRequest request;
+  request.readHead(&slot->client);
+
+  WiFiClient client = slot->client;
+  releaseClientSlot(slot);
+
+  // the image is streamed into the flash by the update task instead of read into the RAM
+  if (firmwareUpdate.begin(&request, &client)) {
+    scheduler.wake(updateTaskId);
     return;
   }
 
-  // Check if we have a new client
-  WiFiClient client = server->available();
-  if (!client) {
+  request.readData(&client);
+
+  if (staticFiles.serve(&request, &client)) {
     return;
   }
 
-  debug.info("Got request.");
+  HttpResponse response = processRequest(&request);
 
-  waitForClient(&client);
+  client.print(response.toString());
+  client.stop();
+}
 
-  HttpRequest request(&statusLed);
-  request.readClient(&client);
+void HttpServerAdvanced::releaseClientSlot(HttpClientSlot* slot)
+{
+  scheduler.clearTimeout(slot->timeoutId);
+  slot->timeoutId = TIMER_WHEEL_INVALID_ID;
+  slot->used = false;
+  slot->client = WiFiClient();
 
-  HttpResponse response = processRequest(&request);
+  for (byte slotIndex = 0; slotIndex < HTTP_CLIENT_SLOTS; slotIndex++) {
+    if (clientSlots[slotIndex].used) {
+      return;
+    }
+  }
 
-  client.flush();
+  statusLed.setPattern(STATUS_LED_STEADY);
+}
 
-  client.print(response.toString());
-  delay(1);
+void HttpServerAdvanced::wifiTask(void* context)
+{
+  HttpServerAdvanced* httpServer = (HttpServerAdvanced*)context;
+  httpServer->wifi.loop();
+
+  if (httpServer->wifi.isConnected() && !httpServer->bootTimer.isMarked(BOOT_PHASE_WIFI_CONNECTED)) {
+    httpServer->bootTimer.mark(BOOT_PHASE_WIFI_CONNECTED);
+    httpServer->bootTimer.fastConnect = httpServer->wifi.fastConnected;
+    httpServer->debug.info(F("Boot times:\n") + httpServer->bootTimer.toString());
+  }
 }
 
-void HttpServerAdvanced::waitForClient(WiFiClient* client)
+void HttpServerAdvanced::udpTask(void* context)
 {
-  debug.info("Waiting for the client to send data");
-  unsigned long startTime = millis();
-  int timeOutMillis = 30 * 1000;
-  unsigned long timeOutTime = startTime + timeOutMillis;
-  int counter = 0;
-  while (!client->available()) {
-    delay(1);
-    counter++;
+  HttpServerAdvanced* httpServer = (HttpServerAdvanced*)context;
+  httpServer->udpControl.loop(httpServer->wifi.isConnected());
+  httpServer->mdns.loop(httpServer->wifi.isConnected());
+}
 
-    if (counter > 250) {
-      statusLed.turnOff();
-    }
+void HttpServerAdvanced::connectionTask(void* context)
+{
+  ((HttpServerAdvanced*)context)->serviceConnection();
+}
 
-    if (counter > 500) {
-      statusLed.turnOn();
-      counter = 0;
-      debug.waiting();
-    }
+void HttpServerAdvanced::serialTask(void* context)
+{
+  HttpServerAdvanced* httpServer = (HttpServerAdvanced*)context;
+  while (httpServer->scheduler.hasBudget() && httpServer->serialQueue.drain() > 0);
+}
 
-    if (timeOutTime < millis()) {
-      debug.waitingFinished();
-      debug.warn("No data received within the timeout period.");
-      return;
-    }
+void HttpServerAdvanced::settingsTask(void* context)
+{
+  ((HttpServerAdvanced*)context)->settings.flush();
+}
+
+void HttpServerAdvanced::sequenceTask(void* context)
+{
+  ((HttpServerAdvanced*)context)->sequencePlayer.loop();
+}
+
+void HttpServerAdvanced::rulesTask(void* context)
+{
+  ((HttpServerAdvanced*)context)->rules.loop();
+}
+
+void HttpServerAdvanced::historyTask(void* context)
+{
+  ((HttpServerAdvanced*)context)->pinHistory.loop();
+}
+
+void HttpServerAdvanced::updateTask(void* context)
+{
+  HttpServerAdvanced* server = (HttpServerAdvanced*)context;
+  server->firmwareUpdate.loop();
+
+  // runs on every iteration until the image is received whole
+  if (server->firmwareUpdate.isReceiving()) {
+    server->scheduler.wake(server->updateTaskId);
   }
+}
 
-  debug.waitingFinished();
-  debug.info("All data received from the client.");
+void HttpServerAdvanced::scheduleTask(void* context)
+{
+  ((HttpServerAdvanced*)context)->schedule.loop();
 }
 
-HttpResponse HttpServerAdvanced::processRequest(HttpRequest* request)
+void HttpServerAdvanced::onClientTimeout(void* context)
 {
-  debug.info("Processesing request");
-  debug.info("request method: " + request->method);
-  debug.info("request uri: " + request->uri);
-  debug.info("request protocol: " + request->protocol);
-  debug.info("request headers: " + request->headers);
-  debug.info("request data: " + request->data);
+  HttpClientSlot* slot = (HttpClientSlot*)context;
+  if (!slot->used) {
+    return;
+  }
 
-  if (request->method == "options") {
-    return HttpResponse();
+  slot->server->debug.warn(F("No data received within the timeout period."));
+  slot->timeoutId = TIMER_WHEEL_INVALID_ID;
+  slot->client.stop();
+  slot->server->releaseClientSlot(slot);
+}
+
+HttpResponse HttpServerAdvanced::processPlatformRequest(HttpRequest* request)
+{
+  //digital/{pinNumber}/history
+  if (request->uri.indexOf("/digital/") == 0 && request->uri.endsWith("/history")) {
+    return processRequestOfHistory(request);
+  }
+
+  //analog
+  if (request->uri == "/analog") {
+    return processRequestOfAnalog(request);
+  }
+
+  //counter/{pinNumber}
+  if (request->uri.indexOf("/counter/") == 0) {
+    return processRequestOfCounter(request);
+  }
+
+  //pwm/{pinNumber}
+  if (request->uri.indexOf("/pwm/") == 0) {
+    return processRequestOfPwm(request);
+  }
+
+  //rules[/{ruleId}]
+  if (request->uri == "/rules" || request->uri.indexOf("/rules/") == 0) {
+    return processRequestOfRules(request);
+  }
+
+  //bus/(i2c|spi)
+  if (request->uri == "/bus/i2c" || request->uri == "/bus/spi") {
+    return processRequestOfBus(request);
+  }
+
+  //schedule[/{id}]
+  if (request->uri == "/schedule" || request->uri.indexOf("/schedule/") == 0) {
+    return processRequestOfSchedule(request);
+  }
+
+  //sequence
+  if (request->uri == "/sequence") {
+    return processRequestOfSequence(request);
   }
 
-  if (request->uri == "/") {
+  //wifi
+  if (request->uri == "/wifi") {
+    return processRequestOfWifi(request);
+  }
+
+  //boot
+  if (request->uri == "/boot") {
     if (request->method == "get") {
       return HttpResponse(
-        "name: " + settings.getNodeName() + "\r\n" +
-        "hsaVersion: " + String(HTTP_SERVER_ADVANCED_VERSION) + "\r\n"
+        bootTimer.toString()
       );
     }
 
-    if (request->method == "post") {
-      settings.setNodeName(request->data);
-      return HttpResponse();
-    }
-
     return HttpResponse::BadRequest();
   }
 
-  //serial
-  if (request->uri == "/serial") {
-    return processRequestOfSerial(request);
-  }
+  //scheduler
+  if (request->uri == "/scheduler") {
+    if (request->method == "get") {
+      return HttpResponse(
+        scheduler.getStats() +
+        F("serialDropped: ") + String(serialQueue.dropped) + "\r\n" +
+        loopPacer.getStats()
+      );
+    }
 
-  //digital/{pinNumber}
-  if (request->uri.indexOf("/digital") == 0) {
-    return processRequestOfDigital(request);
+    return HttpResponse::BadRequest();
   }
 
-  //debug
-  if (request->uri == "/debug") {
+  //update, posting the image is handled by firmwareUpdate
+  if (request->uri == FIRMWARE_UPDATE_URI && firmwareUpdate.enabled) {
     if (request->method == "get") {
       return HttpResponse(
-        debug.get()
+        firmwareUpdate.getStatus()
       );
     }
 
@@ -278,194 +449,698 @@ HttpResponse HttpServerAdvanced::processRequest(HttpRequest* request)
   return HttpResponse::NotFound();
 }
 
-HttpResponse HttpServerAdvanced::processRequestOfSerial(HttpRequest* request)
+void HttpServerAdvanced::releasePin(byte digitalPinNumber)
+{
+  pulseCounter.disable(digitalPinNumber);
+  pwm.disable(digitalPinNumber);
+  pinHistory.disable(digitalPinNumber);
+  rules.removeRulesOfPin(digitalPinNumber);
+}
+
+HttpResponse HttpServerAdvanced::processRequestOfHistory(HttpRequest* request)
+{
+  String strPinNumber = request->uri.substring(9, request->uri.length() - 8);
+
+  byte pinNumber = strPinNumber.toInt();
+  if (String(pinNumber) != strPinNumber) {
+    return HttpResponse::BadRequest(
+      F("The pin number contains non-digit characters.")
+    );
+  }
+
+  if (pinNumber > 15) {
+    return HttpResponse::BadRequest(
+      F("The pin number is out of range. Range: 0-15")
+    );
+  }
+
+  // PUT
+  if (request->method == "put") {
+    if (!pinHistory.enable(pinNumber)) {
+      return HttpResponse::Unacceptable(
+        F("The pin must be initialized, and the history needs 4KB of RAM.\r\n") +
+        getPinData(pinNumber)
+      );
+    }
+
+    return HttpResponse();
+  }
+
+  // DELETE
+  if (request->method == "delete") {
+    pinHistory.disable(pinNumber);
+    return HttpResponse();
+  }
+
+  if (request->method != "get") {
+    return HttpResponse::BadRequest();
+  }
+
+  // negative times are relative to now, the times since boot are unsigned, they pass 2^31 after 24.8 days
+  uint32_t now = millis();
+  uint32_t range[2] = {0, now};
+  String strRange[2] = {request->getQueryParameter("from"), request->getQueryParameter("to")};
+  for (byte rangeIndex = 0; rangeIndex < 2; rangeIndex++) {
+    if (strRange[rangeIndex].length() == 0) {
+      continue;
+    }
+
+    bool relative = strRange[rangeIndex].charAt(0) == '-';
+    const char* digits = strRange[rangeIndex].c_str() + (relative ? 1 : 0);
+    char* end = nullptr;
+    unsigned long value = strtoul(digits, &end, 10);
+    if (digits[0] < '0' || digits[0] > '9' || *end != 0) {
+      return HttpResponse::BadRequest(
+        F("The from and to must be milliseconds since boot, or negative milliseconds before now.")
+      );
+    }
+
+    range[rangeIndex] = !relative ? value : value > now ? 0 : now - value;
+  }
+
+  return HttpResponse(
+    F("pin: ") + String(pinNumber) + "\r\n" +
+    F("from: ") + String(range[0]) + "\r\n" +
+    F("to: ") + String(range[1]) + "\r\n" +
+    pinHistory.query(pinNumber, range[0], range[1])
+  );
+}
+
+HttpResponse HttpServerAdvanced::processRequestOfAnalog(HttpRequest* request)
 {
+  // GET
   if (request->method == "get") {
+    String strCount = request->getQueryParameter("count");
+    if (strCount.length() == 0) {
+      return HttpResponse(
+        analogSampler.getAggregates()
+      );
+    }
+
+    long count = strCount.toInt();
+    long decimate = request->getQueryParameter("decimate", "1").toInt();
+    if (count < 1 || decimate < 1 || decimate > ANALOG_SAMPLER_BUFFER_SIZE) {
+      return HttpResponse::BadRequest(
+        F("The count and decimate must be positive numbers, decimate can't be more than the buffer size.")
+      );
+    }
+
     return HttpResponse(
-      readSerial()
+      analogSampler.getAggregates() +
+      F("decimate: ") + String(decimate) + "\r\n" +
+      F("window: ") + analogSampler.getWindow(min(count, 65535L), decimate) + "\r\n"
     );
   }
 
-  if (request->method == "post") {
-    writeSerial(request->data);
-    return HttpResponse();
+  // PUT
+  if (request->method == "put") {
+    long rate = request->data.toInt();
+    if (String(rate) != request->data || rate < 1 || rate > ANALOG_SAMPLER_MAX_RATE) {
+      return HttpResponse::BadRequest(
+        F("The rate is out of range. Range: 1-") + String(ANALOG_SAMPLER_MAX_RATE)
+      );
+    }
+
+    if (!analogSampler.start(rate)) {
+      return HttpResponse::InternalError();
+    }
+
+    return HttpResponse(
+      analogSampler.getAggregates()
+    );
+  }
+
+  // DELETE
+  if (request->method == "delete") {
+    analogSampler.stop();
+
+    return HttpResponse(
+      analogSampler.getAggregates()
+    );
   }
 
   return HttpResponse::BadRequest();
 }
 
-HttpResponse HttpServerAdvanced::processRequestOfDigital(HttpRequest* request)
+HttpResponse HttpServerAdvanced::processRequestOfCounter(HttpRequest* request)
 {
   String strPinNumber = request->uri.substring(9);
 
   byte pinNumber = strPinNumber.toInt();
   if (String(pinNumber) != strPinNumber) {
     return HttpResponse::BadRequest(
-      "The pin number contains non-digit characters."
+      F("The pin number contains non-digit characters.")
     );
   }
 
-  if (pinNumber < 0 || pinNumber > 15) {
+  if (pinNumber > 15) {
     return HttpResponse::BadRequest(
-      "The pin number is out of range. Range: 0-15"
+      F("The pin number is out of range. Range: 0-15")
     );
   }
 
   // GET
   if (request->method == "get") {
+    if (!pulseCounter.isEnabled(pinNumber)) {
+      return HttpResponse::Unacceptable(
+        F("The pin is not counting.")
+      );
+    }
+
     return HttpResponse(
-      getPinData(pinNumber)
+      pulseCounter.read(pinNumber, request->getQueryParameter("reset", "1") == "1")
     );
   }
 
-  // If the pin is locked, only get is allowed
-  if (settings.isPinLocked(pinNumber)) {
-    return HttpResponse::Unacceptable(
-      "The pin is locked, can't set state.\r\n" +
+  // PUT
+  if (request->method == "put") {
+    int edge = PulseCounter::parseEdge(request->getDataField("edge", "rising"));
+    if (edge < 0) {
+      return HttpResponse::BadRequest(
+        F("Bad edge requested. Following is accepted: rising, falling, change.")
+      );
+    }
+
+    String strDebounce = request->getDataField("debounce", "0");
+    long debounce = strDebounce.toInt();
+    if (String(debounce) != strDebounce || debounce < 0) {
+      return HttpResponse::BadRequest(
+        F("The debounce must be a positive number of microseconds.")
+      );
+    }
+
+    if (!pulseCounter.enable(pinNumber, edge, debounce)) {
+      return HttpResponse::Unacceptable(
+        F("The pin must be initialized as input, and D0 can't count.\r\n") +
+        getPinData(pinNumber)
+      );
+    }
+
+    return HttpResponse(
+      pulseCounter.read(pinNumber, false)
+    );
+  }
+
+  // DELETE
+  if (request->method == "delete") {
+    pulseCounter.disable(pinNumber);
+    return HttpResponse();
+  }
+
+  return HttpResponse::BadRequest();
+}
+
+HttpResponse HttpServerAdvanced::processRequestOfPwm(HttpRequest* request)
+{
+  String strPinNumber = request->uri.substring(5);
+
+  byte pinNumber = strPinNumber.toInt();
+  if (String(pinNumber) != strPinNumber) {
+    return HttpResponse::BadRequest(
+      F("The pin number contains non-digit characters.")
+    );
+  }
+
+  if (pinNumber > 15) {
+    return HttpResponse::BadRequest(
+      F("The pin number is out of range. Range: 0-15")
+    );
+  }
+
+  // GET
+  if (request->method == "get") {
+    if (!pwm.isEnabled(pinNumber)) {
+      return HttpResponse::Unacceptable(
+        F("The pin is not in pwm mode.")
+      );
+    }
+
+    return HttpResponse(
+      pwm.getStatus(pinNumber)
+    );
+  }
+
+  // PUT
+  if (request->method == "put") {
+    String strDuty = request->getDataField("duty", "");
+    long duty = strDuty.toInt();
+    if (String(duty) != strDuty || duty < 0 || duty > PWM_DUTY_RANGE) {
+      return HttpResponse::BadRequest(
+        F("The duty must be a number of permille. Range: 0-") + String(PWM_DUTY_RANGE)
+      );
+    }
+
+    String strFrequency = request->getDataField("frequency", String(pwm.frequency));
+    long frequency = strFrequency.toInt();
+    if (String(frequency) != strFrequency || frequency < PWM_MIN_FREQUENCY || frequency > PWM_MAX_FREQUENCY) {
+      return HttpResponse::BadRequest(
+        F("The frequency is out of range. Range: ") + String(PWM_MIN_FREQUENCY) + "-" + String(PWM_MAX_FREQUENCY)
+      );
+    }
+
+    if (sequencePlayer.running) {
+      return HttpResponse::Unacceptable(
+        F("The timer is used by the sequence, delete the sequence first.")
+      );
+    }
+
+    if (!pwm.enable(pinNumber, duty, frequency)) {
+      return HttpResponse::Unacceptable(
+        F("The pin must be initialized as output, and D0 can't be in pwm mode.\r\n") +
+        getPinData(pinNumber)
+      );
+    }
+
+    return HttpResponse(
+      pwm.getStatus(pinNumber)
+    );
+  }
+
+  // DELETE
+  if (request->method == "delete") {
+    pwm.disable(pinNumber);
+    return HttpResponse(
       getPinData(pinNumber)
     );
   }
 
+  return HttpResponse::BadRequest();
+}
+
+HttpResponse HttpServerAdvanced::processRequestOfRules(HttpRequest* request)
+{
+  // DELETE /rules/{ruleId}
+  if (request->uri.indexOf("/rules/") == 0) {
+    String strRuleId = request->uri.substring(7);
+    long ruleId = strRuleId.toInt();
+    if (String(ruleId) != strRuleId || ruleId < 0) {
+      return HttpResponse::BadRequest(
+        F("The rule id contains non-digit characters.")
+      );
+    }
+
+    if (request->method != "delete") {
+      return HttpResponse::BadRequest();
+    }
+
+    if (!rules.remove(ruleId)) {
+      return HttpResponse::NotFound();
+    }
+
+    return HttpResponse(
+      rules.toString()
+    );
+  }
+
+  // GET
+  if (request->method == "get") {
+    return HttpResponse(
+      rules.toString()
+    );
+  }
+
   // POST
   if (request->method == "post") {
-    if (settings.getPinMode(pinNumber) != OUTPUT) {
+    StoredRule definition;
+    memset(&definition, 0, sizeof(StoredRule));
+
+    int trigger = RuleEngine::parseTrigger(request->getDataField("trigger"));
+    if (trigger < 0) {
+      return HttpResponse::BadRequest(
+        F("Bad trigger requested. Following is accepted: rising, falling, change, low, high, timer.")
+      );
+    }
+    definition.trigger = trigger;
+
+    int action = RuleEngine::parseAction(request->getDataField("action"));
+    if (action < 0) {
+      return HttpResponse::BadRequest(
+        F("Bad action requested. Following is accepted: low, high, toggle, pulse.")
+      );
+    }
+    definition.action = action;
+
+    long values[4];
+    for (byte fieldIndex = 0; fieldIndex < 4; fieldIndex++) {
+      String field = FPSTR(ruleFields[fieldIndex]);
+      String strValue = request->getDataField(field, "0");
+      values[fieldIndex] = strValue.toInt();
+      if (String(values[fieldIndex]) != strValue || values[fieldIndex] < 0) {
+        return HttpResponse::BadRequest(
+          F("The ") + field + F(" must be a positive number.")
+        );
+      }
+    }
+    definition.triggerPin = min(values[0], 255L);
+    definition.targetPin = min(values[1], 255L);
+    definition.periodMillis = values[2];
+    definition.durationMillis = values[3];
+
+    uint16_t conditionMask;
+    uint16_t conditionStates;
+    if (!RuleEngine::parseCondition(request->getDataField("condition"), &conditionMask, &conditionStates)) {
+      return HttpResponse::BadRequest(
+        F("Bad condition requested. Expected comma separated {pinNumber}={state} pairs, e.g. 6=1,7=0")
+      );
+    }
+    definition.conditionMask = conditionMask;
+    definition.conditionStates = conditionStates;
+
+    if (rules.add(&definition) == RULE_NONE) {
       return HttpResponse::Unacceptable(
-        "The pin is not in output mode, can't set state.\r\n" +
-        getPinData(pinNumber)
+        rules.error
       );
     }
 
-    if (!pins.setState(pinNumber, request->data)) {
-      return HttpResponse::InternalError();
+    return HttpResponse(
+      rules.toString()
+    );
+  }
+
+  // DELETE
+  if (request->method == "delete") {
+    rules.clear();
+    return HttpResponse();
+  }
+
+  return HttpResponse::BadRequest();
+}
+
+HttpResponse HttpServerAdvanced::processRequestOfSchedule(HttpRequest* request)
+{
+  if (!schedule.enabled) {
+    return HttpResponse::NotFound();
+  }
+
+  // DELETE /schedule/{id}
+  if (request->uri.indexOf("/schedule/") == 0) {
+    String strId = request->uri.substring(10);
+    long id = strId.toInt();
+    if (String(id) != strId || id < 0) {
+      return HttpResponse::BadRequest(
+        F("The id contains non-digit characters.")
+      );
+    }
+
+    if (request->method != "delete") {
+      return HttpResponse::BadRequest();
+    }
+
+    if (!schedule.remove(id)) {
+      return HttpResponse::NotFound();
     }
 
     return HttpResponse(
-      getPinData(pinNumber)
+      schedule.toString()
     );
   }
 
-  // PUT
-  if (request->method == "put") {
-    if (settings.isPinInitalized(pinNumber)) {
+  // GET
+  if (request->method == "get") {
+    return HttpResponse(
+      schedule.toString()
+    );
+  }
+
+  // POST
+  if (request->method == "post") {
+    StoredScheduleEntry definition;
+    memset(&definition, 0, sizeof(StoredScheduleEntry));
+
+    int action = RuleEngine::parseAction(request->getDataField("action"));
+    if (action < 0) {
+      return HttpResponse::BadRequest(
+        F("Bad action requested. Following is accepted: low, high, toggle, pulse.")
+      );
+    }
+    definition.action = action;
+
+    long values[4];
+    for (byte fieldIndex = 0; fieldIndex < 4; fieldIndex++) {
+      String field = FPSTR(scheduleFields[fieldIndex]);
+      String strValue = request->getDataField(field, "0");
+      values[fieldIndex] = strValue.toInt();
+      if (String(values[fieldIndex]) != strValue || values[fieldIndex] < 0) {
+        return HttpResponse::BadRequest(
+          F("The ") + field + F(" must be a positive number.")
+        );
+      }
+    }
+    definition.pin = min(values[0], 255L);
+    definition.runAt = values[1];
+    definition.periodSeconds = values[2];
+    definition.durationMillis = values[3];
+
+    // a wall-clock deadline, or a relative one
+    String strAt = request->getDataField("at");
+    bool relative = strAt.length() == 0;
+    if (!relative) {
+      if (!schedule.isClockSet()) {
+        return HttpResponse::Unacceptable(
+          F("The clock is not set yet, only relative deadlines can be used.")
+        );
+      }
+
+      definition.runAt = schedule.parseTime(strAt);
+      if (definition.runAt == 0) {
+        return HttpResponse::BadRequest(
+          F("Bad time requested. Expected HH:MM[:SS] in the local time, or a unix time.")
+        );
+      }
+    }
+
+    if (schedule.add(&definition, relative) == SCHEDULE_NONE) {
       return HttpResponse::Unacceptable(
-        "The pin is already initialized.\r\n" +
-        getPinData(pinNumber)
+        schedule.error
       );
     }
 
-    if (
-      request->data != "input" &&
-      request->data != "output" &&
-      request->data != "input_pullup"
-    ) {
+    return HttpResponse(
+      schedule.toString()
+    );
+  }
+
+  // DELETE
+  if (request->method == "delete") {
+    schedule.clear();
+    return HttpResponse();
+  }
+
+  return HttpResponse::BadRequest();
+}
+
+HttpResponse HttpServerAdvanced::processRequestOfBus(HttpRequest* request)
+{
+  if (request->method != "post") {
+    return HttpResponse::BadRequest();
+  }
+
+  bool spi = request->uri == "/bus/spi";
+
+  String strFrequency = request->getQueryParameter("frequency", "0");
+  uint32_t frequency = strtoul(strFrequency.c_str(), nullptr, 0);
+  if (frequency == 0) {
+    frequency = spi ? BUS_DEFAULT_SPI_FREQUENCY : BUS_DEFAULT_I2C_FREQUENCY;
+  }
+
+  String result;
+  bool success;
+  if (spi) {
+    long csPinNumber = request->getQueryParameter("cs", "255").toInt();
+    long mode = request->getQueryParameter("mode", "0").toInt();
+    if (csPinNumber < 0 || csPinNumber > 255 || mode < 0 || mode > 255) {
+      return HttpResponse::BadRequest();
+    }
+
+    success = busScript.runSpi(request->data, csPinNumber, frequency, mode, &result);
+  }
+  else {
+    // required, a missing one would be the general call address of every device
+    String strAddress = request->getQueryParameter("address");
+    char* end;
+    uint32_t address = strtoul(strAddress.c_str(), &end, 0);
+    if (strAddress.length() == 0 || *end != 0 || address > 0x7F) {
       return HttpResponse::BadRequest(
-        "Bad mode requested. Following is accepted: input, output, input_pullup."
+        F("The address is required, and must be 7 bits.")
       );
     }
 
-    if (!pins.initPin(pinNumber, request->data)) {
-      return HttpResponse::InternalError();
+    success = busScript.runI2c(request->data, address, frequency, &result);
+  }
+
+  if (!success) {
+    return HttpResponse::Unacceptable(
+      busScript.error
+    );
+  }
+
+  return HttpResponse(
+    result
+  );
+}
+
+HttpResponse HttpServerAdvanced::processRequestOfSequence(HttpRequest* request)
+{
+  // GET
+  if (request->method == "get") {
+    return HttpResponse(
+      sequencePlayer.getStatus()
+    );
+  }
+
+  // PUT
+  if (request->method == "put") {
+    long repeat = request->getQueryParameter("repeat", "1").toInt();
+    long period = request->getQueryParameter("period", "0").toInt();
+    bool persist = request->getQueryParameter("persist", "0") == "1";
+    if (repeat < 0 || period < 0) {
+      return HttpResponse::BadRequest(
+        F("The repeat and period can't be negative.")
+      );
+    }
+
+    if (!sequencePlayer.load(request->data, repeat, period, persist)) {
+      return HttpResponse::BadRequest(
+        sequencePlayer.error
+      );
     }
 
     return HttpResponse(
-      getPinData(pinNumber)
+      sequencePlayer.getStatus()
     );
   }
 
-  // // PATCH
-  // if (request->method == "patch") {
-  //   if (settings.getPinMode(pinNumber) != OUTPUT) {
-  //     return HttpResponse::Unacceptable(
-  //       "The pin is not in output mode, can't set state.\r\n" +
-  //       getPinData(pinNumber)
-  //     );
-  //   }
+  // POST
+  if (request->method == "post") {
+    if (pwm.isRunning()) {
+      return HttpResponse::Unacceptable(
+        F("The timer is used by the pwm, delete the pwm of the pins first.")
+      );
+    }
 
-  //   if (!pins.setState(pinNumber, request->data)) {
-  //     return HttpResponse::InternalError();
-  //   }
+    if (!sequencePlayer.start()) {
+      return HttpResponse::Unacceptable(
+        F("There's no sequence loaded, or it is running already.\r\n") +
+        sequencePlayer.getStatus()
+      );
+    }
 
-  //   return HttpResponse(
-  //     getPinData(pinNumber)
-  //   );
-  // }
+    return HttpResponse(
+      sequencePlayer.getStatus()
+    );
+  }
 
   // DELETE
   if (request->method == "delete") {
-    settings.unsetPinInit(pinNumber);
+    sequencePlayer.abort();
 
     return HttpResponse(
-      getPinData(pinNumber)
+      sequencePlayer.getStatus()
     );
   }
 
   return HttpResponse::BadRequest();
 }
 
-String HttpServerAdvanced::readSerial()
+HttpResponse HttpServerAdvanced::processRequestOfWifi(HttpRequest* request)
 {
-  debug.info("Reading serial data.");
+  // GET
+  if (request->method == "get") {
+    return HttpResponse(
+      F("state: ") + wifi.getStateName() + "\r\n" +
+      F("ssid: ") + wifi.getSsid() + "\r\n" +
+      F("ip: ") + WiFi.localIP().toString() + "\r\n" +
+      "\r\n" +
+      wifi.accessPoints.toString()
+    );
+  }
 
-  String serialData;
-  while (Serial.available()) {
-    serialData += char(Serial.read());
+  String ssid = request->getDataField("ssid");
+  if (ssid.length() == 0) {
+    return HttpResponse::BadRequest(
+      F("The ssid field is missing.")
+    );
   }
 
-  return serialData;
+  // POST
+  if (request->method == "post") {
+    String strPriority = request->getDataField("priority", "255");
+    long priority = strPriority.toInt();
+    if (String(priority) != strPriority || priority < 0 || priority > 255) {
+      return HttpResponse::BadRequest(
+        F("The priority is out of range. Range: 0-255")
+      );
+    }
+
+    if (!wifi.accessPoints.add(ssid, request->getDataField("psk"), priority, true)) {
+      return HttpResponse::Unacceptable(
+        F("Could not add the access point, the ssid or psk is too long, or the registry is full.")
+      );
+    }
+
+    return HttpResponse(
+      wifi.accessPoints.toString()
+    );
+  }
+
+  // DELETE
+  if (request->method == "delete") {
+    if (!wifi.removeAccessPoint(ssid)) {
+      return HttpResponse::NotFound();
+    }
+
+    return HttpResponse(
+      wifi.accessPoints.toString()
+    );
+  }
+
+  return HttpResponse::BadRequest();
 }
 
-void HttpServerAdvanced::writeSerial(String data)
+void HttpServerAdvanced::enableIpLeaseCache()
 {
-  debug.info("Writing serial data.");
+  wifi.cacheIpLease = true;
+}
 
-  Serial.println(data);
+void HttpServerAdvanced::enableUdpControl(uint16_t port, IPAddress multicastAddress, byte group)
+{
+  udpControl.enabled = true;
+  udpControl.port = port;
+  udpControl.multicastAddress = multicastAddress;
+  udpControl.group = group;
 }
 
-void HttpServerAdvanced::disableEeprom()
+void HttpServerAdvanced::enablePinHistorySpill()
 {
-  this->settings.eepromEnabled = false;
+  pinHistory.spill = true;
 }
 
-void HttpServerAdvanced::enableDebug(bool serial, bool store, bool infoLogs, bool warningLogs, bool errorLogs)
+void HttpServerAdvanced::enableLowPower(uint32_t latencyTargetMillis, bool lightSleep)
 {
-  debug.enabled = true;
-  debug.serial = serial;
-  debug.store = store;
+  loopPacer.enabled = true;
+  loopPacer.latencyTargetMillis = latencyTargetMillis;
+  loopPacer.lightSleep = lightSleep;
+}
 
-  debug.infoLogs = infoLogs;
-  debug.warningLogs = warningLogs;
-  debug.errorLogs = errorLogs;
+void HttpServerAdvanced::enableStaticFiles()
+{
+  staticFiles.enabled = true;
 }
 
-String HttpServerAdvanced::getPinData(byte digitalPinNumber)
+void HttpServerAdvanced::enableFirmwareUpdate()
 {
-  if (!settings.isPinInitalized(digitalPinNumber)) {
-    return
-      "initialized: " +
-        String(settings.isPinInitalized(digitalPinNumber), DEC) +
-        "\r\n" +
-      "locked: " +
-        String(settings.isPinLocked(digitalPinNumber), DEC) +
-        "\r\n" +
-      "state: ?" +
-        "\r\n" +
-      "mode: ?" +
-        "\r\n"
-    ;
-  }
+  firmwareUpdate.enabled = true;
+}
 
-  return
-    "initialized: " +
-      String(settings.isPinInitalized(digitalPinNumber), DEC) +
-      "\r\n" +
-    "locked: " +
-      String(settings.isPinLocked(digitalPinNumber), DEC) +
-      "\r\n" +
-    "state: " +
-      String(pins.getState(digitalPinNumber), DEC) +
-      "\r\n" +
-    "mode: " +
-      String(settings.getPinMode(digitalPinNumber), DEC) +
-      "\r\n"
-  ;
+void HttpServerAdvanced::enableMdns()
+{
+  mdns.enabled = true;
 }
+
+void HttpServerAdvanced::enableSchedule(const char* timezone, const char* ntpServer)
+{
+  schedule.enabled = true;
+  schedule.timezone = timezone;
+  schedule.ntpServer = ntpServer;
+}
+
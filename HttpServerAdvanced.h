@@ -16,43 +16,93 @@
 
 #include "version.h"
 
-#include "HttpRequest.h"
-#include "HttpResponse.h"
+#include "RestApi.h"
+#include "EspPlatform.h"
 #include "StatusLed.h"
-#include "Settings.h"
-#include "Debug.h"
-#include "Pins.h"
-
-struct AccessPoint {
-  char ssid[32];
-  char psk[64];
-  byte priority = 255;
-  int signalStrength = -1000;
-  bool found = false;
+#include "WifiConnection.h"
+#include "BootTimer.h"
+#include "AnalogSampler.h"
+#include "SequencePlayer.h"
+#include "PwmGenerator.h"
+#include "PulseCounter.h"
+#include "UdpControl.h"
+#include "Scheduler.h"
+#include "RuleEngine.h"
+#include "PinHistory.h"
+#include "StaticFiles.h"
+#include "BusScript.h"
+#include "RateLimiter.h"
+#include "LoopPacer.h"
+#include "FirmwareUpdate.h"
+#include "MdnsResponder.h"
+#include "ActionSchedule.h"
+
+// How long a client may take to send its request after connecting.
+#define HTTP_CLIENT_TIMEOUT_MS 30000
+
+// Number of clients connected at once, while one is sending its request slowly the others are served.
+#ifndef HTTP_CLIENT_SLOTS
+#define HTTP_CLIENT_SLOTS 4
+#endif
+
+// Number of scheduler tasks registered by addTasks() at most, with every optional module enabled.
+#define HTTP_SERVER_TASKS 10
+
+#if SCHEDULER_MAX_TASKS < HTTP_SERVER_TASKS
+  #error SCHEDULER_MAX_TASKS leaves no room for the tasks of the server!
+#endif
+
+class HttpServerAdvanced;
+
+// A client connected, but not answered yet.
+struct HttpClientSlot {
+  HttpServerAdvanced* server;
+  WiFiClient client;
+  bool used = false;
+  uint16_t timeoutId = TIMER_WHEEL_INVALID_ID;
 };
 
-class HttpServerAdvanced
+class HttpServerAdvanced : public RestApi
 {
   public:
     int port = 80;
     WiFiServer* server;
+    EspGpio espGpio;
+    EepromStore eepromStore;
+    UartSerialPort uartSerialPort;
     StatusLed statusLed;
-    Settings settings;
-    Debug debug;
-    Pins pins;
-
-    AccessPoint* accessPointList;
-    int accessPointCounter = 0;
+    WifiConnection wifi;
+    BootTimer bootTimer;
+    AnalogSampler analogSampler;
+    SequencePlayer sequencePlayer;
+    PwmGenerator pwm;
+    PulseCounter pulseCounter;
+    UdpControl udpControl;
+    Scheduler scheduler;
+    RuleEngine rules;
+    PinHistory pinHistory;
+    StaticFiles staticFiles;
+    BusScript busScript;
+    RateLimiter rateLimiter;
+    LoopPacer loopPacer;
+    FirmwareUpdate firmwareUpdate;
+    MdnsResponder mdns;
+    ActionSchedule schedule;
 
     bool setupComplete = false;
 
+    // The clients take turns, one request is answered per run of the connection task.
+    HttpClientSlot clientSlots[HTTP_CLIENT_SLOTS];
+    byte nextClientSlot = 0;
+
     HttpServerAdvanced(const char* ssid = nullptr, const char* sskey = nullptr, int port = 80, int ledPinNumber = LED_BUILTIN);
 
     /**
      * Adds a new accessPoint to the existing list of access points.
+     * Up to ACCESS_POINT_REGISTRY_SIZE access points can be added, including the ones added over http.
      * @param  String   ssid     SSID of the AP.
      * @param  String   psk      WPA-PSK for the AP.
-     * @param  byte     priority The lower the number, higher the priority. Range is 0 to 255, default value is 0.
+     * @param  byte     priority The lower the number, higher the priority. Range is 0 to 255, default value is 255.
      * @return bool              False on error.
      */
     bool addAccessPoint(String ssid, String psk, byte priority = 255);
@@ -70,64 +120,132 @@ class HttpServerAdvanced
     void setServerPort(int port);
 
     /**
-     * Disaples reading and writing the eeprom.
+     * Limits the requests of every client by its IP address, the ones over the limit are answered with 429.
+     * @param rate  Requests per second in the long run, 0 disables the limit.
+     * @param burst Requests at once.
      */
-    void disableEeprom();
+    void setRateLimit(uint16_t rate, uint16_t burst);
 
     /**
-     * Sets up the Advanced Http Server
+     * Caches the ip configuration received by DHCP, and reuses it as static configuration
+     * when reconnecting with the cached AP parameters. Saves the DHCP round-trip on boot,
+     * but only use it if the DHCP server always gives the same address to the node.
      */
-    void setup();
+    void enableIpLeaseCache();
 
     /**
-     * Scans for the available wifi networks, gets their signal
-     * strength, and selects the one with highest priority and highest
-     * signal strength.
-     * Priority has higher precedence than signal strength.
+     * Enables the binary udp protocol for the digital pins. See the README for the frame format.
+     * @param port             UDP port to listen on.
+     * @param multicastAddress If set, joins the multicast group too, so a single datagram can control many nodes.
+     * @param group            Frames addressed to a group other than 0 are only handled if it is this group.
      */
-    bool setupWifi();
+    void enableUdpControl(uint16_t port = UDP_CONTROL_DEFAULT_PORT, IPAddress multicastAddress = IPAddress(), byte group = 0);
 
     /**
-     * The loop;
+     * Appends the pin history evicted from the RAM to a file on LittleFS, so the queries can reach further back.
+     * Every 256 bytes of history is a write to the flash, only use it if the pins change rarely.
      */
-    void loop();
+    void enablePinHistorySpill();
+
+    /**
+     * Lets the node sleep in the loop while there's nothing to do, for battery powered nodes.
+     * The requests are answered once the node wakes up, the pin interrupts wake it up immediately.
+     * @param latencyTargetMillis The longest the node sleeps at once, so the longest a request waits.
+     * @param lightSleep          Light sleep instead of modem sleep, it saves more, but the node wakes up slower.
+     */
+    void enableLowPower(uint32_t latencyTargetMillis = LOOP_PACER_DEFAULT_LATENCY_MS, bool lightSleep = false);
 
     /**
-     * Waits for the http client to send the request data
-     * @param client WiFiClient
+     * Serves the files of the /www directory of LittleFS under /ui, e.g. a web UI.
+     * Upload them with the LittleFS data upload tool, a gzipped copy (index.html.gz) is preferred if present.
+     * The file names are case sensitive.
      */
-    void waitForClient(WiFiClient* client);
+    void enableStaticFiles();
 
     /**
-     * Processes the request and returns accodringly
-     * If the endpoint cannot be found, returns 404
-     * If the endpoint can be found, but the parameters
-     * or method is not supported, returns 400
-     * If the endpoint can be found, and the parameters are good,
-     * but the operation failed the validation, returns 406
-     * @param  request The request to process
-     * @return         HttpResponse
+     * Accepts firmware images posted to /update, and restarts into them. See the README for the checks made.
+     * Anyone who can reach the node can replace its firmware, only enable it on a trusted network.
      */
-    HttpResponse processRequest(HttpRequest* request);
+    void enableFirmwareUpdate();
 
-    HttpResponse processRequestOfSerial(HttpRequest* request);
-    HttpResponse processRequestOfDigital(HttpRequest* request);
+    /**
+     * Advertises the http server by mDNS/DNS-SD as an _http._tcp service named after the node,
+     * so the controllers can find the nodes by browsing instead of sweeping the network.
+     */
+    void enableMdns();
 
-    String readSerial();
+    /**
+     * Runs the actions posted to /schedule at their time, the clock is set by NTP.
+     * @param timezone  POSIX TZ string the times of day are in, e.g. "CET-1CEST,M3.5.0,M10.5.0/3".
+     * @param ntpServer
+     */
+    void enableSchedule(const char* timezone = SCHEDULE_DEFAULT_TIMEZONE, const char* ntpServer = SCHEDULE_DEFAULT_NTP_SERVER);
 
-    void writeSerial(String data);
+    /**
+     * Sets up the Advanced Http Server
+     * Returns immediately, the wifi connection is made in the background by loop().
+     */
+    void setup();
 
-    String getPinData(byte digitalPinNumber);
+    /**
+     * Starts the wifi connection state machine. It scans for the available
+     * wifi networks, gets their signal strength, and selects the one with
+     * highest priority and highest signal strength.
+     * Priority has higher precedence than signal strength.
+     * If the connection fails or drops, it retries with exponential backoff.
+     */
+    bool setupWifi();
+
+    /**
+     * The loop;
+     * Runs the due tasks of the scheduler: the wifi connection, the http clients while connected,
+     * the serial output, the deferred EEPROM commits, and the tasks added by the sketch.
+     * Own tasks can be added by scheduler.addTask() any time, they must not block.
+     * With low power enabled, it sleeps until the next task is due afterwards.
+     */
+    void loop();
 
     /**
-     * Enables logging either on serial or on the http interface.
-     * @param serial      enables logs to be outputted on the serial
-     * @param store       enables logs to be stored until it can be retrieved by http interface. Warning this can easily fill the RAM.
-     * @param infoLogs    whether to include info logs
-     * @param warningLogs whether to include warning logs
-     * @param errorLogs   whether to include error logs
+     * Accepts the new clients, and answers the request of the next client in turn that has sent one.
+     * Never waits for the clients, the timeouts are handled by timers.
      */
-    void enableDebug(bool serial = true, bool store = false, bool infoLogs = true, bool warningLogs = true, bool errorLogs = true);
+    void serviceConnection();
+
+    HttpResponse processRequestOfHistory(HttpRequest* request);
+    HttpResponse processRequestOfWifi(HttpRequest* request);
+    HttpResponse processRequestOfAnalog(HttpRequest* request);
+    HttpResponse processRequestOfSequence(HttpRequest* request);
+    HttpResponse processRequestOfCounter(HttpRequest* request);
+    HttpResponse processRequestOfPwm(HttpRequest* request);
+    HttpResponse processRequestOfRules(HttpRequest* request);
+    HttpResponse processRequestOfBus(HttpRequest* request);
+    HttpResponse processRequestOfSchedule(HttpRequest* request);
+
+  protected:
+    HttpResponse processPlatformRequest(HttpRequest* request);
+    void releasePin(byte digitalPinNumber);
+
+  private:
+    // Woken while an update is being received.
+    byte updateTaskId = SCHEDULER_NO_TASK;
+
+    void addTasks();
+    void acceptClients();
+    void respond(HttpClientSlot* slot);
+    void releaseClientSlot(HttpClientSlot* slot);
+    bool isBusy();
+
+    static void wifiTask(void* context);
+    static void udpTask(void* context);
+    static void connectionTask(void* context);
+    static void serialTask(void* context);
+    static void settingsTask(void* context);
+    static void sequenceTask(void* context);
+    static void rulesTask(void* context);
+    static void historyTask(void* context);
+    static void updateTask(void* context);
+    static void scheduleTask(void* context);
+    static void onClientTimeout(void* context);
 };
 
 #endif
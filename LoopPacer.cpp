@@ -0,0 +1,127 @@
+#include "LoopPacer.h"
+
+#include <coredecls.h>
+
+volatile bool LoopPacer::sleeping = false;
+volatile bool LoopPacer::wakeRequested = false;
+volatile uint32_t LoopPacer::wakeMicros = 0;
+
+void LoopPacer::setup(Debug* debug, Scheduler* scheduler)
+{
+  this->debug = debug;
+  this->scheduler = scheduler;
+}
+
+void LoopPacer::begin()
+{
+  if (!enabled) {
+    return;
+  }
+
+  enabledMillis = millis();
+  WiFi.setSleepMode(lightSleep ? WIFI_LIGHT_SLEEP : WIFI_MODEM_SLEEP);
+
+  debug->info(
+    F("Low power pacing with a latency target of ") + String(latencyTargetMillis) + F("ms") +
+    (lightSleep ? F(", light sleep.") : F(", modem sleep."))
+  );
+}
+
+void LoopPacer::markActivity()
+{
+  unsigned long nowMillis = millis();
+  if (active) {
+    uint32_t intervalMillis = nowMillis - lastActivityMillis;
+    averageInterArrivalMillis = averageInterArrivalMillis == 0
+      ? intervalMillis
+      : (uint32_t)(((uint64_t)averageInterArrivalMillis * 7 + intervalMillis) / 8);
+  }
+
+  active = true;
+  lastActivityMillis = nowMillis;
+}
+
+void LoopPacer::pace(bool busy)
+{
+  if (!enabled || busy) {
+    return;
+  }
+
+  // a client that sent a request is likely to send the next one soon, the node stays awake for it
+  uint32_t sinceActivityMillis = millis() - lastActivityMillis;
+  uint32_t awakeMillis = min(averageInterArrivalMillis * LOOP_PACER_AWAKE_FACTOR, (uint32_t)LOOP_PACER_MAX_AWAKE_MS);
+  if (active && sinceActivityMillis < awakeMillis) {
+    return;
+  }
+
+  // then the longer it has been idle, the longer it sleeps, up to the latency target
+  uint32_t sleepMillis = active ? sinceActivityMillis / 4 : latencyTargetMillis;
+  sleepMillis = min(sleepMillis, latencyTargetMillis);
+  sleepMillis = min(sleepMillis, scheduler->getIdleMillis());
+  if (sleepMillis < LOOP_PACER_MIN_SLEEP_MS) {
+    return;
+  }
+
+  wakeRequested = false;
+  sleeping = true;
+  unsigned long startMicros = micros();
+  delay(sleepMillis);
+  sleeping = false;
+
+  uint32_t elapsedMicros = micros() - startMicros;
+  sleeps++;
+  sleptMicros += elapsedMicros;
+
+  if (wakeRequested) {
+    uint32_t eventWakeMicros = micros() - wakeMicros;
+    eventWakes++;
+    totalEventWakeMicros += eventWakeMicros;
+    if (eventWakeMicros > maxEventWakeMicros) {
+      maxEventWakeMicros = eventWakeMicros;
+    }
+    return;
+  }
+
+  uint32_t oversleepMicros = elapsedMicros > sleepMillis * 1000 ? elapsedMicros - sleepMillis * 1000 : 0;
+  totalOversleepMicros += oversleepMicros;
+  if (oversleepMicros > maxOversleepMicros) {
+    maxOversleepMicros = oversleepMicros;
+  }
+}
+
+void IRAM_ATTR LoopPacer::wake()
+{
+  if (!sleeping || wakeRequested) {
+    return;
+  }
+
+  wakeRequested = true;
+  wakeMicros = micros();
+  // resumes the loop suspended in delay()
+  esp_schedule();
+}
+
+String LoopPacer::getStats()
+{
+  if (!enabled) {
+    return F("lowPower: 0\r\n");
+  }
+
+  uint32_t enabledForMillis = millis() - enabledMillis;
+  uint32_t sleptMillis = sleptMicros / 1000;
+  uint32_t timedSleeps = sleeps - eventWakes;
+
+  return
+    String(F("lowPower: 1\r\n")) +
+    F("latencyTarget: ") + String(latencyTargetMillis) + "ms\r\n" +
+    F("lightSleep: ") + String(lightSleep, DEC) + "\r\n" +
+    F("sleeps: ") + String(sleeps) + "\r\n" +
+    F("eventWakes: ") + String(eventWakes) + "\r\n" +
+    F("idle: ") + String(sleptMillis) + F("ms (") +
+      String(enabledForMillis > 0 ? (uint32_t)((uint64_t)sleptMillis * 100 / enabledForMillis) : 0) + "%)\r\n" +
+    F("averageOversleep: ") + String(timedSleeps > 0 ? (uint32_t)(totalOversleepMicros / timedSleeps) : 0) + "us\r\n" +
+    F("maxOversleep: ") + String(maxOversleepMicros) + "us\r\n" +
+    F("averageEventWake: ") + String(eventWakes > 0 ? (uint32_t)(totalEventWakeMicros / eventWakes) : 0) + "us\r\n" +
+    F("maxEventWake: ") + String(maxEventWakeMicros) + "us\r\n" +
+    F("averageInterArrival: ") + String(averageInterArrivalMillis) + "ms\r\n";
+}
@@ -0,0 +1,89 @@
+#ifndef LOOP_PACER_H
+#define LOOP_PACER_H
+
+#include <ESP8266WiFi.h>
+#include <Arduino.h>
+
+#include "Debug.h"
+#include "Scheduler.h"
+
+// The longest a request waits for the node to wake up, unless set otherwise.
+#ifndef LOOP_PACER_DEFAULT_LATENCY_MS
+#define LOOP_PACER_DEFAULT_LATENCY_MS 100
+#endif
+
+// After a request the node stays awake for this many times the average time between the requests,
+// as the next one is likely to come soon, but at most for LOOP_PACER_MAX_AWAKE_MS.
+#define LOOP_PACER_AWAKE_FACTOR 2
+#define LOOP_PACER_MAX_AWAKE_MS 2000
+
+// Sleeping for less is not worth it, the node just yields.
+#define LOOP_PACER_MIN_SLEEP_MS 2
+
+/**
+ * Puts the node to sleep between the iterations of the scheduler, while there's nothing to do.
+ * The sleep is a delay(), so the SDK can keep the radio in modem sleep, or in light sleep if enabled,
+ * and it is cut short by the pin interrupts. The requests are noticed on the next wake up,
+ * so the latency target is the longest sleep. The sleeps start short after a request, and get longer
+ * as the node stays idle.
+ */
+class LoopPacer
+{
+  public:
+    Debug* debug;
+    Scheduler* scheduler;
+
+    bool enabled = false;
+    bool lightSleep = false;
+    uint32_t latencyTargetMillis = LOOP_PACER_DEFAULT_LATENCY_MS;
+
+    // Average time between the requests, a moving average of the last 8 or so.
+    uint32_t averageInterArrivalMillis = 0;
+
+    uint32_t sleeps = 0;
+    // Sleeps cut short by a pin interrupt.
+    uint32_t eventWakes = 0;
+    uint64_t sleptMicros = 0;
+    // How much later than requested the sleeps ended, the time the SDK took to wake up.
+    uint64_t totalOversleepMicros = 0;
+    uint32_t maxOversleepMicros = 0;
+    // The time from a pin interrupt to the loop running again.
+    uint64_t totalEventWakeMicros = 0;
+    uint32_t maxEventWakeMicros = 0;
+
+    void setup(Debug* debug, Scheduler* scheduler);
+
+    /**
+     * Sets the sleep mode of the wifi, call it before the connection is made.
+     */
+    void begin();
+
+    /**
+     * Called for every request, it keeps the node awake for the next one.
+     */
+    void markActivity();
+
+    /**
+     * Sleeps until the next task of the scheduler is due, the latency target at most.
+     * @param busy Whether something is in progress that must not wait, then it only yields.
+     */
+    void pace(bool busy);
+
+    /**
+     * Cuts the current sleep short, called from the pin interrupts.
+     */
+    static void IRAM_ATTR wake();
+
+    String getStats();
+
+  private:
+    unsigned long enabledMillis = 0;
+    unsigned long lastActivityMillis = 0;
+    bool active = false;
+
+    static volatile bool sleeping;
+    static volatile bool wakeRequested;
+    static volatile uint32_t wakeMicros;
+};
+
+#endif
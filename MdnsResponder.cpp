@@ -0,0 +1,425 @@
+#include "MdnsResponder.h"
+
+void MdnsResponder::setup(Settings* settings, Debug* debug)
+{
+  this->settings = settings;
+  this->debug = debug;
+}
+
+void MdnsResponder::loop(bool connected)
+{
+  if (!enabled) {
+    return;
+  }
+
+  if (!connected) {
+    if (listening) {
+      udp.stop();
+      listening = false;
+    }
+    return;
+  }
+
+  // the membership is bound to the interface address, so it has to be renewed after every reconnect, and the node announced again
+  if (!listening) {
+    listening = udp.beginMulticast(WiFi.localIP(), MDNS_ADDRESS, MDNS_PORT);
+    if (!listening) {
+      debug->error(F("Could not join the mDNS group."));
+      return;
+    }
+
+    announcementsLeft = MDNS_ANNOUNCEMENTS;
+    nextAnnouncementMillis = millis();
+  }
+
+  if (settings->nodeNameRevision != builtNodeNameRevision || WiFi.localIP() != builtIp || packetLength == 0) {
+    // the ones who cached the old records drop them right away, instead of when they expire
+    if (packetLength > 0) {
+      sendGoodbye();
+    }
+
+    build();
+    announcementsLeft = MDNS_ANNOUNCEMENTS;
+    nextAnnouncementMillis = millis();
+
+    debug->info(F("Advertising ") + instanceName + F(" on ") + hostName + F(".local"));
+  }
+
+  byte query[MDNS_MAX_QUERY_LENGTH];
+  for (byte queryIndex = 0; queryIndex < MDNS_MAX_QUERIES_PER_LOOP; queryIndex++) {
+    int queryLength = udp.parsePacket();
+    if (queryLength <= 0) {
+      break;
+    }
+
+    size_t length = udp.read(query, min(queryLength, MDNS_MAX_QUERY_LENGTH));
+    handleQuery(query, length, udp.remoteIP(), udp.remotePort());
+  }
+
+  unsigned long now = millis();
+  if (responseDue && (long)(now - responseDueMillis) >= 0) {
+    responseDue = false;
+    sendMulticast();
+  }
+
+  if (announcementsLeft > 0 && (long)(now - nextAnnouncementMillis) >= 0) {
+    announcementsLeft--;
+    nextAnnouncementMillis = now + MDNS_ANNOUNCEMENT_INTERVAL_MS;
+    sendMulticast();
+  }
+}
+
+String MdnsResponder::getHostName()
+{
+  return hostName;
+}
+
+String MdnsResponder::getInstanceName()
+{
+  return instanceName;
+}
+
+void MdnsResponder::build()
+{
+  String nodeName = settings->getNodeName();
+  String chipId = String(ESP.getChipId(), HEX);
+  builtNodeNameRevision = settings->nodeNameRevision;
+  builtIp = WiFi.localIP();
+
+  // the host name is a single label of letters, digits and hyphens, the instance name is a single label of anything
+  hostName = "";
+  instanceName = "";
+  for (unsigned int index = 0; index < nodeName.length(); index++) {
+    char character = nodeName[index];
+    hostName += isalnum(character) ? (char)tolower(character) : '-';
+    instanceName += character == '.' ? ' ' : character;
+  }
+  hostName += "-" + chipId;
+  instanceName += " " + chipId;
+
+  packetLength = 0;
+  recordCount = 0;
+  pointerCount = 0;
+
+  // an authoritative response with the records as answers, and without questions
+  writeUint16(0);
+  writeUint16(0x8400);
+  writeUint16(0);
+  writeUint16(MDNS_RECORD_COUNT);
+  writeUint16(0);
+  writeUint16(0);
+
+  // _http._tcp.local PTR {instance}._http._tcp.local, what the controllers browse for
+  size_t serviceOffset = packetLength;
+  writeLabel("_http");
+  writeLabel("_tcp");
+  size_t localOffset = packetLength;
+  writeLabel("local");
+  writeByte(0);
+  size_t lengthOffset = beginRecord(MDNS_TYPE_PTR, MDNS_CLASS_IN, MDNS_SERVICE_TTL);
+  size_t instanceOffset = packetLength;
+  writeLabel(instanceName);
+  writePointer(serviceOffset);
+  endRecord(lengthOffset);
+
+  // {instance}._http._tcp.local SRV {host}.local:{port}
+  writePointer(instanceOffset);
+  lengthOffset = beginRecord(MDNS_TYPE_SRV, MDNS_CLASS_IN | MDNS_CLASS_FLUSH, MDNS_HOST_TTL);
+  writeUint16(0);
+  writeUint16(0);
+  writeUint16(port);
+  size_t hostOffset = packetLength;
+  writeLabel(hostName);
+  writePointer(localOffset);
+  endRecord(lengthOffset);
+
+  // {instance}._http._tcp.local TXT HSA-Version={version}
+  writePointer(instanceOffset);
+  lengthOffset = beginRecord(MDNS_TYPE_TXT, MDNS_CLASS_IN | MDNS_CLASS_FLUSH, MDNS_SERVICE_TTL);
+  writeLabel(F("HSA-Version=") + String(HTTP_SERVER_ADVANCED_VERSION));
+  endRecord(lengthOffset);
+
+  // {host}.local A {ip}
+  writePointer(hostOffset);
+  lengthOffset = beginRecord(MDNS_TYPE_A, MDNS_CLASS_IN | MDNS_CLASS_FLUSH, MDNS_HOST_TTL);
+  for (byte index = 0; index < 4; index++) {
+    writeByte(builtIp[index]);
+  }
+  endRecord(lengthOffset);
+
+  // _services._dns-sd._udp.local PTR _http._tcp.local, for the browsers listing the service types
+  writeLabel("_services");
+  writeLabel("_dns-sd");
+  writeLabel("_udp");
+  writePointer(localOffset);
+  lengthOffset = beginRecord(MDNS_TYPE_PTR, MDNS_CLASS_IN, MDNS_SERVICE_TTL);
+  writePointer(serviceOffset);
+  endRecord(lengthOffset);
+}
+
+void MdnsResponder::handleQuery(const byte* query, size_t length, IPAddress remoteIp, uint16_t remotePort)
+{
+  queriesReceived++;
+
+  // the responses of the other responders are received too
+  if (length < 12 || query[2] & 0x80) {
+    return;
+  }
+
+  uint16_t questionCount = query[4] << 8 | query[5];
+  size_t offset = 12;
+  bool matched = false;
+  bool unicast = false;
+  String matchedName = "";
+  uint16_t matchedType = 0;
+  for (uint16_t questionIndex = 0; questionIndex < questionCount; questionIndex++) {
+    String name = "";
+    if (!readName(query, length, &offset, &name) || offset + 4 > length) {
+      break;
+    }
+
+    uint16_t type = query[offset] << 8 | query[offset + 1];
+    uint16_t questionClass = query[offset + 2] << 8 | query[offset + 3];
+    offset += 4;
+
+    if (
+      (type != MDNS_TYPE_PTR && type != MDNS_TYPE_SRV && type != MDNS_TYPE_TXT && type != MDNS_TYPE_A && type != MDNS_TYPE_ANY) ||
+      !isOwnName(name)
+    ) {
+      continue;
+    }
+
+    if (!matched) {
+      matchedName = name;
+      matchedType = type;
+    }
+    matched = true;
+    unicast |= (questionClass & MDNS_CLASS_FLUSH) != 0;
+  }
+
+  if (!matched) {
+    return;
+  }
+
+  queriesAnswered++;
+
+  // a plain dns resolver, not listening on the mDNS port, is answered directly with the id of its query
+  if (remotePort != MDNS_PORT) {
+    sendLegacyUnicast(remoteIp, remotePort, query[0] << 8 | query[1], matchedName, matchedType);
+    return;
+  }
+
+  if (unicast) {
+    sendUnicast(remoteIp);
+    return;
+  }
+
+  if (responseDue) {
+    return;
+  }
+
+  responseDue = true;
+  responseDueMillis = millis() + random(MDNS_RESPONSE_DELAY_MIN_MS, MDNS_RESPONSE_DELAY_MAX_MS + 1);
+  if ((long)(lastMulticastMillis + MDNS_MIN_MULTICAST_INTERVAL_MS - responseDueMillis) > 0) {
+    responseDueMillis = lastMulticastMillis + MDNS_MIN_MULTICAST_INTERVAL_MS;
+  }
+}
+
+bool MdnsResponder::isOwnName(String name)
+{
+  if (name == F("_http._tcp.local") || name == F("_services._dns-sd._udp.local")) {
+    return true;
+  }
+
+  String ownName = hostName + F(".local");
+  if (name == ownName) {
+    return true;
+  }
+
+  ownName = instanceName + F("._http._tcp.local");
+  ownName.toLowerCase();
+  return name == ownName;
+}
+
+void MdnsResponder::sendGoodbye()
+{
+  // the packet is rebuilt after it anyway
+  for (byte recordIndex = 0; recordIndex < recordCount; recordIndex++) {
+    memset(packet + ttlOffsets[recordIndex], 0, 4);
+  }
+
+  sendMulticast();
+}
+
+void MdnsResponder::sendMulticast()
+{
+  udp.beginPacketMulticast(MDNS_ADDRESS, MDNS_PORT, WiFi.localIP(), 255);
+  udp.write(packet, packetLength);
+  udp.endPacket();
+
+  lastMulticastMillis = millis();
+}
+
+void MdnsResponder::sendUnicast(IPAddress remoteIp)
+{
+  udp.beginPacket(remoteIp, MDNS_PORT);
+  udp.write(packet, packetLength);
+  udp.endPacket();
+}
+
+void MdnsResponder::sendLegacyUnicast(IPAddress remoteIp, uint16_t remotePort, uint16_t id, String name, uint16_t type)
+{
+  // the name is one of the names of the node, the question fits
+  byte reply[MDNS_PACKET_SIZE + MDNS_MAX_QUERY_LENGTH];
+  memcpy(reply, packet, 12);
+  reply[0] = id >> 8;
+  reply[1] = id;
+  reply[4] = 0;
+  reply[5] = 1;
+  size_t length = 12;
+
+  // the question is written uncompressed, the pointers of the query point into the query
+  int labelStart = 0;
+  while (labelStart < (int)name.length() && length < MDNS_MAX_QUERY_LENGTH - 6) {
+    int labelEnd = name.indexOf('.', labelStart);
+    if (labelEnd < 0) {
+      labelEnd = name.length();
+    }
+
+    byte labelLength = min(labelEnd - labelStart, 63);
+    reply[length++] = labelLength;
+    memcpy(reply + length, name.c_str() + labelStart, labelLength);
+    length += labelLength;
+    labelStart = labelEnd + 1;
+  }
+  reply[length++] = 0;
+  reply[length++] = type >> 8;
+  reply[length++] = type;
+  reply[length++] = MDNS_CLASS_IN >> 8;
+  reply[length++] = MDNS_CLASS_IN & 0xFF;
+
+  // the records follow the question, their pointers are moved by its length
+  size_t shift = length - 12;
+  memcpy(reply + length, packet + 12, packetLength - 12);
+  length += packetLength - 12;
+
+  for (byte pointerIndex = 0; pointerIndex < pointerCount; pointerIndex++) {
+    size_t pointerOffset = pointerOffsets[pointerIndex] + shift;
+    uint16_t target = ((reply[pointerOffset] & 0x3F) << 8 | reply[pointerOffset + 1]) + shift;
+    reply[pointerOffset] = 0xC0 | target >> 8;
+    reply[pointerOffset + 1] = target;
+  }
+
+  for (byte recordIndex = 0; recordIndex < recordCount; recordIndex++) {
+    size_t ttlOffset = ttlOffsets[recordIndex] + shift;
+    // the class is right before the TTL
+    reply[ttlOffset - 2] &= ~(MDNS_CLASS_FLUSH >> 8);
+    reply[ttlOffset] = 0;
+    reply[ttlOffset + 1] = 0;
+    reply[ttlOffset + 2] = 0;
+    reply[ttlOffset + 3] = MDNS_LEGACY_TTL;
+  }
+
+  udp.beginPacket(remoteIp, remotePort);
+  udp.write(reply, length);
+  udp.endPacket();
+}
+
+void MdnsResponder::writeByte(byte value)
+{
+  if (packetLength < MDNS_PACKET_SIZE) {
+    packet[packetLength++] = value;
+  }
+}
+
+void MdnsResponder::writeUint16(uint16_t value)
+{
+  writeByte(value >> 8);
+  writeByte(value);
+}
+
+void MdnsResponder::writeLabel(String label)
+{
+  byte length = min(label.length(), (unsigned int)63);
+  writeByte(length);
+  for (byte index = 0; index < length; index++) {
+    writeByte(label[index]);
+  }
+}
+
+void MdnsResponder::writePointer(size_t offset)
+{
+  if (pointerCount < MDNS_POINTER_COUNT) {
+    pointerOffsets[pointerCount++] = packetLength;
+  }
+  writeUint16(0xC000 | offset);
+}
+
+size_t MdnsResponder::beginRecord(uint16_t type, uint16_t recordClass, uint32_t ttl)
+{
+  writeUint16(type);
+  writeUint16(recordClass);
+
+  ttlOffsets[recordCount++] = packetLength;
+  writeUint16(ttl >> 16);
+  writeUint16(ttl);
+
+  // the length of the data, written by endRecord()
+  size_t lengthOffset = packetLength;
+  writeUint16(0);
+  return lengthOffset;
+}
+
+void MdnsResponder::endRecord(size_t lengthOffset)
+{
+  uint16_t length = packetLength - lengthOffset - 2;
+  packet[lengthOffset] = length >> 8;
+  packet[lengthOffset + 1] = length;
+}
+
+bool MdnsResponder::readName(const byte* packet, size_t length, size_t* offset, String* name)
+{
+  size_t position = *offset;
+  bool jumped = false;
+
+  // bounded, so a loop of pointers can't hang the node
+  for (byte labelIndex = 0; labelIndex < 32; labelIndex++) {
+    if (position >= length) {
+      return false;
+    }
+
+    byte labelLength = packet[position];
+    if (labelLength == 0) {
+      if (!jumped) {
+        *offset = position + 1;
+      }
+      return true;
+    }
+
+    if ((labelLength & 0xC0) == 0xC0) {
+      if (position + 1 >= length) {
+        return false;
+      }
+      if (!jumped) {
+        *offset = position + 2;
+      }
+      jumped = true;
+      position = (labelLength & 0x3F) << 8 | packet[position + 1];
+      continue;
+    }
+
+    if (labelLength > 63 || position + 1 + labelLength > length) {
+      return false;
+    }
+
+    if (name->length() > 0) {
+      *name += '.';
+    }
+    for (byte index = 0; index < labelLength; index++) {
+      *name += (char)tolower(packet[position + 1 + index]);
+    }
+    position += 1 + labelLength;
+  }
+
+  return false;
+}
@@ -0,0 +1,140 @@
+#ifndef MDNS_RESPONDER_H
+#define MDNS_RESPONDER_H
+
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <Arduino.h>
+
+#include "version.h"
+#include "Settings.h"
+#include "Debug.h"
+
+#define MDNS_PORT 5353
+#define MDNS_ADDRESS IPAddress(224, 0, 0, 251)
+
+// The records of the node fit in it with the longest node name.
+#define MDNS_PACKET_SIZE 256
+// Only the questions are read from the queries, they come first.
+#define MDNS_MAX_QUERY_LENGTH 256
+// Queries handled in one loop, so a flood can't starve the http clients.
+#define MDNS_MAX_QUERIES_PER_LOOP 4
+
+#define MDNS_TYPE_A 1
+#define MDNS_TYPE_PTR 12
+#define MDNS_TYPE_TXT 16
+#define MDNS_TYPE_SRV 33
+#define MDNS_TYPE_ANY 255
+#define MDNS_CLASS_IN 0x0001
+// In a record: the record replaces the ones cached for the name. In a question: the answer is wanted by unicast.
+#define MDNS_CLASS_FLUSH 0x8000
+#define MDNS_RECORD_COUNT 5
+// Compression pointers in the packet, they are moved for the legacy answers.
+#define MDNS_POINTER_COUNT 8
+
+// The recommended TTLs of the records of the host name, and of the other records.
+#define MDNS_HOST_TTL 120
+#define MDNS_SERVICE_TTL 4500
+// The TTL of the answers to the plain dns resolvers, they don't see the updates.
+#define MDNS_LEGACY_TTL 10
+
+// The announcement is sent this many times, this far apart, after connecting and after a change.
+#define MDNS_ANNOUNCEMENTS 2
+#define MDNS_ANNOUNCEMENT_INTERVAL_MS 1000
+// The shared records aren't multicast more often than this, however many queries arrive.
+#define MDNS_MIN_MULTICAST_INTERVAL_MS 1000
+// The answer to a multicast query is delayed randomly by this much, so the nodes don't answer in a single burst.
+#define MDNS_RESPONSE_DELAY_MIN_MS 20
+#define MDNS_RESPONSE_DELAY_MAX_MS 120
+
+/**
+ * Advertises the http server of the node by mDNS/DNS-SD as {nodeName} {chipId}._http._tcp.local,
+ * on the host {nodename}-{chipid}.local, with the version of the library as TXT data.
+ * The chip id makes the names unique, so there's no probing for conflicts.
+ * Every record is in a single packet, built once and rebuilt only when the node name or the IP address changes,
+ * it is the announcement, and the answer to any question about the names of the node.
+ */
+class MdnsResponder
+{
+  public:
+    Settings* settings;
+    Debug* debug;
+
+    bool enabled = false;
+    uint16_t port = 80;
+
+    uint32_t queriesReceived = 0;
+    uint32_t queriesAnswered = 0;
+
+    void setup(Settings* settings, Debug* debug);
+
+    /**
+     * Joins the mDNS group once the wifi is connected, leaves it when it's lost,
+     * announces the node, and answers the queries. Must be called from the main loop.
+     * @param connected Whether the wifi is connected.
+     */
+    void loop(bool connected);
+
+    String getHostName();
+    String getInstanceName();
+
+  private:
+    WiFiUDP udp;
+    bool listening = false;
+
+    byte packet[MDNS_PACKET_SIZE];
+    size_t packetLength = 0;
+    // Of the TTL of every record, they are zeroed for the goodbye.
+    size_t ttlOffsets[MDNS_RECORD_COUNT];
+    byte recordCount = 0;
+    size_t pointerOffsets[MDNS_POINTER_COUNT];
+    byte pointerCount = 0;
+
+    // What the packet is built from.
+    uint16_t builtNodeNameRevision = 0;
+    IPAddress builtIp;
+    String hostName = "";
+    String instanceName = "";
+
+    byte announcementsLeft = 0;
+    unsigned long nextAnnouncementMillis = 0;
+    bool responseDue = false;
+    unsigned long responseDueMillis = 0;
+    unsigned long lastMulticastMillis = 0;
+
+    void build();
+    void handleQuery(const byte* query, size_t length, IPAddress remoteIp, uint16_t remotePort);
+    bool isOwnName(String name);
+    void sendGoodbye();
+    void sendMulticast();
+    void sendUnicast(IPAddress remoteIp);
+
+    /**
+     * Answers a plain dns resolver, as RFC 6762 6.7 asks: with the id of its query, the question repeated,
+     * and the records without the cache-flush bit and with MDNS_LEGACY_TTL.
+     * @param remoteIp
+     * @param remotePort
+     * @param id
+     * @param name       Of the question, one of the names of the node.
+     * @param type       Of the question.
+     */
+    void sendLegacyUnicast(IPAddress remoteIp, uint16_t remotePort, uint16_t id, String name, uint16_t type);
+
+    void writeByte(byte value);
+    void writeUint16(uint16_t value);
+    void writeLabel(String label);
+    void writePointer(size_t offset);
+    size_t beginRecord(uint16_t type, uint16_t recordClass, uint32_t ttl);
+    void endRecord(size_t lengthOffset);
+
+    /**
+     * Reads a name, following the compression pointers, as lowercase labels separated by dots.
+     * @param  packet
+     * @param  length
+     * @param  offset Of the name, set to after the name.
+     * @param  name
+     * @return bool   False if the name is malformed, or runs past the end of the packet.
+     */
+    static bool readName(const byte* packet, size_t length, size_t* offset, String* name);
+};
+
+#endif
@@ -0,0 +1,326 @@
+#include "PinHistory.h"
+
+void PinHistory::setup(Settings* settings, Debug* debug, Pins* pins)
+{
+  this->settings = settings;
+  this->debug = debug;
+  this->pins = pins;
+
+  listenerId = pins->addListener(PinHistory::onPinEdge, this, true);
+}
+
+bool PinHistory::enable(byte digitalPinNumber)
+{
+  if (digitalPinNumber > 15 || !settings->isPinInitalized(digitalPinNumber)) {
+    return false;
+  }
+
+  if (!buffer) {
+    buffer = new (std::nothrow) byte[PIN_HISTORY_BLOCK_COUNT * PIN_HISTORY_BLOCK_SIZE];
+    if (!buffer) {
+      debug->error(F("Not enough memory for the pin history."));
+      return false;
+    }
+  }
+
+  bitSet(enabledPins, digitalPinNumber);
+  track();
+  return true;
+}
+
+void PinHistory::disable(byte digitalPinNumber)
+{
+  if (!isEnabled(digitalPinNumber)) {
+    return;
+  }
+
+  bitClear(enabledPins, digitalPinNumber);
+  track();
+}
+
+bool PinHistory::isEnabled(byte digitalPinNumber)
+{
+  return digitalPinNumber < 16 && bitRead(enabledPins, digitalPinNumber);
+}
+
+void PinHistory::begin()
+{
+  if (!spill) {
+    return;
+  }
+
+  if (!LittleFS.begin()) {
+    debug->error(F("Could not mount LittleFS, the pin history is kept in RAM only."));
+    return;
+  }
+
+  LittleFS.remove(PIN_HISTORY_SPILL_FILE);
+  LittleFS.remove(PIN_HISTORY_SPILL_OLD_FILE);
+  spillReady = true;
+}
+
+void PinHistory::loop()
+{
+  if (!enabledPins && !trackedPins) {
+    return;
+  }
+
+  // the edges first, they happened before the polled changes are noticed
+  while (stagedTail != stagedHead) {
+    PinHistoryEvent* event = &staged[stagedTail];
+    if (bitRead(trackedPins, event->digitalPinNumber)) {
+      record(event->millis, event->digitalPinNumber, event->level);
+    }
+    stagedTail = (stagedTail + 1) % PIN_HISTORY_STAGING_SIZE;
+  }
+
+  track();
+
+  // a pin attached with a single edge for the other listeners has the other edge polled
+  uint32_t now = millis();
+  for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+    if (
+      !bitRead(trackedPins, digitalPinNumber) ||
+      (bitRead(listenedPins, digitalPinNumber) && pins->getInterruptMode(digitalPinNumber) == CHANGE)
+    ) {
+      continue;
+    }
+
+    record(now, digitalPinNumber, digitalRead(pins->digital2gpio(digitalPinNumber)));
+  }
+}
+
+String PinHistory::query(byte digitalPinNumber, uint32_t fromMillis, uint32_t toMillis)
+{
+  String result = "";
+  uint16_t resultCount = 0;
+
+  if (spillReady) {
+    querySpillFile(PIN_HISTORY_SPILL_OLD_FILE, digitalPinNumber, fromMillis, toMillis, &result, &resultCount);
+    querySpillFile(PIN_HISTORY_SPILL_FILE, digitalPinNumber, fromMillis, toMillis, &result, &resultCount);
+  }
+
+  uint32_t oldestMillis = millis();
+  for (byte blockOffset = 0; blockOffset < blockCount; blockOffset++) {
+    byte blockIndex = (currentBlock + PIN_HISTORY_BLOCK_COUNT - blockCount + 1 + blockOffset) % PIN_HISTORY_BLOCK_COUNT;
+    PinHistoryBlock* block = &blocks[blockIndex];
+    if (blockOffset == 0) {
+      oldestMillis = block->firstMillis;
+    }
+
+    queryBlock(block, &buffer[blockIndex * PIN_HISTORY_BLOCK_SIZE], digitalPinNumber, fromMillis, toMillis, &result, &resultCount);
+  }
+
+  return
+    F("now: ") + String(millis()) + "\r\n" +
+    F("oldest: ") + String(oldestMillis) + "\r\n" +
+    F("recorded: ") + String(recorded) + "\r\n" +
+    F("missed: ") + String(missed) + "\r\n" +
+    F("transitions: ") + String(resultCount) + "\r\n" +
+    F("truncated: ") + String(resultCount >= PIN_HISTORY_MAX_RESULTS, DEC) + "\r\n" +
+    result;
+}
+
+void PinHistory::track()
+{
+  for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+    bool enabled = settings->isPinInitalized(digitalPinNumber) && bitRead(enabledPins, digitalPinNumber);
+    bool input = enabled && pins->isInput(digitalPinNumber) && pins->digital2gpio(digitalPinNumber) != 16;
+
+    if (input != (bool)bitRead(listenedPins, digitalPinNumber)) {
+      if (pins->listen(listenerId, digitalPinNumber, input ? CHANGE : 0) && input) {
+        bitSet(listenedPins, digitalPinNumber);
+      }
+      else {
+        bitClear(listenedPins, digitalPinNumber);
+      }
+    }
+
+    if (enabled && !bitRead(trackedPins, digitalPinNumber)) {
+      // the level at the start of the tracking is the first entry, the rest are the transitions from it
+      bitSet(trackedPins, digitalPinNumber);
+      append(millis(), digitalPinNumber, digitalRead(pins->digital2gpio(digitalPinNumber)) ? 1 : 0);
+    }
+    else if (!enabled) {
+      bitClear(trackedPins, digitalPinNumber);
+    }
+  }
+}
+
+void PinHistory::record(uint32_t eventMillis, byte digitalPinNumber, byte level)
+{
+  level = level ? 1 : 0;
+  if (bitRead(levels, digitalPinNumber) == level) {
+    return;
+  }
+
+  append(eventMillis, digitalPinNumber, level);
+}
+
+void PinHistory::append(uint32_t eventMillis, byte digitalPinNumber, byte level)
+{
+  bitWrite(levels, digitalPinNumber, level);
+
+  PinHistoryBlock* block = &blocks[currentBlock];
+
+  // the interrupt and the polling can be a millisecond apart, time never goes backwards in the ring
+  uint32_t delta = 0;
+  if (blockCount > 0 && eventMillis > block->lastMillis) {
+    delta = eventMillis - block->lastMillis;
+  }
+
+  byte entry[6];
+  byte length = 0;
+  do {
+    entry[length] = delta & 0x7F;
+    delta >>= 7;
+    if (delta > 0) {
+      entry[length] |= 0x80;
+    }
+    length++;
+  } while (delta > 0);
+  entry[length++] = digitalPinNumber << 1 | level;
+
+  if (blockCount == 0 || block->used + length > PIN_HISTORY_BLOCK_SIZE) {
+    currentBlock = blockCount == 0 ? 0 : (currentBlock + 1) % PIN_HISTORY_BLOCK_COUNT;
+    if (blockCount == PIN_HISTORY_BLOCK_COUNT) {
+      // the ring is full, the oldest block goes
+      spillBlock(currentBlock);
+    }
+    else {
+      blockCount++;
+    }
+
+    block = &blocks[currentBlock];
+    uint32_t previousMillis = blockCount > 1 ? blocks[(currentBlock + PIN_HISTORY_BLOCK_COUNT - 1) % PIN_HISTORY_BLOCK_COUNT].lastMillis : 0;
+    block->firstMillis = max(eventMillis, previousMillis);
+    block->lastMillis = block->firstMillis;
+    block->pinMask = 0;
+    block->used = 0;
+
+    // a block starts from its own time
+    entry[0] = 0;
+    entry[1] = digitalPinNumber << 1 | level;
+    length = 2;
+  }
+
+  memcpy(&buffer[currentBlock * PIN_HISTORY_BLOCK_SIZE + block->used], entry, length);
+  block->used += length;
+  block->lastMillis = max(eventMillis, block->lastMillis);
+  bitSet(block->pinMask, digitalPinNumber);
+  recorded++;
+}
+
+void PinHistory::spillBlock(byte blockIndex)
+{
+  if (!spillReady) {
+    return;
+  }
+
+  File file = LittleFS.open(PIN_HISTORY_SPILL_FILE, "a");
+  if (!file) {
+    debug->error(F("Could not open the pin history file!"));
+    return;
+  }
+
+  file.write((const uint8_t*)&blocks[blockIndex], sizeof(PinHistoryBlock));
+  file.write(&buffer[blockIndex * PIN_HISTORY_BLOCK_SIZE], blocks[blockIndex].used);
+  size_t size = file.size();
+  file.close();
+
+  if (size >= PIN_HISTORY_SPILL_MAX_SIZE) {
+    LittleFS.remove(PIN_HISTORY_SPILL_OLD_FILE);
+    LittleFS.rename(PIN_HISTORY_SPILL_FILE, PIN_HISTORY_SPILL_OLD_FILE);
+  }
+}
+
+void PinHistory::queryBlock(PinHistoryBlock* block, const byte* data, byte digitalPinNumber, uint32_t fromMillis, uint32_t toMillis, String* result, uint16_t* resultCount)
+{
+  // the time index: most of the blocks are skipped without decoding
+  if (
+    !bitRead(block->pinMask, digitalPinNumber) ||
+    block->lastMillis < fromMillis ||
+    block->firstMillis > toMillis
+  ) {
+    return;
+  }
+
+  uint32_t time = block->firstMillis;
+  uint16_t position = 0;
+  while (position < block->used && *resultCount < PIN_HISTORY_MAX_RESULTS) {
+    uint32_t delta = 0;
+    byte shift = 0;
+    while (position < block->used) {
+      byte value = data[position++];
+      delta |= (uint32_t)(value & 0x7F) << shift;
+      shift += 7;
+      if (!(value & 0x80)) {
+        break;
+      }
+    }
+
+    time += delta;
+    if (time > toMillis || position >= block->used) {
+      return;
+    }
+
+    byte pinAndLevel = data[position++];
+    if ((pinAndLevel >> 1) != digitalPinNumber || time < fromMillis) {
+      continue;
+    }
+
+    *result += String(time) + ": " + String(pinAndLevel & 1) + "\r\n";
+    (*resultCount)++;
+  }
+}
+
+void PinHistory::querySpillFile(const char* path, byte digitalPinNumber, uint32_t fromMillis, uint32_t toMillis, String* result, uint16_t* resultCount)
+{
+  File file = LittleFS.open(path, "r");
+  if (!file) {
+    return;
+  }
+
+  byte data[PIN_HISTORY_BLOCK_SIZE];
+  PinHistoryBlock block;
+  while (file.read((uint8_t*)&block, sizeof(PinHistoryBlock)) == sizeof(PinHistoryBlock)) {
+    if (block.used > PIN_HISTORY_BLOCK_SIZE) {
+      break;
+    }
+
+    // the headers are the index of the file, the blocks out of the range are skipped without reading them
+    if (
+      !bitRead(block.pinMask, digitalPinNumber) ||
+      block.lastMillis < fromMillis ||
+      block.firstMillis > toMillis
+    ) {
+      file.seek(block.used, SeekCur);
+      continue;
+    }
+
+    if (file.read(data, block.used) != block.used) {
+      break;
+    }
+
+    queryBlock(&block, data, digitalPinNumber, fromMillis, toMillis, result, resultCount);
+  }
+
+  file.close();
+}
+
+void IRAM_ATTR PinHistory::onPinEdge(void* context, byte digitalPinNumber, byte level, uint32_t micros)
+{
+  PinHistory* history = (PinHistory*)context;
+
+  byte nextHead = (history->stagedHead + 1) % PIN_HISTORY_STAGING_SIZE;
+  if (nextHead == history->stagedTail) {
+    history->missed++;
+    return;
+  }
+
+  PinHistoryEvent* event = &history->staged[history->stagedHead];
+  event->millis = millis();
+  event->digitalPinNumber = digitalPinNumber;
+  event->level = level;
+  history->stagedHead = nextHead;
+}
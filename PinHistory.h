@@ -0,0 +1,136 @@
+#ifndef PIN_HISTORY_H
+#define PIN_HISTORY_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <new>
+
+#include "Settings.h"
+#include "Debug.h"
+#include "Pins.h"
+
+// The ring is made of blocks, a block is the unit of eviction and of the time index.
+#ifndef PIN_HISTORY_BLOCK_COUNT
+#define PIN_HISTORY_BLOCK_COUNT 16
+#endif
+#define PIN_HISTORY_BLOCK_SIZE 256
+
+// Edges caught by the interrupt, waiting for the loop to record them.
+#define PIN_HISTORY_STAGING_SIZE 32
+
+// Maximum number of transitions returned by a query.
+#define PIN_HISTORY_MAX_RESULTS 256
+
+// The evicted blocks are appended to the spill file, up to this size, then it is rotated.
+#define PIN_HISTORY_SPILL_FILE "/history.bin"
+#define PIN_HISTORY_SPILL_OLD_FILE "/history.old"
+#define PIN_HISTORY_SPILL_MAX_SIZE 65536
+
+/**
+ * Entry of the time index, one per block.
+ */
+struct __attribute__((packed)) PinHistoryBlock {
+  // Time of the first entry, the deltas of the block start from it.
+  uint32_t firstMillis;
+  uint32_t lastMillis;
+  // Pins having an entry in the block.
+  uint16_t pinMask;
+  uint16_t used;
+};
+
+struct PinHistoryEvent {
+  uint32_t millis;
+  byte digitalPinNumber;
+  byte level;
+};
+
+/**
+ * Records the transitions of the pins it is enabled for.
+ * An entry is the time since the previous entry as a varint, and a byte of the pin and the level,
+ * 2 bytes for transitions within 127ms, so the default 4KB holds a couple of thousand transitions.
+ * The ring is only allocated when the history is enabled for a pin.
+ * The inputs are recorded from the pin interrupt as a passive listener, so a pin counting or triggering rules on a single edge
+ * is not attached with both, the other edge is polled by loop() then, like the outputs and D0.
+ */
+class PinHistory
+{
+  public:
+    Settings* settings;
+    Debug* debug;
+    Pins* pins;
+
+    // Whether the evicted blocks are appended to a file on LittleFS.
+    bool spill = false;
+
+    uint32_t recorded = 0;
+    // Edges lost because the loop did not keep up with the interrupt.
+    volatile uint32_t missed = 0;
+
+    void setup(Settings* settings, Debug* debug, Pins* pins);
+
+    /**
+     * Starts recording the pin, from its current level.
+     * @param  digitalPinNumber Must be initialized.
+     * @return bool             False if the pin is not initialized, or there's not enough memory for the ring.
+     */
+    bool enable(byte digitalPinNumber);
+
+    /**
+     * Stops recording the pin, its history is kept until the ring overwrites it.
+     * @param digitalPinNumber
+     */
+    void disable(byte digitalPinNumber);
+
+    bool isEnabled(byte digitalPinNumber);
+
+    /**
+     * Starts recording. The spill files of the previous boot are removed, their times are meaningless now.
+     */
+    void begin();
+
+    /**
+     * Records the edges caught by the interrupt, and the polled changes.
+     * Starts and stops listening to the pins as they are initialized and deleted.
+     */
+    void loop();
+
+    /**
+     * Returns the transitions of the pin between the two times, as "{millis}: {state}" lines.
+     * Only the blocks overlapping the range and having the pin are decoded.
+     * @param  digitalPinNumber
+     * @param  fromMillis       Milliseconds since boot.
+     * @param  toMillis
+     * @return String
+     */
+    String query(byte digitalPinNumber, uint32_t fromMillis, uint32_t toMillis);
+
+  private:
+    byte* buffer = nullptr;
+    PinHistoryBlock blocks[PIN_HISTORY_BLOCK_COUNT];
+    byte currentBlock = 0;
+    byte blockCount = 0;
+
+    // The last recorded levels, the pins the history is enabled for, and the pins recorded at all.
+    uint16_t levels = 0;
+    uint16_t enabledPins = 0;
+    uint16_t trackedPins = 0;
+    uint16_t listenedPins = 0;
+
+    PinHistoryEvent staged[PIN_HISTORY_STAGING_SIZE];
+    volatile byte stagedHead = 0;
+    volatile byte stagedTail = 0;
+
+    byte listenerId = 255;
+    bool spillReady = false;
+
+    void track();
+    void record(uint32_t eventMillis, byte digitalPinNumber, byte level);
+    void append(uint32_t eventMillis, byte digitalPinNumber, byte level);
+    void spillBlock(byte blockIndex);
+    void queryBlock(PinHistoryBlock* block, const byte* data, byte digitalPinNumber, uint32_t fromMillis, uint32_t toMillis, String* result, uint16_t* resultCount);
+    void querySpillFile(const char* path, byte digitalPinNumber, uint32_t fromMillis, uint32_t toMillis, String* result, uint16_t* resultCount);
+
+    static void onPinEdge(void* context, byte digitalPinNumber, byte level, uint32_t micros);
+};
+
+#endif
@@ -1,11 +1,120 @@
 #include "Pins.h"
 
-void Pins::setup(Settings* settings, Debug* debug)
+#ifdef ARDUINO_ARCH_ESP8266
+#include "LoopPacer.h"
+#endif
+
+void Pins::setup(Settings* settings, Debug* debug, GpioDriver* gpio)
 {
   this->settings = settings;
   this->debug = debug;
+  this->gpio = gpio;
+}
+
+byte Pins::addListener(PinEdgeHandler handler, void* context, bool passive)
+{
+  if (listenerCount >= PINS_MAX_LISTENERS) {
+    debug->error(F("Too many pin listeners!"));
+    return 255;
+  }
+
+  PinListener* listener = &listeners[listenerCount];
+  listener->handler = handler;
+  listener->context = context;
+  listener->passive = passive;
+  memset(listener->modes, 0, sizeof(listener->modes));
+
+  return listenerCount++;
 }
 
+bool Pins::listen(byte listenerId, byte digitalPinNumber, byte mode)
+{
+  if (listenerId >= listenerCount || digitalPinNumber > 15) {
+    return false;
+  }
+
+#ifndef ARDUINO_ARCH_ESP8266
+  debug->error("Pin " + String(digitalPinNumber) + F(" has no interrupt on this platform."));
+  return false;
+#else
+  byte gpioNumber = digital2gpio(digitalPinNumber);
+  if (gpioNumber == 255 || gpioNumber == 16) {
+    debug->error("Pin " + String(digitalPinNumber) + F(" has no interrupt."));
+    return false;
+  }
+
+  listeners[listenerId].modes[digitalPinNumber] = mode;
+
+  // RISING | FALLING == CHANGE, so the union of the modes is the mode to attach with,
+  // the passive listeners only count if no other listener needs the pin, so they don't double the interrupts of a single edge
+  byte interruptMode = 0;
+  byte passiveMode = 0;
+  for (byte listenerIndex = 0; listenerIndex < listenerCount; listenerIndex++) {
+    if (listeners[listenerIndex].passive) {
+      passiveMode |= listeners[listenerIndex].modes[digitalPinNumber];
+    }
+    else {
+      interruptMode |= listeners[listenerIndex].modes[digitalPinNumber];
+    }
+  }
+  if (interruptMode == 0) {
+    interruptMode = passiveMode;
+  }
+
+  if (interruptMode == interruptModes[digitalPinNumber]) {
+    return true;
+  }
+
+  detachInterrupt(gpioNumber);
+  interruptModes[digitalPinNumber] = interruptMode;
+
+  if (interruptMode == 0) {
+    debug->info(F("Stopped listening to pin ") + String(digitalPinNumber));
+    return true;
+  }
+
+  pinInterrupts[digitalPinNumber].pins = this;
+  pinInterrupts[digitalPinNumber].digitalPinNumber = digitalPinNumber;
+  pinInterrupts[digitalPinNumber].gpioNumber = gpioNumber;
+  attachInterruptArg(gpioNumber, Pins::onInterrupt, &pinInterrupts[digitalPinNumber], interruptMode);
+
+  debug->info(F("Listening to pin ") + String(digitalPinNumber) + F(" with mode ") + String(interruptMode));
+  return true;
+#endif
+}
+
+byte Pins::getInterruptMode(byte digitalPinNumber)
+{
+  return digitalPinNumber < 16 ? interruptModes[digitalPinNumber] : 0;
+}
+
+#ifdef ARDUINO_ARCH_ESP8266
+void IRAM_ATTR Pins::onInterrupt(void* arg)
+{
+  uint32_t now = micros();
+  PinInterrupt* pinInterrupt = (PinInterrupt*)arg;
+  Pins* pins = pinInterrupt->pins;
+  byte digitalPinNumber = pinInterrupt->digitalPinNumber;
+
+  // with a single edge attached the level is known, and reading it could miss a short pulse
+  byte edge = pins->interruptModes[digitalPinNumber];
+  if (edge == CHANGE) {
+    edge = digitalRead(pinInterrupt->gpioNumber) ? RISING : FALLING;
+  }
+  byte level = edge == RISING ? HIGH : LOW;
+
+  for (byte listenerIndex = 0; listenerIndex < pins->listenerCount; listenerIndex++) {
+    PinListener* listener = &pins->listeners[listenerIndex];
+    if (listener->modes[digitalPinNumber] & edge) {
+      listener->handler(listener->context, digitalPinNumber, level, now);
+    }
+  }
+
+  // the loop handles the rest of the edge, it shouldn't sleep through it
+  LoopPacer::wake();
+}
+#endif
+
 byte Pins::digital2gpio(byte digitalPinNumber)
 {
   switch (digitalPinNumber) {
@@ -65,7 +174,13 @@ byte Pins::digital2gpio(byte digitalPinNumber)
     #endif
   }
 
-  debug->error("Pin is out of range.");
+  #ifndef ARDUINO_ARCH_ESP8266
+    if (digitalPinNumber < 16 && gpio->hasPin(digitalPinNumber)) {
+      return digitalPinNumber;
+    }
+  #endif
+
+  debug->error(F("Pin is out of range."));
 
   return 255;
 }
@@ -73,7 +188,7 @@ byte Pins::digital2gpio(byte digitalPinNumber)
 byte Pins::getState(byte digitalPinNumber)
 {
   debug->info(
-    "Getting the state of pin: " +
+    F("Getting the state of pin: ") +
     String(digitalPinNumber)
   );
 
@@ -84,15 +199,15 @@ byte Pins::getState(byte digitalPinNumber)
   }
 
   debug->info(
-    "GPIO pin number: " +
+    F("GPIO pin number: ") +
     String(gpioNumber)
   );
 
   // if the pin is input mode, read the value of it
   if (isInput(digitalPinNumber)) {
-    pinState = digitalRead(gpioNumber);
+    pinState = gpio->read(gpioNumber);
     debug->info(
-      "Pin is in input mode, read state: " +
+      F("Pin is in input mode, read state: ") +
       String(pinState)
     );
     return pinState;
@@ -101,7 +216,7 @@ byte Pins::getState(byte digitalPinNumber)
   // otherwise return the stored value
   pinState = settings->getPinState(digitalPinNumber);
   debug->info(
-    "Pin is in output mode, stored state: " +
+    F("Pin is in output mode, stored state: ") +
     String(pinState)
   );
   return pinState;
@@ -110,21 +225,32 @@ byte Pins::getState(byte digitalPinNumber)
 bool Pins::setState(byte digitalPinNumber, String strPinState)
 {
   debug->info(
-    "Setting pin state of " +
+    F("Setting pin state of ") +
     String(digitalPinNumber) +
     " to " + strPinState
   );
 
+  int state = parseState(strPinState);
+  if (state < 0) {
+    debug->warn(F("The requested state is invalid! Accepted values: 0, 1, low, high."));
+    return false;
+  }
+
+  return setState(digitalPinNumber, (byte)state);
+}
+
+bool Pins::setState(byte digitalPinNumber, byte state)
+{
   if (!isOutput(digitalPinNumber)) {
     debug->error(
-      "The pin is not in output mode!"
+      F("The pin is not in output mode!")
     );
     return false;
   }
 
   if (settings->isPinLocked(digitalPinNumber)) {
     debug->error(
-      "The pin is locked!"
+      F("The pin is locked!")
     );
     return false;
   }
@@ -135,41 +261,86 @@ bool Pins::setState(byte digitalPinNumber, String strPinState)
   }
 
   debug->info(
-    "GPIO pin number: " +
-    String(gpioNumber)
+    F("GPIO pin number: ") +
+    String(gpioNumber) +
+    F(", state: ") +
+    String(state)
   );
 
-  int state = -1;
-  if (strPinState == "0" || strPinState == "low") {
-    state = LOW;
-  }
+  gpio->write(gpioNumber, state);
+  settings->storePinState(digitalPinNumber, state);
+  return true;
+}
 
-  if (strPinState == "1" || strPinState == "high") {
-    state = HIGH;
+bool Pins::setStates(uint16_t pinMask, uint16_t stateMask)
+{
+  debug->info(
+    F("Setting pin states of mask ") +
+    String(pinMask, BIN) +
+    " to " + String(stateMask & pinMask, BIN)
+  );
+
+  for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+    if (!bitRead(pinMask, digitalPinNumber)) {
+      continue;
+    }
+
+    if (
+      !settings->isPinInitalized(digitalPinNumber) ||
+      !isOutput(digitalPinNumber) ||
+      settings->isPinLocked(digitalPinNumber) ||
+      digital2gpio(digitalPinNumber) == 255
+    ) {
+      debug->error("Pin " + String(digitalPinNumber) + F(" is not an initialized, unlocked output pin!"));
+      return false;
+    }
   }
 
-  debug->info("Requested pin state: " + String(state));
+  for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+    if (!bitRead(pinMask, digitalPinNumber)) {
+      continue;
+    }
 
-  if (state < 0) {
-    debug->warn("The requested state is invalid! Accepted values: 0, 1, low, high.");
-    return false;
+    byte state = bitRead(stateMask, digitalPinNumber);
+    gpio->write(digital2gpio(digitalPinNumber), state);
+    settings->writeByteSet(settings->pinStates, digitalPinNumber, state);
   }
 
-  digitalWrite(gpioNumber, state);
-  settings->storePinState(digitalPinNumber, state);
+  settings->writeEeprom(EEPROM_INDEX_PINSTATES, settings->pinStates);
   return true;
 }
 
 bool Pins::initPin(byte digitalPinNumber, String strPinMode)
 {
   debug->info(
-    "Initializing pin " +
+    F("Initializing pin ") +
     String(digitalPinNumber) +
-    " with mode " + strPinMode
+    F(" with mode ") + strPinMode
   );
 
+  int mode = parseMode(strPinMode);
+  if (mode < 0) {
+    debug->error(F("Pin mode is invalid!"));
+    return false;
+  }
+
+  return initPin(digitalPinNumber, (byte)mode);
+}
+
+bool Pins::initPin(byte digitalPinNumber, byte mode)
+{
+  if (mode != INPUT && mode != OUTPUT && mode != INPUT_PULLUP) {
+    debug->error(F("Pin mode is invalid!"));
+    return false;
+  }
+
   if (settings->isPinLocked(digitalPinNumber)) {
-    debug->error("Pin is locked!");
+    debug->error(F("Pin is locked!"));
+    return false;
+  }
+
+  if (isReserved(digitalPinNumber)) {
+    debug->error(F("Pin is used by a bus!"));
     return false;
   }
 
@@ -179,40 +350,60 @@ bool Pins::initPin(byte digitalPinNumber, String strPinMode)
   }
 
   debug->info(
-    "GPIO pin number: " +
+    F("GPIO pin number: ") +
     String(gpioNumber)
   );
 
-  int mode = -1;
-  if (strPinMode == "input") {
-    mode = INPUT;
-  }
-  else if (strPinMode == "output") {
-    mode = OUTPUT;
-  }
-  else if (strPinMode == "input_pullup") {
-    mode = INPUT_PULLUP;
-  }
-  else {
-    debug->error("Pin mode is invalid!");
-    return false;
-  }
-
-  pinMode(gpioNumber, mode);
+  gpio->setMode(gpioNumber, mode);
   settings->setPinInit(digitalPinNumber);
   settings->storePinMode(digitalPinNumber, mode);
   debug->info(
-    "Pin initialized with mode " +
+    F("Pin initialized with mode ") +
     String(mode)
   );
   return true;
 }
 
+int Pins::parseState(String strPinState)
+{
+  if (strPinState == "0" || strPinState == "low") {
+    return LOW;
+  }
+
+  if (strPinState == "1" || strPinState == "high") {
+    return HIGH;
+  }
+
+  return -1;
+}
+
+int Pins::parseMode(String strPinMode)
+{
+  if (strPinMode == "input") {
+    return INPUT;
+  }
+
+  if (strPinMode == "output") {
+    return OUTPUT;
+  }
+
+  if (strPinMode == "input_pullup") {
+    return INPUT_PULLUP;
+  }
+
+  return -1;
+}
+
 bool Pins::isInput(byte digitalPinNumber)
 {
   return !isOutput(digitalPinNumber);
 }
 
+bool Pins::isReserved(byte digitalPinNumber)
+{
+  return digitalPinNumber < 16 && bitRead(reservedMask, digitalPinNumber);
+}
+
 bool Pins::isOutput(byte digitalPinNumber)
 {
   return settings->getPinMode(digitalPinNumber) == OUTPUT;
@@ -220,7 +411,7 @@ bool Pins::isOutput(byte digitalPinNumber)
 
 void Pins::restorePinModesAndStates()
 {
-  debug->info("Restoring pin modes and states.");
+  debug->info(F("Restoring pin modes and states."));
 
   for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
     if (
@@ -235,16 +426,16 @@ void Pins::restorePinModesAndStates()
     // if it is an output pin, set the mode to output, get the stored state and write that out
     if (isOutput(digitalPinNumber)) {
       byte pinState = settings->getPinState(digitalPinNumber);
-      pinMode(gpioNumber, OUTPUT);
-      digitalWrite(gpioNumber, pinState);
+      gpio->setMode(gpioNumber, OUTPUT);
+      gpio->write(gpioNumber, pinState);
 
-      debug->info("Restored pin " + String(digitalPinNumber) + " with mode output and state " + String(pinState));
+      debug->info(F("Restored pin ") + String(digitalPinNumber) + F(" with mode output and state ") + String(pinState));
       continue;
     }
 
     // otherwise just set the pinmode to the stored mode
-    pinMode(gpioNumber, settings->getPinMode(digitalPinNumber));
+    gpio->setMode(gpioNumber, settings->getPinMode(digitalPinNumber));
 
-    debug->info("Restored pin " + String(digitalPinNumber) + " with mode input or input_pullup");
+    debug->info(F("Restored pin ") + String(digitalPinNumber) + F(" with mode input or input_pullup"));
   }
 }
@@ -2,22 +2,86 @@
 #define PINS_H
 
 #include <Arduino.h>
+#include "Platform.h"
 #include "Settings.h"
 #include "Debug.h"
 
+#define PINS_MAX_LISTENERS 4
+
+class Pins;
+
+/**
+ * Called from the pin interrupt, so it must be IRAM_ATTR and quick.
+ * @param context          The pointer given when the listener was added.
+ * @param digitalPinNumber
+ * @param level            The level of the pin after the edge.
+ * @param micros           The time of the edge.
+ */
+typedef void (*PinEdgeHandler)(void* context, byte digitalPinNumber, byte level, uint32_t micros);
+
+struct PinListener {
+  PinEdgeHandler handler;
+  void* context;
+  // RISING, FALLING or CHANGE for every pin listened to, 0 for the rest.
+  byte modes[16];
+  // A passive listener only widens the interrupt of a pin no other listener needs, otherwise it gets the edges attached for them.
+  bool passive;
+};
+
+struct PinInterrupt {
+  Pins* pins;
+  byte digitalPinNumber;
+  byte gpioNumber;
+};
+
 class Pins
 {
   public:
     Settings* settings;
     Debug* debug;
+    GpioDriver* gpio;
+
+    PinListener listeners[PINS_MAX_LISTENERS];
+    byte listenerCount = 0;
+
+    // Bits of the digital pins taken by a peripheral, e.g. a bus, until the restart. They can't be initialized as gpio.
+    uint16_t reservedMask = 0;
+
+    void setup(Settings* settings, Debug* debug, GpioDriver* gpio);
 
-    void setup(Settings* settings, Debug* debug);
+    /**
+     * Registers a handler for pin edges. The pins to listen to are set by listen().
+     * @param  handler
+     * @param  context Passed to the handler.
+     * @param  passive Whether the edges of the other listeners are enough for it, see PinListener.
+     * @return byte    Id of the listener, or 255 if there are too many.
+     */
+    byte addListener(PinEdgeHandler handler, void* context, bool passive = false);
+
+    /**
+     * Starts or stops listening to the edges of the pin. The interrupt of the pin is attached
+     * with the edges any of the listeners need, and detached when none of them need it anymore.
+     * GPIO16 (D0) has no interrupt, and the pin interrupts are only supported on the ESP8266.
+     * @param  listenerId
+     * @param  digitalPinNumber
+     * @param  mode             RISING, FALLING, CHANGE, or 0 to stop listening.
+     * @return bool             False if the pin has no interrupt.
+     */
+    bool listen(byte listenerId, byte digitalPinNumber, byte mode);
+
+    /**
+     * Returns the edges the interrupt of the pin is attached with.
+     * @param  digitalPinNumber
+     * @return byte             RISING, FALLING, CHANGE, or 0 if it is not attached.
+     */
+    byte getInterruptMode(byte digitalPinNumber);
 
     /**
      * Converts the String pin to byte pin and validates it.
      * It accepts numeric value where the string is going to be converted to integer meaning the GPIO pin is going to be used.
      * Accepts D# format where the digital pin number will be translated to a GPIO pin and that will be returned.
      * If the string doesn't confomr any of the above rules, it will return 255, indicating an error.
+     * On the other platforms the pins are numbered by the driver, the digital pin number is the gpio number.
      * @param  digitalPinNumber
      * @return byte The GPIO pin number or 255 on error
      */
@@ -35,13 +99,60 @@ class Pins
 
     bool setState(byte digitalPinNumber, String strPinState);
 
+    /**
+     * Sets the state of an output pin, and stores it.
+     * @param  digitalPinNumber
+     * @param  state            LOW or HIGH
+     * @return bool             False if the pin is not an output, or it is locked.
+     */
+    bool setState(byte digitalPinNumber, byte state);
+
+    /**
+     * Sets the states of several output pins at once, and stores them with a single EEPROM commit.
+     * Nothing is changed if any of the pins is not an output, or it is locked.
+     * @param  pinMask   Bits of the digital pins to set.
+     * @param  stateMask Bits of the states to set the pins to.
+     * @return bool
+     */
+    bool setStates(uint16_t pinMask, uint16_t stateMask);
+
     bool initPin(byte digitalPinNumber, String strPinMode);
 
+    /**
+     * Sets the mode of the pin, and stores it.
+     * @param  digitalPinNumber
+     * @param  mode             INPUT, OUTPUT or INPUT_PULLUP
+     * @return bool             False if the pin is locked or reserved.
+     */
+    bool initPin(byte digitalPinNumber, byte mode);
+
+    /**
+     * Converts the state from the http interface.
+     * @param  strPinState 0, 1, low or high
+     * @return int         LOW, HIGH, or -1 if invalid.
+     */
+    int parseState(String strPinState);
+
+    /**
+     * Converts the mode from the http interface.
+     * @param  strPinMode input, output or input_pullup
+     * @return int        INPUT, OUTPUT, INPUT_PULLUP, or -1 if invalid.
+     */
+    int parseMode(String strPinMode);
+
     bool isInput(byte digitalPinNumber);
 
     bool isOutput(byte digitalPinNumber);
 
+    bool isReserved(byte digitalPinNumber);
+
     void restorePinModesAndStates();
+
+  private:
+    PinInterrupt pinInterrupts[16];
+    byte interruptModes[16] = {0};
+
+    static void onInterrupt(void* arg);
 };
 
 #endif
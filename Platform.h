@@ -0,0 +1,121 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <Arduino.h>
+
+/**
+ * The hardware the portable part of the server works through: the REST API, the settings, the pins and the serial queue.
+ * The ESP8266 implementations are in EspPlatform.h, the Linux ones in the linux directory.
+ */
+
+/**
+ * Drives the pins by the gpio numbers given by Pins::digital2gpio().
+ */
+class GpioDriver
+{
+  public:
+    virtual ~GpioDriver() {}
+
+    /**
+     * @param  gpioNumber
+     * @return bool       False if the platform has no such pin.
+     */
+    virtual bool hasPin(byte gpioNumber) = 0;
+
+    /**
+     * @param gpioNumber
+     * @param mode       INPUT, OUTPUT or INPUT_PULLUP
+     */
+    virtual void setMode(byte gpioNumber, byte mode) = 0;
+
+    virtual void write(byte gpioNumber, byte level) = 0;
+    virtual byte read(byte gpioNumber) = 0;
+};
+
+/**
+ * Byte addressed persistent storage of the settings, with the semantics of the EEPROM library:
+ * the writes go to a copy in RAM, and commit() makes them persistent.
+ */
+class SettingsStore
+{
+  public:
+    virtual ~SettingsStore() {}
+
+    /**
+     * Loads the stored bytes, the ones never written read as 0.
+     * @param  size
+     * @return bool False if the storage is not available.
+     */
+    virtual bool begin(size_t size) = 0;
+
+    virtual byte read(int address) = 0;
+    virtual void write(int address, byte value) = 0;
+
+    /**
+     * @return bool False if the bytes could not be persisted.
+     */
+    virtual bool commit() = 0;
+
+    /**
+     * Reads the warm state, a copy of the settings kept in memory that survives a deep sleep, but not a power loss.
+     * The caller validates it, there's none by default.
+     * @param  bytes
+     * @param  length
+     * @return bool   False if the store has no such memory, or it didn't survive.
+     */
+    virtual bool readWarmState(byte* bytes, size_t length)
+    {
+      return false;
+    }
+
+    virtual void writeWarmState(const byte* bytes, size_t length)
+    {
+    }
+
+    template <typename T>
+    T& get(int address, T& value)
+    {
+      byte* bytes = (byte*)&value;
+      for (size_t index = 0; index < sizeof(T); index++) {
+        bytes[index] = read(address + index);
+      }
+
+      return value;
+    }
+
+    template <typename T>
+    const T& put(int address, const T& value)
+    {
+      const byte* bytes = (const byte*)&value;
+      for (size_t index = 0; index < sizeof(T); index++) {
+        write(address + index, bytes[index]);
+      }
+
+      return value;
+    }
+};
+
+/**
+ * The serial port behind /serial. Neither the reads nor the writes may block.
+ */
+class SerialPort
+{
+  public:
+    virtual ~SerialPort() {}
+
+    virtual int available() = 0;
+
+    /**
+     * @return int The next byte, or -1 if there's none.
+     */
+    virtual int read() = 0;
+
+    /**
+     * @return int Number of bytes write() takes without blocking.
+     */
+    virtual int availableForWrite() = 0;
+
+    virtual size_t write(const uint8_t* data, size_t length) = 0;
+};
+
+#endif
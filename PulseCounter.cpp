@@ -0,0 +1,182 @@
+#include "PulseCounter.h"
+
+void PulseCounter::setup(Settings* settings, Debug* debug, Pins* pins)
+{
+  this->settings = settings;
+  this->debug = debug;
+  this->pins = pins;
+
+  listenerId = pins->addListener(PulseCounter::onPinEdge, this);
+}
+
+void PulseCounter::restore()
+{
+  StoredPinCounters storedPinCounters;
+  if (!settings->getPinCounters(&storedPinCounters)) {
+    return;
+  }
+
+  for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+    if (!bitRead(storedPinCounters.pinMask, digitalPinNumber)) {
+      continue;
+    }
+
+    enable(
+      digitalPinNumber,
+      storedPinCounters.edges[digitalPinNumber],
+      storedPinCounters.debounceMicros[digitalPinNumber],
+      false
+    );
+  }
+}
+
+bool PulseCounter::enable(byte digitalPinNumber, byte edge, uint32_t debounceMicros, bool store)
+{
+  if (digitalPinNumber > 15 || !settings->isPinInitalized(digitalPinNumber) || !pins->isInput(digitalPinNumber)) {
+    debug->error(F("Only initialized input pins can count."));
+    return false;
+  }
+
+  // stop the interrupt while the channel is reset
+  pins->listen(listenerId, digitalPinNumber, 0);
+
+  PulseCounterChannel* channel = &channels[digitalPinNumber];
+  *channel = PulseCounterChannel();
+  channel->edge = edge;
+  channel->debounceMicros = debounceMicros;
+  channel->windowStartMillis = millis();
+
+  if (!pins->listen(listenerId, digitalPinNumber, edge)) {
+    bitClear(pinMask, digitalPinNumber);
+    return false;
+  }
+
+  bitSet(pinMask, digitalPinNumber);
+  if (store) {
+    this->store();
+  }
+
+  return true;
+}
+
+void PulseCounter::disable(byte digitalPinNumber, bool store)
+{
+  if (!isEnabled(digitalPinNumber)) {
+    return;
+  }
+
+  pins->listen(listenerId, digitalPinNumber, 0);
+  bitClear(pinMask, digitalPinNumber);
+
+  if (store) {
+    this->store();
+  }
+}
+
+bool PulseCounter::isEnabled(byte digitalPinNumber)
+{
+  return digitalPinNumber < 16 && bitRead(pinMask, digitalPinNumber);
+}
+
+String PulseCounter::read(byte digitalPinNumber, bool reset)
+{
+  PulseCounterChannel* channel = &channels[digitalPinNumber];
+
+  // take a consistent snapshot, the interrupt can't update the channel meanwhile
+  noInterrupts();
+  uint32_t count = channel->count;
+  uint32_t periodCount = channel->periodCount;
+  uint64_t periodSum = channel->periodSum;
+  uint32_t minPeriod = channel->minPeriod;
+  uint32_t maxPeriod = channel->maxPeriod;
+  uint32_t totalCount = channel->totalCount;
+  if (reset) {
+    channel->count = 0;
+    channel->periodCount = 0;
+    channel->periodSum = 0;
+    channel->minPeriod = UINT32_MAX;
+    channel->maxPeriod = 0;
+  }
+  interrupts();
+
+  unsigned long now = millis();
+  unsigned long windowMillis = now - channel->windowStartMillis;
+  if (reset) {
+    channel->windowStartMillis = now;
+  }
+
+  String rate = "?";
+  if (windowMillis > 0) {
+    rate = String(count * 1000.0 / windowMillis, 3);
+  }
+
+  String period = "?";
+  if (periodCount > 0) {
+    period =
+      String((uint32_t)(periodSum / periodCount)) + F(" (min: ") +
+      String(minPeriod) + F(", max: ") +
+      String(maxPeriod) + ")";
+  }
+
+  return
+    F("count: ") + String(count) + "\r\n" +
+    F("total: ") + String(totalCount) + "\r\n" +
+    F("window: ") + String(windowMillis) + "\r\n" +
+    F("rate: ") + rate + "\r\n" +
+    F("period: ") + period + "\r\n" +
+    F("debounce: ") + String(channel->debounceMicros) + "\r\n";
+}
+
+int PulseCounter::parseEdge(String strEdge)
+{
+  if (strEdge == "rising") {
+    return RISING;
+  }
+
+  if (strEdge == "falling") {
+    return FALLING;
+  }
+
+  if (strEdge == "change") {
+    return CHANGE;
+  }
+
+  return -1;
+}
+
+void PulseCounter::store()
+{
+  StoredPinCounters storedPinCounters;
+  storedPinCounters.pinMask = pinMask;
+  for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+    storedPinCounters.edges[digitalPinNumber] = channels[digitalPinNumber].edge;
+    storedPinCounters.debounceMicros[digitalPinNumber] = channels[digitalPinNumber].debounceMicros;
+  }
+
+  settings->storePinCounters(&storedPinCounters);
+}
+
+void IRAM_ATTR PulseCounter::onPinEdge(void* context, byte digitalPinNumber, byte level, uint32_t micros)
+{
+  PulseCounterChannel* channel = &((PulseCounter*)context)->channels[digitalPinNumber];
+
+  uint32_t period = micros - channel->lastEdgeMicros;
+  if (channel->totalCount > 0) {
+    if (period < channel->debounceMicros) {
+      return;
+    }
+
+    channel->periodSum += period;
+    channel->periodCount++;
+    if (period < channel->minPeriod) {
+      channel->minPeriod = period;
+    }
+    if (period > channel->maxPeriod) {
+      channel->maxPeriod = period;
+    }
+  }
+
+  channel->lastEdgeMicros = micros;
+  channel->count++;
+  channel->totalCount++;
+}
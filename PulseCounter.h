@@ -0,0 +1,85 @@
+#ifndef PULSE_COUNTER_H
+#define PULSE_COUNTER_H
+
+#include <Arduino.h>
+
+#include "Settings.h"
+#include "Debug.h"
+#include "Pins.h"
+
+struct PulseCounterChannel {
+  // Since the last read
+  volatile uint32_t count = 0;
+  volatile uint32_t periodCount = 0;
+  volatile uint64_t periodSum = 0;
+  volatile uint32_t minPeriod = UINT32_MAX;
+  volatile uint32_t maxPeriod = 0;
+
+  // Since enabled
+  volatile uint32_t totalCount = 0;
+  volatile uint32_t lastEdgeMicros = 0;
+
+  uint32_t debounceMicros = 0;
+  byte edge = RISING;
+  // Start of the window the rate is calculated over.
+  unsigned long windowStartMillis = 0;
+};
+
+/**
+ * Counts the edges of input pins from the pin interrupt, and measures their frequency.
+ */
+class PulseCounter
+{
+  public:
+    Settings* settings;
+    Debug* debug;
+    Pins* pins;
+
+    PulseCounterChannel channels[16];
+    // Pins in counter mode.
+    uint16_t pinMask = 0;
+
+    void setup(Settings* settings, Debug* debug, Pins* pins);
+
+    /**
+     * Enables the counters stored in the EEPROM, must be called after the pin modes are restored.
+     */
+    void restore();
+
+    /**
+     * Starts counting the edges of the pin.
+     * @param  digitalPinNumber Must be initialized as input.
+     * @param  edge             RISING, FALLING or CHANGE.
+     * @param  debounceMicros   Edges closer to the previous counted edge than this are ignored.
+     * @param  store            Whether to store the settings in the EEPROM.
+     * @return bool             False if the pin is not an input, or has no interrupt.
+     */
+    bool enable(byte digitalPinNumber, byte edge, uint32_t debounceMicros, bool store = true);
+
+    void disable(byte digitalPinNumber, bool store = true);
+
+    bool isEnabled(byte digitalPinNumber);
+
+    /**
+     * Returns the count, rate and period statistics since the last read as "name: value" lines.
+     * @param  digitalPinNumber
+     * @param  reset            Whether to start a new window.
+     * @return String
+     */
+    String read(byte digitalPinNumber, bool reset = true);
+
+    /**
+     * Converts the edge from the http interface.
+     * @param  strEdge rising, falling or change
+     * @return int     RISING, FALLING, CHANGE, or -1 if invalid.
+     */
+    static int parseEdge(String strEdge);
+
+  private:
+    byte listenerId = 255;
+
+    void store();
+    static void onPinEdge(void* context, byte digitalPinNumber, byte level, uint32_t micros);
+};
+
+#endif
@@ -0,0 +1,319 @@
+#include "PwmGenerator.h"
+
+PwmGenerator* PwmGenerator::instance = nullptr;
+
+void PwmGenerator::setup(Settings* settings, Debug* debug, Pins* pins)
+{
+  this->settings = settings;
+  this->debug = debug;
+  this->pins = pins;
+}
+
+void PwmGenerator::restore()
+{
+  StoredPwm storedPwm;
+  if (!settings->getPwm(&storedPwm)) {
+    return;
+  }
+
+  for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+    if (!bitRead(storedPwm.pinMask, digitalPinNumber)) {
+      continue;
+    }
+
+    enable(digitalPinNumber, storedPwm.duty[digitalPinNumber], storedPwm.frequency, false);
+  }
+}
+
+bool PwmGenerator::enable(byte digitalPinNumber, uint16_t duty, uint16_t frequency, bool store)
+{
+  if (
+    digitalPinNumber > 15 ||
+    !settings->isPinInitalized(digitalPinNumber) ||
+    !pins->isOutput(digitalPinNumber) ||
+    settings->isPinLocked(digitalPinNumber)
+  ) {
+    debug->error(F("Only initialized, unlocked output pins can be in pwm mode."));
+    return false;
+  }
+
+  byte gpioNumber = pins->digital2gpio(digitalPinNumber);
+  if (gpioNumber > 15) {
+    debug->error(F("GPIO16 can't be in pwm mode."));
+    return false;
+  }
+
+  if (frequency < PWM_MIN_FREQUENCY || frequency > PWM_MAX_FREQUENCY || duty > PWM_DUTY_RANGE) {
+    debug->error(F("The frequency or the duty is out of range."));
+    return false;
+  }
+
+  this->frequency = frequency;
+  this->duty[digitalPinNumber] = duty;
+  bitSet(pinMask, digitalPinNumber);
+
+  debug->info(
+    F("Pwm of pin ") + String(digitalPinNumber) +
+    F(" with duty ") + String(duty) +
+    F(" at ") + String(frequency) + "Hz"
+  );
+
+  update();
+  if (store) {
+    this->store();
+  }
+
+  return true;
+}
+
+void PwmGenerator::disable(byte digitalPinNumber, bool store)
+{
+  if (!isEnabled(digitalPinNumber)) {
+    return;
+  }
+
+  bitClear(pinMask, digitalPinNumber);
+
+  // the pin is set to its stored state with the switch to the table without it, not while the interrupt still drives it
+  uint16_t gpioBit = 1 << pins->digital2gpio(digitalPinNumber);
+  noInterrupts();
+  if (settings->getPinState(digitalPinNumber)) {
+    releaseSetMask |= gpioBit;
+    releaseClearMask &= ~gpioBit;
+  }
+  else {
+    releaseClearMask |= gpioBit;
+    releaseSetMask &= ~gpioBit;
+  }
+  interrupts();
+
+  debug->info(F("Stopped the pwm of pin ") + String(digitalPinNumber));
+
+  update();
+  if (store) {
+    this->store();
+  }
+}
+
+bool PwmGenerator::isEnabled(byte digitalPinNumber)
+{
+  return digitalPinNumber < 16 && bitRead(pinMask, digitalPinNumber);
+}
+
+bool PwmGenerator::isRunning()
+{
+  return running;
+}
+
+void PwmGenerator::update()
+{
+  if (pinMask == 0) {
+    if (running) {
+      timer1_disable();
+      timer1_detachInterrupt();
+      running = false;
+      pending = false;
+
+      debug->info(F("Pwm stopped."));
+    }
+
+    GPOC = releaseClearMask;
+    GPOS = releaseSetMask;
+    releaseClearMask = 0;
+    releaseSetMask = 0;
+    return;
+  }
+
+  if (running) {
+    // the interrupt can't switch to the table while it is written, a pending one is overwritten
+    noInterrupts();
+    PwmTable* table = &tables[activeIndex ^ 1];
+    uint16_t lowMask = buildTable(table);
+    releaseSetMask &= ~(lowMask | table->steps[0].setMask);
+    releaseClearMask = (releaseClearMask & ~table->steps[0].setMask) | lowMask;
+    pending = true;
+    interrupts();
+    return;
+  }
+
+  activeIndex = 0;
+  stepIndex = 0;
+  pending = false;
+  uint16_t lowMask = buildTable(&tables[0]);
+  GPOC = (releaseClearMask & ~tables[0].steps[0].setMask) | lowMask;
+  GPOS = releaseSetMask & ~(lowMask | tables[0].steps[0].setMask);
+  releaseClearMask = 0;
+  releaseSetMask = 0;
+
+  interruptCount = 0;
+  busyCycles = 0;
+  startMillis = millis();
+  instance = this;
+  running = true;
+
+  debug->info(F("Pwm started."));
+
+  timer1_attachInterrupt(PwmGenerator::onTimer);
+  timer1_enable(TIM_DIV16, TIM_EDGE, TIM_SINGLE);
+  timer1_write(PWM_MIN_TICKS);
+}
+
+uint16_t PwmGenerator::buildTable(PwmTable* table)
+{
+  uint32_t periodTicks = 1000000UL * PWM_TICKS_PER_MICROSECOND / frequency;
+
+  uint16_t setMask = 0;
+  uint16_t lowMask = 0;
+  uint16_t edgeMasks[16];
+  uint32_t edgeTicks[16];
+  byte edgeCount = 0;
+
+  for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+    if (!bitRead(pinMask, digitalPinNumber)) {
+      continue;
+    }
+
+    uint16_t gpioBit = 1 << pins->digital2gpio(digitalPinNumber);
+    uint32_t ticks = (uint64_t)periodTicks * duty[digitalPinNumber] / PWM_DUTY_RANGE;
+
+    // the pins with 0 duty are held low, the ones with the edge too close to the end of the period are held high
+    if (duty[digitalPinNumber] == 0) {
+      lowMask |= gpioBit;
+      continue;
+    }
+
+    setMask |= gpioBit;
+    if (ticks + PWM_MIN_TICKS > periodTicks) {
+      continue;
+    }
+
+    // sorted by the time of the edge as inserted
+    ticks = max(ticks, (uint32_t)PWM_MIN_TICKS);
+    byte edgeIndex = edgeCount++;
+    while (edgeIndex > 0 && edgeTicks[edgeIndex - 1] > ticks) {
+      edgeTicks[edgeIndex] = edgeTicks[edgeIndex - 1];
+      edgeMasks[edgeIndex] = edgeMasks[edgeIndex - 1];
+      edgeIndex--;
+    }
+    edgeTicks[edgeIndex] = ticks;
+    edgeMasks[edgeIndex] = gpioBit;
+  }
+
+  table->steps[0].setMask = setMask;
+  table->steps[0].clearMask = 0;
+  table->stepCount = 1;
+
+  // the edges closer than the interrupt can keep up with are merged into the earlier one
+  uint32_t stepTicks[17] = {0};
+  for (byte edgeIndex = 0; edgeIndex < edgeCount; edgeIndex++) {
+    PwmStep* lastStep = &table->steps[table->stepCount - 1];
+    if (table->stepCount > 1 && edgeTicks[edgeIndex] - stepTicks[table->stepCount - 1] < PWM_MIN_TICKS) {
+      lastStep->clearMask |= edgeMasks[edgeIndex];
+      continue;
+    }
+
+    PwmStep* step = &table->steps[table->stepCount];
+    step->setMask = 0;
+    step->clearMask = edgeMasks[edgeIndex];
+    stepTicks[table->stepCount] = edgeTicks[edgeIndex];
+    table->stepCount++;
+  }
+
+  for (byte stepIndex = 0; stepIndex < table->stepCount; stepIndex++) {
+    uint32_t nextTicks = stepIndex + 1 < table->stepCount ? stepTicks[stepIndex + 1] : periodTicks;
+    table->steps[stepIndex].ticksToNext = nextTicks - stepTicks[stepIndex];
+  }
+
+  return lowMask;
+}
+
+String PwmGenerator::getStatus(byte digitalPinNumber)
+{
+  uint32_t periodTicks = 1000000UL * PWM_TICKS_PER_MICROSECOND / frequency;
+
+  noInterrupts();
+  PwmTable table = tables[pending ? activeIndex ^ 1 : activeIndex];
+  uint32_t interruptTotal = interruptCount;
+  uint64_t cycles = busyCycles;
+  interrupts();
+
+  // the time the pin is high as played, after the edges are merged
+  uint16_t gpioBit = 1 << pins->digital2gpio(digitalPinNumber);
+  uint32_t highTicks = 0;
+  if (table.steps[0].setMask & gpioBit) {
+    highTicks = periodTicks;
+    uint32_t ticks = 0;
+    for (byte stepIndex = 0; stepIndex < table.stepCount; stepIndex++) {
+      if (table.steps[stepIndex].clearMask & gpioBit) {
+        highTicks = ticks;
+        break;
+      }
+      ticks += table.steps[stepIndex].ticksToNext;
+    }
+  }
+
+  byte channels = 0;
+  for (byte pinIndex = 0; pinIndex < 16; pinIndex++) {
+    channels += bitRead(pinMask, pinIndex);
+  }
+
+  unsigned long elapsedMillis = millis() - startMillis;
+  float cpuCycles = (float)elapsedMillis * ESP.getCpuFreqMHz() * 1000;
+  float load = cpuCycles > 0 ? cycles * 100.0 / cpuCycles : 0;
+
+  return
+    F("frequency: ") + String(frequency) + "\r\n" +
+    F("duty: ") + String(duty[digitalPinNumber]) + "\r\n" +
+    F("period: ") + String(periodTicks / PWM_TICKS_PER_MICROSECOND) + "\r\n" +
+    F("high: ") + String(highTicks / (float)PWM_TICKS_PER_MICROSECOND, 1) + "\r\n" +
+    F("channels: ") + String(channels) + "\r\n" +
+    F("interruptsPerSecond: ") + String(elapsedMillis > 0 ? interruptTotal * 1000.0 / elapsedMillis : 0, 1) + "\r\n" +
+    F("cyclesPerInterrupt: ") + String(interruptTotal > 0 ? (uint32_t)(cycles / interruptTotal) : 0) + "\r\n" +
+    F("load: ") + String(load, 3) + "\r\n" +
+    F("loadPerChannel: ") + String(channels > 0 ? load / channels : 0, 3) + "\r\n";
+}
+
+void PwmGenerator::store()
+{
+  StoredPwm storedPwm;
+  storedPwm.frequency = frequency;
+  storedPwm.pinMask = pinMask;
+  memcpy(storedPwm.duty, duty, sizeof(duty));
+
+  settings->storePwm(&storedPwm);
+}
+
+void IRAM_ATTR PwmGenerator::onTimer()
+{
+  uint32_t startCycles = ESP.getCycleCount();
+  PwmGenerator* pwm = instance;
+
+  // a change takes effect at the start of a period, with the pins released by it
+  if (pwm->stepIndex == 0 && pwm->pending) {
+    pwm->activeIndex ^= 1;
+    pwm->pending = false;
+    GPOC = pwm->releaseClearMask;
+    GPOS = pwm->releaseSetMask;
+    pwm->releaseClearMask = 0;
+    pwm->releaseSetMask = 0;
+  }
+
+  PwmTable* table = &pwm->tables[pwm->activeIndex];
+  PwmStep* step = &table->steps[pwm->stepIndex];
+
+  // the timer counts from here, the time of the writes doesn't add up over the period
+  timer1_write(step->ticksToNext);
+
+  if (step->setMask) {
+    GPOS = step->setMask;
+  }
+  if (step->clearMask) {
+    GPOC = step->clearMask;
+  }
+
+  byte nextStepIndex = pwm->stepIndex + 1;
+  pwm->stepIndex = nextStepIndex < table->stepCount ? nextStepIndex : 0;
+
+  pwm->interruptCount++;
+  pwm->busyCycles += ESP.getCycleCount() - startCycles;
+}
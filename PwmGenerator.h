@@ -0,0 +1,135 @@
+#ifndef PWM_GENERATOR_H
+#define PWM_GENERATOR_H
+
+#include <ESP8266WiFi.h>
+#include <Arduino.h>
+
+#include "Settings.h"
+#include "Debug.h"
+#include "Pins.h"
+
+// timer1 runs from the 80MHz clock divided by 16
+#define PWM_TICKS_PER_MICROSECOND 5
+// Edges closer than this are merged, so the interrupt has time to return before the next one.
+#define PWM_MIN_TICKS 50
+
+#define PWM_MIN_FREQUENCY 1
+#define PWM_MAX_FREQUENCY 1000
+#define PWM_DEFAULT_FREQUENCY 100
+// The duty is given in permille.
+#define PWM_DUTY_RANGE 1000
+
+/**
+ * An interrupt of the period: the start of the period, when the pins go high, or an edge, when some pins go low.
+ */
+struct PwmStep {
+  // GPIO masks, GPIO16 is not in the same register as the others, so it can't be used.
+  uint16_t setMask;
+  uint16_t clearMask;
+  // Timer ticks until the next step, for the last step until the start of the next period.
+  uint32_t ticksToNext;
+};
+
+/**
+ * The steps of a period, the channels with the same duty share a step.
+ */
+struct PwmTable {
+  PwmStep steps[17];
+  byte stepCount = 0;
+};
+
+/**
+ * Drives the pins in pwm mode from the timer1 interrupt, every channel at the same frequency.
+ * All the channels go high together at the start of the period, and every edge is a single write to the GPIO register,
+ * however many channels change at it.
+ * The changes are done on a copy of the steps, the interrupt switches to it at the start of the next period,
+ * so a period is never cut short or stretched by a change.
+ * Uses timer1 exclusively, so it can't be used together with the sequence, analogWrite, tone or Servo.
+ */
+class PwmGenerator
+{
+  public:
+    Settings* settings;
+    Debug* debug;
+    Pins* pins;
+
+    // Pins in pwm mode.
+    uint16_t pinMask = 0;
+    // Of every pin, in permille.
+    uint16_t duty[16] = {0};
+    uint16_t frequency = PWM_DEFAULT_FREQUENCY;
+
+    // Of the interrupt since the timer started, for the overhead.
+    volatile uint32_t interruptCount = 0;
+    volatile uint64_t busyCycles = 0;
+
+    void setup(Settings* settings, Debug* debug, Pins* pins);
+
+    /**
+     * Enables the channels stored in the EEPROM, must be called after the pin modes are restored.
+     */
+    void restore();
+
+    /**
+     * Puts the pin in pwm mode, or changes its duty.
+     * @param  digitalPinNumber Must be initialized as output, D0 can't be used.
+     * @param  duty             In permille, 0 is low, PWM_DUTY_RANGE is high.
+     * @param  frequency        Of every channel, PWM_MIN_FREQUENCY - PWM_MAX_FREQUENCY Hz.
+     * @param  store            Whether to store the settings in the EEPROM.
+     * @return bool             False if the pin is not an unlocked output, or the frequency is out of range.
+     */
+    bool enable(byte digitalPinNumber, uint16_t duty, uint16_t frequency, bool store = true);
+
+    /**
+     * Stops the pwm of the pin, and sets it to its stored state.
+     * @param digitalPinNumber
+     * @param store            Whether to store the settings in the EEPROM.
+     */
+    void disable(byte digitalPinNumber, bool store = true);
+
+    bool isEnabled(byte digitalPinNumber);
+
+    /**
+     * Whether the timer is running, it is as long as any pin is in pwm mode.
+     * @return bool
+     */
+    bool isRunning();
+
+    /**
+     * Returns the settings of the channel, the time it is high as played, and the overhead of the interrupt as "name: value" lines.
+     * @param  digitalPinNumber
+     * @return String
+     */
+    String getStatus(byte digitalPinNumber);
+
+  private:
+    PwmTable tables[2];
+    // The table played by the interrupt.
+    volatile byte activeIndex = 0;
+    // Whether the other table is to be played from the next period.
+    volatile bool pending = false;
+    volatile byte stepIndex = 0;
+    // Pins to set to their stored states when the next table is switched to.
+    volatile uint16_t releaseSetMask = 0;
+    volatile uint16_t releaseClearMask = 0;
+
+    bool running = false;
+    unsigned long startMillis = 0;
+
+    /**
+     * Plays the channels as set, from the next period if the timer is running, starts or stops the timer as needed.
+     */
+    void update();
+
+    /**
+     * @param  table
+     * @return uint16_t GPIO mask of the pins with 0 duty, they are held low outside of the table.
+     */
+    uint16_t buildTable(PwmTable* table);
+    void store();
+
+    static PwmGenerator* instance;
+    static void onTimer();
+};
+
+#endif
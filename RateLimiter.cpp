@@ -0,0 +1,67 @@
+#include "RateLimiter.h"
+
+void RateLimiter::setup(uint16_t rate, uint16_t burst)
+{
+  this->rate = rate;
+  this->burst = burst > 0 ? burst : 1;
+  reset();
+}
+
+bool RateLimiter::admit(uint32_t address, uint32_t* retryAfterSeconds)
+{
+  *retryAfterSeconds = 0;
+  if (rate == 0) {
+    return true;
+  }
+
+  uint32_t now = millis();
+  RateLimiterBucket* bucket = findBucket(address, now);
+
+  uint32_t capacity = (uint32_t)burst * RATE_LIMITER_TOKEN;
+  // the elapsed time is capped at a full refill, so the product can't overflow
+  uint32_t elapsed = min(now - bucket->lastMillis, capacity / rate + 1);
+  bucket->tokens = min(bucket->tokens + elapsed * rate, capacity);
+  bucket->lastMillis = now;
+
+  if (bucket->tokens >= RATE_LIMITER_TOKEN) {
+    bucket->tokens -= RATE_LIMITER_TOKEN;
+    return true;
+  }
+
+  uint32_t waitMillis = (RATE_LIMITER_TOKEN - bucket->tokens + rate - 1) / rate;
+  *retryAfterSeconds = (waitMillis + 999) / 1000;
+  rejected++;
+  return false;
+}
+
+void RateLimiter::reset()
+{
+  for (byte bucketIndex = 0; bucketIndex < RATE_LIMITER_SIZE; bucketIndex++) {
+    buckets[bucketIndex].used = false;
+  }
+}
+
+RateLimiterBucket* RateLimiter::findBucket(uint32_t address, uint32_t now)
+{
+  RateLimiterBucket* oldest = &buckets[0];
+  for (byte bucketIndex = 0; bucketIndex < RATE_LIMITER_SIZE; bucketIndex++) {
+    RateLimiterBucket* bucket = &buckets[bucketIndex];
+    if (bucket->used && bucket->address == address) {
+      return bucket;
+    }
+
+    if (!bucket->used) {
+      oldest = bucket;
+    }
+    else if (oldest->used && now - bucket->lastMillis > now - oldest->lastMillis) {
+      oldest = bucket;
+    }
+  }
+
+  // a new client starts with a full bucket
+  oldest->address = address;
+  oldest->tokens = (uint32_t)burst * RATE_LIMITER_TOKEN;
+  oldest->lastMillis = now;
+  oldest->used = true;
+  return oldest;
+}
@@ -0,0 +1,71 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <Arduino.h>
+
+// Number of clients tracked at once, a new client takes the place of the one seen least recently.
+#ifndef RATE_LIMITER_SIZE
+#define RATE_LIMITER_SIZE 8
+#endif
+
+// Requests per second a client may send in the long run, and the number of requests it may send at once.
+// No limit by default, the sketch sets one with setRateLimit().
+#ifndef RATE_LIMITER_DEFAULT_RATE
+#define RATE_LIMITER_DEFAULT_RATE 0
+#endif
+
+#ifndef RATE_LIMITER_DEFAULT_BURST
+#define RATE_LIMITER_DEFAULT_BURST 20
+#endif
+
+// A token is a request, the buckets count them in thousandths, so the refill of every millisecond is an integer.
+#define RATE_LIMITER_TOKEN 1000
+
+struct RateLimiterBucket {
+  uint32_t address = 0;
+  uint32_t tokens = 0;
+  uint32_t lastMillis = 0;
+  bool used = false;
+};
+
+/**
+ * Token buckets of the clients by their address.
+ * A bucket holds up to burst tokens and refills by rate tokens per second, a request takes a token.
+ * A client polling faster than the rate gets refused once its bucket is empty,
+ * while the others still have theirs.
+ */
+class RateLimiter
+{
+  public:
+    uint16_t rate = RATE_LIMITER_DEFAULT_RATE;
+    uint16_t burst = RATE_LIMITER_DEFAULT_BURST;
+
+    // Requests refused since the start.
+    uint32_t rejected = 0;
+
+    /**
+     * @param rate  Requests per second, 0 disables the limit.
+     * @param burst Requests at once, at least 1.
+     */
+    void setup(uint16_t rate, uint16_t burst);
+
+    /**
+     * Takes a token from the bucket of the client.
+     * @param  address           IPv4 address of the client, or a hash of a longer one.
+     * @param  retryAfterSeconds Set to the seconds until the next token if refused.
+     * @return bool              False if the client is over the limit.
+     */
+    bool admit(uint32_t address, uint32_t* retryAfterSeconds);
+
+    /**
+     * Forgets every client.
+     */
+    void reset();
+
+  private:
+    RateLimiterBucket buckets[RATE_LIMITER_SIZE];
+
+    RateLimiterBucket* findBucket(uint32_t address, uint32_t now);
+};
+
+#endif
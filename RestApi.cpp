@@ -0,0 +1,456 @@
+#include "RestApi.h"
+
+void RestApi::setupPlatform(GpioDriver* gpio, SettingsStore* store, SerialPort* serialPort)
+{
+  this->serialPort = serialPort;
+  settings.store = store;
+  pins.setup(&settings, &debug, gpio);
+  serialQueue.setup(serialPort);
+}
+
+HttpResponse RestApi::processRequest(HttpRequest* request)
+{
+  debug.info(F("Processesing request"));
+  debug.info(F("request method: ") + request->method);
+  debug.info(F("request uri: ") + request->uri);
+  debug.info(F("request protocol: ") + request->protocol);
+  debug.info(F("request headers: ") + request->headers);
+  debug.info(F("request data: ") + request->data);
+
+  if (request->method == "options") {
+    return HttpResponse();
+  }
+
+  if (request->uri == "/") {
+    if (request->method == "get") {
+      return HttpResponse(
+        F("name: ") + settings.getNodeName() + "\r\n" +
+        F("hsaVersion: ") + String(HTTP_SERVER_ADVANCED_VERSION) + "\r\n"
+      );
+    }
+
+    if (request->method == "post") {
+      settings.setNodeName(request->data);
+      return HttpResponse();
+    }
+
+    return HttpResponse::BadRequest();
+  }
+
+  //serial
+  if (request->uri == "/serial") {
+    return processRequestOfSerial(request);
+  }
+
+  //digital/{pinNumber}, the subresources of the pins are up to the platform
+  if (request->uri.indexOf("/digital") == 0 && request->uri.indexOf('/', 9) < 0) {
+    return processRequestOfDigital(request);
+  }
+
+  //batch
+  if (request->uri == "/batch") {
+    return processRequestOfBatch(request);
+  }
+
+  //debug
+  if (request->uri == "/debug") {
+    if (request->method == "get") {
+      return HttpResponse(
+        debug.get()
+      );
+    }
+
+    return HttpResponse::BadRequest();
+  }
+
+  return processPlatformRequest(request);
+}
+
+HttpResponse RestApi::processPlatformRequest(HttpRequest* request)
+{
+  return HttpResponse::NotFound();
+}
+
+void RestApi::releasePin(byte digitalPinNumber)
+{
+}
+
+HttpResponse RestApi::processRequestOfSerial(HttpRequest* request)
+{
+  if (request->method == "get") {
+    return HttpResponse(
+      readSerial()
+    );
+  }
+
+  if (request->method == "post") {
+    if (!writeSerial(request->data)) {
+      return HttpResponse::Unacceptable(
+        F("The serial queue is full.")
+      );
+    }
+
+    return HttpResponse();
+  }
+
+  return HttpResponse::BadRequest();
+}
+
+HttpResponse RestApi::processRequestOfDigital(HttpRequest* request)
+{
+  String strPinNumber = request->uri.substring(9);
+
+  byte pinNumber = strPinNumber.toInt();
+  if (String(pinNumber) != strPinNumber) {
+    return HttpResponse::BadRequest(
+      F("The pin number contains non-digit characters.")
+    );
+  }
+
+  if (pinNumber < 0 || pinNumber > 15) {
+    return HttpResponse::BadRequest(
+      F("The pin number is out of range. Range: 0-15")
+    );
+  }
+
+  // GET
+  if (request->method == "get") {
+    return HttpResponse(
+      getPinData(pinNumber)
+    );
+  }
+
+  // If the pin is locked, only get is allowed
+  if (settings.isPinLocked(pinNumber)) {
+    return HttpResponse::Unacceptable(
+      F("The pin is locked, can't set state.\r\n") +
+      getPinData(pinNumber)
+    );
+  }
+
+  // POST
+  if (request->method == "post") {
+    if (settings.getPinMode(pinNumber) != OUTPUT) {
+      return HttpResponse::Unacceptable(
+        F("The pin is not in output mode, can't set state.\r\n") +
+        getPinData(pinNumber)
+      );
+    }
+
+    if (!pins.setState(pinNumber, request->data)) {
+      return HttpResponse::InternalError();
+    }
+
+    return HttpResponse(
+      getPinData(pinNumber)
+    );
+  }
+
+  // PUT
+  if (request->method == "put") {
+    if (settings.isPinInitalized(pinNumber)) {
+      return HttpResponse::Unacceptable(
+        F("The pin is already initialized.\r\n") +
+        getPinData(pinNumber)
+      );
+    }
+
+    if (pins.isReserved(pinNumber)) {
+      return HttpResponse::Unacceptable(
+        F("The pin is used by a bus.\r\n") +
+        getPinData(pinNumber)
+      );
+    }
+
+    if (
+      request->data != "input" &&
+      request->data != "output" &&
+      request->data != "input_pullup"
+    ) {
+      return HttpResponse::BadRequest(
+        F("Bad mode requested. Following is accepted: input, output, input_pullup.")
+      );
+    }
+
+    if (!pins.initPin(pinNumber, request->data)) {
+      return HttpResponse::InternalError();
+    }
+
+    return HttpResponse(
+      getPinData(pinNumber)
+    );
+  }
+
+  // // PATCH
+  // if (request->method == "patch") {
+  //   if (settings.getPinMode(pinNumber) != OUTPUT) {
+  //     return HttpResponse::Unacceptable(
+  //       "The pin is not in output mode, can't set state.\r\n" +
+  //       getPinData(pinNumber)
+  //     );
+  //   }
+
+  //   if (!pins.setState(pinNumber, request->data)) {
+  //     return HttpResponse::InternalError();
+  //   }
+
+  //   return HttpResponse(
+  //     getPinData(pinNumber)
+  //   );
+  // }
+
+  // DELETE
+  if (request->method == "delete") {
+    releasePin(pinNumber);
+    settings.unsetPinInit(pinNumber);
+
+    return HttpResponse(
+      getPinData(pinNumber)
+    );
+  }
+
+  return HttpResponse::BadRequest();
+}
+
+HttpResponse RestApi::processRequestOfBatch(HttpRequest* request)
+{
+  if (request->method != "post") {
+    return HttpResponse::BadRequest();
+  }
+
+  // the data is what has arrived so far, a batch cut short could still parse as a shorter one
+  String strLength = request->getHeader("Content-Length");
+  if (strLength.length() == 0 || strLength != String(request->data.length())) {
+    return HttpResponse::BadRequest(
+      F("The Content-Length of the batch is required, and the whole batch must arrive with the request.")
+    );
+  }
+
+  // every line is checked first, so a malformed batch does not run at all
+  byte operationCount = 0;
+  int lineStart = 0;
+  while (lineStart < (int)request->data.length()) {
+    String line = getBatchLine(request, &lineStart);
+    if (line.length() == 0) {
+      continue;
+    }
+
+    if (operationCount >= BATCH_MAX_OPERATIONS) {
+      return HttpResponse::BadRequest(
+        F("Too many operations, the limit is ") + String(BATCH_MAX_OPERATIONS) + "."
+      );
+    }
+
+    HttpRequest operation;
+    if (!parseBatchOperation(line, &operation)) {
+      return HttpResponse::BadRequest(
+        F("Bad operation on line ") + String(operationCount + 1) + F(", expected: {method} {uri} {data}")
+      );
+    }
+
+    if (operation.uri == "/batch") {
+      return HttpResponse::BadRequest(
+        F("Batches can't be nested.")
+      );
+    }
+
+    if (!isBatchable(&operation)) {
+      return HttpResponse::BadRequest(
+        F("Only the node name and the /digital operations but DELETE can be batched, line ") + String(operationCount + 1) + "."
+      );
+    }
+
+    operationCount++;
+  }
+
+  if (operationCount == 0) {
+    return HttpResponse::BadRequest(
+      F("The batch is empty.")
+    );
+  }
+
+  if (!settings.beginTransaction()) {
+    return HttpResponse::InternalError(
+      F("Could not start the transaction.")
+    );
+  }
+
+  byte pinInits[2] = {settings.pinInits[0], settings.pinInits[1]};
+
+  String results = "";
+  byte operationIndex = 0;
+  lineStart = 0;
+  while (lineStart < (int)request->data.length()) {
+    String line = getBatchLine(request, &lineStart);
+    if (line.length() == 0) {
+      continue;
+    }
+
+    HttpRequest operation;
+    parseBatchOperation(line, &operation);
+    HttpResponse response = processRequest(&operation);
+    operationIndex++;
+
+    results +=
+      "--- " + operation.method + " " + operation.uri + ": " +
+      String(response.code) + " " + response.status + "\r\n" +
+      response.data;
+
+    if (response.code >= 200 && response.code < 300) {
+      continue;
+    }
+
+    // the pins initialized by the batch go back to the reset state, the rest to their stored settings
+    for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+      if (
+        settings.isPinInitalized(digitalPinNumber) &&
+        !settings.readByteSet(pinInits, digitalPinNumber)
+      ) {
+        pins.gpio->setMode(pins.digital2gpio(digitalPinNumber), INPUT);
+      }
+    }
+
+    settings.rollbackTransaction();
+    pins.restorePinModesAndStates();
+
+    return HttpResponse(
+      response.code,
+      response.status,
+      results +
+      F("--- rolled back, ") + String(operationCount - operationIndex) + F(" operations skipped\r\n")
+    );
+  }
+
+  settings.commitTransaction();
+
+  return HttpResponse(
+    results
+  );
+}
+
+bool RestApi::isBatchable(HttpRequest* operation)
+{
+  // the other modules keep their state in RAM too, a rollback of the settings would leave them out of sync,
+  // deleting a pin stops its counter, pwm and rules
+  return
+    operation->uri == "/" ||
+    (operation->uri.indexOf("/digital") == 0 && operation->uri.indexOf('/', 9) < 0 && operation->method != "delete");
+}
+
+String RestApi::getBatchLine(HttpRequest* request, int* lineStart)
+{
+  int lineEnd = request->data.indexOf('\n', *lineStart);
+  if (lineEnd < 0) {
+    lineEnd = request->data.length();
+  }
+
+  String line = request->data.substring(*lineStart, lineEnd);
+  line.trim();
+  *lineStart = lineEnd + 1;
+
+  return line;
+}
+
+bool RestApi::parseBatchOperation(String line, HttpRequest* operation)
+{
+  int delimIndex = line.indexOf(' ');
+  if (delimIndex <= 0) {
+    return false;
+  }
+
+  operation->method = line.substring(0, delimIndex);
+  operation->method.toLowerCase();
+  line.remove(0, delimIndex + 1);
+  line.trim();
+
+  delimIndex = line.indexOf(' ');
+  if (delimIndex < 0) {
+    delimIndex = line.length();
+  }
+
+  operation->uri = line.substring(0, delimIndex);
+  operation->uri.toLowerCase();
+  if (operation->uri.indexOf('/') != 0) {
+    return false;
+  }
+
+  operation->data = line.substring(delimIndex);
+  operation->data.trim();
+  operation->data.replace("\\n", "\n");
+
+  int queryIndex = operation->uri.indexOf('?');
+  if (queryIndex >= 0) {
+    operation->query = operation->uri.substring(queryIndex + 1);
+    operation->uri.remove(queryIndex);
+  }
+
+  return true;
+}
+
+String RestApi::readSerial()
+{
+  debug.info(F("Reading serial data."));
+
+  String serialData;
+  while (serialPort->available()) {
+    serialData += char(serialPort->read());
+  }
+
+  return serialData;
+}
+
+bool RestApi::writeSerial(String data)
+{
+  debug.info(F("Writing serial data."));
+
+  return serialQueue.println(data);
+}
+
+void RestApi::disableEeprom()
+{
+  this->settings.eepromEnabled = false;
+}
+
+void RestApi::enableDebug(bool serial, bool store, bool infoLogs, bool warningLogs, bool errorLogs)
+{
+  debug.enabled = true;
+  debug.serial = serial;
+  debug.store = store;
+
+  debug.infoLogs = infoLogs;
+  debug.warningLogs = warningLogs;
+  debug.errorLogs = errorLogs;
+}
+
+String RestApi::getPinData(byte digitalPinNumber)
+{
+  if (!settings.isPinInitalized(digitalPinNumber)) {
+    return
+      F("initialized: ") +
+        String(settings.isPinInitalized(digitalPinNumber), DEC) +
+        "\r\n" +
+      F("locked: ") +
+        String(settings.isPinLocked(digitalPinNumber), DEC) +
+        "\r\n" +
+      F("state: ?") +
+        "\r\n" +
+      F("mode: ?") +
+        "\r\n"
+    ;
+  }
+
+  return
+    F("initialized: ") +
+      String(settings.isPinInitalized(digitalPinNumber), DEC) +
+      "\r\n" +
+    F("locked: ") +
+      String(settings.isPinLocked(digitalPinNumber), DEC) +
+      "\r\n" +
+    F("state: ") +
+      String(pins.getState(digitalPinNumber), DEC) +
+      "\r\n" +
+    F("mode: ") +
+      String(settings.getPinMode(digitalPinNumber), DEC) +
+      "\r\n"
+  ;
+}
@@ -0,0 +1,121 @@
+#ifndef REST_API_H
+#define REST_API_H
+
+#include <Arduino.h>
+
+#include "version.h"
+
+#include "Platform.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "Settings.h"
+#include "Debug.h"
+#include "Pins.h"
+#include "SerialQueue.h"
+
+// Maximum number of operations in a POST /batch request.
+#ifndef BATCH_MAX_OPERATIONS
+#define BATCH_MAX_OPERATIONS 32
+#endif
+
+/**
+ * The endpoints every platform has: the node name, /serial, /digital, /batch and /debug.
+ * Works only through the platform drivers, the platform specific endpoints are added by processPlatformRequest().
+ */
+class RestApi
+{
+  public:
+    Settings settings;
+    Debug debug;
+    Pins pins;
+    SerialQueue serialQueue;
+    SerialPort* serialPort = nullptr;
+
+    virtual ~RestApi() {}
+
+    /**
+     * Connects the settings, the pins and the serial to the drivers of the platform.
+     * @param gpio
+     * @param store
+     * @param serialPort
+     */
+    void setupPlatform(GpioDriver* gpio, SettingsStore* store, SerialPort* serialPort);
+
+    /**
+     * Processes the request and returns accodringly
+     * If the endpoint cannot be found, returns 404
+     * If the endpoint can be found, but the parameters
+     * or method is not supported, returns 400
+     * If the endpoint can be found, and the parameters are good,
+     * but the operation failed the validation, returns 406
+     * @param  request The request to process
+     * @return         HttpResponse
+     */
+    HttpResponse processRequest(HttpRequest* request);
+
+    HttpResponse processRequestOfSerial(HttpRequest* request);
+    HttpResponse processRequestOfDigital(HttpRequest* request);
+
+    /**
+     * Runs the operations of the batch in order, with the settings in a transaction.
+     * If every operation succeeds, the changes are written to the flash with a single commit,
+     * otherwise the rest of the operations are skipped, and the settings and the pins are rolled back.
+     * Only the node name and the /digital operations are accepted, see isBatchable().
+     * @param  request One operation per line: "{method} {uri} {data}", "\n" in the data stands for a new line.
+     * @return         HttpResponse With the result of every operation run.
+     */
+    HttpResponse processRequestOfBatch(HttpRequest* request);
+
+    String readSerial();
+
+    /**
+     * Queues the data to be written to the serial.
+     * @param  data
+     * @return bool False if the serial queue is full.
+     */
+    bool writeSerial(String data);
+
+    String getPinData(byte digitalPinNumber);
+
+    /**
+     * Disaples reading and writing the eeprom.
+     */
+    void disableEeprom();
+
+    /**
+     * Enables logging either on serial or on the http interface.
+     * @param serial      enables logs to be outputted on the serial
+     * @param store       enables logs to be stored until it can be retrieved by http interface. Warning this can easily fill the RAM.
+     * @param infoLogs    whether to include info logs
+     * @param warningLogs whether to include warning logs
+     * @param errorLogs   whether to include error logs
+     */
+    void enableDebug(bool serial = true, bool store = false, bool infoLogs = true, bool warningLogs = true, bool errorLogs = true);
+
+  protected:
+    /**
+     * Processes the requests of the endpoints of the platform, called if none of the common endpoints matched.
+     * @param  request
+     * @return         HttpResponse 404 if the platform has no such endpoint either.
+     */
+    virtual HttpResponse processPlatformRequest(HttpRequest* request);
+
+    /**
+     * Called when the digital pin is deleted, to stop what the platform does with it.
+     * @param digitalPinNumber
+     */
+    virtual void releasePin(byte digitalPinNumber);
+
+  private:
+    /**
+     * Whether the operation only changes the stored settings and the pins, the ones a rollback restores.
+     * @param  operation
+     * @return bool
+     */
+    bool isBatchable(HttpRequest* operation);
+
+    String getBatchLine(HttpRequest* request, int* lineStart);
+    bool parseBatchOperation(String line, HttpRequest* operation);
+};
+
+#endif
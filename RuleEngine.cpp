@@ -0,0 +1,573 @@
+#include "RuleEngine.h"
+
+void RuleEngine::setup(Settings* settings, Debug* debug, Pins* pins, Scheduler* scheduler)
+{
+  this->settings = settings;
+  this->debug = debug;
+  this->pins = pins;
+  this->scheduler = scheduler;
+
+  for (byte ruleIndex = 0; ruleIndex < RULE_ENGINE_MAX_RULES; ruleIndex++) {
+    rules[ruleIndex].triggerTimerId = TIMER_WHEEL_INVALID_ID;
+    rules[ruleIndex].pulseTimerId = TIMER_WHEEL_INVALID_ID;
+  }
+
+  listenerId = pins->addListener(RuleEngine::onPinEdge, this);
+}
+
+void RuleEngine::restore()
+{
+  StoredRules storedRules;
+  if (!settings->getRules(&storedRules)) {
+    return;
+  }
+
+  detach();
+  for (byte ruleIndex = 0; ruleIndex < storedRules.count; ruleIndex++) {
+    rules[ruleIndex].definition = storedRules.list[ruleIndex];
+    rules[ruleIndex].fired = 0;
+  }
+  count = storedRules.count;
+  attach();
+
+  debug->info(F("Loaded ") + String(count) + F(" rules."));
+
+  evaluateLevels();
+}
+
+byte RuleEngine::add(StoredRule* definition)
+{
+  if (count >= RULE_ENGINE_MAX_RULES) {
+    error = F("There are ") + String(RULE_ENGINE_MAX_RULES) + F(" rules already.");
+    return RULE_NONE;
+  }
+
+  if (!validate(definition)) {
+    return RULE_NONE;
+  }
+
+  detach();
+  rules[count].definition = *definition;
+  rules[count].fired = 0;
+  byte ruleId = count++;
+  attach();
+
+  store();
+  evaluateLevels();
+
+  return ruleId;
+}
+
+bool RuleEngine::remove(byte ruleId)
+{
+  if (ruleId >= count) {
+    return false;
+  }
+
+  detach();
+  for (byte ruleIndex = ruleId; ruleIndex + 1 < count; ruleIndex++) {
+    rules[ruleIndex].definition = rules[ruleIndex + 1].definition;
+    rules[ruleIndex].fired = rules[ruleIndex + 1].fired;
+  }
+  count--;
+  attach();
+
+  store();
+  return true;
+}
+
+void RuleEngine::clear()
+{
+  detach();
+  count = 0;
+  attach();
+
+  store();
+}
+
+byte RuleEngine::removeRulesOfPin(byte digitalPinNumber)
+{
+  detach();
+  byte kept = 0;
+  for (byte ruleIndex = 0; ruleIndex < count; ruleIndex++) {
+    StoredRule* definition = &rules[ruleIndex].definition;
+    if (
+      (definition->trigger != RULE_TRIGGER_TIMER && definition->triggerPin == digitalPinNumber) ||
+      definition->targetPin == digitalPinNumber ||
+      bitRead(definition->conditionMask, digitalPinNumber)
+    ) {
+      continue;
+    }
+
+    rules[kept].definition = *definition;
+    rules[kept].fired = rules[ruleIndex].fired;
+    kept++;
+  }
+  byte removed = count - kept;
+  count = kept;
+  attach();
+
+  if (removed > 0) {
+    debug->info(F("Removed ") + String(removed) + F(" rules of pin ") + String(digitalPinNumber));
+    store();
+  }
+
+  return removed;
+}
+
+void RuleEngine::loop()
+{
+  updateOutputMask();
+
+  noInterrupts();
+  uint32_t pulses = startedPulses;
+  uint16_t changed = changedPins;
+  startedPulses = 0;
+  changedPins = 0;
+  interrupts();
+
+  for (byte ruleIndex = 0; pulses && ruleIndex < count; ruleIndex++) {
+    if (!bitRead(pulses, ruleIndex)) {
+      continue;
+    }
+
+    // a pulse triggered again while it is on is extended
+    Rule* rule = &rules[ruleIndex];
+    scheduler->clearTimeout(rule->pulseTimerId);
+    rule->pulseTimerId = scheduler->setTimeout(rule->definition.durationMillis, RuleEngine::onPulseEnd, rule);
+    if (rule->pulseTimerId == TIMER_WHEEL_INVALID_ID) {
+      debug->error(F("No timer left to end the pulse of rule ") + String(ruleIndex) + "!");
+    }
+  }
+
+  // the states are only kept in RAM, like the states set by a sequence
+  for (byte digitalPinNumber = 0; changed && digitalPinNumber < 16; digitalPinNumber++) {
+    if (bitRead(changed, digitalPinNumber)) {
+      settings->writeByteSet(settings->pinStates, digitalPinNumber, digitalRead(pins->digital2gpio(digitalPinNumber)));
+    }
+  }
+}
+
+String RuleEngine::toString()
+{
+  String report = "";
+  for (byte ruleIndex = 0; ruleIndex < count; ruleIndex++) {
+    StoredRule* definition = &rules[ruleIndex].definition;
+
+    String condition = "";
+    for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+      if (bitRead(definition->conditionMask, digitalPinNumber)) {
+        condition +=
+          (condition.length() > 0 ? "," : "") +
+          String(digitalPinNumber) + "=" +
+          String(bitRead(definition->conditionStates, digitalPinNumber));
+      }
+    }
+
+    report +=
+      "id: " + String(ruleIndex) +
+      F(", trigger: ") + getTriggerName(definition->trigger) +
+      (definition->trigger == RULE_TRIGGER_TIMER
+        ? F(", period: ") + String(definition->periodMillis)
+        : F(", pin: ") + String(definition->triggerPin)) +
+      F(", condition: ") + condition +
+      F(", action: ") + getActionName(definition->action) +
+      F(", target: ") + String(definition->targetPin) +
+      (definition->action == RULE_ACTION_PULSE ? F(", duration: ") + String(definition->durationMillis) : "") +
+      F(", fired: ") + String(rules[ruleIndex].fired) + "\r\n";
+  }
+
+  return report;
+}
+
+int RuleEngine::parseTrigger(String strTrigger)
+{
+  for (byte trigger = RULE_TRIGGER_RISING; trigger <= RULE_TRIGGER_TIMER; trigger++) {
+    if (strTrigger == getTriggerName(trigger)) {
+      return trigger;
+    }
+  }
+
+  return -1;
+}
+
+int RuleEngine::parseAction(String strAction)
+{
+  for (byte action = RULE_ACTION_LOW; action <= RULE_ACTION_PULSE; action++) {
+    if (strAction == getActionName(action)) {
+      return action;
+    }
+  }
+
+  return -1;
+}
+
+bool RuleEngine::parseCondition(String strCondition, uint16_t* conditionMask, uint16_t* conditionStates)
+{
+  *conditionMask = 0;
+  *conditionStates = 0;
+
+  int pairStart = 0;
+  while (pairStart < (int)strCondition.length()) {
+    int pairEnd = strCondition.indexOf(',', pairStart);
+    if (pairEnd < 0) {
+      pairEnd = strCondition.length();
+    }
+
+    String pair = strCondition.substring(pairStart, pairEnd);
+    pair.trim();
+    pairStart = pairEnd + 1;
+
+    int delimIndex = pair.indexOf('=');
+    if (delimIndex <= 0) {
+      return false;
+    }
+
+    String strPinNumber = pair.substring(0, delimIndex);
+    String strState = pair.substring(delimIndex + 1);
+    long pinNumber = strPinNumber.toInt();
+    if (String(pinNumber) != strPinNumber || pinNumber < 0 || pinNumber > 15) {
+      return false;
+    }
+
+    if (strState != "0" && strState != "1") {
+      return false;
+    }
+
+    bitSet(*conditionMask, pinNumber);
+    bitWrite(*conditionStates, pinNumber, strState == "1");
+  }
+
+  return true;
+}
+
+String RuleEngine::getTriggerName(byte trigger)
+{
+  switch (trigger) {
+    case RULE_TRIGGER_RISING:
+      return F("rising");
+    case RULE_TRIGGER_FALLING:
+      return F("falling");
+    case RULE_TRIGGER_CHANGE:
+      return F("change");
+    case RULE_TRIGGER_LOW:
+      return F("low");
+    case RULE_TRIGGER_HIGH:
+      return F("high");
+    case RULE_TRIGGER_TIMER:
+      return F("timer");
+    default:
+      return "";
+  }
+}
+
+String RuleEngine::getActionName(byte action)
+{
+  switch (action) {
+    case RULE_ACTION_LOW:
+      return F("low");
+    case RULE_ACTION_HIGH:
+      return F("high");
+    case RULE_ACTION_TOGGLE:
+      return F("toggle");
+    case RULE_ACTION_PULSE:
+      return F("pulse");
+    default:
+      return "";
+  }
+}
+
+bool RuleEngine::validate(StoredRule* definition)
+{
+  if (definition->trigger > RULE_TRIGGER_TIMER) {
+    error = F("Bad trigger.");
+    return false;
+  }
+
+  if (definition->trigger == RULE_TRIGGER_TIMER) {
+    if (definition->periodMillis < TIMER_WHEEL_TICK_MS) {
+      error = F("The period of the timer must be at least ") + String(TIMER_WHEEL_TICK_MS) + "ms.";
+      return false;
+    }
+  }
+  else {
+    byte triggerPin = definition->triggerPin;
+    if (triggerPin > 15 || !settings->isPinInitalized(triggerPin) || !pins->isInput(triggerPin)) {
+      error = F("The trigger pin must be initialized as input.");
+      return false;
+    }
+
+    if (pins->digital2gpio(triggerPin) == 16) {
+      error = F("D0 has no interrupt, it can't trigger.");
+      return false;
+    }
+  }
+
+  if (definition->action > RULE_ACTION_PULSE) {
+    error = F("Bad action.");
+    return false;
+  }
+
+  if (definition->action == RULE_ACTION_PULSE && definition->durationMillis == 0) {
+    error = F("The duration of the pulse is missing.");
+    return false;
+  }
+
+  byte targetPin = definition->targetPin;
+  if (targetPin > 15 || !settings->isPinInitalized(targetPin) || !pins->isOutput(targetPin) || settings->isPinLocked(targetPin)) {
+    error = F("The target pin must be initialized as output, and can't be locked.");
+    return false;
+  }
+
+  if (definition->conditionStates & ~definition->conditionMask) {
+    error = F("Bad condition.");
+    return false;
+  }
+
+  return true;
+}
+
+void RuleEngine::detach()
+{
+  // nothing may run a rule while the table changes
+  for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+    if (bitRead(listenedPins, digitalPinNumber)) {
+      pins->listen(listenerId, digitalPinNumber, 0);
+    }
+  }
+  listenedPins = 0;
+
+  // the pulses started by the interrupt since the last loop have no timer yet
+  noInterrupts();
+  uint32_t pulses = startedPulses;
+  startedPulses = 0;
+  interrupts();
+
+  for (byte ruleIndex = 0; ruleIndex < count; ruleIndex++) {
+    Rule* rule = &rules[ruleIndex];
+    scheduler->clearTimeout(rule->triggerTimerId);
+    rule->triggerTimerId = TIMER_WHEEL_INVALID_ID;
+
+    // end the running pulses, nothing would end them later
+    if (scheduler->timers.isActive(rule->pulseTimerId) || bitRead(pulses, ruleIndex)) {
+      scheduler->clearTimeout(rule->pulseTimerId);
+      onPulseEnd(rule);
+    }
+    rule->pulseTimerId = TIMER_WHEEL_INVALID_ID;
+  }
+}
+
+void RuleEngine::attach()
+{
+  byte modes[16] = {0};
+
+  for (byte ruleIndex = 0; ruleIndex < count; ruleIndex++) {
+    Rule* rule = &rules[ruleIndex];
+    StoredRule* definition = &rule->definition;
+
+    rule->engine = this;
+    rule->index = ruleIndex;
+    rule->targetGpioMask = 1UL << pins->digital2gpio(definition->targetPin);
+    rule->conditionGpioMask = 0;
+    rule->conditionGpioStates = 0;
+    for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+      if (!bitRead(definition->conditionMask, digitalPinNumber)) {
+        continue;
+      }
+
+      uint32_t gpioBit = 1UL << pins->digital2gpio(digitalPinNumber);
+      rule->conditionGpioMask |= gpioBit;
+      if (bitRead(definition->conditionStates, digitalPinNumber)) {
+        rule->conditionGpioStates |= gpioBit;
+      }
+    }
+
+    switch (definition->trigger) {
+      case RULE_TRIGGER_RISING:
+      case RULE_TRIGGER_HIGH:
+        modes[definition->triggerPin] |= RISING;
+        break;
+      case RULE_TRIGGER_FALLING:
+      case RULE_TRIGGER_LOW:
+        modes[definition->triggerPin] |= FALLING;
+        break;
+      case RULE_TRIGGER_CHANGE:
+        modes[definition->triggerPin] |= CHANGE;
+        break;
+      case RULE_TRIGGER_TIMER:
+        rule->triggerTimerId = scheduler->setTimeout(definition->periodMillis, RuleEngine::onTimer, rule);
+        if (rule->triggerTimerId == TIMER_WHEEL_INVALID_ID) {
+          debug->error(F("No timer left for rule ") + String(ruleIndex) + "!");
+        }
+        break;
+    }
+  }
+
+  updateOutputMask();
+
+  for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+    if (modes[digitalPinNumber] && pins->listen(listenerId, digitalPinNumber, modes[digitalPinNumber])) {
+      bitSet(listenedPins, digitalPinNumber);
+    }
+  }
+}
+
+void RuleEngine::store()
+{
+  StoredRules storedRules;
+  storedRules.count = count;
+  for (byte ruleIndex = 0; ruleIndex < count; ruleIndex++) {
+    storedRules.list[ruleIndex] = rules[ruleIndex].definition;
+  }
+
+  settings->storeRules(&storedRules);
+}
+
+void RuleEngine::updateOutputMask()
+{
+  uint16_t mask = 0;
+  for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+    if (
+      settings->isPinInitalized(digitalPinNumber) &&
+      !settings->isPinLocked(digitalPinNumber) &&
+      pins->isOutput(digitalPinNumber)
+    ) {
+      bitSet(mask, digitalPinNumber);
+    }
+  }
+
+  outputMask = mask;
+}
+
+void RuleEngine::evaluateLevels()
+{
+  for (byte ruleIndex = 0; ruleIndex < count; ruleIndex++) {
+    Rule* rule = &rules[ruleIndex];
+    byte trigger = rule->definition.trigger;
+    if (trigger != RULE_TRIGGER_LOW && trigger != RULE_TRIGGER_HIGH) {
+      continue;
+    }
+
+    byte level = digitalRead(pins->digital2gpio(rule->definition.triggerPin));
+    if (level == (trigger == RULE_TRIGGER_HIGH ? HIGH : LOW)) {
+      noInterrupts();
+      run(rule);
+      interrupts();
+    }
+  }
+}
+
+void IRAM_ATTR RuleEngine::run(Rule* rule)
+{
+  RuleEngine* engine = rule->engine;
+  StoredRule* definition = &rule->definition;
+
+  if (!(engine->outputMask & (1 << definition->targetPin))) {
+    return;
+  }
+
+  uint32_t levels = GPI | (GP16I & 1) << 16;
+  if ((levels & rule->conditionGpioMask) != rule->conditionGpioStates) {
+    return;
+  }
+
+  bool high;
+  switch (definition->action) {
+    case RULE_ACTION_LOW:
+      high = false;
+      break;
+    case RULE_ACTION_TOGGLE:
+      high = !((GPO | (GP16O & 1) << 16) & rule->targetGpioMask);
+      break;
+    case RULE_ACTION_PULSE:
+      engine->startedPulses |= 1UL << rule->index;
+      high = true;
+      break;
+    default:
+      high = true;
+      break;
+  }
+
+  uint32_t mask = rule->targetGpioMask;
+  if (mask & 0x10000) {
+    if (high) {
+      GP16O |= 1;
+    }
+    else {
+      GP16O &= ~1;
+    }
+  }
+  else if (high) {
+    GPOS = mask;
+  }
+  else {
+    GPOC = mask;
+  }
+
+  rule->fired++;
+  engine->changedPins |= 1 << definition->targetPin;
+}
+
+void IRAM_ATTR RuleEngine::onPinEdge(void* context, byte digitalPinNumber, byte level, uint32_t micros)
+{
+  RuleEngine* engine = (RuleEngine*)context;
+
+  for (byte ruleIndex = 0; ruleIndex < engine->count; ruleIndex++) {
+    Rule* rule = &engine->rules[ruleIndex];
+    if (rule->definition.triggerPin != digitalPinNumber) {
+      continue;
+    }
+
+    bool triggered;
+    switch (rule->definition.trigger) {
+      case RULE_TRIGGER_RISING:
+      case RULE_TRIGGER_HIGH:
+        triggered = level == HIGH;
+        break;
+      case RULE_TRIGGER_FALLING:
+      case RULE_TRIGGER_LOW:
+        triggered = level == LOW;
+        break;
+      case RULE_TRIGGER_CHANGE:
+        triggered = true;
+        break;
+      default:
+        triggered = false;
+        break;
+    }
+
+    if (triggered) {
+      run(rule);
+    }
+  }
+}
+
+void RuleEngine::onTimer(void* context)
+{
+  Rule* rule = (Rule*)context;
+
+  // the interrupt may run rules too
+  noInterrupts();
+  run(rule);
+  interrupts();
+
+  rule->triggerTimerId = rule->engine->scheduler->setTimeout(rule->definition.periodMillis, RuleEngine::onTimer, rule);
+}
+
+void RuleEngine::onPulseEnd(void* context)
+{
+  Rule* rule = (Rule*)context;
+  RuleEngine* engine = rule->engine;
+  byte targetPin = rule->definition.targetPin;
+  rule->pulseTimerId = TIMER_WHEEL_INVALID_ID;
+
+  if (!(engine->outputMask & (1 << targetPin))) {
+    return;
+  }
+
+  digitalWrite(engine->pins->digital2gpio(targetPin), LOW);
+
+  noInterrupts();
+  engine->changedPins |= 1 << targetPin;
+  interrupts();
+}
@@ -0,0 +1,163 @@
+#ifndef RULE_ENGINE_H
+#define RULE_ENGINE_H
+
+#include <Arduino.h>
+
+#include "Settings.h"
+#include "Debug.h"
+#include "Pins.h"
+#include "Scheduler.h"
+
+#define RULE_NONE 255
+
+#if RULE_ENGINE_MAX_RULES > 32
+  #error RULE_ENGINE_MAX_RULES must not be more than 32
+#endif
+
+class RuleEngine;
+
+enum RuleTrigger {
+  RULE_TRIGGER_RISING,
+  RULE_TRIGGER_FALLING,
+  RULE_TRIGGER_CHANGE,
+  // The pin went to the level, and when the rules are loaded, the pin is at the level.
+  RULE_TRIGGER_LOW,
+  RULE_TRIGGER_HIGH,
+  RULE_TRIGGER_TIMER
+};
+
+enum RuleAction {
+  RULE_ACTION_LOW,
+  RULE_ACTION_HIGH,
+  RULE_ACTION_TOGGLE,
+  // High for the duration, then low. Triggering it again restarts the duration.
+  RULE_ACTION_PULSE
+};
+
+struct Rule {
+  StoredRule definition;
+
+  // Precalculated GPIO masks, bit 16 is GPIO16, so the interrupt does not have to translate the pins.
+  uint32_t conditionGpioMask;
+  uint32_t conditionGpioStates;
+  uint32_t targetGpioMask;
+
+  volatile uint32_t fired;
+  uint16_t triggerTimerId;
+  uint16_t pulseTimerId;
+
+  // Context of the timers of the rule.
+  RuleEngine* engine;
+  byte index;
+};
+
+/**
+ * Links input pins to output pins without a round-trip to a controller.
+ * The edge and level triggers run the action right in the pin interrupt, the timers
+ * (timer triggers and the end of the pulses) run on the timer wheel of the scheduler.
+ */
+class RuleEngine
+{
+  public:
+    Settings* settings;
+    Debug* debug;
+    Pins* pins;
+    Scheduler* scheduler;
+
+    Rule rules[RULE_ENGINE_MAX_RULES];
+    byte count = 0;
+
+    // Set when the last operation failed, for the http response.
+    String error;
+
+    void setup(Settings* settings, Debug* debug, Pins* pins, Scheduler* scheduler);
+
+    /**
+     * Loads the rules stored in the EEPROM, must be called after the pin modes are restored.
+     */
+    void restore();
+
+    /**
+     * Adds a rule and stores the rules.
+     * @param  definition
+     * @return byte       Id of the rule, or RULE_NONE if the rule is invalid or there are too many, see error.
+     */
+    byte add(StoredRule* definition);
+
+    /**
+     * Removes a rule and stores the rules. The ids of the following rules shift down.
+     * @param  ruleId
+     * @return bool   False if there's no such rule.
+     */
+    bool remove(byte ruleId);
+
+    void clear();
+
+    /**
+     * Removes the rules triggered by, targeting or conditioned on the pin, and stores the rules, for a pin being deleted.
+     * @param  digitalPinNumber
+     * @return byte             Number of rules removed.
+     */
+    byte removeRulesOfPin(byte digitalPinNumber);
+
+    /**
+     * Starts the timers of the pulses started by the interrupt, and updates the stored
+     * pin states of the outputs the rules changed. Must be called from the main loop.
+     */
+    void loop();
+
+    String toString();
+
+    /**
+     * Converts the trigger from the http interface.
+     * @param  strTrigger rising, falling, change, low, high or timer
+     * @return int        One of the RuleTrigger values, or -1 if invalid.
+     */
+    static int parseTrigger(String strTrigger);
+
+    /**
+     * Converts the action from the http interface.
+     * @param  strAction low, high, toggle or pulse
+     * @return int       One of the RuleAction values, or -1 if invalid.
+     */
+    static int parseAction(String strAction);
+
+    /**
+     * Converts the condition from the http interface.
+     * @param  strCondition   Comma separated "{pinNumber}={state}" pairs, e.g. "6=1,7=0", or empty for no condition.
+     * @param  conditionMask   Filled with the bits of the pins.
+     * @param  conditionStates Filled with the bits of the states.
+     * @return bool            False if invalid.
+     */
+    static bool parseCondition(String strCondition, uint16_t* conditionMask, uint16_t* conditionStates);
+
+    static String getTriggerName(byte trigger);
+    static String getActionName(byte action);
+
+  private:
+    byte listenerId = 255;
+
+    // Initialized, unlocked outputs, the only pins the rules may change.
+    volatile uint16_t outputMask = 0;
+    // Rules whose pulse started in the interrupt, and needs its timer started.
+    volatile uint32_t startedPulses = 0;
+    // Pins changed by the rules since the last loop.
+    volatile uint16_t changedPins = 0;
+
+    // Trigger pins the interrupt is attached to.
+    uint16_t listenedPins = 0;
+
+    bool validate(StoredRule* definition);
+    void detach();
+    void attach();
+    void store();
+    void updateOutputMask();
+    void evaluateLevels();
+
+    static void run(Rule* rule);
+    static void onPinEdge(void* context, byte digitalPinNumber, byte level, uint32_t micros);
+    static void onTimer(void* context);
+    static void onPulseEnd(void* context);
+};
+
+#endif
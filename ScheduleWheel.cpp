@@ -0,0 +1,165 @@
+#include "ScheduleWheel.h"
+
+ScheduleWheel::~ScheduleWheel()
+{
+  delete[] nodes;
+}
+
+bool ScheduleWheel::begin(uint16_t capacity, uint32_t tick)
+{
+  delete[] nodes;
+  nodes = new (std::nothrow) ScheduleWheelNode[capacity];
+  if (!nodes) {
+    this->capacity = 0;
+    return false;
+  }
+
+  this->capacity = capacity;
+  this->tick = tick;
+  armedCount = 0;
+
+  for (uint16_t bucket = 0; bucket <= SCHEDULE_WHEEL_EXPIRED; bucket++) {
+    heads[bucket] = SCHEDULE_WHEEL_NONE;
+  }
+
+  for (uint16_t index = 0; index < capacity; index++) {
+    nodes[index].bucket = SCHEDULE_WHEEL_NONE;
+  }
+
+  return true;
+}
+
+void ScheduleWheel::insert(uint16_t index, uint32_t deadline)
+{
+  if (index >= capacity) {
+    return;
+  }
+
+  if (nodes[index].bucket != SCHEDULE_WHEEL_NONE) {
+    unlink(index);
+  }
+  else {
+    armedCount++;
+  }
+
+  nodes[index].deadline = deadline;
+  link(index, getBucket(deadline));
+}
+
+void ScheduleWheel::remove(uint16_t index)
+{
+  if (index >= capacity || nodes[index].bucket == SCHEDULE_WHEEL_NONE) {
+    return;
+  }
+
+  unlink(index);
+  armedCount--;
+}
+
+bool ScheduleWheel::isArmed(uint16_t index)
+{
+  return index < capacity && nodes[index].bucket != SCHEDULE_WHEEL_NONE;
+}
+
+uint32_t ScheduleWheel::getDeadline(uint16_t index)
+{
+  return nodes[index].deadline;
+}
+
+uint32_t ScheduleWheel::getTick()
+{
+  return tick;
+}
+
+uint16_t ScheduleWheel::getArmedCount()
+{
+  return armedCount;
+}
+
+void ScheduleWheel::advance()
+{
+  tick++;
+
+  // the higher levels are cascaded first, so their entries reach the lowest level in the same tick
+  byte levels = 1;
+  while (levels < SCHEDULE_WHEEL_LEVELS && (tick & ((1UL << (SCHEDULE_WHEEL_BITS * levels)) - 1)) == 0) {
+    levels++;
+  }
+  for (byte level = levels - 1; level > 0; level--) {
+    cascade(level * SCHEDULE_WHEEL_SLOTS + ((tick >> (SCHEDULE_WHEEL_BITS * level)) & (SCHEDULE_WHEEL_SLOTS - 1)));
+  }
+
+  // the ones beyond the reach of the wheel wait in the last slot of the top level, they go round again
+  cascade(tick & (SCHEDULE_WHEEL_SLOTS - 1));
+}
+
+uint16_t ScheduleWheel::popExpired()
+{
+  uint16_t index = heads[SCHEDULE_WHEEL_EXPIRED];
+  if (index == SCHEDULE_WHEEL_NONE) {
+    return SCHEDULE_WHEEL_NONE;
+  }
+
+  unlink(index);
+  armedCount--;
+  return index;
+}
+
+void ScheduleWheel::link(uint16_t index, uint16_t bucket)
+{
+  ScheduleWheelNode* node = &nodes[index];
+  node->bucket = bucket;
+  node->prev = SCHEDULE_WHEEL_NONE;
+  node->next = heads[bucket];
+  if (node->next != SCHEDULE_WHEEL_NONE) {
+    nodes[node->next].prev = index;
+  }
+  heads[bucket] = index;
+}
+
+void ScheduleWheel::unlink(uint16_t index)
+{
+  ScheduleWheelNode* node = &nodes[index];
+  if (node->prev != SCHEDULE_WHEEL_NONE) {
+    nodes[node->prev].next = node->next;
+  }
+  else {
+    heads[node->bucket] = node->next;
+  }
+
+  if (node->next != SCHEDULE_WHEEL_NONE) {
+    nodes[node->next].prev = node->prev;
+  }
+
+  node->bucket = SCHEDULE_WHEEL_NONE;
+}
+
+uint16_t ScheduleWheel::getBucket(uint32_t deadline)
+{
+  if ((int32_t)(deadline - tick) <= 0) {
+    return SCHEDULE_WHEEL_EXPIRED;
+  }
+
+  uint32_t delta = deadline - tick;
+  for (byte level = 0; level < SCHEDULE_WHEEL_LEVELS; level++) {
+    if (delta < (1ULL << (SCHEDULE_WHEEL_BITS * (level + 1)))) {
+      return level * SCHEDULE_WHEEL_SLOTS + ((deadline >> (SCHEDULE_WHEEL_BITS * level)) & (SCHEDULE_WHEEL_SLOTS - 1));
+    }
+  }
+
+  // the slot of the top level cascaded last
+  byte topShift = SCHEDULE_WHEEL_BITS * (SCHEDULE_WHEEL_LEVELS - 1);
+  return (SCHEDULE_WHEEL_LEVELS - 1) * SCHEDULE_WHEEL_SLOTS + (((tick >> topShift) - 1) & (SCHEDULE_WHEEL_SLOTS - 1));
+}
+
+void ScheduleWheel::cascade(uint16_t bucket)
+{
+  uint16_t index = heads[bucket];
+  heads[bucket] = SCHEDULE_WHEEL_NONE;
+
+  while (index != SCHEDULE_WHEEL_NONE) {
+    uint16_t next = nodes[index].next;
+    link(index, getBucket(nodes[index].deadline));
+    index = next;
+  }
+}
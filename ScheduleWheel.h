@@ -0,0 +1,86 @@
+#ifndef SCHEDULE_WHEEL_H
+#define SCHEDULE_WHEEL_H
+
+#include <Arduino.h>
+#include <new>
+
+// Every level has 2^SCHEDULE_WHEEL_BITS slots, a slot of a level spans a turn of the level below.
+// With 4 levels of 64 one-second ticks it reaches 194 days ahead, the entries further wait in the last slot.
+#define SCHEDULE_WHEEL_BITS 6
+#define SCHEDULE_WHEEL_SLOTS (1 << SCHEDULE_WHEEL_BITS)
+#define SCHEDULE_WHEEL_LEVELS 4
+
+#define SCHEDULE_WHEEL_NONE 0xFFFF
+// The bucket of the entries due, after the slots of every level.
+#define SCHEDULE_WHEEL_EXPIRED (SCHEDULE_WHEEL_LEVELS * SCHEDULE_WHEEL_SLOTS)
+
+struct ScheduleWheelNode {
+  uint32_t deadline;
+  uint16_t next;
+  uint16_t prev;
+  // Index of the slot it is linked into, SCHEDULE_WHEEL_NONE if it is not armed.
+  uint16_t bucket;
+};
+
+/**
+ * Hierarchical timer wheel of the entries of the schedule, in ticks of the caller.
+ * Arming and cancelling an entry is O(1), a tick costs a slot of the lowest level,
+ * and every SCHEDULE_WHEEL_SLOTS ticks the entries of a slot of the level above are cascaded down.
+ * The entries are identified by their index, the nodes are allocated for all of them by begin().
+ */
+class ScheduleWheel
+{
+  public:
+    ~ScheduleWheel();
+
+    /**
+     * @param  capacity Number of entries, at most SCHEDULE_WHEEL_NONE - 1.
+     * @param  tick     The current tick.
+     * @return bool     False if there's not enough memory.
+     */
+    bool begin(uint16_t capacity, uint32_t tick);
+
+    /**
+     * Arms the entry, or moves it if it is armed already.
+     * @param index
+     * @param deadline Tick it is due at, the entries due already are expired right away.
+     */
+    void insert(uint16_t index, uint32_t deadline);
+
+    void remove(uint16_t index);
+
+    bool isArmed(uint16_t index);
+    uint32_t getDeadline(uint16_t index);
+    uint32_t getTick();
+    uint16_t getArmedCount();
+
+    /**
+     * Moves to the next tick, the entries due at it are expired.
+     */
+    void advance();
+
+    /**
+     * Takes an expired entry off the wheel.
+     * @return uint16_t Its index, SCHEDULE_WHEEL_NONE if there's none.
+     */
+    uint16_t popExpired();
+
+  private:
+    ScheduleWheelNode* nodes = nullptr;
+    uint16_t capacity = 0;
+    uint16_t heads[SCHEDULE_WHEEL_EXPIRED + 1];
+    uint32_t tick = 0;
+    uint16_t armedCount = 0;
+
+    void link(uint16_t index, uint16_t bucket);
+    void unlink(uint16_t index);
+    uint16_t getBucket(uint32_t deadline);
+
+    /**
+     * Inserts the entries of the slot again, they go to a lower level, or expire.
+     * @param bucket
+     */
+    void cascade(uint16_t bucket);
+};
+
+#endif
@@ -0,0 +1,199 @@
+#include "Scheduler.h"
+
+byte Scheduler::addTask(const char* name, TaskCallback callback, void* context, uint32_t periodMillis, uint32_t budgetMicros)
+{
+  if (taskCount >= SCHEDULER_MAX_TASKS) {
+    return SCHEDULER_NO_TASK;
+  }
+
+  ScheduledTask* task = &tasks[taskCount];
+  task->name = name;
+  task->callback = callback;
+  task->context = context;
+  task->periodMillis = periodMillis;
+  task->budgetMicros = budgetMicros;
+  task->nextRunMillis = millis();
+  task->enabled = true;
+  task->periodic = true;
+  task->runs = 0;
+  task->overruns = 0;
+  task->totalMicros = 0;
+  task->maxMicros = 0;
+
+  return taskCount++;
+}
+
+byte Scheduler::addDeadlineTask(const char* name, TaskCallback callback, void* context, uint32_t budgetMicros)
+{
+  byte taskId = addTask(name, callback, context, 0, budgetMicros);
+  if (taskId != SCHEDULER_NO_TASK) {
+    tasks[taskId].enabled = false;
+    tasks[taskId].periodic = false;
+  }
+
+  return taskId;
+}
+
+void Scheduler::wake(byte taskId, uint32_t delayMillis)
+{
+  if (taskId >= taskCount) {
+    return;
+  }
+
+  tasks[taskId].nextRunMillis = millis() + delayMillis;
+  tasks[taskId].enabled = true;
+}
+
+void Scheduler::enable(byte taskId)
+{
+  if (taskId < taskCount) {
+    tasks[taskId].enabled = true;
+  }
+}
+
+void Scheduler::disable(byte taskId)
+{
+  if (taskId < taskCount) {
+    tasks[taskId].enabled = false;
+  }
+}
+
+void Scheduler::run()
+{
+  iterationStartMicros = micros();
+  unsigned long nowMillis = millis();
+
+  timers.advance(nowMillis);
+
+  byte firstIndex = resumeIndex;
+  resumeIndex = 0;
+  for (byte offset = 0; offset < taskCount; offset++) {
+    byte taskIndex = (firstIndex + offset) % taskCount;
+    ScheduledTask* task = &tasks[taskIndex];
+
+    if (!task->enabled || (long)(nowMillis - task->nextRunMillis) < 0) {
+      continue;
+    }
+
+    if (micros() - iterationStartMicros >= SCHEDULER_ITERATION_BUDGET_US) {
+      // the tasks at the end of the order would starve if the next iteration started from the first one again
+      resumeIndex = taskIndex;
+      deferrals++;
+      break;
+    }
+
+    runTask(task, nowMillis);
+  }
+
+  uint32_t iterationMicros = micros() - iterationStartMicros;
+  if (iterationMicros > maxIterationMicros) {
+    maxIterationMicros = iterationMicros;
+  }
+  iterations++;
+}
+
+bool Scheduler::hasBudget()
+{
+  unsigned long nowMicros = micros();
+  if (nowMicros - iterationStartMicros >= SCHEDULER_ITERATION_BUDGET_US) {
+    return false;
+  }
+
+  return !currentTask || nowMicros - taskStartMicros < currentTask->budgetMicros;
+}
+
+uint32_t Scheduler::getIdleMillis()
+{
+  unsigned long nowMillis = millis();
+  uint32_t idleMillis = timers.getIdleMillis(nowMillis);
+
+  // the deferred tasks are due already
+  if (resumeIndex > 0) {
+    return 0;
+  }
+
+  for (byte taskIndex = 0; taskIndex < taskCount; taskIndex++) {
+    ScheduledTask* task = &tasks[taskIndex];
+    if (!task->enabled || (task->periodic && task->periodMillis == 0)) {
+      continue;
+    }
+
+    long untilRunMillis = (long)(task->nextRunMillis - nowMillis);
+    if (untilRunMillis <= 0) {
+      return 0;
+    }
+
+    if ((uint32_t)untilRunMillis < idleMillis) {
+      idleMillis = untilRunMillis;
+    }
+  }
+
+  return idleMillis;
+}
+
+uint16_t Scheduler::setTimeout(uint32_t delayMillis, TimerCallback callback, void* context)
+{
+  return timers.start(delayMillis, callback, context);
+}
+
+void Scheduler::clearTimeout(uint16_t timerId)
+{
+  timers.cancel(timerId);
+}
+
+String Scheduler::getStats()
+{
+  String stats =
+    F("iterations: ") + String(iterations) + "\r\n" +
+    F("deferrals: ") + String(deferrals) + "\r\n" +
+    F("maxIteration: ") + String(maxIterationMicros) + "us\r\n" +
+    F("timers: ") + String(timers.getActiveCount()) + "\r\n";
+
+  for (byte taskIndex = 0; taskIndex < taskCount; taskIndex++) {
+    ScheduledTask* task = &tasks[taskIndex];
+    uint32_t averageMicros = task->runs > 0 ? (uint32_t)(task->totalMicros / task->runs) : 0;
+
+    stats +=
+      String(task->name) + ": " +
+      F("runs: ") + String(task->runs) +
+      F(", overruns: ") + String(task->overruns) +
+      F(", average: ") + String(averageMicros) + "us" +
+      F(", max: ") + String(task->maxMicros) + "us" +
+      F(", budget: ") + String(task->budgetMicros) + "us" +
+      F(", enabled: ") + String(task->enabled, DEC) + "\r\n";
+  }
+
+  return stats;
+}
+
+void Scheduler::runTask(ScheduledTask* task, unsigned long nowMillis)
+{
+  if (task->periodic) {
+    // keep the phase, unless the task fell behind by a whole period
+    task->nextRunMillis += task->periodMillis;
+    if ((long)(nowMillis - task->nextRunMillis) >= 0) {
+      task->nextRunMillis = nowMillis + task->periodMillis;
+    }
+  }
+  else {
+    task->enabled = false;
+  }
+
+  currentTask = task;
+  taskStartMicros = micros();
+
+  task->callback(task->context);
+
+  uint32_t elapsedMicros = micros() - taskStartMicros;
+  currentTask = nullptr;
+
+  task->runs++;
+  task->totalMicros += elapsedMicros;
+  if (elapsedMicros > task->maxMicros) {
+    task->maxMicros = elapsedMicros;
+  }
+
+  if (elapsedMicros > task->budgetMicros) {
+    task->overruns++;
+  }
+}
@@ -0,0 +1,125 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+
+#include "TimerWheel.h"
+
+// HttpServerAdvanced registers up to HTTP_SERVER_TASKS of them, the rest are left to the sketch.
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS 16
+#endif
+
+// Time an iteration of run() may take before the rest of the due tasks are deferred to the next one.
+#ifndef SCHEDULER_ITERATION_BUDGET_US
+#define SCHEDULER_ITERATION_BUDGET_US 20000
+#endif
+
+#define SCHEDULER_NO_TASK 255
+
+typedef void (*TaskCallback)(void* context);
+
+struct ScheduledTask {
+  const char* name;
+  TaskCallback callback;
+  void* context;
+
+  // 0 runs it on every iteration.
+  uint32_t periodMillis;
+  // Time the task should return in, long running work checks hasBudget() and continues on the next run.
+  uint32_t budgetMicros;
+  unsigned long nextRunMillis;
+  bool enabled;
+  // Deadline tasks run once when their deadline passes, then wait for the next wake().
+  bool periodic;
+
+  uint32_t runs;
+  // Number of runs that took longer than the budget.
+  uint32_t overruns;
+  uint64_t totalMicros;
+  uint32_t maxMicros;
+};
+
+/**
+ * Cooperative scheduler, run() is the whole body of the main loop.
+ * Tasks must never block, they do a bounded amount of work and return.
+ */
+class Scheduler
+{
+  public:
+    TimerWheel timers;
+
+    /**
+     * Registers a periodic task.
+     * @param  name         Shown in the stats, must be a string literal or otherwise outlive the scheduler.
+     * @param  callback
+     * @param  context      Passed to the callback.
+     * @param  periodMillis 0 runs it on every iteration.
+     * @param  budgetMicros
+     * @return byte         Id of the task, SCHEDULER_NO_TASK if there are SCHEDULER_MAX_TASKS tasks already.
+     */
+    byte addTask(const char* name, TaskCallback callback, void* context, uint32_t periodMillis, uint32_t budgetMicros);
+
+    /**
+     * Registers a deadline task, it does not run until it is woken up.
+     * @return byte Id of the task, SCHEDULER_NO_TASK if there are SCHEDULER_MAX_TASKS tasks already.
+     */
+    byte addDeadlineTask(const char* name, TaskCallback callback, void* context, uint32_t budgetMicros);
+
+    /**
+     * Runs the task once the delay has passed. Waking it again before it ran moves the deadline.
+     * @param taskId
+     * @param delayMillis
+     */
+    void wake(byte taskId, uint32_t delayMillis = 0);
+
+    void enable(byte taskId);
+    void disable(byte taskId);
+
+    /**
+     * Advances the timers, then runs the due tasks in order. Once the iteration took
+     * SCHEDULER_ITERATION_BUDGET_US, the rest of the due tasks are deferred, and the next
+     * iteration starts with them.
+     */
+    void run();
+
+    /**
+     * Whether the running task is still within its own budget and the budget of the iteration.
+     * @return bool
+     */
+    bool hasBudget();
+
+    /**
+     * Returns the time until the next periodic task with a period, deadline task or timer is due.
+     * The tasks with a period of 0 are polls, they don't keep the node awake, they run on every wake up.
+     * @return uint32_t 0 if something is due, TIMER_WHEEL_IDLE_FOREVER if nothing is scheduled.
+     */
+    uint32_t getIdleMillis();
+
+    /**
+     * Calls the callback once after the delay, from run().
+     * @return uint16_t Id of the timer, TIMER_WHEEL_INVALID_ID if all the timers are in use.
+     */
+    uint16_t setTimeout(uint32_t delayMillis, TimerCallback callback, void* context);
+
+    void clearTimeout(uint16_t timerId);
+
+    String getStats();
+
+  private:
+    ScheduledTask tasks[SCHEDULER_MAX_TASKS];
+    byte taskCount = 0;
+    byte resumeIndex = 0;
+
+    ScheduledTask* currentTask = nullptr;
+    unsigned long taskStartMicros = 0;
+    unsigned long iterationStartMicros = 0;
+
+    uint32_t iterations = 0;
+    uint32_t deferrals = 0;
+    uint32_t maxIterationMicros = 0;
+
+    void runTask(ScheduledTask* task, unsigned long nowMillis);
+};
+
+#endif
@@ -0,0 +1,287 @@
+#include "SequencePlayer.h"
+
+SequencePlayer* SequencePlayer::instance = nullptr;
+
+void SequencePlayer::setup(Settings* settings, Debug* debug, Pins* pins)
+{
+  this->settings = settings;
+  this->debug = debug;
+  this->pins = pins;
+}
+
+bool SequencePlayer::load(String data, uint32_t repeat, uint32_t periodMicros, bool persist)
+{
+  abort();
+
+  stepCount = 0;
+  pinMask = 0;
+  this->repeat = repeat;
+  this->periodMicros = periodMicros;
+  this->persist = persist;
+  error = "";
+
+  uint16_t digitalMasks[SEQUENCE_MAX_STEPS];
+  uint16_t digitalValues[SEQUENCE_MAX_STEPS];
+
+  int lineStart = 0;
+  while (lineStart < (int)data.length()) {
+    int lineEnd = data.indexOf('\n', lineStart);
+    if (lineEnd < 0) {
+      lineEnd = data.length();
+    }
+
+    String line = data.substring(lineStart, lineEnd);
+    lineStart = lineEnd + 1;
+
+    line.trim();
+    if (line.length() == 0) {
+      continue;
+    }
+
+    const char* cursor = line.c_str();
+    char* end;
+    uint32_t offsetMicros = strtoul(cursor, &end, 10);
+    bool valid = end != cursor;
+    cursor = end;
+    uint32_t stepPinMask = strtoul(cursor, &end, 0);
+    valid = valid && end != cursor;
+    cursor = end;
+    uint32_t stepValueMask = strtoul(cursor, &end, 0);
+    valid = valid && end != cursor;
+
+    if (!valid || stepPinMask > 0xFFFF || stepValueMask > 0xFFFF) {
+      return fail(F("Invalid step: ") + line);
+    }
+
+    if (stepCount > 0 && offsetMicros < steps[stepCount - 1].offsetMicros) {
+      return fail(F("The steps must be in the order of their offsets: ") + line);
+    }
+
+    // steps at the same time are merged, the later one wins
+    if (stepCount > 0 && offsetMicros == steps[stepCount - 1].offsetMicros) {
+      byte previous = stepCount - 1;
+      digitalValues[previous] = (digitalValues[previous] & ~stepPinMask) | (stepValueMask & stepPinMask);
+      digitalMasks[previous] |= stepPinMask;
+      pinMask |= stepPinMask;
+      continue;
+    }
+
+    if (stepCount >= SEQUENCE_MAX_STEPS) {
+      return fail(F("Too many steps, the maximum is ") + String(SEQUENCE_MAX_STEPS));
+    }
+
+    steps[stepCount].offsetMicros = offsetMicros;
+    digitalMasks[stepCount] = stepPinMask;
+    digitalValues[stepCount] = stepValueMask & stepPinMask;
+    pinMask |= stepPinMask;
+    stepCount++;
+  }
+
+  if (stepCount == 0) {
+    return fail(F("The sequence is empty."));
+  }
+
+  uint32_t lastOffsetMicros = steps[stepCount - 1].offsetMicros;
+  if (repeat != 1 && periodMicros <= lastOffsetMicros) {
+    return fail(F("The period must be longer than the offset of the last step when repeating."));
+  }
+
+  if (lastOffsetMicros > UINT32_MAX / SEQUENCE_TICKS_PER_MICROSECOND || periodMicros > UINT32_MAX / SEQUENCE_TICKS_PER_MICROSECOND) {
+    return fail(F("The sequence is too long."));
+  }
+
+  for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+    if (!bitRead(pinMask, digitalPinNumber)) {
+      continue;
+    }
+
+    if (
+      !settings->isPinInitalized(digitalPinNumber) ||
+      !pins->isOutput(digitalPinNumber) ||
+      settings->isPinLocked(digitalPinNumber)
+    ) {
+      return fail("Pin " + String(digitalPinNumber) + F(" is not an initialized, unlocked output pin."));
+    }
+
+    if (pins->digital2gpio(digitalPinNumber) == 255) {
+      return fail("Pin " + String(digitalPinNumber) + F(" is out of range."));
+    }
+  }
+
+  // everything the interrupt needs is calculated here, so it only has to write the registers
+  for (byte index = 0; index < stepCount; index++) {
+    SequenceStep* step = &steps[index];
+    step->setMask = 0;
+    step->clearMask = 0;
+
+    for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+      if (!bitRead(digitalMasks[index], digitalPinNumber)) {
+        continue;
+      }
+
+      uint32_t gpioBit = 1UL << pins->digital2gpio(digitalPinNumber);
+      if (bitRead(digitalValues[index], digitalPinNumber)) {
+        step->setMask |= gpioBit;
+      }
+      else {
+        step->clearMask |= gpioBit;
+      }
+    }
+
+    uint32_t nextOffsetMicros = index + 1 < stepCount
+      ? steps[index + 1].offsetMicros
+      : periodMicros + steps[0].offsetMicros;
+
+    step->ticksToNext = max(
+      (uint32_t)SEQUENCE_MIN_TICKS,
+      (nextOffsetMicros - step->offsetMicros) * SEQUENCE_TICKS_PER_MICROSECOND
+    );
+  }
+
+  debug->info(F("Sequence loaded with ") + String(stepCount) + F(" steps."));
+  return true;
+}
+
+bool SequencePlayer::start()
+{
+  if (stepCount == 0 || running) {
+    return false;
+  }
+
+  instance = this;
+  stepIndex = 0;
+  cycles = 0;
+  finished = false;
+  running = true;
+
+  debug->info(F("Starting sequence."));
+
+  timer1_attachInterrupt(SequencePlayer::onTimer);
+  timer1_enable(TIM_DIV16, TIM_EDGE, TIM_SINGLE);
+  schedule(max(
+    (uint32_t)SEQUENCE_MIN_TICKS,
+    steps[0].offsetMicros * SEQUENCE_TICKS_PER_MICROSECOND
+  ));
+
+  return true;
+}
+
+void SequencePlayer::abort()
+{
+  if (!running) {
+    return;
+  }
+
+  timer1_disable();
+  timer1_detachInterrupt();
+
+  debug->info(F("Sequence aborted at step ") + String(stepIndex) + F(" of cycle ") + String(cycles));
+  finish();
+}
+
+void SequencePlayer::loop()
+{
+  if (!finished) {
+    return;
+  }
+
+  timer1_detachInterrupt();
+
+  debug->info(F("Sequence finished after ") + String(cycles) + F(" cycles."));
+  finish();
+}
+
+void SequencePlayer::finish()
+{
+  running = false;
+  finished = false;
+
+  // the interrupt only wrote the registers, bring the stored states up to date in one go
+  for (byte digitalPinNumber = 0; digitalPinNumber < 16; digitalPinNumber++) {
+    if (!bitRead(pinMask, digitalPinNumber)) {
+      continue;
+    }
+
+    byte pinState = digitalRead(pins->digital2gpio(digitalPinNumber));
+    settings->writeByteSet(settings->pinStates, digitalPinNumber, pinState);
+  }
+
+  if (persist) {
+    settings->writeEeprom(EEPROM_INDEX_PINSTATES, settings->pinStates);
+  }
+}
+
+bool SequencePlayer::fail(String error)
+{
+  stepCount = 0;
+  pinMask = 0;
+  this->error = error;
+  debug->error(error);
+  return false;
+}
+
+String SequencePlayer::getStatus()
+{
+  return
+    F("running: ") + String(running, DEC) + "\r\n" +
+    F("steps: ") + String(stepCount) + "\r\n" +
+    F("step: ") + String(stepIndex) + "\r\n" +
+    F("cycles: ") + String(cycles) + "\r\n" +
+    F("repeat: ") + String(repeat) + "\r\n" +
+    F("period: ") + String(periodMicros) + "\r\n" +
+    F("persist: ") + String(persist, DEC) + "\r\n";
+}
+
+void IRAM_ATTR SequencePlayer::onTimer()
+{
+  SequencePlayer* player = instance;
+
+  // the gap is longer than what the timer can count, keep counting
+  if (player->remainingTicks > 0) {
+    schedule(player->remainingTicks);
+    return;
+  }
+
+  SequenceStep* step = &player->steps[player->stepIndex];
+
+  GPOS = step->setMask & 0xFFFF;
+  GPOC = step->clearMask & 0xFFFF;
+  if (step->setMask & SEQUENCE_GPIO16_BIT) {
+    GP16O |= 1;
+  }
+  if (step->clearMask & SEQUENCE_GPIO16_BIT) {
+    GP16O &= ~1;
+  }
+
+  byte nextStepIndex = player->stepIndex + 1;
+  if (nextStepIndex >= player->stepCount) {
+    nextStepIndex = 0;
+    player->cycles++;
+
+    if (player->repeat > 0 && player->cycles >= player->repeat) {
+      timer1_disable();
+      player->finished = true;
+      return;
+    }
+  }
+
+  player->stepIndex = nextStepIndex;
+  schedule(step->ticksToNext);
+}
+
+void IRAM_ATTR SequencePlayer::schedule(uint32_t ticks)
+{
+  if (ticks > SEQUENCE_MAX_TICKS) {
+    // don't leave a remainder too short to schedule
+    uint32_t chunk = ticks - SEQUENCE_MAX_TICKS < SEQUENCE_MIN_TICKS
+      ? SEQUENCE_MAX_TICKS - SEQUENCE_MIN_TICKS
+      : SEQUENCE_MAX_TICKS;
+
+    instance->remainingTicks = ticks - chunk;
+    timer1_write(chunk);
+    return;
+  }
+
+  instance->remainingTicks = 0;
+  timer1_write(ticks);
+}
@@ -0,0 +1,106 @@
+#ifndef SEQUENCE_PLAYER_H
+#define SEQUENCE_PLAYER_H
+
+#include <ESP8266WiFi.h>
+#include <Arduino.h>
+
+#include "Settings.h"
+#include "Debug.h"
+#include "Pins.h"
+
+#ifndef SEQUENCE_MAX_STEPS
+#define SEQUENCE_MAX_STEPS 64
+#endif
+
+// timer1 runs from the 80MHz clock divided by 16
+#define SEQUENCE_TICKS_PER_MICROSECOND 5
+#define SEQUENCE_MAX_TICKS 8388607
+// Steps closer than this are delayed, so the interrupt has time to return before the next one.
+#define SEQUENCE_MIN_TICKS 50
+
+// Bit of GPIO16 in the masks, it is not in the same register as the others.
+#define SEQUENCE_GPIO16_BIT 0x10000
+
+struct SequenceStep {
+  uint32_t offsetMicros;
+  // GPIO masks, bit 16 is GPIO16
+  uint32_t setMask;
+  uint32_t clearMask;
+  // Timer ticks until the next step, for the last step until the first step of the next cycle.
+  uint32_t ticksToNext;
+};
+
+/**
+ * Plays a sequence of timed output changes from the timer1 interrupt.
+ * Uses timer1 exclusively, so it can't be used together with the pwm, analogWrite, tone or Servo.
+ */
+class SequencePlayer
+{
+  public:
+    Settings* settings;
+    Debug* debug;
+    Pins* pins;
+
+    SequenceStep steps[SEQUENCE_MAX_STEPS];
+    byte stepCount = 0;
+
+    // Digital pins changed by the sequence.
+    uint16_t pinMask = 0;
+    // Length of a cycle in microseconds, only used when repeating.
+    uint32_t periodMicros = 0;
+    // Number of cycles to play, 0 is forever.
+    uint32_t repeat = 1;
+    // Whether to store the states of the pins in the EEPROM when the sequence ends.
+    bool persist = false;
+
+    // Description of the last load error.
+    String error = "";
+
+    volatile bool running = false;
+    volatile bool finished = false;
+    volatile byte stepIndex = 0;
+    volatile uint32_t cycles = 0;
+
+    void setup(Settings* settings, Debug* debug, Pins* pins);
+
+    /**
+     * Loads a sequence. Every line of the data is a step: "{offset} {pinMask} {valueMask}", where
+     * offset is the time of the step in microseconds from the start of the cycle, and the masks
+     * are the digital pin numbers as bits, in decimal or 0x prefixed hex.
+     * The pins must be initialized as output and can't be locked.
+     * Stops the sequence being played.
+     * @param  data
+     * @param  repeat        Number of cycles to play, 0 is forever.
+     * @param  periodMicros  Length of a cycle, must be more than the offset of the last step when repeating.
+     * @param  persist       Whether to store the states of the pins in the EEPROM when the sequence ends.
+     * @return bool          False if the sequence is invalid, the reason is in error.
+     */
+    bool load(String data, uint32_t repeat, uint32_t periodMicros, bool persist);
+
+    /**
+     * Starts playing the loaded sequence.
+     * @return bool False if there's no sequence loaded, or it is being played already.
+     */
+    bool start();
+
+    void abort();
+
+    /**
+     * Handles the end of the sequence, must be called from the main loop.
+     */
+    void loop();
+
+    String getStatus();
+
+  private:
+    uint32_t remainingTicks = 0;
+
+    void finish();
+    bool fail(String error);
+
+    static SequencePlayer* instance;
+    static void onTimer();
+    static void schedule(uint32_t ticks);
+};
+
+#endif
@@ -0,0 +1,60 @@
+#include "SerialQueue.h"
+
+void SerialQueue::setup(SerialPort* port)
+{
+  this->port = port;
+}
+
+bool SerialQueue::println(const String& data)
+{
+  if (data.length() + 2 > (size_t)(SERIAL_QUEUE_SIZE - count)) {
+    dropped++;
+    return false;
+  }
+
+  push(data.c_str(), data.length());
+  push("\r\n", 2);
+  return true;
+}
+
+size_t SerialQueue::drain()
+{
+  size_t written = 0;
+
+  while (count > 0) {
+    int room = port->availableForWrite();
+    if (room <= 0) {
+      break;
+    }
+
+    // up to the end of the buffer, the wrapped part goes on the next round
+    size_t length = min((size_t)count, (size_t)(SERIAL_QUEUE_SIZE - tail));
+    length = min(length, (size_t)room);
+
+    length = port->write((const uint8_t*)&buffer[tail], length);
+    if (length == 0) {
+      break;
+    }
+
+    tail = (tail + length) & (SERIAL_QUEUE_SIZE - 1);
+    count -= length;
+    written += length;
+  }
+
+  return written;
+}
+
+bool SerialQueue::isEmpty()
+{
+  return count == 0;
+}
+
+void SerialQueue::push(const char* data, size_t length)
+{
+  for (size_t index = 0; index < length; index++) {
+    buffer[head] = data[index];
+    head = (head + 1) & (SERIAL_QUEUE_SIZE - 1);
+  }
+
+  count += length;
+}
@@ -0,0 +1,51 @@
+#ifndef SERIAL_QUEUE_H
+#define SERIAL_QUEUE_H
+
+#include <Arduino.h>
+
+#include "Platform.h"
+
+// Must be a power of two.
+#ifndef SERIAL_QUEUE_SIZE
+#define SERIAL_QUEUE_SIZE 1024
+#endif
+
+/**
+ * Buffers the serial output, so printing never waits for the uart.
+ * The buffer is written out by drain() as the uart fifo frees up.
+ */
+class SerialQueue
+{
+  public:
+    SerialPort* port = nullptr;
+
+    // Number of messages dropped because the queue was full.
+    uint32_t dropped = 0;
+
+    void setup(SerialPort* port);
+
+    /**
+     * Queues the data followed by a new line. The message is queued whole or not at all.
+     * @param  data
+     * @return bool False if there's no room for it.
+     */
+    bool println(const String& data);
+
+    /**
+     * Writes as much of the queue as the port takes without blocking.
+     * @return size_t Number of bytes written.
+     */
+    size_t drain();
+
+    bool isEmpty();
+
+  private:
+    char buffer[SERIAL_QUEUE_SIZE];
+    uint16_t head = 0;
+    uint16_t tail = 0;
+    uint16_t count = 0;
+
+    void push(const char* data, size_t length);
+};
+
+#endif
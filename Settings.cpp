@@ -6,7 +6,16 @@ void Settings::setup()
     return;
   }
 
-  EEPROM.begin(EEPROM_LENGTH);
+  // the warm state is only written once the EEPROM is initialized, the store is begun on its first use
+  if (restoreWarmState()) {
+    warmStart = true;
+    dataRestored = true;
+    return;
+  }
+
+  if (!openStore()) {
+    return;
+  }
 
   if (!isEepromIdPresent()) {
     initEeprom();
@@ -14,35 +23,144 @@ void Settings::setup()
   }
 
   for (byte byteSetIndex = 0; byteSetIndex < 2; byteSetIndex++) {
-    pinStates[byteSetIndex] = EEPROM.read(EEPROM_INDEX_PINSTATES + byteSetIndex);
-    pinModes[byteSetIndex] = EEPROM.read(EEPROM_INDEX_PINMODES + byteSetIndex);
-    pinPullups[byteSetIndex] = EEPROM.read(EEPROM_INDEX_PINPULLUPS + byteSetIndex);
-    pinInits[byteSetIndex] = EEPROM.read(EEPROM_INDEX_PININITS + byteSetIndex);
-    pinLocks[byteSetIndex] = EEPROM.read(EEPROM_INDEX_PINLOCKS + byteSetIndex);
+    pinStates[byteSetIndex] = store->read(EEPROM_INDEX_PINSTATES + byteSetIndex);
+    pinModes[byteSetIndex] = store->read(EEPROM_INDEX_PINMODES + byteSetIndex);
+    pinPullups[byteSetIndex] = store->read(EEPROM_INDEX_PINPULLUPS + byteSetIndex);
+    pinInits[byteSetIndex] = store->read(EEPROM_INDEX_PININITS + byteSetIndex);
+    pinLocks[byteSetIndex] = store->read(EEPROM_INDEX_PINLOCKS + byteSetIndex);
   }
 
   dataRestored = true;
+  loadWarmState();
+  store->writeWarmState((byte*)&warmState, sizeof(WarmState));
+}
+
+bool Settings::openStore()
+{
+  if (!this->eepromEnabled) {
+    return false;
+  }
+
+  if (storeOpen) {
+    return true;
+  }
+
+  storeOpen = true;
+  if (!store->begin(EEPROM_LENGTH)) {
+    eepromEnabled = false;
+    return false;
+  }
+
+  return true;
+}
+
+bool Settings::restoreWarmState()
+{
+  if (!store->readWarmState((byte*)&warmState, sizeof(WarmState))) {
+    return false;
+  }
+
+  if (
+    warmState.magic != WARM_STATE_MAGIC ||
+    warmState.layout != EEPROM_LENGTH ||
+    warmState.checksum != getChecksum((byte*)&warmState, sizeof(WarmState))
+  ) {
+    warmState.magic = 0;
+    return false;
+  }
+
+  memcpy(pinStates, warmState.pinStates, 2);
+  memcpy(pinModes, warmState.pinModes, 2);
+  memcpy(pinPullups, warmState.pinPullups, 2);
+  memcpy(pinInits, warmState.pinInits, 2);
+  memcpy(pinLocks, warmState.pinLocks, 2);
+
+  warmState.nodeName[30] = 0;
+  nodeName = warmState.nodeName;
+  nodeNameLoaded = true;
+
+  return true;
+}
+
+void Settings::loadWarmState()
+{
+  warmState.magic = WARM_STATE_MAGIC;
+  warmState.layout = EEPROM_LENGTH;
+
+  for (byte byteSetIndex = 0; byteSetIndex < 2; byteSetIndex++) {
+    warmState.pinStates[byteSetIndex] = store->read(EEPROM_INDEX_PINSTATES + byteSetIndex);
+    warmState.pinModes[byteSetIndex] = store->read(EEPROM_INDEX_PINMODES + byteSetIndex);
+    warmState.pinPullups[byteSetIndex] = store->read(EEPROM_INDEX_PINPULLUPS + byteSetIndex);
+    warmState.pinInits[byteSetIndex] = store->read(EEPROM_INDEX_PININITS + byteSetIndex);
+    warmState.pinLocks[byteSetIndex] = store->read(EEPROM_INDEX_PINLOCKS + byteSetIndex);
+  }
+
+  for (byte index = 0; index < 30; index++) {
+    warmState.nodeName[index] = (char)store->read(EEPROM_INDEX_NODENAME + index);
+  }
+  warmState.nodeName[30] = 0;
+
+  store->get(EEPROM_INDEX_WIFICACHE, warmState.wifiCache);
+
+  // only whether they are there, the ones missing are not looked for in the EEPROM
+  warmState.storedMask =
+    (store->read(EEPROM_INDEX_ACCESSPOINTS) == ACCESS_POINTS_MAGIC ? WARM_STATE_STORED_ACCESS_POINTS : 0) |
+    (store->read(EEPROM_INDEX_PINCOUNTERS) == PIN_COUNTERS_MAGIC ? WARM_STATE_STORED_PIN_COUNTERS : 0) |
+    (store->read(EEPROM_INDEX_RULES) == RULES_MAGIC ? WARM_STATE_STORED_RULES : 0) |
+    (store->read(EEPROM_INDEX_PWM) == PWM_MAGIC ? WARM_STATE_STORED_PWM : 0);
+
+  warmState.checksum = getChecksum((byte*)&warmState, sizeof(WarmState));
+}
+
+bool Settings::isStored(byte storedBit)
+{
+  return warmState.magic != WARM_STATE_MAGIC || (warmState.storedMask & storedBit);
+}
+
+void Settings::commitStore()
+{
+  if (!openStore()) {
+    return;
+  }
+
+  // the RAM copy of the store is what the flash holds right after a commit, a failed one leaves the flash unknown
+  if (!store->commit()) {
+    warmState.magic = 0;
+    store->writeWarmState((byte*)&warmState, sizeof(WarmState));
+    return;
+  }
+
+  loadWarmState();
+  store->writeWarmState((byte*)&warmState, sizeof(WarmState));
 }
 
 bool Settings::isEepromIdPresent()
 {
+  if (!openStore()) {
+    return false;
+  }
+
   return
-    EEPROM.read(0) == EEPROM_ID &&
-    EEPROM.read(1) == EEPROM_ID &&
-    EEPROM.read(2) == EEPROM_ID;
+    store->read(0) == EEPROM_ID &&
+    store->read(1) == EEPROM_ID &&
+    store->read(2) == EEPROM_ID;
 }
 
 void Settings::initEeprom()
 {
-  EEPROM.write(0, EEPROM_ID);
-  EEPROM.write(1, EEPROM_ID);
-  EEPROM.write(2, EEPROM_ID);
+  if (!openStore()) {
+    return;
+  }
+
+  store->write(0, EEPROM_ID);
+  store->write(1, EEPROM_ID);
+  store->write(2, EEPROM_ID);
 
   for (int index = 3; index < EEPROM_LENGTH; index++) {
-    EEPROM.write(index, 0);
+    store->write(index, 0);
   }
 
-  EEPROM.commit();
+  commit();
 }
 
 void Settings::storePinMode(byte pinNumber, byte mode)
@@ -149,34 +267,49 @@ void Settings::unsetPinLock(byte pinNumber)
 
 void Settings::writeEeprom(byte eepromIndex, byte* byteSet)
 {
-  if (this->eepromEnabled) {
-    EEPROM.write(eepromIndex, byteSet[0]);
-    EEPROM.write(eepromIndex + 1, byteSet[1]);
-    EEPROM.commit();
+  if (openStore()) {
+    store->write(eepromIndex, byteSet[0]);
+    store->write(eepromIndex + 1, byteSet[1]);
+    commit();
   }
 }
 
 void Settings::setNodeName(String name)
 {
   nodeName = name;
+  nodeNameLoaded = true;
+  nodeNameRevision++;
+
+  if (!openStore()) {
+    return;
+  }
 
   for(int index = 0; index < 30; index++) {
     if (name.length() == index) {
-      EEPROM.write(EEPROM_INDEX_NODENAME + index, 0);
+      store->write(EEPROM_INDEX_NODENAME + index, 0);
     }
     else {
-      EEPROM.write(EEPROM_INDEX_NODENAME + index, (byte)name[index]);
+      store->write(EEPROM_INDEX_NODENAME + index, (byte)name[index]);
     }
   }
 
-  EEPROM.commit();
+  commit();
 }
 
 String Settings::getNodeName()
 {
+  if (nodeNameLoaded) {
+    return nodeName;
+  }
+
+  nodeNameLoaded = true;
   nodeName = "";
+  if (!openStore()) {
+    return nodeName;
+  }
+
   for(int index = 0; index < 30; index++) {
-    char character = (char)EEPROM.read(EEPROM_INDEX_NODENAME + index);
+    char character = (char)store->read(EEPROM_INDEX_NODENAME + index);
 
     if (character <= 0) {
       break;
@@ -186,4 +319,276 @@ String Settings::getNodeName()
   }
 
   return nodeName;
-}
\ No newline at end of file
+}
+
+bool Settings::getWifiCache(WifiCache* wifiCache)
+{
+  if (!this->eepromEnabled) {
+    return false;
+  }
+
+  if (warmState.magic == WARM_STATE_MAGIC) {
+    *wifiCache = warmState.wifiCache;
+  }
+  else if (openStore()) {
+    store->get(EEPROM_INDEX_WIFICACHE, *wifiCache);
+  }
+  else {
+    return false;
+  }
+
+  return
+    wifiCache->magic == WIFI_CACHE_MAGIC &&
+    wifiCache->checksum == getChecksum((byte*)wifiCache, sizeof(WifiCache));
+}
+
+void Settings::storeWifiCache(WifiCache* wifiCache)
+{
+  if (!this->eepromEnabled) {
+    return;
+  }
+
+  wifiCache->magic = WIFI_CACHE_MAGIC;
+  wifiCache->checksum = getChecksum((byte*)wifiCache, sizeof(WifiCache));
+
+  // reconnecting to the same AP is the common case, don't wear the flash with the same data
+  WifiCache storedWifiCache;
+  if (warmState.magic == WARM_STATE_MAGIC) {
+    storedWifiCache = warmState.wifiCache;
+  }
+  else if (openStore()) {
+    store->get(EEPROM_INDEX_WIFICACHE, storedWifiCache);
+  }
+  else {
+    return;
+  }
+
+  if (memcmp(&storedWifiCache, wifiCache, sizeof(WifiCache)) == 0) {
+    return;
+  }
+
+  if (!openStore()) {
+    return;
+  }
+
+  store->put(EEPROM_INDEX_WIFICACHE, *wifiCache);
+  if (warmState.magic == WARM_STATE_MAGIC) {
+    warmState.wifiCache = *wifiCache;
+  }
+  commit();
+}
+
+bool Settings::getAccessPoints(StoredAccessPoints* storedAccessPoints)
+{
+  if (!isStored(WARM_STATE_STORED_ACCESS_POINTS) || !openStore()) {
+    return false;
+  }
+
+  store->get(EEPROM_INDEX_ACCESSPOINTS, *storedAccessPoints);
+
+  return
+    storedAccessPoints->magic == ACCESS_POINTS_MAGIC &&
+    storedAccessPoints->count <= ACCESS_POINT_REGISTRY_SIZE &&
+    storedAccessPoints->checksum == getChecksum((byte*)storedAccessPoints, sizeof(StoredAccessPoints));
+}
+
+void Settings::storeAccessPoints(StoredAccessPoints* storedAccessPoints)
+{
+  if (!openStore()) {
+    return;
+  }
+
+  storedAccessPoints->magic = ACCESS_POINTS_MAGIC;
+  storedAccessPoints->checksum = getChecksum((byte*)storedAccessPoints, sizeof(StoredAccessPoints));
+
+  store->put(EEPROM_INDEX_ACCESSPOINTS, *storedAccessPoints);
+  warmState.storedMask |= WARM_STATE_STORED_ACCESS_POINTS;
+  commit();
+}
+
+bool Settings::getPinCounters(StoredPinCounters* storedPinCounters)
+{
+  if (!isStored(WARM_STATE_STORED_PIN_COUNTERS) || !openStore()) {
+    return false;
+  }
+
+  store->get(EEPROM_INDEX_PINCOUNTERS, *storedPinCounters);
+
+  return
+    storedPinCounters->magic == PIN_COUNTERS_MAGIC &&
+    storedPinCounters->checksum == getChecksum((byte*)storedPinCounters, sizeof(StoredPinCounters));
+}
+
+void Settings::storePinCounters(StoredPinCounters* storedPinCounters)
+{
+  if (!openStore()) {
+    return;
+  }
+
+  storedPinCounters->magic = PIN_COUNTERS_MAGIC;
+  storedPinCounters->checksum = getChecksum((byte*)storedPinCounters, sizeof(StoredPinCounters));
+
+  store->put(EEPROM_INDEX_PINCOUNTERS, *storedPinCounters);
+  warmState.storedMask |= WARM_STATE_STORED_PIN_COUNTERS;
+  commit();
+}
+
+bool Settings::getRules(StoredRules* storedRules)
+{
+  if (!isStored(WARM_STATE_STORED_RULES) || !openStore()) {
+    return false;
+  }
+
+  store->get(EEPROM_INDEX_RULES, *storedRules);
+
+  return
+    storedRules->magic == RULES_MAGIC &&
+    storedRules->count <= RULE_ENGINE_MAX_RULES &&
+    storedRules->checksum == getChecksum((byte*)storedRules, sizeof(StoredRules));
+}
+
+void Settings::storeRules(StoredRules* storedRules)
+{
+  if (!openStore()) {
+    return;
+  }
+
+  storedRules->magic = RULES_MAGIC;
+  storedRules->checksum = getChecksum((byte*)storedRules, sizeof(StoredRules));
+
+  store->put(EEPROM_INDEX_RULES, *storedRules);
+  warmState.storedMask |= WARM_STATE_STORED_RULES;
+  commit();
+}
+
+bool Settings::getPwm(StoredPwm* storedPwm)
+{
+  if (!isStored(WARM_STATE_STORED_PWM) || !openStore()) {
+    return false;
+  }
+
+  store->get(EEPROM_INDEX_PWM, *storedPwm);
+
+  return
+    storedPwm->magic == PWM_MAGIC &&
+    storedPwm->checksum == getChecksum((byte*)storedPwm, sizeof(StoredPwm));
+}
+
+void Settings::storePwm(StoredPwm* storedPwm)
+{
+  if (!openStore()) {
+    return;
+  }
+
+  storedPwm->magic = PWM_MAGIC;
+  storedPwm->checksum = getChecksum((byte*)storedPwm, sizeof(StoredPwm));
+
+  store->put(EEPROM_INDEX_PWM, *storedPwm);
+  warmState.storedMask |= WARM_STATE_STORED_PWM;
+  commit();
+}
+
+void Settings::commit()
+{
+  if (deferCommits || transaction) {
+    dirty = true;
+    return;
+  }
+
+  commitStore();
+}
+
+void Settings::flush()
+{
+  if (!dirty || transaction) {
+    return;
+  }
+
+  dirty = false;
+  commitStore();
+}
+
+bool Settings::beginTransaction()
+{
+  if (transaction) {
+    return false;
+  }
+
+  transaction = new (std::nothrow) SettingsSnapshot;
+  if (!transaction) {
+    return false;
+  }
+
+  memcpy(transaction->pinStates, pinStates, 2);
+  memcpy(transaction->pinModes, pinModes, 2);
+  memcpy(transaction->pinPullups, pinPullups, 2);
+  memcpy(transaction->pinInits, pinInits, 2);
+  memcpy(transaction->pinLocks, pinLocks, 2);
+  transaction->dirty = dirty;
+
+  if (openStore()) {
+    for (int index = 0; index < EEPROM_TRANSACTION_LENGTH; index++) {
+      transaction->eeprom[index] = store->read(index);
+    }
+  }
+
+  return true;
+}
+
+void Settings::commitTransaction()
+{
+  if (!transaction) {
+    return;
+  }
+
+  delete transaction;
+  transaction = nullptr;
+
+  // the deferred changes from before the transaction go with this commit too
+  flush();
+}
+
+void Settings::rollbackTransaction()
+{
+  if (!transaction) {
+    return;
+  }
+
+  memcpy(pinStates, transaction->pinStates, 2);
+  memcpy(pinModes, transaction->pinModes, 2);
+  memcpy(pinPullups, transaction->pinPullups, 2);
+  memcpy(pinInits, transaction->pinInits, 2);
+  memcpy(pinLocks, transaction->pinLocks, 2);
+  dirty = transaction->dirty;
+
+  if (openStore()) {
+    for (int index = 0; index < EEPROM_TRANSACTION_LENGTH; index++) {
+      store->write(index, transaction->eeprom[index]);
+    }
+
+    // the cached copies follow the restored bytes, the RTC memory is only written by the next commit
+    if (warmState.magic == WARM_STATE_MAGIC) {
+      loadWarmState();
+    }
+  }
+
+  delete transaction;
+  transaction = nullptr;
+
+  // the ones built from the name rebuild, if the batch changed it
+  String discardedName = nodeName;
+  nodeNameLoaded = false;
+  if (getNodeName() != discardedName) {
+    nodeNameRevision++;
+  }
+}
+
+byte Settings::getChecksum(byte* bytes, size_t length)
+{
+  byte checksum = 0;
+  for (size_t index = 0; index < length - 1; index++) {
+    checksum = (checksum << 1 | checksum >> 7) ^ bytes[index];
+  }
+
+  return checksum;
+}
@@ -1,9 +1,10 @@
 #ifndef SETTINGS_H
 #define SETTINGS_H
 
-#include <ESP8266WiFi.h>
 #include <Arduino.h>
-#include <EEPROM.h>
+#include <new>
+
+#include "Platform.h"
 
 #define EEPROM_ID 112
 #define EEPROM_INDEX_PINMODES 3
@@ -12,7 +13,151 @@
 #define EEPROM_INDEX_PININITS 9
 #define EEPROM_INDEX_PINLOCKS 11
 #define EEPROM_INDEX_NODENAME 13
-#define EEPROM_LENGTH 44
+#define EEPROM_INDEX_WIFICACHE 44
+#define EEPROM_INDEX_ACCESSPOINTS (EEPROM_INDEX_WIFICACHE + (int)sizeof(WifiCache))
+#define EEPROM_INDEX_PINCOUNTERS (EEPROM_INDEX_ACCESSPOINTS + (int)sizeof(StoredAccessPoints))
+#define EEPROM_INDEX_RULES (EEPROM_INDEX_PINCOUNTERS + (int)sizeof(StoredPinCounters))
+#define EEPROM_INDEX_PWM (EEPROM_INDEX_RULES + (int)sizeof(StoredRules))
+#define EEPROM_LENGTH (EEPROM_INDEX_PWM + (int)sizeof(StoredPwm))
+// The part a transaction can change, the pin settings and the node name.
+#define EEPROM_TRANSACTION_LENGTH EEPROM_INDEX_WIFICACHE
+
+#define WIFI_CACHE_MAGIC 0xA5
+#define ACCESS_POINTS_MAGIC 0xA6
+#define PIN_COUNTERS_MAGIC 0xA7
+#define RULES_MAGIC 0xA8
+#define PWM_MAGIC 0xA9
+#define WARM_STATE_MAGIC 0xAA
+
+// Bits of WarmState::storedMask, the structures present in the EEPROM.
+#define WARM_STATE_STORED_ACCESS_POINTS 1
+#define WARM_STATE_STORED_PIN_COUNTERS 2
+#define WARM_STATE_STORED_RULES 4
+#define WARM_STATE_STORED_PWM 8
+
+// Maximum number of access points, both the ones added in the sketch and the ones stored in the EEPROM.
+// Changing it changes the EEPROM layout, the stored access points are dropped.
+#ifndef ACCESS_POINT_REGISTRY_SIZE
+#define ACCESS_POINT_REGISTRY_SIZE 8
+#endif
+
+// Maximum number of rules of the rule engine.
+// Changing it changes the EEPROM layout, the stored rules are dropped.
+#ifndef RULE_ENGINE_MAX_RULES
+#define RULE_ENGINE_MAX_RULES 16
+#endif
+
+/**
+ * Parameters of the last successful wifi connection, used to reconnect without scanning.
+ * The ip fields are only used if ipCached is set.
+ */
+struct __attribute__((packed)) WifiCache {
+  byte magic = 0;
+  uint32_t ssidHash = 0;
+  byte bssid[6] = {0,0,0,0,0,0};
+  byte channel = 0;
+  bool ipCached = false;
+  uint32_t ip = 0;
+  uint32_t gateway = 0;
+  uint32_t subnet = 0;
+  uint32_t dns = 0;
+  byte checksum = 0;
+};
+
+struct __attribute__((packed)) StoredAccessPoint {
+  char ssid[33];
+  char psk[65];
+  byte priority;
+};
+
+/**
+ * The access points added over the http interface.
+ */
+struct __attribute__((packed)) StoredAccessPoints {
+  byte magic = 0;
+  byte count = 0;
+  StoredAccessPoint list[ACCESS_POINT_REGISTRY_SIZE];
+  byte checksum = 0;
+};
+
+/**
+ * The pins in counter mode, and their settings.
+ */
+struct __attribute__((packed)) StoredPinCounters {
+  byte magic = 0;
+  uint16_t pinMask = 0;
+  byte edges[16];
+  uint32_t debounceMicros[16];
+  byte checksum = 0;
+};
+
+/**
+ * A rule of the rule engine: when the trigger happens and the condition holds, the action is done on the target pin.
+ */
+struct __attribute__((packed)) StoredRule {
+  byte trigger;
+  byte triggerPin;
+  // Pins that must be in the given states for the action to be done, bits of the digital pins.
+  uint16_t conditionMask;
+  uint16_t conditionStates;
+  byte action;
+  byte targetPin;
+  // Interval of the timer trigger.
+  uint32_t periodMillis;
+  // Length of the pulse action.
+  uint32_t durationMillis;
+};
+
+struct __attribute__((packed)) StoredRules {
+  byte magic = 0;
+  byte count = 0;
+  StoredRule list[RULE_ENGINE_MAX_RULES];
+  byte checksum = 0;
+};
+
+/**
+ * The pins in pwm mode, their duty in permille, and the frequency of all of them.
+ */
+struct __attribute__((packed)) StoredPwm {
+  byte magic = 0;
+  uint16_t frequency = 0;
+  uint16_t pinMask = 0;
+  uint16_t duty[16];
+  byte checksum = 0;
+};
+
+/**
+ * The settings read on every boot, as they are in the flash, kept in memory that survives a deep sleep.
+ * With a valid one the EEPROM is not read at all, unless one of the structures marked in storedMask is needed,
+ * or something is written. The layout makes the one of a firmware with another EEPROM layout invalid.
+ */
+struct __attribute__((packed)) WarmState {
+  byte magic = 0;
+  uint16_t layout = 0;
+  byte pinStates[2];
+  byte pinModes[2];
+  byte pinPullups[2];
+  byte pinInits[2];
+  byte pinLocks[2];
+  char nodeName[31];
+  WifiCache wifiCache;
+  byte storedMask = 0;
+  byte checksum = 0;
+};
+
+/**
+ * Copy of the settings taken when a transaction begins, written back if it is rolled back.
+ * Only the start of the EEPROM is copied, the batches only change the pin settings and the node name.
+ */
+struct SettingsSnapshot {
+  byte pinStates[2];
+  byte pinModes[2];
+  byte pinPullups[2];
+  byte pinInits[2];
+  byte pinLocks[2];
+  bool dirty;
+  byte eeprom[EEPROM_TRANSACTION_LENGTH];
+};
 
 class Settings
 {
@@ -24,9 +169,24 @@ class Settings
     byte pinLocks[2] = {0,0};
 
     String nodeName = "";
+    // Incremented by setNodeName(), so the ones built from the name know when to rebuild.
+    uint16_t nodeNameRevision = 0;
+
+    // Where the settings are stored, the EEPROM on the ESP8266.
+    SettingsStore* store = nullptr;
 
     bool eepromEnabled = true;
     bool dataRestored = false;
+    // Whether the settings were restored from the warm state, without reading the EEPROM.
+    bool warmStart = false;
+
+    // Whether commit() only marks the EEPROM dirty, and flush() writes it to the flash later.
+    // A burst of changes costs one flash write this way, but the changes since the last flush are lost on a reset.
+    bool deferCommits = false;
+    bool dirty = false;
+
+    // Set while a transaction is open, the changes are only committed when it ends.
+    SettingsSnapshot* transaction = nullptr;
 
     void setup();
 
@@ -59,7 +219,131 @@ class Settings
     void writeEeprom(byte eepromIndex, byte* byteSet);
 
     void setNodeName(String name);
+
+    /**
+     * Returns the node name, it is only read from the EEPROM the first time.
+     * @return String
+     */
     String getNodeName();
+
+    /**
+     * Reads the cached wifi connection parameters.
+     * @param  wifiCache Filled with the cached values.
+     * @return bool      False if there's no valid cache stored.
+     */
+    bool getWifiCache(WifiCache* wifiCache);
+
+    /**
+     * Stores the wifi connection parameters, if they differ from the stored ones.
+     * @param wifiCache
+     */
+    void storeWifiCache(WifiCache* wifiCache);
+
+    /**
+     * Reads the access points stored in the EEPROM.
+     * @param  storedAccessPoints Filled with the stored access points.
+     * @return bool               False if there's no valid list stored.
+     */
+    bool getAccessPoints(StoredAccessPoints* storedAccessPoints);
+
+    void storeAccessPoints(StoredAccessPoints* storedAccessPoints);
+
+    /**
+     * Reads the pin counter settings stored in the EEPROM.
+     * @param  storedPinCounters Filled with the stored settings.
+     * @return bool              False if there are no valid settings stored.
+     */
+    bool getPinCounters(StoredPinCounters* storedPinCounters);
+
+    void storePinCounters(StoredPinCounters* storedPinCounters);
+
+    /**
+     * Reads the rules stored in the EEPROM.
+     * @param  storedRules Filled with the stored rules.
+     * @return bool        False if there are no valid rules stored.
+     */
+    bool getRules(StoredRules* storedRules);
+
+    void storeRules(StoredRules* storedRules);
+
+    /**
+     * Reads the pwm settings stored in the EEPROM.
+     * @param  storedPwm Filled with the stored settings.
+     * @return bool      False if there are no valid settings stored.
+     */
+    bool getPwm(StoredPwm* storedPwm);
+
+    void storePwm(StoredPwm* storedPwm);
+
+    /**
+     * Writes the changes to the flash, or only marks them to be written if the commits are deferred.
+     */
+    void commit();
+
+    /**
+     * Writes the deferred changes to the flash, if there are any.
+     */
+    void flush();
+
+    /**
+     * Starts collecting the changes in RAM, they are committed together by commitTransaction(),
+     * or undone by rollbackTransaction(). Transactions can't be nested.
+     * @return bool False if a transaction is open already, or there's not enough memory for the snapshot.
+     */
+    bool beginTransaction();
+
+    /**
+     * Ends the transaction, and writes its changes to the flash with a single commit.
+     */
+    void commitTransaction();
+
+    /**
+     * Ends the transaction, and restores the settings to the state when it began.
+     * Only the stored settings are restored, the pins have to be restored by the caller.
+     */
+    void rollbackTransaction();
+
+    /**
+     * Checksum of the stored structures, calculated over everything but the last byte, which is the checksum itself.
+     * @param  bytes
+     * @param  length Length of the structure, including the checksum.
+     * @return byte
+     */
+    byte getChecksum(byte* bytes, size_t length);
+
+  private:
+    WarmState warmState;
+    bool nodeNameLoaded = false;
+    bool storeOpen = false;
+
+    /**
+     * Begins the store on its first use, so a warm start doesn't read the whole EEPROM into RAM.
+     * @return bool False if the EEPROM is disabled or not available.
+     */
+    bool openStore();
+
+    /**
+     * Restores the settings from the warm state of the store.
+     * @return bool False if there's no valid warm state, e.g. after a power loss.
+     */
+    bool restoreWarmState();
+
+    /**
+     * Fills the warm state from the RAM copy of the store.
+     */
+    void loadWarmState();
+
+    /**
+     * Whether the structure may be in the EEPROM, false only if the warm state knows it is not.
+     * @param  storedBit One of WARM_STATE_STORED_*.
+     * @return bool
+     */
+    bool isStored(byte storedBit);
+
+    /**
+     * Commits the store, then writes the warm state from what was committed, so it never gets ahead of the flash.
+     */
+    void commitStore();
 };
 
 #endif
@@ -0,0 +1,223 @@
+#include "StaticFiles.h"
+
+void StaticFiles::setup(Debug* debug, Scheduler* scheduler)
+{
+  this->debug = debug;
+  this->scheduler = scheduler;
+}
+
+void StaticFiles::begin()
+{
+  if (!enabled) {
+    return;
+  }
+
+  if (!LittleFS.begin()) {
+    debug->error(F("Could not mount LittleFS, the static files are not served."));
+    enabled = false;
+  }
+}
+
+bool StaticFiles::serve(HttpRequest* request, WiFiClient* client)
+{
+  if (!enabled || request->method != "get" || request->uri.indexOf(STATIC_FILES_URI_PREFIX) != 0) {
+    return false;
+  }
+
+  // the prefix is a whole segment, /uifoo is not under it
+  unsigned int prefixLength = strlen(STATIC_FILES_URI_PREFIX);
+  if (request->uri.length() > prefixLength && request->uri[prefixLength] != '/') {
+    return false;
+  }
+
+  // LittleFS resolves the parent directories, they would reach the files outside the root
+  String relativePath = request->originalUri.substring(prefixLength);
+  if (relativePath.indexOf("..") >= 0 || relativePath.indexOf("//") >= 0) {
+    client->print(HttpResponse::BadRequest(F("Bad path.")).toString());
+    client->stop();
+    return true;
+  }
+
+  if (serving) {
+    HttpResponse response(503, F("Service Unavailable"), F("Another file is being served."));
+    response.headers = F("Retry-After: 1\r\n");
+    client->print(response.toString());
+    client->stop();
+    return true;
+  }
+
+  String path = STATIC_FILES_ROOT + relativePath;
+  if (path.endsWith("/")) {
+    path += F("index.html");
+  }
+
+  // a directory is served by its index
+  if (path.indexOf('.', path.lastIndexOf('/')) < 0) {
+    path += F("/index.html");
+  }
+
+  bool gzip = false;
+  if (request->getHeader("Accept-Encoding").indexOf("gzip") >= 0 && LittleFS.exists(path + ".gz")) {
+    gzip = true;
+  }
+  else if (!LittleFS.exists(path)) {
+    return false;
+  }
+
+  file = LittleFS.open(gzip ? path + ".gz" : path, "r");
+  if (!file) {
+    return false;
+  }
+
+  String etag = getEtag(&file);
+
+  // the html refers to the other files, it is revalidated every time, the rest for a while
+  String cacheControl = path.endsWith(".html")
+    ? String(F("no-cache"))
+    : F("public, max-age=") + String(STATIC_FILES_MAX_AGE);
+
+  String headers =
+    F("Content-Type: ") + getContentType(path) + "\r\n" +
+    F("Cache-Control: ") + cacheControl + "\r\n" +
+    F("ETag: ") + etag + "\r\n" +
+    F("Vary: Accept-Encoding\r\n") +
+    F("Connection: close\r\n");
+
+  if (request->getHeader("If-None-Match") == etag) {
+    file.close();
+    client->print(F("HTTP/1.1 304 Not Modified\r\n") + headers + "\r\n");
+    client->stop();
+    return true;
+  }
+
+  remaining = file.size();
+  client->print(
+    F("HTTP/1.1 200 OK\r\n") + headers +
+    (gzip ? F("Content-Encoding: gzip\r\n") : F("")) +
+    F("Content-Length: ") + String(remaining) + "\r\n" +
+    "\r\n"
+  );
+
+  debug->info(F("Serving ") + path + (gzip ? F(" gzipped") : F("")) + ", " + String(remaining) + F(" bytes"));
+
+  this->client = *client;
+  serving = true;
+  restartStallTimer();
+  loop();
+  return true;
+}
+
+void StaticFiles::loop()
+{
+  if (!serving) {
+    return;
+  }
+
+  if (!client.connected()) {
+    debug->warn(F("The client disconnected during the transfer."));
+    finish();
+    return;
+  }
+
+  byte chunk[STATIC_FILES_CHUNK_SIZE];
+  bool written = false;
+  while (remaining > 0 && scheduler->hasBudget()) {
+    // only as much as the socket takes without waiting
+    int room = client.availableForWrite();
+    if (room <= 0) {
+      break;
+    }
+
+    size_t length = file.read(chunk, min((size_t)room, min((size_t)STATIC_FILES_CHUNK_SIZE, (size_t)remaining)));
+    if (length == 0) {
+      debug->error(F("Could not read ") + String(file.name()) + "!");
+      finish();
+      return;
+    }
+
+    client.write(chunk, length);
+    remaining -= length;
+    written = true;
+  }
+
+  if (remaining == 0) {
+    finish();
+    return;
+  }
+
+  if (written) {
+    restartStallTimer();
+  }
+}
+
+bool StaticFiles::isServing()
+{
+  return serving;
+}
+
+String StaticFiles::getEtag(File* file)
+{
+  // the files only change by uploading the file system, the new image has their new modification times
+  return F("\"") + String(file->size(), HEX) + "-" + String((uint32_t)file->getLastWrite(), HEX) + "\"";
+}
+
+String StaticFiles::getContentType(String path)
+{
+  if (path.endsWith(".html")) {
+    return F("text/html");
+  }
+
+  if (path.endsWith(".css")) {
+    return F("text/css");
+  }
+
+  if (path.endsWith(".js")) {
+    return F("application/javascript");
+  }
+
+  if (path.endsWith(".json")) {
+    return F("application/json");
+  }
+
+  if (path.endsWith(".svg")) {
+    return F("image/svg+xml");
+  }
+
+  if (path.endsWith(".png")) {
+    return F("image/png");
+  }
+
+  if (path.endsWith(".ico")) {
+    return F("image/x-icon");
+  }
+
+  if (path.endsWith(".txt")) {
+    return F("text/plain");
+  }
+
+  return F("application/octet-stream");
+}
+
+void StaticFiles::finish()
+{
+  scheduler->clearTimeout(stallTimerId);
+  stallTimerId = TIMER_WHEEL_INVALID_ID;
+  file.close();
+  client.stop();
+  serving = false;
+  remaining = 0;
+}
+
+void StaticFiles::restartStallTimer()
+{
+  scheduler->clearTimeout(stallTimerId);
+  stallTimerId = scheduler->setTimeout(STATIC_FILES_STALL_TIMEOUT_MS, StaticFiles::onStall, this);
+}
+
+void StaticFiles::onStall(void* context)
+{
+  StaticFiles* staticFiles = (StaticFiles*)context;
+  staticFiles->stallTimerId = TIMER_WHEEL_INVALID_ID;
+  staticFiles->debug->warn(F("The client took nothing for ") + String(STATIC_FILES_STALL_TIMEOUT_MS) + F("ms, the transfer is aborted."));
+  staticFiles->finish();
+}
@@ -0,0 +1,80 @@
+#ifndef STATIC_FILES_H
+#define STATIC_FILES_H
+
+#include <ESP8266WiFi.h>
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "Scheduler.h"
+#include "Debug.h"
+
+// The uri prefix of the static files, and the directory on LittleFS they are served from.
+#define STATIC_FILES_URI_PREFIX "/ui"
+#define STATIC_FILES_ROOT "/www"
+
+// Size of the buffer the files are streamed through, the only RAM a transfer needs.
+#define STATIC_FILES_CHUNK_SIZE 1024
+
+// The files are not fingerprinted, so the browsers only use their copy this long before revalidating it by the ETag.
+#define STATIC_FILES_MAX_AGE 300
+
+// A transfer is aborted when the client took nothing for this long, so a client not reading can't hold the server.
+#define STATIC_FILES_STALL_TIMEOUT_MS 10000
+
+/**
+ * Serves the files of the LittleFS directory STATIC_FILES_ROOT under STATIC_FILES_URI_PREFIX.
+ * The file is streamed to the socket a chunk at a time by loop(), as the socket takes it,
+ * so a large file neither needs the RAM nor blocks the loop. A file is served at a time,
+ * the other requests are answered meanwhile.
+ */
+class StaticFiles
+{
+  public:
+    Debug* debug;
+    Scheduler* scheduler;
+
+    bool enabled = false;
+
+    void setup(Debug* debug, Scheduler* scheduler);
+
+    /**
+     * Mounts the file system, if the static files are enabled.
+     */
+    void begin();
+
+    /**
+     * Starts serving the requested file. Prefers the .gz variant if the client accepts gzip,
+     * and answers 304 if the client has the same version already. The file names are case sensitive,
+     * the paths with ".." or "//" are refused, and 503 is answered while another file is being served.
+     * @param  request
+     * @param  client
+     * @return bool    False if the request is not for a static file, or the file does not exist.
+     */
+    bool serve(HttpRequest* request, WiFiClient* client);
+
+    /**
+     * Writes the next chunks of the file being served, as long as the socket takes them and the task has budget.
+     * Closes the connection at the end of the file, or if the client took nothing for STATIC_FILES_STALL_TIMEOUT_MS.
+     */
+    void loop();
+
+    bool isServing();
+
+  private:
+    File file;
+    WiFiClient client;
+    bool serving = false;
+    uint32_t remaining = 0;
+    uint16_t stallTimerId = TIMER_WHEEL_INVALID_ID;
+
+    String getEtag(File* file);
+    String getContentType(String path);
+    void finish();
+    void restartStallTimer();
+
+    static void onStall(void* context);
+};
+
+#endif
@@ -4,20 +4,80 @@ void StatusLed::setup()
 {
   if (ledPinNumber >= 0) {
     pinMode(ledPinNumber, OUTPUT);
-    turnOn();
+    setPattern(STATUS_LED_STEADY);
+    update();
+    ticker.attach_ms(STATUS_LED_TICK_MS, StatusLed::tick, this);
   }
 }
 
 void StatusLed::turnOn()
 {
-  if (ledPinNumber >= 0) {
-    digitalWrite(ledPinNumber, LOW);
-  }
+  setPattern(STATUS_LED_STEADY);
 }
 
 void StatusLed::turnOff()
 {
-  if (ledPinNumber >= 0) {
-    digitalWrite(ledPinNumber, HIGH);
+  setPattern(STATUS_LED_OFF);
+}
+
+void StatusLed::setPattern(StatusLedPattern pattern)
+{
+  switch (pattern) {
+    case STATUS_LED_OFF:
+      patternMask = STATUS_LED_MASK_OFF;
+      break;
+    case STATUS_LED_STEADY:
+      patternMask = STATUS_LED_MASK_STEADY;
+      break;
+    case STATUS_LED_SLOW_BLINK:
+      patternMask = STATUS_LED_MASK_SLOW_BLINK;
+      break;
+    case STATUS_LED_FAST_BLINK:
+      patternMask = STATUS_LED_MASK_FAST_BLINK;
+      break;
+  }
+}
+
+void StatusLed::burst(byte flashes)
+{
+  // every flash is one step off and one step on
+  unsigned int steps = burstSteps + flashes * 2;
+  burstSteps = steps > 255 ? 254 : steps;
+}
+
+void StatusLed::update()
+{
+  if (ledPinNumber < 0) {
+    return;
   }
+
+  bool on;
+  if (burstSteps > 0) {
+    burstSteps--;
+    on = burstSteps & 1;
+  }
+  else {
+    on = bitRead(patternMask, step);
+  }
+
+  step = (step + 1) & 15;
+
+  write(on);
+}
+
+void StatusLed::write(bool on)
+{
+  if (level == on) {
+    return;
+  }
+
+  level = on;
+
+  // the builtin led is wired in inverse mode, LOW = on
+  digitalWrite(ledPinNumber, on ? LOW : HIGH);
+}
+
+void StatusLed::tick(StatusLed* statusLed)
+{
+  statusLed->update();
 }
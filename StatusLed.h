@@ -3,15 +3,62 @@
 
 #include <ESP8266WiFi.h>
 #include <Arduino.h>
+#include <Ticker.h>
+
+// Length of one pattern step in milliseconds. A pattern is 16 steps long.
+#define STATUS_LED_TICK_MS 50
+
+// Pattern bitmasks, bit 0 is played first. 1 = on, 0 = off.
+#define STATUS_LED_MASK_OFF 0x0000
+#define STATUS_LED_MASK_STEADY 0xFFFF
+#define STATUS_LED_MASK_SLOW_BLINK 0x00FF
+#define STATUS_LED_MASK_FAST_BLINK 0x3333
+
+enum StatusLedPattern {
+  STATUS_LED_OFF,
+  STATUS_LED_STEADY,
+  STATUS_LED_SLOW_BLINK,
+  STATUS_LED_FAST_BLINK
+};
 
 class StatusLed
 {
   public:
-    int ledPinNumber;
+    int ledPinNumber = -1;
 
     void setup();
     void turnOn();
     void turnOff();
+
+    /**
+     * Sets the pattern played by the ticker in the background.
+     * Only stores the pattern, the led itself is updated on the next tick.
+     * @param pattern One of the StatusLedPattern values.
+     */
+    void setPattern(StatusLedPattern pattern);
+
+    /**
+     * Plays a short burst of quick flashes over the current pattern,
+     * then returns to the pattern.
+     * @param flashes Number of flashes, bursts requested in a row add up.
+     */
+    void burst(byte flashes = 2);
+
+    /**
+     * Advances the pattern by one step and writes the pin if the level changed.
+     * Called by the ticker every STATUS_LED_TICK_MS.
+     */
+    void update();
+
+  private:
+    Ticker ticker;
+    volatile uint16_t patternMask = STATUS_LED_MASK_STEADY;
+    volatile byte burstSteps = 0;
+    byte step = 0;
+    int8_t level = -1;
+
+    void write(bool on);
+    static void tick(StatusLed* statusLed);
 };
 
 #endif
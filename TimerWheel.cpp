@@ -0,0 +1,190 @@
+#include "TimerWheel.h"
+
+TimerWheel::TimerWheel()
+{
+  memset(slots, TIMER_WHEEL_NONE, sizeof(slots));
+
+  // all the timers are on the free list, linked by next
+  for (byte timerIndex = 0; timerIndex < TIMER_WHEEL_MAX_TIMERS; timerIndex++) {
+    timers[timerIndex].next = timerIndex + 1 < TIMER_WHEEL_MAX_TIMERS ? timerIndex + 1 : TIMER_WHEEL_NONE;
+    timers[timerIndex].generation = 0;
+    timers[timerIndex].active = false;
+  }
+}
+
+uint16_t TimerWheel::start(uint32_t delayMillis, TimerCallback callback, void* context)
+{
+  if (freeHead == TIMER_WHEEL_NONE) {
+    return TIMER_WHEEL_INVALID_ID;
+  }
+
+  if (!started) {
+    started = true;
+    lastTickMillis = millis();
+  }
+
+  byte timerIndex = freeHead;
+  WheelTimer* timer = &timers[timerIndex];
+  freeHead = timer->next;
+
+  uint32_t ticks = (delayMillis + TIMER_WHEEL_TICK_MS - 1) / TIMER_WHEEL_TICK_MS;
+  if (ticks == 0) {
+    ticks = 1;
+  }
+
+  timer->callback = callback;
+  timer->context = context;
+  timer->rounds = (ticks - 1) / TIMER_WHEEL_SLOTS;
+  timer->active = true;
+  timer->generation++;
+  if (timer->generation == 0) {
+    timer->generation = 1;
+  }
+
+  link(timerIndex, (currentTick + ticks) & (TIMER_WHEEL_SLOTS - 1));
+  activeCount++;
+
+  return (uint16_t)timer->generation << 8 | timerIndex;
+}
+
+void TimerWheel::cancel(uint16_t timerId)
+{
+  WheelTimer* timer = find(timerId);
+  if (!timer) {
+    return;
+  }
+
+  byte timerIndex = timerId & 0xFF;
+  unlink(timerIndex);
+  release(timerIndex);
+}
+
+bool TimerWheel::isActive(uint16_t timerId)
+{
+  return find(timerId) != nullptr;
+}
+
+void TimerWheel::advance(unsigned long nowMillis)
+{
+  if (!started) {
+    return;
+  }
+
+  while (nowMillis - lastTickMillis >= TIMER_WHEEL_TICK_MS) {
+    lastTickMillis += TIMER_WHEEL_TICK_MS;
+    currentTick++;
+
+    // the due timers are moved to the expired list first, no callback runs while the slot is walked
+    byte slot = currentTick & (TIMER_WHEEL_SLOTS - 1);
+    byte timerIndex = slots[slot];
+    while (timerIndex != TIMER_WHEEL_NONE) {
+      WheelTimer* timer = &timers[timerIndex];
+      byte nextIndex = timer->next;
+
+      if (timer->rounds > 0) {
+        timer->rounds--;
+      }
+      else {
+        unlink(timerIndex);
+        link(timerIndex, TIMER_WHEEL_EXPIRED_SLOT);
+      }
+
+      timerIndex = nextIndex;
+    }
+
+    // a callback cancelling an expired timer takes it off the list, so it's not called
+    while (expiredHead != TIMER_WHEEL_NONE) {
+      timerIndex = expiredHead;
+      WheelTimer* timer = &timers[timerIndex];
+
+      // free it before the callback, so the callback can start a new timer
+      TimerCallback callback = timer->callback;
+      void* context = timer->context;
+      unlink(timerIndex);
+      release(timerIndex);
+      callback(context);
+    }
+  }
+}
+
+byte TimerWheel::getActiveCount()
+{
+  return activeCount;
+}
+
+uint32_t TimerWheel::getIdleMillis(unsigned long nowMillis)
+{
+  if (activeCount == 0) {
+    return TIMER_WHEEL_IDLE_FOREVER;
+  }
+
+  for (uint32_t ticks = 1; ticks <= TIMER_WHEEL_SLOTS; ticks++) {
+    byte timerIndex = slots[(currentTick + ticks) & (TIMER_WHEEL_SLOTS - 1)];
+    while (timerIndex != TIMER_WHEEL_NONE) {
+      if (timers[timerIndex].rounds == 0) {
+        unsigned long dueMillis = lastTickMillis + ticks * TIMER_WHEEL_TICK_MS;
+        return (long)(dueMillis - nowMillis) > 0 ? dueMillis - nowMillis : 0;
+      }
+
+      timerIndex = timers[timerIndex].next;
+    }
+  }
+
+  return TIMER_WHEEL_SLOTS * TIMER_WHEEL_TICK_MS;
+}
+
+void TimerWheel::link(byte timerIndex, byte slot)
+{
+  byte* head = slot == TIMER_WHEEL_EXPIRED_SLOT ? &expiredHead : &slots[slot];
+
+  WheelTimer* timer = &timers[timerIndex];
+  timer->slot = slot;
+  timer->prev = TIMER_WHEEL_NONE;
+  timer->next = *head;
+  if (timer->next != TIMER_WHEEL_NONE) {
+    timers[timer->next].prev = timerIndex;
+  }
+  *head = timerIndex;
+}
+
+void TimerWheel::unlink(byte timerIndex)
+{
+  WheelTimer* timer = &timers[timerIndex];
+  if (timer->prev != TIMER_WHEEL_NONE) {
+    timers[timer->prev].next = timer->next;
+  }
+  else if (timer->slot == TIMER_WHEEL_EXPIRED_SLOT) {
+    expiredHead = timer->next;
+  }
+  else {
+    slots[timer->slot] = timer->next;
+  }
+
+  if (timer->next != TIMER_WHEEL_NONE) {
+    timers[timer->next].prev = timer->prev;
+  }
+}
+
+void TimerWheel::release(byte timerIndex)
+{
+  WheelTimer* timer = &timers[timerIndex];
+  timer->active = false;
+  timer->next = freeHead;
+  freeHead = timerIndex;
+  activeCount--;
+}
+
+WheelTimer* TimerWheel::find(uint16_t timerId)
+{
+  byte timerIndex = timerId & 0xFF;
+  if (timerId == TIMER_WHEEL_INVALID_ID || timerIndex >= TIMER_WHEEL_MAX_TIMERS) {
+    return nullptr;
+  }
+
+  WheelTimer* timer = &timers[timerIndex];
+  if (!timer->active || timer->generation != timerId >> 8) {
+    return nullptr;
+  }
+
+  return timer;
+}
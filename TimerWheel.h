@@ -0,0 +1,95 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <Arduino.h>
+
+// Number of slots, must be a power of two. A timer further than a turn of the wheel waits for more rounds.
+#define TIMER_WHEEL_SLOTS 64
+#define TIMER_WHEEL_TICK_MS 10
+
+#ifndef TIMER_WHEEL_MAX_TIMERS
+#define TIMER_WHEEL_MAX_TIMERS 48
+#endif
+
+#define TIMER_WHEEL_NONE 255
+// The slot of the timers expired by advance() whose callbacks are still to be called.
+#define TIMER_WHEEL_EXPIRED_SLOT 255
+// Returned instead of a timer id when all the timers are in use.
+#define TIMER_WHEEL_INVALID_ID 0
+#define TIMER_WHEEL_IDLE_FOREVER 0xFFFFFFFF
+
+typedef void (*TimerCallback)(void* context);
+
+struct WheelTimer {
+  TimerCallback callback;
+  void* context;
+  // Turns of the wheel left before it expires.
+  uint32_t rounds;
+  // Incremented on every reuse, so a stale id can't cancel the timer reusing the same entry.
+  byte generation;
+  byte slot;
+  byte next;
+  byte prev;
+  bool active;
+};
+
+/**
+ * Hashed timer wheel for the timeouts, starting and cancelling a timer is O(1),
+ * advancing costs one slot per tick no matter how many timers are running.
+ */
+class TimerWheel
+{
+  public:
+    TimerWheel();
+
+    /**
+     * Starts a one-shot timer.
+     * @param  delayMillis Rounded up to TIMER_WHEEL_TICK_MS.
+     * @param  callback    Called from advance() when the timer expires.
+     * @param  context     Passed to the callback.
+     * @return uint16_t    Id of the timer, TIMER_WHEEL_INVALID_ID if all the timers are in use.
+     */
+    uint16_t start(uint32_t delayMillis, TimerCallback callback, void* context);
+
+    /**
+     * Cancels the timer, does nothing if it has expired already.
+     * @param timerId
+     */
+    void cancel(uint16_t timerId);
+
+    bool isActive(uint16_t timerId);
+
+    /**
+     * Expires the timers up to now, calling their callbacks.
+     * The callbacks may start and cancel any timer, the expired ones not called yet too.
+     * @param nowMillis
+     */
+    void advance(unsigned long nowMillis);
+
+    byte getActiveCount();
+
+    /**
+     * Returns the time until the next timer expires, for sleeping until then.
+     * A timer further than a turn of the wheel is not looked for, a turn is returned instead.
+     * @param  nowMillis
+     * @return uint32_t  0 if a timer is due, TIMER_WHEEL_IDLE_FOREVER if there's no timer.
+     */
+    uint32_t getIdleMillis(unsigned long nowMillis);
+
+  private:
+    WheelTimer timers[TIMER_WHEEL_MAX_TIMERS];
+    byte slots[TIMER_WHEEL_SLOTS];
+    byte expiredHead = TIMER_WHEEL_NONE;
+    byte freeHead = 0;
+    byte activeCount = 0;
+    uint32_t currentTick = 0;
+    unsigned long lastTickMillis = 0;
+    bool started = false;
+
+    void link(byte timerIndex, byte slot);
+    void unlink(byte timerIndex);
+    void release(byte timerIndex);
+    WheelTimer* find(uint16_t timerId);
+};
+
+#endif
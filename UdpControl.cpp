@@ -0,0 +1,233 @@
+#include "UdpControl.h"
+
+void UdpControl::setup(Settings* settings, Debug* debug, Pins* pins)
+{
+  this->settings = settings;
+  this->debug = debug;
+  this->pins = pins;
+}
+
+void UdpControl::loop(bool connected)
+{
+  if (!enabled) {
+    return;
+  }
+
+  if (!connected) {
+    if (listening) {
+      udp.stop();
+      listening = false;
+    }
+    return;
+  }
+
+  // the multicast membership is bound to the interface address, so it has to be renewed after every reconnect
+  if (!listening) {
+    if (multicastAddress.isSet()) {
+      listening = udp.beginMulticast(WiFi.localIP(), multicastAddress, port);
+    }
+    else {
+      listening = udp.begin(port);
+    }
+
+    if (!listening) {
+      debug->error(F("Could not listen on udp port ") + String(port));
+      return;
+    }
+
+    debug->info(F("Listening on udp port ") + String(port));
+  }
+
+  byte frame[UDP_CONTROL_MAX_FRAME_LENGTH];
+  byte ack[UDP_CONTROL_MAX_FRAME_LENGTH];
+  for (byte frameIndex = 0; frameIndex < UDP_CONTROL_MAX_FRAMES_PER_LOOP; frameIndex++) {
+    int packetLength = udp.parsePacket();
+    if (packetLength <= 0) {
+      return;
+    }
+
+    framesReceived++;
+
+    if (packetLength > UDP_CONTROL_MAX_FRAME_LENGTH) {
+      framesRejected++;
+      continue;
+    }
+
+    size_t length = udp.read(frame, packetLength);
+    IPAddress remoteIp = udp.remoteIP();
+    uint16_t remotePort = udp.remotePort();
+
+    size_t ackLength = 0;
+    uint16_t sequence = length >= UDP_CONTROL_HEADER_LENGTH ? frame[4] | frame[5] << 8 : 0;
+
+    // a retransmission of the last request, answer it without executing it again
+    if (
+      lastAckLength > 0 &&
+      sequence == lastSequence &&
+      remotePort == lastRemotePort &&
+      remoteIp == lastRemoteIp
+    ) {
+      framesDuplicate++;
+      memcpy(ack, lastAck, lastAckLength);
+      ackLength = lastAckLength;
+    }
+    else {
+      ackLength = handleFrame(frame, length, ack);
+      if (ackLength > 0) {
+        lastRemoteIp = remoteIp;
+        lastRemotePort = remotePort;
+        lastSequence = sequence;
+        memcpy(lastAck, ack, ackLength);
+        lastAckLength = ackLength;
+      }
+    }
+
+    if (ackLength == 0) {
+      continue;
+    }
+
+    udp.beginPacket(remoteIp, remotePort);
+    udp.write(ack, ackLength);
+    udp.endPacket();
+  }
+}
+
+size_t UdpControl::handleFrame(const byte* frame, size_t length, byte* ack)
+{
+  if (
+    length < UDP_CONTROL_HEADER_LENGTH ||
+    frame[0] != UDP_CONTROL_MAGIC_0 ||
+    frame[1] != UDP_CONTROL_MAGIC_1 ||
+    frame[2] != UDP_CONTROL_VERSION ||
+    (frame[3] & UDP_CONTROL_OP_ACK)
+  ) {
+    framesRejected++;
+    return 0;
+  }
+
+  byte opcode = frame[3];
+  byte flags = frame[6];
+  byte frameGroup = frame[7];
+
+  if (frameGroup != 0 && frameGroup != group) {
+    return 0;
+  }
+
+  size_t ackPayloadLength = 0;
+  byte status = execute(
+    opcode,
+    frame + UDP_CONTROL_HEADER_LENGTH,
+    length - UDP_CONTROL_HEADER_LENGTH,
+    ack + UDP_CONTROL_HEADER_LENGTH + 1,
+    &ackPayloadLength
+  );
+
+  if (flags & UDP_CONTROL_FLAG_NO_ACK) {
+    return 0;
+  }
+
+  memcpy(ack, frame, UDP_CONTROL_HEADER_LENGTH);
+  ack[3] = opcode | UDP_CONTROL_OP_ACK;
+  ack[7] = group;
+  ack[UDP_CONTROL_HEADER_LENGTH] = status;
+
+  return UDP_CONTROL_HEADER_LENGTH + 1 + ackPayloadLength;
+}
+
+byte UdpControl::execute(byte opcode, const byte* payload, size_t payloadLength, byte* ackPayload, size_t* ackPayloadLength)
+{
+  switch (opcode) {
+    case UDP_CONTROL_OP_INIT: {
+      if (payloadLength < 2 || payload[0] > 15 || payload[1] > 2) {
+        return UDP_CONTROL_STATUS_BAD_REQUEST;
+      }
+
+      byte pinNumber = payload[0];
+      if (settings->isPinInitalized(pinNumber) || settings->isPinLocked(pinNumber) || pins->isReserved(pinNumber)) {
+        return UDP_CONTROL_STATUS_UNACCEPTABLE;
+      }
+
+      byte modes[] = {INPUT, OUTPUT, INPUT_PULLUP};
+      if (!pins->initPin(pinNumber, modes[payload[1]])) {
+        return UDP_CONTROL_STATUS_INTERNAL_ERROR;
+      }
+
+      return UDP_CONTROL_STATUS_OK;
+    }
+
+    case UDP_CONTROL_OP_SET: {
+      if (payloadLength < 2 || payload[0] > 15 || payload[1] > 1) {
+        return UDP_CONTROL_STATUS_BAD_REQUEST;
+      }
+
+      byte pinNumber = payload[0];
+      if (
+        !settings->isPinInitalized(pinNumber) ||
+        settings->isPinLocked(pinNumber) ||
+        settings->getPinMode(pinNumber) != OUTPUT
+      ) {
+        return UDP_CONTROL_STATUS_UNACCEPTABLE;
+      }
+
+      if (!pins->setState(pinNumber, payload[1])) {
+        return UDP_CONTROL_STATUS_INTERNAL_ERROR;
+      }
+
+      return UDP_CONTROL_STATUS_OK;
+    }
+
+    case UDP_CONTROL_OP_GET: {
+      if (payloadLength < 1 || payload[0] > 15) {
+        return UDP_CONTROL_STATUS_BAD_REQUEST;
+      }
+
+      byte pinNumber = payload[0];
+      bool initialized = settings->isPinInitalized(pinNumber);
+      ackPayload[0] = pinNumber;
+      ackPayload[1] = initialized;
+      ackPayload[2] = settings->isPinLocked(pinNumber);
+      ackPayload[3] = initialized ? pins->getState(pinNumber) : 255;
+      ackPayload[4] = initialized ? settings->getPinMode(pinNumber) : 255;
+      *ackPayloadLength = 5;
+      return UDP_CONTROL_STATUS_OK;
+    }
+
+    case UDP_CONTROL_OP_SET_MASK: {
+      if (payloadLength < 4) {
+        return UDP_CONTROL_STATUS_BAD_REQUEST;
+      }
+
+      uint16_t pinMask = payload[0] | payload[1] << 8;
+      uint16_t stateMask = payload[2] | payload[3] << 8;
+      if (!pins->setStates(pinMask, stateMask)) {
+        return UDP_CONTROL_STATUS_UNACCEPTABLE;
+      }
+
+      return UDP_CONTROL_STATUS_OK;
+    }
+
+    case UDP_CONTROL_OP_GET_MASK: {
+      uint16_t initMask = 0;
+      uint16_t stateMask = 0;
+      for (byte pinNumber = 0; pinNumber < 16; pinNumber++) {
+        if (!settings->isPinInitalized(pinNumber) || pins->digital2gpio(pinNumber) == 255) {
+          continue;
+        }
+
+        bitSet(initMask, pinNumber);
+        if (pins->getState(pinNumber) == HIGH) {
+          bitSet(stateMask, pinNumber);
+        }
+      }
+
+      ackPayload[0] = initMask & 0xFF;
+      ackPayload[1] = initMask >> 8;
+      ackPayload[2] = stateMask & 0xFF;
+      ackPayload[3] = stateMask >> 8;
+      *ackPayloadLength = 4;
+      return UDP_CONTROL_STATUS_OK;
+    }
+  }
+
+  return UDP_CONTROL_STATUS_NOT_FOUND;
+}
@@ -0,0 +1,96 @@
+#ifndef UDP_CONTROL_H
+#define UDP_CONTROL_H
+
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <Arduino.h>
+
+#include "Settings.h"
+#include "Debug.h"
+#include "Pins.h"
+
+#define UDP_CONTROL_DEFAULT_PORT 4210
+
+// Every frame starts with the magic "HS", the version, the opcode, the sequence number
+// (little endian), the flags and the group, followed by the payload of the opcode.
+#define UDP_CONTROL_MAGIC_0 'H'
+#define UDP_CONTROL_MAGIC_1 'S'
+#define UDP_CONTROL_VERSION 1
+#define UDP_CONTROL_HEADER_LENGTH 8
+#define UDP_CONTROL_MAX_FRAME_LENGTH 32
+
+// Requests, the acknowledgement has the same opcode with the highest bit set.
+#define UDP_CONTROL_OP_INIT 0x01      // pin, mode (0 input, 1 output, 2 input_pullup)
+#define UDP_CONTROL_OP_SET 0x02       // pin, state
+#define UDP_CONTROL_OP_GET 0x03       // pin -> pin, initialized, locked, state, mode
+#define UDP_CONTROL_OP_SET_MASK 0x04  // pinMask (16 bit), stateMask (16 bit)
+#define UDP_CONTROL_OP_GET_MASK 0x05  // -> initMask (16 bit), stateMask (16 bit)
+#define UDP_CONTROL_OP_ACK 0x80
+
+// Flags
+#define UDP_CONTROL_FLAG_NO_ACK 0x01
+
+// The first byte of the acknowledgement payload, mirroring the http status codes.
+#define UDP_CONTROL_STATUS_OK 0
+#define UDP_CONTROL_STATUS_BAD_REQUEST 1
+#define UDP_CONTROL_STATUS_NOT_FOUND 2
+#define UDP_CONTROL_STATUS_UNACCEPTABLE 3
+#define UDP_CONTROL_STATUS_INTERNAL_ERROR 4
+
+// Frames handled in one loop, so a flood can't starve the http clients.
+#define UDP_CONTROL_MAX_FRAMES_PER_LOOP 8
+
+/**
+ * Compact binary protocol over UDP for the operations of the /digital endpoint,
+ * optionally listening on a multicast address too, so a single datagram can switch a group of nodes.
+ */
+class UdpControl
+{
+  public:
+    Settings* settings;
+    Debug* debug;
+    Pins* pins;
+
+    bool enabled = false;
+    uint16_t port = UDP_CONTROL_DEFAULT_PORT;
+    IPAddress multicastAddress;
+    // Frames with a group other than 0 are only handled if it is this group.
+    byte group = 0;
+
+    uint32_t framesReceived = 0;
+    uint32_t framesRejected = 0;
+    uint32_t framesDuplicate = 0;
+
+    void setup(Settings* settings, Debug* debug, Pins* pins);
+
+    /**
+     * Starts listening once the wifi is connected, stops when it's lost,
+     * and handles the received frames. Must be called from the main loop.
+     * @param connected Whether the wifi is connected.
+     */
+    void loop(bool connected);
+
+    /**
+     * Handles a single frame, independent of the socket.
+     * @param  frame
+     * @param  length
+     * @param  ack    Buffer of UDP_CONTROL_MAX_FRAME_LENGTH for the acknowledgement.
+     * @return size_t Length of the acknowledgement, 0 if there's nothing to send back.
+     */
+    size_t handleFrame(const byte* frame, size_t length, byte* ack);
+
+  private:
+    WiFiUDP udp;
+    bool listening = false;
+
+    // The last acknowledgement, resent if the same request arrives again.
+    IPAddress lastRemoteIp;
+    uint16_t lastRemotePort = 0;
+    uint16_t lastSequence = 0;
+    byte lastAck[UDP_CONTROL_MAX_FRAME_LENGTH];
+    size_t lastAckLength = 0;
+
+    byte execute(byte opcode, const byte* payload, size_t payloadLength, byte* ackPayload, size_t* ackPayloadLength);
+};
+
+#endif
@@ -0,0 +1,314 @@
+#include "WifiConnection.h"
+
+void WifiConnection::setup(Debug* debug, StatusLed* statusLed, Settings* settings)
+{
+  this->debug = debug;
+  this->statusLed = statusLed;
+  this->settings = settings;
+
+  accessPoints.setup(settings, debug);
+}
+
+bool WifiConnection::begin()
+{
+  accessPoints.load();
+  if (accessPoints.count == 0) {
+    debug->error(F("No access points are configured!"));
+    return false;
+  }
+
+  // the reconnects are handled by the state machine, and there is no need to wear the flash with the credentials
+  WiFi.persistent(false);
+  WiFi.setAutoReconnect(false);
+  WiFi.mode(WIFI_STA);
+
+  if (beginFastConnect()) {
+    return true;
+  }
+
+  enterState(WIFI_STATE_SCAN);
+  return true;
+}
+
+bool WifiConnection::beginFastConnect()
+{
+  WifiCache wifiCache;
+  if (!settings->getWifiCache(&wifiCache)) {
+    return false;
+  }
+
+  byte accessPointIndex = accessPoints.find(wifiCache.ssidHash);
+  if (accessPointIndex == ACCESS_POINT_NONE) {
+    debug->warn(F("The cached AP is not configured anymore."));
+    return false;
+  }
+
+  // it was the last one that worked
+  accessPoints.markSuccess(accessPointIndex);
+  AccessPoint* accessPoint = &accessPoints.list[accessPointIndex];
+
+  if (cacheIpLease && wifiCache.ipCached) {
+    WiFi.config(
+      IPAddress(wifiCache.ip),
+      IPAddress(wifiCache.gateway),
+      IPAddress(wifiCache.subnet),
+      IPAddress(wifiCache.dns)
+    );
+  }
+
+  debug->info(
+    F("Connecting to ") + String(accessPoint->ssid) +
+    F(" on channel ") + String(wifiCache.channel) + F(" without scanning")
+  );
+
+  selectedAccessPoint = accessPointIndex;
+  fastConnect = true;
+  WiFi.begin(accessPoint->ssid, accessPoint->psk, wifiCache.channel, wifiCache.bssid);
+  enterState(WIFI_STATE_CONNECT);
+  return true;
+}
+
+void WifiConnection::storeWifiCache()
+{
+  // removed while connecting
+  if (selectedAccessPoint == ACCESS_POINT_NONE) {
+    return;
+  }
+
+  WifiCache wifiCache;
+  wifiCache.ssidHash = accessPoints.list[selectedAccessPoint].ssidHash;
+  memcpy(wifiCache.bssid, WiFi.BSSID(), 6);
+  wifiCache.channel = WiFi.channel();
+
+  if (cacheIpLease) {
+    wifiCache.ipCached = true;
+    wifiCache.ip = WiFi.localIP();
+    wifiCache.gateway = WiFi.gatewayIP();
+    wifiCache.subnet = WiFi.subnetMask();
+    wifiCache.dns = WiFi.dnsIP();
+  }
+
+  settings->storeWifiCache(&wifiCache);
+}
+
+void WifiConnection::loop()
+{
+  switch (state) {
+    case WIFI_STATE_IDLE:
+      return;
+    case WIFI_STATE_SCAN:
+      loopScan();
+      return;
+    case WIFI_STATE_SELECT:
+      loopSelect();
+      return;
+    case WIFI_STATE_CONNECT:
+      loopConnect();
+      return;
+    case WIFI_STATE_CONNECTED:
+      loopConnected();
+      return;
+    case WIFI_STATE_LOST:
+      debug->warn(F("WiFi connection lost."));
+      WiFi.disconnect();
+      backoffMillis = WIFI_BACKOFF_MIN_MS;
+      enterState(WIFI_STATE_BACKOFF);
+      return;
+    case WIFI_STATE_BACKOFF:
+      loopBackoff();
+      return;
+  }
+}
+
+bool WifiConnection::isConnected()
+{
+  return state == WIFI_STATE_CONNECTED;
+}
+
+String WifiConnection::getStateName()
+{
+  switch (state) {
+    case WIFI_STATE_IDLE:
+      return F("idle");
+    case WIFI_STATE_SCAN:
+      return F("scan");
+    case WIFI_STATE_SELECT:
+      return F("select");
+    case WIFI_STATE_CONNECT:
+      return F("connect");
+    case WIFI_STATE_CONNECTED:
+      return F("connected");
+    case WIFI_STATE_LOST:
+      return F("lost");
+    case WIFI_STATE_BACKOFF:
+      return F("backoff");
+  }
+
+  return "";
+}
+
+String WifiConnection::getSsid()
+{
+  if (
+    selectedAccessPoint == ACCESS_POINT_NONE ||
+    (state != WIFI_STATE_CONNECT && state != WIFI_STATE_CONNECTED)
+  ) {
+    return "";
+  }
+
+  return accessPoints.list[selectedAccessPoint].ssid;
+}
+
+bool WifiConnection::removeAccessPoint(String ssid)
+{
+  return accessPoints.remove(ssid, &selectedAccessPoint);
+}
+
+void WifiConnection::enterState(WifiState state)
+{
+  this->state = state;
+  stateChangedAt = millis();
+
+  switch (state) {
+    case WIFI_STATE_SCAN:
+      statusLed->setPattern(STATUS_LED_SLOW_BLINK);
+      WiFi.scanDelete();
+      WiFi.scanNetworks(true);
+      break;
+    case WIFI_STATE_CONNECTED:
+      statusLed->setPattern(STATUS_LED_STEADY);
+      break;
+    case WIFI_STATE_BACKOFF:
+      statusLed->setPattern(STATUS_LED_FAST_BLINK);
+      break;
+    default:
+      break;
+  }
+}
+
+unsigned long WifiConnection::inStateFor()
+{
+  return millis() - stateChangedAt;
+}
+
+void WifiConnection::loopScan()
+{
+  int8_t numberOfNetworks = WiFi.scanComplete();
+  if (numberOfNetworks == WIFI_SCAN_RUNNING) {
+    return;
+  }
+
+  if (numberOfNetworks == WIFI_SCAN_FAILED) {
+    fail(F("Scanning failed!"));
+    return;
+  }
+
+  if (numberOfNetworks == 0) {
+    fail(F("No networks found!"));
+    return;
+  }
+
+  enterState(WIFI_STATE_SELECT);
+}
+
+void WifiConnection::loopSelect()
+{
+  int numberOfNetworks = WiFi.scanComplete();
+
+  accessPoints.resetScan();
+  for (int scanIndex = 0; scanIndex < numberOfNetworks; scanIndex++) {
+    bss_info* scanInfo = WiFi.getScanInfoByIndex(scanIndex);
+    if (!scanInfo) {
+      continue;
+    }
+
+    bool matched = accessPoints.matchScanResult((const char*)scanInfo->ssid, scanInfo->ssid_len, scanInfo->rssi);
+
+    if (debug->enabled) {
+      debug->info(
+        F("Found AP: '") + WiFi.SSID(scanIndex) + F("' rssi: ") + WiFi.RSSI(scanIndex) +
+        (matched ? F(" (known)") : F(""))
+      );
+    }
+  }
+
+  WiFi.scanDelete();
+
+  selectedAccessPoint = accessPoints.select();
+  if (selectedAccessPoint == ACCESS_POINT_NONE) {
+    fail(F("None of the stored networks are visible!"));
+    return;
+  }
+
+  AccessPoint* accessPoint = &accessPoints.list[selectedAccessPoint];
+  debug->info(F("Connecting to ") + String(accessPoint->ssid));
+  fastConnect = false;
+  WiFi.begin(accessPoint->ssid, accessPoint->psk);
+  enterState(WIFI_STATE_CONNECT);
+}
+
+void WifiConnection::loopConnect()
+{
+  wl_status_t status = WiFi.status();
+  if (status == WL_CONNECTED) {
+    debug->info(F("WiFi connected, local IP: ") + WiFi.localIP().toString());
+    backoffMillis = WIFI_BACKOFF_MIN_MS;
+    accessPoints.markSuccess(selectedAccessPoint);
+    storeWifiCache();
+    // the reconnects after a lost connection scan again
+    fastConnected = fastConnect;
+    fastConnect = false;
+    enterState(WIFI_STATE_CONNECTED);
+    return;
+  }
+
+  unsigned long timeOutMillis = fastConnect ? WIFI_FAST_CONNECT_TIMEOUT_MS : WIFI_CONNECT_TIMEOUT_MS;
+  bool failed =
+    status == WL_CONNECT_FAILED ||
+    status == WL_NO_SSID_AVAIL ||
+    status == WL_WRONG_PASSWORD ||
+    inStateFor() > timeOutMillis;
+
+  // the cached parameters may be stale (AP moved channel, lease expired), fall back to scanning right away
+  if (fastConnect && failed) {
+    debug->warn(F("Connecting with the cached parameters failed, scanning."));
+    fastConnect = false;
+    WiFi.disconnect();
+    WiFi.config(IPAddress(0u), IPAddress(0u), IPAddress(0u));
+    enterState(WIFI_STATE_SCAN);
+    return;
+  }
+
+  if (failed) {
+    WiFi.disconnect();
+    fail(F("Could not connect to ") + getSsid() + F(", status: ") + String(status));
+  }
+}
+
+void WifiConnection::loopConnected()
+{
+  if (WiFi.status() != WL_CONNECTED) {
+    fastConnected = false;
+    enterState(WIFI_STATE_LOST);
+  }
+}
+
+void WifiConnection::loopBackoff()
+{
+  if (inStateFor() < backoffMillis) {
+    return;
+  }
+
+  backoffMillis *= 2;
+  if (backoffMillis > WIFI_BACKOFF_MAX_MS) {
+    backoffMillis = WIFI_BACKOFF_MAX_MS;
+  }
+
+  enterState(WIFI_STATE_SCAN);
+}
+
+void WifiConnection::fail(String reason)
+{
+  debug->error(reason + F(" Retrying in ") + String(backoffMillis) + "ms.");
+  enterState(WIFI_STATE_BACKOFF);
+}
@@ -0,0 +1,101 @@
+#ifndef WIFI_CONNECTION_H
+#define WIFI_CONNECTION_H
+
+#include <ESP8266WiFi.h>
+#include <Arduino.h>
+
+#include "AccessPointRegistry.h"
+#include "StatusLed.h"
+#include "Settings.h"
+#include "Debug.h"
+
+// How long a connection attempt may take before it is given up.
+#define WIFI_CONNECT_TIMEOUT_MS 15000
+// How long a direct connection with the cached parameters may take before falling back to a scan.
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 5000
+// First and last delay of the exponential backoff between attempts.
+#define WIFI_BACKOFF_MIN_MS 1000
+#define WIFI_BACKOFF_MAX_MS 60000
+
+enum WifiState {
+  WIFI_STATE_IDLE,
+  WIFI_STATE_SCAN,
+  WIFI_STATE_SELECT,
+  WIFI_STATE_CONNECT,
+  WIFI_STATE_CONNECTED,
+  WIFI_STATE_LOST,
+  WIFI_STATE_BACKOFF
+};
+
+class WifiConnection
+{
+  public:
+    Debug* debug;
+    StatusLed* statusLed;
+    Settings* settings;
+
+    AccessPointRegistry accessPoints;
+
+    WifiState state = WIFI_STATE_IDLE;
+    unsigned long stateChangedAt = 0;
+    unsigned long backoffMillis = WIFI_BACKOFF_MIN_MS;
+    byte selectedAccessPoint = ACCESS_POINT_NONE;
+
+    // Whether the current connection attempt uses the cached parameters instead of a scan.
+    bool fastConnect = false;
+    // Whether the current connection was made with the cached parameters.
+    bool fastConnected = false;
+    // Whether the ip configuration is cached and reused as static configuration.
+    bool cacheIpLease = false;
+
+    void setup(Debug* debug, StatusLed* statusLed, Settings* settings);
+
+    /**
+     * Loads the stored access points, and starts the state machine. If the parameters of the
+     * last successful connection are cached, connects directly to that AP, otherwise starts with a scan.
+     * Returns immediately, the connection is made by loop().
+     * @return bool False if there are no access points to connect to.
+     */
+    bool begin();
+
+    /**
+     * Advances the state machine. Never blocks, must be called from the main loop.
+     * scan -> select -> connect -> connected -> lost -> backoff -> scan
+     */
+    void loop();
+
+    bool isConnected();
+
+    String getStateName();
+
+    /**
+     * Returns the ssid of the AP being connected or connected to, empty string otherwise.
+     * @return String
+     */
+    String getSsid();
+
+    /**
+     * Removes an access point from the registry, keeping track of the selected one.
+     * The current connection is kept even if its access point is removed, it is not reconnected to.
+     * @param  ssid
+     * @return bool False if there's no such access point.
+     */
+    bool removeAccessPoint(String ssid);
+
+  private:
+    bool beginFastConnect();
+    void storeWifiCache();
+
+    void enterState(WifiState state);
+    unsigned long inStateFor();
+
+    void loopScan();
+    void loopSelect();
+    void loopConnect();
+    void loopConnected();
+    void loopBackoff();
+
+    void fail(String reason);
+};
+
+#endif
@@ -0,0 +1,525 @@
+#include "EpollServer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+EpollServer::~EpollServer()
+{
+  for (size_t fd = 0; fd < connections.size(); fd++) {
+    if (connections[fd]) {
+      closeConnection(connections[fd]);
+    }
+  }
+
+  if (listenFd >= 0) {
+    close(listenFd);
+  }
+
+  if (epollFd >= 0) {
+    close(epollFd);
+  }
+}
+
+void EpollServer::setup(RestApi* api)
+{
+  this->api = api;
+  pipeline.setup(api);
+}
+
+bool EpollServer::begin(uint16_t port, bool loopbackOnly)
+{
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd < 0) {
+    return fail("Could not create the epoll instance: " + String(strerror(errno)));
+  }
+
+  // every server seeds its emulated losses differently, but the same on every run
+  randomState = 2463534242u ^ ((uint32_t)port * 2654435761u);
+
+  // dual stack if the host has ipv6, ipv4 only otherwise
+  listenFd = loopbackOnly ? -1 : socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listenFd >= 0) {
+    int off = 0;
+    setsockopt(listenFd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+
+    int on = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_in6 address;
+    memset(&address, 0, sizeof(address));
+    address.sin6_family = AF_INET6;
+    address.sin6_addr = in6addr_any;
+    address.sin6_port = htons(port);
+    if (bind(listenFd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+      close(listenFd);
+      listenFd = -1;
+    }
+  }
+
+  if (listenFd < 0) {
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+      return fail("Could not create the socket: " + String(strerror(errno)));
+    }
+
+    int on = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(listenFd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+      return fail("Could not bind port " + String(port) + ": " + String(strerror(errno)));
+    }
+  }
+
+  if (listen(listenFd, EPOLL_SERVER_LISTEN_BACKLOG) < 0) {
+    return fail("Could not listen on port " + String(port) + ": " + String(strerror(errno)));
+  }
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = listenFd;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) < 0) {
+    return fail("Could not watch the socket: " + String(strerror(errno)));
+  }
+
+  lastSweepMillis = millis();
+  api->debug.info("Listening on port " + String(port));
+  return true;
+}
+
+void EpollServer::loop(int timeoutMillis)
+{
+  // while connections wait for their turn the queue is served without sleeping
+  struct epoll_event events[EPOLL_SERVER_MAX_EVENTS];
+  int eventCount = epoll_wait(epollFd, events, EPOLL_SERVER_MAX_EVENTS, getWaitMillis(timeoutMillis));
+  if (eventCount < 0 && errno != EINTR) {
+    fail("epoll_wait failed: " + String(strerror(errno)));
+  }
+
+  // the new connections are accepted after the events of the batch,
+  // so a descriptor closed in the batch is not reused by a new connection while it still has events in the batch
+  bool acceptPending = false;
+  for (int eventIndex = 0; eventIndex < eventCount; eventIndex++) {
+    int fd = events[eventIndex].data.fd;
+    if (fd == listenFd) {
+      acceptPending = true;
+      continue;
+    }
+
+    if ((size_t)fd >= connections.size() || !connections[fd]) {
+      continue;
+    }
+
+    uint32_t flags = events[eventIndex].events;
+    if (flags & (EPOLLERR | EPOLLHUP)) {
+      closeConnection(connections[fd]);
+      continue;
+    }
+
+    if (flags & EPOLLIN) {
+      receive(connections[fd]);
+    }
+
+    if ((flags & EPOLLOUT) && connections[fd]) {
+      send(connections[fd]);
+    }
+  }
+
+  if (acceptPending) {
+    accept();
+  }
+
+  deliverDelayed();
+  serveQueue();
+
+  if (millis() - lastSweepMillis >= 1000) {
+    lastSweepMillis = millis();
+    closeIdleConnections();
+
+    // the descriptors may have been freed by other than the connections
+    pauseAccept(false);
+  }
+}
+
+size_t EpollServer::getConnectionCount()
+{
+  return connectionCount;
+}
+
+int EpollServer::getFd()
+{
+  return epollFd;
+}
+
+int EpollServer::getWaitMillis(int timeoutMillis)
+{
+  if (!readyQueue.empty()) {
+    return 0;
+  }
+
+  if (deliveries.empty()) {
+    return timeoutMillis;
+  }
+
+  int32_t dueMillis = deliveries.top().dueMillis - (uint32_t)millis();
+  return max(0, min(timeoutMillis, (int)dueMillis));
+}
+
+void EpollServer::accept()
+{
+  while (true) {
+    struct sockaddr_storage peer;
+    socklen_t peerLength = sizeof(peer);
+    int fd = accept4(listenFd, (struct sockaddr*)&peer, &peerLength, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EMFILE || errno == ENFILE) {
+        acceptFailures++;
+        pauseAccept(true);
+
+        if (lastFdWarningMillis == 0 || millis() - lastFdWarningMillis >= EPOLL_SERVER_FD_WARNING_INTERVAL_MS) {
+          lastFdWarningMillis = millis();
+          api->debug.warn(
+            "Out of file descriptors, " + String((unsigned long)connectionCount) + " connections are open, accepting failed " +
+            String((unsigned long)acceptFailures) + " times since the last warning."
+          );
+          acceptFailures = 0;
+        }
+      }
+      return;
+    }
+
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    if ((size_t)fd >= connections.size()) {
+      connections.resize(fd + 1, nullptr);
+    }
+
+    EpollConnection* connection = new EpollConnection;
+    connection->fd = fd;
+    connection->id = accepted + 1;
+    connection->lastActiveMillis = millis();
+    connection->address = getAddressKey(&peer);
+    connection->events = EPOLLIN | EPOLLRDHUP;
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = connection->events;
+    event.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+      close(fd);
+      delete connection;
+      continue;
+    }
+
+    connections[fd] = connection;
+    connectionCount++;
+    accepted++;
+
+    if (capture) {
+      capture->recordOpen(connection->id, connection->address);
+    }
+  }
+}
+
+void EpollServer::pauseAccept(bool paused)
+{
+  if (paused == acceptPaused) {
+    return;
+  }
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = paused ? 0 : EPOLLIN;
+  event.data.fd = listenFd;
+  epoll_ctl(epollFd, EPOLL_CTL_MOD, listenFd, &event);
+
+  acceptPaused = paused;
+}
+
+void EpollServer::receive(EpollConnection* connection)
+{
+  // a client sending faster than its turns come is left in the socket buffer, until its input is processed
+  char buffer[16384];
+  while (connection->input.size() + connection->delayedBytes < HTTP_PIPELINE_MAX_REQUEST_SIZE) {
+    ssize_t length = read(connection->fd, buffer, sizeof(buffer));
+    if (length > 0) {
+      // the requests after a "Connection: close" are not answered
+      if (connection->closing) {
+        continue;
+      }
+
+      if (latencyMillis > 0 || lossRate > 0) {
+        delay(connection, buffer, length);
+      }
+      else {
+        appendInput(connection, buffer, length);
+      }
+      continue;
+    }
+
+    if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+
+    if (length < 0 && errno == EINTR) {
+      continue;
+    }
+
+    // the client closed its side, the requests already received are still answered
+    if (connection->delayed.empty()) {
+      connection->peerClosed = true;
+    }
+    else {
+      connection->peerClosedDelayed = true;
+    }
+    break;
+  }
+
+  connection->lastActiveMillis = millis();
+  enqueue(connection);
+  updateEvents(connection);
+}
+
+void EpollServer::appendInput(EpollConnection* connection, const char* data, size_t length)
+{
+  connection->input.append(data, length);
+  if (capture) {
+    capture->recordInput(connection->id, data, length);
+  }
+}
+
+void EpollServer::delay(EpollConnection* connection, const char* data, size_t length)
+{
+  uint32_t dueMillis = millis() + latencyMillis;
+
+  uint32_t retransmitMillis = EPOLL_SERVER_RETRANSMIT_TIMEOUT_MS;
+  while (lossRate > 0) {
+    // xorshift32
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    if (randomState / 4294967296.0 >= lossRate) {
+      break;
+    }
+
+    lostSegments++;
+    dueMillis += retransmitMillis;
+    retransmitMillis *= 2;
+  }
+
+  // a segment arriving earlier waits for the ones before it, as the receiver of TCP does
+  if (!connection->delayed.empty() && (int32_t)(connection->delayed.back().dueMillis - dueMillis) > 0) {
+    dueMillis = connection->delayed.back().dueMillis;
+  }
+
+  connection->delayed.push_back({dueMillis, std::string(data, length)});
+  connection->delayedBytes += length;
+  deliveries.push({dueMillis, connection->fd, connection->id});
+}
+
+void EpollServer::deliverDelayed()
+{
+  uint32_t now = millis();
+  while (!deliveries.empty() && (int32_t)(now - deliveries.top().dueMillis) >= 0) {
+    DelayedDelivery delivery = deliveries.top();
+    deliveries.pop();
+
+    // closed since, or a new connection on the same descriptor
+    EpollConnection* connection = (size_t)delivery.fd < connections.size() ? connections[delivery.fd] : nullptr;
+    if (!connection || connection->id != delivery.connectionId) {
+      continue;
+    }
+
+    while (!connection->delayed.empty() && (int32_t)(now - connection->delayed.front().dueMillis) >= 0) {
+      DelayedSegment* segment = &connection->delayed.front();
+      connection->delayedBytes -= segment->data.size();
+      appendInput(connection, segment->data.data(), segment->data.size());
+      connection->delayed.pop_front();
+    }
+
+    if (connection->delayed.empty() && connection->peerClosedDelayed) {
+      connection->peerClosed = true;
+    }
+
+    connection->lastActiveMillis = now;
+    enqueue(connection);
+    updateEvents(connection);
+  }
+}
+
+void EpollServer::enqueue(EpollConnection* connection)
+{
+  if (connection->queued) {
+    return;
+  }
+
+  connection->queued = true;
+  readyQueue.push_back(connection->fd);
+}
+
+void EpollServer::serveQueue()
+{
+  // every connection queued before this pass gets a single turn, the ones queued again wait for the next pass
+  size_t turns = readyQueue.size();
+  while (turns-- > 0) {
+    int fd = readyQueue.front();
+    readyQueue.pop_front();
+
+    // closed since, or a new connection on the same descriptor, queued by its own entry
+    EpollConnection* connection = connections[fd];
+    if (!connection || !connection->queued) {
+      continue;
+    }
+
+    connection->queued = false;
+    processInput(connection);
+  }
+}
+
+void EpollServer::processInput(EpollConnection* connection)
+{
+  size_t outputLength = connection->output.size();
+
+  // the next pipelined request waits for the next turn
+  if (pipeline.processNext(connection)) {
+    enqueue(connection);
+  }
+
+  if (capture && connection->output.size() > outputLength) {
+    capture->recordOutput(connection->id, connection->output.data() + outputLength, connection->output.size() - outputLength);
+  }
+
+  // the requests already received are answered before closing
+  if (connection->peerClosed && !connection->queued) {
+    connection->closing = true;
+  }
+
+  send(connection);
+}
+
+void EpollServer::send(EpollConnection* connection)
+{
+  while (connection->outputOffset < connection->output.size()) {
+    ssize_t length = ::send(
+      connection->fd,
+      connection->output.data() + connection->outputOffset,
+      connection->output.size() - connection->outputOffset,
+      MSG_NOSIGNAL
+    );
+
+    if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+
+    if (length < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (length <= 0) {
+      closeConnection(connection);
+      return;
+    }
+
+    connection->outputOffset += length;
+  }
+
+  if (connection->outputOffset == connection->output.size()) {
+    connection->output.clear();
+    connection->outputOffset = 0;
+
+    if (connection->closing) {
+      closeConnection(connection);
+      return;
+    }
+  }
+
+  updateEvents(connection);
+}
+
+void EpollServer::updateEvents(EpollConnection* connection)
+{
+  // a closing connection only waits for its output to be written
+  uint32_t events =
+    (connection->closing || connection->peerClosedDelayed || connection->input.size() + connection->delayedBytes >= HTTP_PIPELINE_MAX_REQUEST_SIZE ? 0 : EPOLLIN | EPOLLRDHUP) |
+    (connection->output.size() > 0 ? EPOLLOUT : 0);
+  if (events == connection->events) {
+    return;
+  }
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = events;
+  event.data.fd = connection->fd;
+  epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+
+  connection->events = events;
+}
+
+void EpollServer::closeConnection(EpollConnection* connection)
+{
+  if (capture) {
+    capture->recordClose(connection->id);
+  }
+
+  int fd = connection->fd;
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+
+  connections[fd] = nullptr;
+  connectionCount--;
+  delete connection;
+
+  // a descriptor is free for a new connection
+  pauseAccept(false);
+}
+
+void EpollServer::closeIdleConnections()
+{
+  uint32_t now = millis();
+  for (size_t fd = 0; fd < connections.size(); fd++) {
+    EpollConnection* connection = connections[fd];
+    if (connection && now - connection->lastActiveMillis > EPOLL_SERVER_IDLE_TIMEOUT_MS) {
+      closeConnection(connection);
+    }
+  }
+}
+
+uint32_t EpollServer::getAddressKey(const struct sockaddr_storage* peer)
+{
+  if (peer->ss_family == AF_INET) {
+    return ntohl(((const struct sockaddr_in*)peer)->sin_addr.s_addr);
+  }
+
+  const uint8_t* bytes = ((const struct sockaddr_in6*)peer)->sin6_addr.s6_addr;
+  if (IN6_IS_ADDR_V4MAPPED(&((const struct sockaddr_in6*)peer)->sin6_addr)) {
+    return ((uint32_t)bytes[12] << 24) | ((uint32_t)bytes[13] << 16) | ((uint32_t)bytes[14] << 8) | bytes[15];
+  }
+
+  // FNV-1a of the /64 prefix, a client has a whole subnet to pick its address from
+  uint32_t hash = 2166136261u;
+  for (byte byteIndex = 0; byteIndex < 8; byteIndex++) {
+    hash = (hash ^ bytes[byteIndex]) * 16777619u;
+  }
+
+  return hash;
+}
+
+bool EpollServer::fail(String error)
+{
+  this->error = error;
+  api->debug.error(error);
+  fprintf(stderr, "%s\n", error.c_str());
+  return false;
+}
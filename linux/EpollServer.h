@@ -0,0 +1,178 @@
+#ifndef EPOLL_SERVER_H
+#define EPOLL_SERVER_H
+
+#include <Arduino.h>
+#include <sys/socket.h>
+#include <deque>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "RestApi.h"
+#include "HttpPipeline.h"
+#include "TrafficCapture.h"
+
+// A keep-alive connection idle for longer is closed.
+#define EPOLL_SERVER_IDLE_TIMEOUT_MS 60000
+
+// Number of events taken from the kernel at once.
+#define EPOLL_SERVER_MAX_EVENTS 256
+
+#define EPOLL_SERVER_LISTEN_BACKLOG 1024
+
+// Out of file descriptors, the warning is logged at most this often.
+#define EPOLL_SERVER_FD_WARNING_INTERVAL_MS 10000
+
+// A segment lost by the emulated network arrives after the retransmission timeout of TCP, doubled for every loss in a row.
+#define EPOLL_SERVER_RETRANSMIT_TIMEOUT_MS 200
+
+// A segment held back by the emulated network.
+struct DelayedSegment {
+  uint32_t dueMillis;
+  std::string data;
+};
+
+// When a connection has a delayed segment due, the queue of them is ordered by the time.
+struct DelayedDelivery {
+  uint32_t dueMillis;
+  int fd;
+  uint32_t connectionId;
+
+  bool operator>(const DelayedDelivery& other) const
+  {
+    return (int32_t)(dueMillis - other.dueMillis) > 0;
+  }
+};
+
+struct EpollConnection : HttpSession {
+  int fd = -1;
+  // Numbered from 1 in the order of the accepts, the id in the capture.
+  uint32_t id = 0;
+  size_t outputOffset = 0;
+  uint32_t lastActiveMillis = 0;
+  // Whether it waits in the queue for its turn.
+  bool queued = false;
+  // The epoll events watched, EPOLLOUT is only on while the output waits for the socket.
+  uint32_t events = 0;
+
+  // Received, but held back by the emulated network, in order.
+  std::deque<DelayedSegment> delayed;
+  size_t delayedBytes = 0;
+  // The client closed its side after the delayed segments.
+  bool peerClosedDelayed = false;
+};
+
+/**
+ * HTTP/1.1 server of the REST API on a single thread, for Linux gateways.
+ * The sockets are non-blocking and multiplexed by epoll, so the idle keep-alive connections only cost
+ * their buffers, and thousands of them are served by one core. The pipelined requests are answered in order,
+ * one per turn of the connection, the connections with a request take turns in a queue.
+ */
+class EpollServer
+{
+  public:
+    RestApi* api;
+    HttpPipeline pipeline;
+    String error;
+
+    uint32_t accepted = 0;
+
+    // If set, the bytes received and sent are recorded.
+    TrafficCapture* capture = nullptr;
+
+    // Emulated network for the simulated nodes: every segment received is held back by the latency,
+    // and a lost one by the retransmission timeouts too, the ones after it wait for it as in TCP.
+    uint32_t latencyMillis = 0;
+    // Probability of losing a segment, 0-1.
+    float lossRate = 0;
+    uint32_t lostSegments = 0;
+
+    ~EpollServer();
+
+    void setup(RestApi* api);
+
+    /**
+     * Starts listening on every address.
+     * @param  port
+     * @param  loopbackOnly Whether to listen on 127.0.0.1 only.
+     * @return bool         False if the port could not be bound, see error.
+     */
+    bool begin(uint16_t port, bool loopbackOnly = false);
+
+    /**
+     * Waits for the sockets for up to the timeout, and serves the ones ready.
+     * @param timeoutMillis
+     */
+    void loop(int timeoutMillis);
+
+    size_t getConnectionCount();
+
+    /**
+     * The epoll instance, it is readable while a socket of the server is ready, so servers can be nested in an outer event loop.
+     * @return int
+     */
+    int getFd();
+
+    /**
+     * How long loop() may wait for the sockets, 0 if connections wait for their turn, or less than the timeout if a delayed segment is due sooner.
+     * @param  timeoutMillis
+     * @return int
+     */
+    int getWaitMillis(int timeoutMillis);
+
+  private:
+    int listenFd = -1;
+    int epollFd = -1;
+
+    // Out of file descriptors the listening socket stays readable, it is not watched until a connection closes,
+    // or the next sweep, so the loop doesn't spin on it.
+    bool acceptPaused = false;
+    uint32_t acceptFailures = 0;
+    uint32_t lastFdWarningMillis = 0;
+
+    // Indexed by the file descriptor, they are small and reused by the kernel.
+    std::vector<EpollConnection*> connections;
+    size_t connectionCount = 0;
+    uint32_t lastSweepMillis = 0;
+
+    // The file descriptors of the connections with input to process, in the order of their turns.
+    std::deque<int> readyQueue;
+
+    std::priority_queue<DelayedDelivery, std::vector<DelayedDelivery>, std::greater<DelayedDelivery>> deliveries;
+    uint32_t randomState = 1;
+
+    void accept();
+
+    /**
+     * Stops or starts watching the listening socket.
+     * @param paused
+     */
+    void pauseAccept(bool paused);
+    void receive(EpollConnection* connection);
+    void appendInput(EpollConnection* connection, const char* data, size_t length);
+    void delay(EpollConnection* connection, const char* data, size_t length);
+    void deliverDelayed();
+    void enqueue(EpollConnection* connection);
+    void serveQueue();
+
+    /**
+     * Answers the first request of the input, if it arrived whole, and queues the connection again for the next one.
+     * @param connection
+     */
+    void processInput(EpollConnection* connection);
+    void send(EpollConnection* connection);
+    void updateEvents(EpollConnection* connection);
+    void closeConnection(EpollConnection* connection);
+    void closeIdleConnections();
+
+    /**
+     * Returns the key of the client in the rate limiter.
+     * @param  peer
+     * @return uint32_t The IPv4 address, or a hash of the /64 prefix of the IPv6 address.
+     */
+    uint32_t getAddressKey(const struct sockaddr_storage* peer);
+
+    bool fail(String error);
+};
+
+#endif
@@ -0,0 +1,59 @@
+#include "FakeGpio.h"
+
+FakeGpio::FakeGpio()
+{
+  memset(modes, INPUT, sizeof(modes));
+  memset(outputs, LOW, sizeof(outputs));
+  memset(inputs, LOW, sizeof(inputs));
+  memset(driven, 0, sizeof(driven));
+}
+
+bool FakeGpio::hasPin(byte gpioNumber)
+{
+  return gpioNumber < FAKE_GPIO_PIN_COUNT;
+}
+
+void FakeGpio::setMode(byte gpioNumber, byte mode)
+{
+  if (!hasPin(gpioNumber)) {
+    return;
+  }
+
+  modes[gpioNumber] = mode;
+}
+
+void FakeGpio::write(byte gpioNumber, byte level)
+{
+  if (!hasPin(gpioNumber)) {
+    return;
+  }
+
+  outputs[gpioNumber] = level ? HIGH : LOW;
+}
+
+byte FakeGpio::read(byte gpioNumber)
+{
+  if (!hasPin(gpioNumber)) {
+    return LOW;
+  }
+
+  if (modes[gpioNumber] == OUTPUT) {
+    return outputs[gpioNumber];
+  }
+
+  if (modes[gpioNumber] == INPUT_PULLUP && !driven[gpioNumber]) {
+    return HIGH;
+  }
+
+  return inputs[gpioNumber];
+}
+
+void FakeGpio::setInput(byte gpioNumber, byte level)
+{
+  if (!hasPin(gpioNumber)) {
+    return;
+  }
+
+  inputs[gpioNumber] = level ? HIGH : LOW;
+  driven[gpioNumber] = true;
+}
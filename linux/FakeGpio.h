@@ -0,0 +1,38 @@
+#ifndef FAKE_GPIO_H
+#define FAKE_GPIO_H
+
+#include <Arduino.h>
+
+#include "Platform.h"
+
+#define FAKE_GPIO_PIN_COUNT 16
+
+/**
+ * Pins in memory, for running without hardware and for tests.
+ * An output reads back what was written, an input reads what setInput() set, or high with the pullup.
+ */
+class FakeGpio : public GpioDriver
+{
+  public:
+    byte modes[FAKE_GPIO_PIN_COUNT];
+    byte outputs[FAKE_GPIO_PIN_COUNT];
+    byte inputs[FAKE_GPIO_PIN_COUNT];
+    // Whether setInput() drives the pin, a pin driven by nothing floats, or reads high with the pullup.
+    bool driven[FAKE_GPIO_PIN_COUNT];
+
+    FakeGpio();
+
+    bool hasPin(byte gpioNumber);
+    void setMode(byte gpioNumber, byte mode);
+    void write(byte gpioNumber, byte level);
+    byte read(byte gpioNumber);
+
+    /**
+     * Sets the level the outside world drives the pin to, when it is an input.
+     * @param gpioNumber
+     * @param level
+     */
+    void setInput(byte gpioNumber, byte level);
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "FileSettingsStore.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+FileSettingsStore::FileSettingsStore(String path)
+{
+  this->path = path;
+}
+
+bool FileSettingsStore::begin(size_t size)
+{
+  bytes.assign(size, 0);
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    // a new node, the settings are initialized by Settings
+    if (errno == ENOENT) {
+      return true;
+    }
+
+    return fail("Could not open " + path + ": " + String(strerror(errno)));
+  }
+
+  // a shorter file is from an older layout, the rest reads as 0 as an erased EEPROM would
+  size_t offset = 0;
+  while (offset < size) {
+    ssize_t length = ::read(fd, &bytes[offset], size - offset);
+    if (length <= 0) {
+      break;
+    }
+    offset += length;
+  }
+
+  close(fd);
+  return true;
+}
+
+byte FileSettingsStore::read(int address)
+{
+  if (address < 0 || (size_t)address >= bytes.size()) {
+    return 0;
+  }
+
+  return bytes[address];
+}
+
+void FileSettingsStore::write(int address, byte value)
+{
+  if (address < 0 || (size_t)address >= bytes.size() || bytes[address] == value) {
+    return;
+  }
+
+  bytes[address] = value;
+  changed = true;
+}
+
+bool FileSettingsStore::commit()
+{
+  if (!changed) {
+    return true;
+  }
+
+  String temporaryPath = path + ".tmp";
+  int fd = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return fail("Could not create " + temporaryPath + ": " + String(strerror(errno)));
+  }
+
+  size_t offset = 0;
+  while (offset < bytes.size()) {
+    ssize_t length = ::write(fd, &bytes[offset], bytes.size() - offset);
+    if (length <= 0) {
+      close(fd);
+      unlink(temporaryPath.c_str());
+      return fail("Could not write " + temporaryPath + ": " + String(strerror(errno)));
+    }
+    offset += length;
+  }
+
+  if (fsync(fd) < 0 || close(fd) < 0) {
+    unlink(temporaryPath.c_str());
+    return fail("Could not write " + temporaryPath + ": " + String(strerror(errno)));
+  }
+
+  if (rename(temporaryPath.c_str(), path.c_str()) < 0) {
+    unlink(temporaryPath.c_str());
+    return fail("Could not replace " + path + ": " + String(strerror(errno)));
+  }
+
+  changed = false;
+  return true;
+}
+
+bool FileSettingsStore::fail(String error)
+{
+  this->error = error;
+  fprintf(stderr, "%s\n", error.c_str());
+  return false;
+}
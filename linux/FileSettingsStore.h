@@ -0,0 +1,33 @@
+#ifndef FILE_SETTINGS_STORE_H
+#define FILE_SETTINGS_STORE_H
+
+#include <Arduino.h>
+#include <vector>
+
+#include "Platform.h"
+
+/**
+ * The settings in a file, the same bytes as the EEPROM of the ESP8266.
+ * The file is replaced by a rename on commit, so a crash leaves either the old or the new settings, never half of them.
+ */
+class FileSettingsStore : public SettingsStore
+{
+  public:
+    String path;
+    String error;
+
+    FileSettingsStore(String path);
+
+    bool begin(size_t size);
+    byte read(int address);
+    void write(int address, byte value);
+    bool commit();
+
+  private:
+    std::vector<byte> bytes;
+    bool changed = false;
+
+    bool fail(String error);
+};
+
+#endif
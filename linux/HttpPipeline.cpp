@@ -0,0 +1,98 @@
+#include "HttpPipeline.h"
+
+void HttpPipeline::setup(RestApi* api)
+{
+  this->api = api;
+}
+
+bool HttpPipeline::processNext(HttpSession* session)
+{
+  if (session->closing) {
+    return false;
+  }
+
+  size_t length;
+  if (!getRequestLength(session->input, &length)) {
+    HttpResponse response(413, "Payload Too Large", "The request can't be longer than " + String(HTTP_PIPELINE_MAX_REQUEST_SIZE) + " bytes.");
+    session->output += response.toString().str();
+    session->input.clear();
+    session->closing = true;
+    return false;
+  }
+
+  if (length == 0) {
+    return false;
+  }
+
+  requests++;
+
+  // refused before parsing, it costs the same however long the request is,
+  // and the connection is closed, as without parsing it is unknown whether the client expects that
+  uint32_t retryAfterSeconds;
+  if (!rateLimiter.admit(session->address, &retryAfterSeconds)) {
+    session->input.clear();
+    session->closing = true;
+
+    HttpResponse response = HttpResponse::TooManyRequests(retryAfterSeconds);
+    session->output += response.toString().str();
+  }
+  else {
+    HttpRequest request;
+    request.parse(String(session->input.substr(0, length)));
+    session->input.erase(0, length);
+
+    String connectionHeader = request.getHeader("Connection");
+    connectionHeader.toLowerCase();
+    if (request.protocol.indexOf("http/1.0") == 0) {
+      session->closing = connectionHeader != "keep-alive";
+    }
+    else {
+      session->closing = connectionHeader == "close";
+    }
+
+    HttpResponse response = api->processRequest(&request);
+    response.keepAlive = !session->closing;
+    session->output += response.toString().str();
+  }
+
+  if (session->closing || session->input.size() == 0) {
+    return false;
+  }
+
+  size_t nextLength;
+  return !getRequestLength(session->input, &nextLength) || nextLength > 0;
+}
+
+bool HttpPipeline::getRequestLength(const std::string& input, size_t* length)
+{
+  *length = 0;
+
+  size_t headersEnd = input.find("\r\n\r\n");
+  if (headersEnd == std::string::npos) {
+    return input.size() <= HTTP_PIPELINE_MAX_REQUEST_SIZE;
+  }
+
+  size_t dataLength = 0;
+  String headers(input.substr(0, headersEnd));
+  headers.toLowerCase();
+  int fieldIndex = headers.indexOf("\ncontent-length:");
+  if (fieldIndex >= 0) {
+    dataLength = strtoul(headers.c_str() + fieldIndex + 16, nullptr, 10);
+  }
+
+  // a huge length, or a negative one read as huge, can't wrap the sum around
+  if (dataLength > HTTP_PIPELINE_MAX_REQUEST_SIZE) {
+    return false;
+  }
+
+  size_t requestLength = headersEnd + 4 + dataLength;
+  if (requestLength > HTTP_PIPELINE_MAX_REQUEST_SIZE) {
+    return false;
+  }
+
+  if (input.size() >= requestLength) {
+    *length = requestLength;
+  }
+
+  return true;
+}
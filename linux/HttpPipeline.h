@@ -0,0 +1,57 @@
+#ifndef HTTP_PIPELINE_H
+#define HTTP_PIPELINE_H
+
+#include <Arduino.h>
+#include <string>
+
+#include "RestApi.h"
+#include "RateLimiter.h"
+
+// A request with the headers and the data can't be longer, the connection is closed with 413.
+#define HTTP_PIPELINE_MAX_REQUEST_SIZE 65536
+
+/**
+ * The HTTP state of a connection, the bytes received and not processed yet, and the responses not sent yet.
+ */
+struct HttpSession {
+  std::string input;
+  std::string output;
+  // IPv4 address of the client, or the hash of its IPv6 address, the key of the rate limiter.
+  uint32_t address = 0;
+  // Set by "Connection: close", HTTP/1.0 and the client closing its side,
+  // the connection is closed once the responses are written.
+  bool closing = false;
+  bool peerClosed = false;
+};
+
+/**
+ * Frames the requests of a connection by their Content-Length, and answers them by the REST API.
+ * Works on the bytes only, so the server, the replay of a capture and the fuzzer run the same code.
+ */
+class HttpPipeline
+{
+  public:
+    RestApi* api;
+    RateLimiter rateLimiter;
+
+    uint32_t requests = 0;
+
+    void setup(RestApi* api);
+
+    /**
+     * Answers the first request of the input, if it arrived whole, and appends the response to the output.
+     * @param  session
+     * @return bool    Whether another whole request is waiting in the input.
+     */
+    bool processNext(HttpSession* session);
+
+    /**
+     * Returns the length of the first request in the buffer, once it arrived whole.
+     * @param  input
+     * @param  length Set to the length of the request, or 0 if it is incomplete.
+     * @return bool   False if the request is malformed or too long.
+     */
+    static bool getRequestLength(const std::string& input, size_t* length);
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "LinuxGpio.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+
+LinuxGpio::LinuxGpio()
+{
+  for (byte pinIndex = 0; pinIndex < LINUX_GPIO_PIN_COUNT; pinIndex++) {
+    lineOffsets[pinIndex] = LINUX_GPIO_NO_LINE;
+    lineFds[pinIndex] = -1;
+    levels[pinIndex] = LOW;
+  }
+}
+
+LinuxGpio::~LinuxGpio()
+{
+  for (byte pinIndex = 0; pinIndex < LINUX_GPIO_PIN_COUNT; pinIndex++) {
+    if (lineFds[pinIndex] >= 0) {
+      close(lineFds[pinIndex]);
+    }
+  }
+
+  if (chipFd >= 0) {
+    close(chipFd);
+  }
+}
+
+bool LinuxGpio::begin(String chipPath)
+{
+  chipFd = open(chipPath.c_str(), O_RDWR | O_CLOEXEC);
+  if (chipFd < 0) {
+    return fail("Could not open " + chipPath + ": " + String(strerror(errno)));
+  }
+
+  struct gpiochip_info info;
+  memset(&info, 0, sizeof(info));
+  if (ioctl(chipFd, GPIO_GET_CHIPINFO_IOCTL, &info) < 0) {
+    return fail(chipPath + " is not a gpio chip: " + String(strerror(errno)));
+  }
+
+  for (byte pinIndex = 0; pinIndex < LINUX_GPIO_PIN_COUNT; pinIndex++) {
+    if (lineOffsets[pinIndex] != LINUX_GPIO_NO_LINE && lineOffsets[pinIndex] >= info.lines) {
+      return fail("Pin " + String(pinIndex) + " is mapped to line " + String(lineOffsets[pinIndex]) + ", " + String(info.name) + " has " + String(info.lines) + " lines.");
+    }
+  }
+
+  return true;
+}
+
+void LinuxGpio::mapPin(byte digitalPinNumber, uint32_t lineOffset)
+{
+  if (digitalPinNumber < LINUX_GPIO_PIN_COUNT) {
+    lineOffsets[digitalPinNumber] = lineOffset;
+  }
+}
+
+bool LinuxGpio::hasPin(byte gpioNumber)
+{
+  return gpioNumber < LINUX_GPIO_PIN_COUNT && lineOffsets[gpioNumber] != LINUX_GPIO_NO_LINE;
+}
+
+void LinuxGpio::setMode(byte gpioNumber, byte mode)
+{
+  if (!hasPin(gpioNumber) || chipFd < 0) {
+    return;
+  }
+
+  struct gpio_v2_line_request request;
+  memset(&request, 0, sizeof(request));
+  request.offsets[0] = lineOffsets[gpioNumber];
+  request.num_lines = 1;
+  strncpy(request.consumer, LINUX_GPIO_CONSUMER, sizeof(request.consumer) - 1);
+
+  if (mode == OUTPUT) {
+    // the output starts at the last written level, not glitching to low
+    request.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+    request.config.num_attrs = 1;
+    request.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    request.config.attrs[0].attr.values = levels[gpioNumber];
+    request.config.attrs[0].mask = 1;
+  }
+  else {
+    request.config.flags = GPIO_V2_LINE_FLAG_INPUT | (mode == INPUT_PULLUP ? GPIO_V2_LINE_FLAG_BIAS_PULL_UP : GPIO_V2_LINE_FLAG_BIAS_DISABLED);
+  }
+
+  // a requested line is reconfigured in place, so it is not released to other processes in between
+  if (lineFds[gpioNumber] >= 0) {
+    if (ioctl(lineFds[gpioNumber], GPIO_V2_LINE_SET_CONFIG_IOCTL, &request.config) < 0) {
+      fail("Could not reconfigure line " + String(lineOffsets[gpioNumber]) + ": " + String(strerror(errno)));
+    }
+    return;
+  }
+
+  if (ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &request) < 0) {
+    fail("Could not request line " + String(lineOffsets[gpioNumber]) + ": " + String(strerror(errno)));
+    return;
+  }
+
+  lineFds[gpioNumber] = request.fd;
+}
+
+void LinuxGpio::write(byte gpioNumber, byte level)
+{
+  if (!hasPin(gpioNumber)) {
+    return;
+  }
+
+  levels[gpioNumber] = level ? HIGH : LOW;
+  if (lineFds[gpioNumber] < 0) {
+    return;
+  }
+
+  struct gpio_v2_line_values values;
+  memset(&values, 0, sizeof(values));
+  values.bits = levels[gpioNumber];
+  values.mask = 1;
+  if (ioctl(lineFds[gpioNumber], GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0) {
+    fail("Could not set line " + String(lineOffsets[gpioNumber]) + ": " + String(strerror(errno)));
+  }
+}
+
+byte LinuxGpio::read(byte gpioNumber)
+{
+  if (!hasPin(gpioNumber) || lineFds[gpioNumber] < 0) {
+    return LOW;
+  }
+
+  struct gpio_v2_line_values values;
+  memset(&values, 0, sizeof(values));
+  values.mask = 1;
+  if (ioctl(lineFds[gpioNumber], GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) {
+    fail("Could not read line " + String(lineOffsets[gpioNumber]) + ": " + String(strerror(errno)));
+    return LOW;
+  }
+
+  return values.bits & 1 ? HIGH : LOW;
+}
+
+bool LinuxGpio::fail(String error)
+{
+  this->error = error;
+  fprintf(stderr, "%s\n", error.c_str());
+  return false;
+}
@@ -0,0 +1,54 @@
+#ifndef LINUX_GPIO_H
+#define LINUX_GPIO_H
+
+#include <Arduino.h>
+
+#include "Platform.h"
+
+#define LINUX_GPIO_PIN_COUNT 16
+#define LINUX_GPIO_NO_LINE 0xFFFFFFFF
+#define LINUX_GPIO_CONSUMER "HttpServerAdvanced"
+
+/**
+ * Drives the lines of a gpio character device, e.g. /dev/gpiochip0, through the v2 uAPI.
+ * The digital pins 0-15 are mapped to the line offsets given by mapPin(), the rest of the lines are left alone.
+ * A pin is requested from the kernel when its mode is set, and held until the process exits,
+ * so no other process can drive it meanwhile.
+ */
+class LinuxGpio : public GpioDriver
+{
+  public:
+    String error;
+
+    LinuxGpio();
+    ~LinuxGpio();
+
+    /**
+     * Opens the gpio chip.
+     * @param  chipPath
+     * @return bool     False if it could not be opened, see error.
+     */
+    bool begin(String chipPath);
+
+    /**
+     * Maps the digital pin to a line of the chip.
+     * @param digitalPinNumber
+     * @param lineOffset
+     */
+    void mapPin(byte digitalPinNumber, uint32_t lineOffset);
+
+    bool hasPin(byte gpioNumber);
+    void setMode(byte gpioNumber, byte mode);
+    void write(byte gpioNumber, byte level);
+    byte read(byte gpioNumber);
+
+  private:
+    int chipFd = -1;
+    uint32_t lineOffsets[LINUX_GPIO_PIN_COUNT];
+    int lineFds[LINUX_GPIO_PIN_COUNT];
+    byte levels[LINUX_GPIO_PIN_COUNT];
+
+    bool fail(String error);
+};
+
+#endif
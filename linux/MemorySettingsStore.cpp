@@ -0,0 +1,34 @@
+#include "MemorySettingsStore.h"
+
+MemorySettingsStore::MemorySettingsStore(const std::string& initialBytes)
+{
+  bytes = initialBytes;
+}
+
+bool MemorySettingsStore::begin(size_t size)
+{
+  bytes.resize(size, 0);
+  return true;
+}
+
+byte MemorySettingsStore::read(int address)
+{
+  if (address < 0 || (size_t)address >= bytes.size()) {
+    return 0;
+  }
+
+  return bytes[address];
+}
+
+void MemorySettingsStore::write(int address, byte value)
+{
+  if (address >= 0 && (size_t)address < bytes.size()) {
+    bytes[address] = value;
+  }
+}
+
+bool MemorySettingsStore::commit()
+{
+  commits++;
+  return true;
+}
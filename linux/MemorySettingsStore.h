@@ -0,0 +1,27 @@
+#ifndef MEMORY_SETTINGS_STORE_H
+#define MEMORY_SETTINGS_STORE_H
+
+#include <Arduino.h>
+#include <string>
+
+#include "Platform.h"
+
+/**
+ * The settings in memory only, for the replay and the fuzzer.
+ * Starts from the bytes given, the rest reads as 0 as an erased EEPROM would.
+ */
+class MemorySettingsStore : public SettingsStore
+{
+  public:
+    std::string bytes;
+    uint32_t commits = 0;
+
+    MemorySettingsStore(const std::string& initialBytes = "");
+
+    bool begin(size_t size);
+    byte read(int address);
+    void write(int address, byte value);
+    bool commit();
+};
+
+#endif
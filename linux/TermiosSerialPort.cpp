@@ -0,0 +1,141 @@
+#include "TermiosSerialPort.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+struct TermiosBaudRate {
+  uint32_t rate;
+  speed_t speed;
+};
+
+static const TermiosBaudRate baudRates[] = {
+  {9600, B9600},
+  {19200, B19200},
+  {38400, B38400},
+  {57600, B57600},
+  {115200, B115200},
+  {230400, B230400},
+  {460800, B460800},
+  {921600, B921600},
+  {1000000, B1000000},
+  {2000000, B2000000},
+  {4000000, B4000000},
+};
+
+TermiosSerialPort::~TermiosSerialPort()
+{
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+bool TermiosSerialPort::begin(String path, uint32_t baudRate)
+{
+  speed_t speed = 0;
+  for (size_t rateIndex = 0; rateIndex < sizeof(baudRates) / sizeof(TermiosBaudRate); rateIndex++) {
+    if (baudRates[rateIndex].rate == baudRate) {
+      speed = baudRates[rateIndex].speed;
+    }
+  }
+
+  if (speed == 0) {
+    return fail("Unsupported baud rate: " + String(baudRate));
+  }
+
+  fd = open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    return fail("Could not open " + path + ": " + String(strerror(errno)));
+  }
+
+  return setRaw(path, speed);
+}
+
+bool TermiosSerialPort::beginPty()
+{
+  fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    return fail("Could not open a pseudo terminal: " + String(strerror(errno)));
+  }
+
+  const char* slavePath = nullptr;
+  if (grantpt(fd) < 0 || unlockpt(fd) < 0 || !(slavePath = ptsname(fd))) {
+    return fail("Could not unlock the pseudo terminal: " + String(strerror(errno)));
+  }
+
+  ptyPath = slavePath;
+  return setRaw(ptyPath, B115200);
+}
+
+bool TermiosSerialPort::setRaw(String path, speed_t speed)
+{
+  struct termios options;
+  if (tcgetattr(fd, &options) < 0) {
+    return fail(path + " is not a tty: " + String(strerror(errno)));
+  }
+
+  // 8N1, no echo, no line editing, no translation of the line endings
+  cfmakeraw(&options);
+  options.c_cflag |= CLOCAL | CREAD;
+  options.c_cflag &= ~(CSTOPB | CRTSCTS);
+  cfsetispeed(&options, speed);
+  cfsetospeed(&options, speed);
+
+  if (tcsetattr(fd, TCSANOW, &options) < 0) {
+    return fail("Could not set up " + path + ": " + String(strerror(errno)));
+  }
+
+  tcflush(fd, TCIOFLUSH);
+  return true;
+}
+
+int TermiosSerialPort::available()
+{
+  int count = 0;
+  if (fd < 0 || ioctl(fd, FIONREAD, &count) < 0) {
+    return 0;
+  }
+
+  return count;
+}
+
+int TermiosSerialPort::read()
+{
+  byte value;
+  if (fd < 0 || ::read(fd, &value, 1) != 1) {
+    return -1;
+  }
+
+  return value;
+}
+
+int TermiosSerialPort::availableForWrite()
+{
+  int queued = 0;
+  if (fd < 0 || ioctl(fd, TIOCOUTQ, &queued) < 0) {
+    return 0;
+  }
+
+  return max(TERMIOS_SERIAL_OUTPUT_BUFFER_SIZE - queued, 0);
+}
+
+size_t TermiosSerialPort::write(const uint8_t* data, size_t length)
+{
+  if (fd < 0) {
+    return 0;
+  }
+
+  ssize_t written = ::write(fd, data, length);
+  return written < 0 ? 0 : written;
+}
+
+bool TermiosSerialPort::fail(String error)
+{
+  this->error = error;
+  fprintf(stderr, "%s\n", error.c_str());
+  return false;
+}
@@ -0,0 +1,53 @@
+#ifndef TERMIOS_SERIAL_PORT_H
+#define TERMIOS_SERIAL_PORT_H
+
+#include <Arduino.h>
+
+#include <termios.h>
+
+#include "Platform.h"
+
+// Size of the kernel output buffer of a tty, availableForWrite() is the part of it not queued yet.
+#define TERMIOS_SERIAL_OUTPUT_BUFFER_SIZE 4096
+
+/**
+ * A tty, e.g. /dev/ttyUSB0 or /dev/serial0, in raw 8N1 mode, non-blocking.
+ * Or the master side of a pseudo terminal, for simulated nodes, its slave side acts as the serial device of the node.
+ */
+class TermiosSerialPort : public SerialPort
+{
+  public:
+    String error;
+    // Of the slave side, if a pseudo terminal is opened.
+    String ptyPath;
+
+    ~TermiosSerialPort();
+
+    /**
+     * Opens the tty and sets it up.
+     * @param  path
+     * @param  baudRate One of the standard rates, 9600-4000000.
+     * @return bool     False if it could not be opened, or the rate is not supported, see error.
+     */
+    bool begin(String path, uint32_t baudRate);
+
+    /**
+     * Opens a new pseudo terminal, in raw mode. What the node writes is read from ptyPath, and the other way around.
+     * @return bool False if the pseudo terminals have run out, see error.
+     */
+    bool beginPty();
+
+    int available();
+    int read();
+    int availableForWrite();
+    size_t write(const uint8_t* data, size_t length);
+
+  private:
+    int fd = -1;
+
+    bool setRaw(String path, speed_t speed);
+
+    bool fail(String error);
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "TrafficCapture.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t getMonotonicMicros()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+TrafficCapture::TrafficCapture(String path)
+{
+  this->path = path;
+}
+
+TrafficCapture::~TrafficCapture()
+{
+  if (file) {
+    fclose(file);
+  }
+}
+
+bool TrafficCapture::begin(SettingsStore* store, size_t settingsLength, RateLimiter* rateLimiter)
+{
+  file = fopen(path.c_str(), "wbe");
+  if (!file) {
+    return fail("Could not create " + path + ": " + String(strerror(errno)));
+  }
+
+  fwrite(TRAFFIC_CAPTURE_MAGIC, 1, 4, file);
+  fputc(TRAFFIC_CAPTURE_VERSION, file);
+  writeVarint(settingsLength);
+  for (size_t address = 0; address < settingsLength; address++) {
+    fputc(store->read(address), file);
+  }
+  writeVarint(rateLimiter->rate);
+  writeVarint(rateLimiter->burst);
+
+  lastMicros = getMonotonicMicros();
+  return true;
+}
+
+void TrafficCapture::recordOpen(uint32_t connectionId, uint32_t address)
+{
+  writeHeader(TRAFFIC_RECORD_OPEN, connectionId);
+  writeVarint(address);
+}
+
+void TrafficCapture::recordInput(uint32_t connectionId, const char* data, size_t length)
+{
+  writeHeader(TRAFFIC_RECORD_INPUT, connectionId);
+  writeVarint(length);
+  fwrite(data, 1, length, file);
+}
+
+void TrafficCapture::recordOutput(uint32_t connectionId, const char* data, size_t length)
+{
+  writeHeader(TRAFFIC_RECORD_OUTPUT, connectionId);
+  writeVarint(length);
+  fwrite(data, 1, length, file);
+}
+
+void TrafficCapture::recordClose(uint32_t connectionId)
+{
+  writeHeader(TRAFFIC_RECORD_CLOSE, connectionId);
+}
+
+void TrafficCapture::flush()
+{
+  if (file) {
+    fflush(file);
+  }
+}
+
+bool TrafficCapture::open(std::string* settings, RateLimiter* rateLimiter)
+{
+  file = fopen(path.c_str(), "rbe");
+  if (!file) {
+    return fail("Could not open " + path + ": " + String(strerror(errno)));
+  }
+
+  char magic[4];
+  if (fread(magic, 1, 4, file) != 4 || memcmp(magic, TRAFFIC_CAPTURE_MAGIC, 4) != 0) {
+    return fail(path + " is not a capture.");
+  }
+
+  int version = fgetc(file);
+  if (version != TRAFFIC_CAPTURE_VERSION) {
+    return fail(path + " is a capture of version " + String(version) + ", expected " + String(TRAFFIC_CAPTURE_VERSION) + ".");
+  }
+
+  uint64_t settingsLength;
+  if (!readVarint(&settingsLength) || settingsLength > 65536) {
+    return fail(path + " is truncated.");
+  }
+
+  settings->resize(settingsLength);
+  if (fread(&(*settings)[0], 1, settingsLength, file) != settingsLength) {
+    return fail(path + " is truncated.");
+  }
+
+  uint64_t rate;
+  uint64_t burst;
+  if (!readVarint(&rate) || !readVarint(&burst)) {
+    return fail(path + " is truncated.");
+  }
+  rateLimiter->setup(rate, burst);
+
+  return true;
+}
+
+bool TrafficCapture::read(TrafficRecord* record)
+{
+  int type = fgetc(file);
+  if (type == EOF) {
+    return false;
+  }
+
+  uint64_t connectionId;
+  if (!readVarint(&connectionId) || !readVarint(&record->deltaMicros)) {
+    return fail(path + " is truncated.");
+  }
+
+  record->type = (TrafficRecordType)type;
+  record->connectionId = connectionId;
+  record->address = 0;
+  record->data.clear();
+
+  uint64_t value;
+  switch (type) {
+    case TRAFFIC_RECORD_OPEN:
+      if (!readVarint(&value)) {
+        return fail(path + " is truncated.");
+      }
+      record->address = value;
+      return true;
+    case TRAFFIC_RECORD_INPUT:
+    case TRAFFIC_RECORD_OUTPUT:
+      if (!readVarint(&value) || value > (1 << 24)) {
+        return fail(path + " is truncated.");
+      }
+      record->data.resize(value);
+      if (value > 0 && fread(&record->data[0], 1, value, file) != value) {
+        return fail(path + " is truncated.");
+      }
+      return true;
+    case TRAFFIC_RECORD_CLOSE:
+      return true;
+  }
+
+  return fail(path + " has an unknown record type " + String(type) + ".");
+}
+
+void TrafficCapture::writeHeader(TrafficRecordType type, uint32_t connectionId)
+{
+  uint64_t nowMicros = getMonotonicMicros();
+  fputc(type, file);
+  writeVarint(connectionId);
+  writeVarint(nowMicros - lastMicros);
+  lastMicros = nowMicros;
+}
+
+void TrafficCapture::writeVarint(uint64_t value)
+{
+  while (value >= 0x80) {
+    fputc((value & 0x7F) | 0x80, file);
+    value >>= 7;
+  }
+  fputc(value, file);
+}
+
+bool TrafficCapture::readVarint(uint64_t* value)
+{
+  *value = 0;
+  for (byte shift = 0; shift < 64; shift += 7) {
+    int nextByte = fgetc(file);
+    if (nextByte == EOF) {
+      return false;
+    }
+
+    *value |= (uint64_t)(nextByte & 0x7F) << shift;
+    if (!(nextByte & 0x80)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool TrafficCapture::fail(String error)
+{
+  this->error = error;
+  fprintf(stderr, "%s\n", error.c_str());
+  return false;
+}
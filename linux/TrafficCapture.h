@@ -0,0 +1,91 @@
+#ifndef TRAFFIC_CAPTURE_H
+#define TRAFFIC_CAPTURE_H
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <string>
+
+#include "Platform.h"
+#include "RateLimiter.h"
+
+#define TRAFFIC_CAPTURE_MAGIC "HSAC"
+#define TRAFFIC_CAPTURE_VERSION 1
+
+enum TrafficRecordType {
+  TRAFFIC_RECORD_OPEN = 1,
+  TRAFFIC_RECORD_INPUT = 2,
+  TRAFFIC_RECORD_OUTPUT = 3,
+  TRAFFIC_RECORD_CLOSE = 4
+};
+
+struct TrafficRecord {
+  TrafficRecordType type;
+  uint32_t connectionId;
+  // Time since the previous record.
+  uint64_t deltaMicros;
+  // The address of the client for the open records.
+  uint32_t address;
+  // The bytes of a segment as read from the socket, or of the responses as written.
+  std::string data;
+};
+
+/**
+ * File of the traffic of the server, for replaying it by hsa-replay.
+ *
+ * The file starts with "HSAC", the version byte, the length and the bytes of the settings at the start,
+ * then the rate and the burst of the rate limiter.
+ * Every record is the type byte, the connection id and the microseconds since the previous record as varints,
+ * then for the open records the address, for the input and output records the length and the bytes.
+ * The varints are LEB128, 7 bits a byte, the lowest first, so a small segment costs a few bytes above its data.
+ */
+class TrafficCapture
+{
+  public:
+    String path;
+    String error;
+
+    TrafficCapture(String path);
+    ~TrafficCapture();
+
+    /**
+     * Creates the file, and writes the state the traffic starts from.
+     * @param  store
+     * @param  settingsLength
+     * @param  rateLimiter
+     * @return bool           False if the file could not be created, see error.
+     */
+    bool begin(SettingsStore* store, size_t settingsLength, RateLimiter* rateLimiter);
+
+    void recordOpen(uint32_t connectionId, uint32_t address);
+    void recordInput(uint32_t connectionId, const char* data, size_t length);
+    void recordOutput(uint32_t connectionId, const char* data, size_t length);
+    void recordClose(uint32_t connectionId);
+
+    void flush();
+
+    /**
+     * Opens a capture for reading.
+     * @param  settings    Set to the bytes of the settings at the start.
+     * @param  rateLimiter Set up with the rate and the burst of the capture.
+     * @return bool        False if the file could not be opened or is not a capture, see error.
+     */
+    bool open(std::string* settings, RateLimiter* rateLimiter);
+
+    /**
+     * Reads the next record.
+     * @param  record
+     * @return bool   False at the end of the file, or if the file is truncated.
+     */
+    bool read(TrafficRecord* record);
+
+  private:
+    FILE* file = nullptr;
+    uint64_t lastMicros = 0;
+
+    void writeHeader(TrafficRecordType type, uint32_t connectionId);
+    void writeVarint(uint64_t value);
+    bool readVarint(uint64_t* value);
+    bool fail(String error);
+};
+
+#endif
@@ -0,0 +1,423 @@
+#include "Arduino.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <strings.h>
+#include <time.h>
+
+static uint64_t getMonotonicMicros()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// the times start at the start of the process, as they start at the boot on the ESP8266
+static const uint64_t startMicros = getMonotonicMicros();
+
+static bool virtualClock = false;
+static uint64_t virtualMicros = 0;
+
+static uint64_t getElapsedMicros()
+{
+  return virtualClock ? virtualMicros : getMonotonicMicros() - startMicros;
+}
+
+unsigned long millis()
+{
+  return (uint32_t)(getElapsedMicros() / 1000);
+}
+
+unsigned long micros()
+{
+  return (uint32_t)getElapsedMicros();
+}
+
+void useVirtualClock(uint64_t startMicros)
+{
+  virtualClock = true;
+  virtualMicros = startMicros;
+}
+
+void advanceVirtualClock(uint64_t elapsedMicros)
+{
+  virtualMicros += elapsedMicros;
+}
+
+void delay(unsigned long millis)
+{
+  if (virtualClock) {
+    advanceVirtualClock((uint64_t)millis * 1000);
+    return;
+  }
+
+  struct timespec duration;
+  duration.tv_sec = millis / 1000;
+  duration.tv_nsec = (millis % 1000) * 1000000;
+  nanosleep(&duration, nullptr);
+}
+
+static std::string formatUnsigned(unsigned long long value, unsigned char base)
+{
+  if (base < 2 || base > 36) {
+    base = DEC;
+  }
+
+  if (value == 0) {
+    return "0";
+  }
+
+  std::string digits;
+  while (value > 0) {
+    byte digit = value % base;
+    digits.insert(digits.begin(), digit < 10 ? '0' + digit : 'a' + digit - 10);
+    value /= base;
+  }
+
+  return digits;
+}
+
+static std::string formatSigned(long long value, unsigned char base)
+{
+  // as the Arduino core, the negative numbers are only signed in decimal
+  if (value < 0 && base == DEC) {
+    return "-" + formatUnsigned(-(unsigned long long)value, base);
+  }
+
+  return formatUnsigned((unsigned long long)value, base);
+}
+
+String::String(const char* value) : value(value ? value : "")
+{
+}
+
+String::String(const std::string& value) : value(value)
+{
+}
+
+String::String(const __FlashStringHelper* value) : String(reinterpret_cast<const char*>(value))
+{
+}
+
+String::String(char value) : value(1, value)
+{
+}
+
+String::String(int value, unsigned char base) : value(base == DEC ? formatSigned(value, base) : formatUnsigned((unsigned int)value, base))
+{
+}
+
+String::String(unsigned int value, unsigned char base) : value(formatUnsigned(value, base))
+{
+}
+
+String::String(long value, unsigned char base) : value(base == DEC ? formatSigned(value, base) : formatUnsigned((unsigned long)value, base))
+{
+}
+
+String::String(unsigned long value, unsigned char base) : value(formatUnsigned(value, base))
+{
+}
+
+String::String(long long value, unsigned char base) : value(formatSigned(value, base))
+{
+}
+
+String::String(unsigned long long value, unsigned char base) : value(formatUnsigned(value, base))
+{
+}
+
+String::String(double value, unsigned char decimalPlaces)
+{
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", decimalPlaces, value);
+  this->value = buffer;
+}
+
+unsigned int String::length() const
+{
+  return value.length();
+}
+
+const char* String::c_str() const
+{
+  return value.c_str();
+}
+
+const std::string& String::str() const
+{
+  return value;
+}
+
+bool String::reserve(unsigned int size)
+{
+  value.reserve(size);
+  return true;
+}
+
+char String::charAt(unsigned int index) const
+{
+  return index < value.length() ? value[index] : 0;
+}
+
+void String::setCharAt(unsigned int index, char value)
+{
+  if (index < this->value.length()) {
+    this->value[index] = value;
+  }
+}
+
+char String::operator[](unsigned int index) const
+{
+  return charAt(index);
+}
+
+char& String::operator[](unsigned int index)
+{
+  return value[index];
+}
+
+String& String::operator+=(const String& value)
+{
+  this->value += value.value;
+  return *this;
+}
+
+String& String::operator+=(const char* value)
+{
+  if (value) {
+    this->value += value;
+  }
+  return *this;
+}
+
+String& String::operator+=(const __FlashStringHelper* value)
+{
+  return *this += reinterpret_cast<const char*>(value);
+}
+
+String& String::operator+=(char value)
+{
+  this->value += value;
+  return *this;
+}
+
+bool String::concat(const String& value)
+{
+  this->value += value.value;
+  return true;
+}
+
+bool String::operator==(const String& value) const
+{
+  return this->value == value.value;
+}
+
+bool String::operator==(const char* value) const
+{
+  return this->value == (value ? value : "");
+}
+
+bool String::operator!=(const String& value) const
+{
+  return !(*this == value);
+}
+
+bool String::operator!=(const char* value) const
+{
+  return !(*this == value);
+}
+
+bool String::operator<(const String& value) const
+{
+  return this->value < value.value;
+}
+
+bool String::equals(const String& value) const
+{
+  return *this == value;
+}
+
+bool String::equalsIgnoreCase(const String& value) const
+{
+  return this->value.length() == value.value.length() && strcasecmp(this->value.c_str(), value.value.c_str()) == 0;
+}
+
+bool String::startsWith(const String& prefix) const
+{
+  return value.compare(0, prefix.value.length(), prefix.value) == 0;
+}
+
+bool String::endsWith(const String& suffix) const
+{
+  return
+    value.length() >= suffix.value.length() &&
+    value.compare(value.length() - suffix.value.length(), suffix.value.length(), suffix.value) == 0;
+}
+
+int String::indexOf(char value, unsigned int fromIndex) const
+{
+  size_t index = this->value.find(value, fromIndex);
+  return index == std::string::npos ? -1 : (int)index;
+}
+
+int String::indexOf(const String& value, unsigned int fromIndex) const
+{
+  size_t index = this->value.find(value.value, fromIndex);
+  return index == std::string::npos ? -1 : (int)index;
+}
+
+int String::lastIndexOf(char value) const
+{
+  size_t index = this->value.rfind(value);
+  return index == std::string::npos ? -1 : (int)index;
+}
+
+int String::lastIndexOf(const String& value) const
+{
+  size_t index = this->value.rfind(value.value);
+  return index == std::string::npos ? -1 : (int)index;
+}
+
+String String::substring(unsigned int beginIndex) const
+{
+  return substring(beginIndex, value.length());
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const
+{
+  // as the Arduino core, the indexes are swapped if they are in reverse, and clipped to the length
+  if (beginIndex > endIndex) {
+    unsigned int index = beginIndex;
+    beginIndex = endIndex;
+    endIndex = index;
+  }
+
+  if (beginIndex >= value.length()) {
+    return String();
+  }
+
+  if (endIndex > value.length()) {
+    endIndex = value.length();
+  }
+
+  return String(value.substr(beginIndex, endIndex - beginIndex));
+}
+
+void String::remove(unsigned int index)
+{
+  if (index < value.length()) {
+    value.erase(index);
+  }
+}
+
+void String::remove(unsigned int index, unsigned int count)
+{
+  if (index < value.length()) {
+    value.erase(index, count);
+  }
+}
+
+void String::replace(const String& find, const String& replacement)
+{
+  if (find.value.length() == 0) {
+    return;
+  }
+
+  size_t index = 0;
+  while ((index = value.find(find.value, index)) != std::string::npos) {
+    value.replace(index, find.value.length(), replacement.value);
+    index += replacement.value.length();
+  }
+}
+
+void String::replace(char find, char replacement)
+{
+  for (size_t index = 0; index < value.length(); index++) {
+    if (value[index] == find) {
+      value[index] = replacement;
+    }
+  }
+}
+
+void String::trim()
+{
+  size_t begin = 0;
+  while (begin < value.length() && isspace((unsigned char)value[begin])) {
+    begin++;
+  }
+
+  size_t end = value.length();
+  while (end > begin && isspace((unsigned char)value[end - 1])) {
+    end--;
+  }
+
+  value = value.substr(begin, end - begin);
+}
+
+void String::toLowerCase()
+{
+  for (size_t index = 0; index < value.length(); index++) {
+    value[index] = tolower((unsigned char)value[index]);
+  }
+}
+
+void String::toUpperCase()
+{
+  for (size_t index = 0; index < value.length(); index++) {
+    value[index] = toupper((unsigned char)value[index]);
+  }
+}
+
+long String::toInt() const
+{
+  return atol(value.c_str());
+}
+
+float String::toFloat() const
+{
+  return atof(value.c_str());
+}
+
+String operator+(const String& left, const String& right)
+{
+  return String(left.value + right.value);
+}
+
+String operator+(const String& left, const char* right)
+{
+  return String(left.value + (right ? right : ""));
+}
+
+String operator+(const char* left, const String& right)
+{
+  return String((left ? left : "") + right.value);
+}
+
+String operator+(const String& left, char right)
+{
+  return String(left.value + right);
+}
+
+String operator+(const String& left, const __FlashStringHelper* right)
+{
+  return left + reinterpret_cast<const char*>(right);
+}
+
+String operator+(const __FlashStringHelper* left, const String& right)
+{
+  return reinterpret_cast<const char*>(left) + right;
+}
+
+ConsoleSerial Serial;
+
+void ConsoleSerial::print(const String& data)
+{
+  fputs(data.c_str(), stdout);
+  fflush(stdout);
+}
+
+void ConsoleSerial::println(const String& data)
+{
+  print(data + "\r\n");
+}
@@ -0,0 +1,160 @@
+#ifndef ARDUINO_COMPAT_H
+#define ARDUINO_COMPAT_H
+
+/**
+ * The part of the Arduino core the portable sources use, implemented on the C++ standard library,
+ * so they compile unchanged for Linux.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+// the values of the ESP8266 core, they are stored in the settings
+#define INPUT 0x00
+#define OUTPUT 0x01
+#define INPUT_PULLUP 0x02
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define DEC 10
+#define HEX 16
+#define BIN 2
+
+#define IRAM_ATTR
+
+// there's no separate flash on Linux, the constant strings are only typed as the ones of the boards
+#define PROGMEM
+#define PSTR(value) (value)
+#define FPSTR(pointer) (reinterpret_cast<const __FlashStringHelper*>(pointer))
+#define F(value) FPSTR(PSTR(value))
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_ptr(address) (*(const void* const*)(address))
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define memcpy_P memcpy
+
+class __FlashStringHelper;
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+
+template <typename T>
+const T& min(const T& a, const T& b)
+{
+  return b < a ? b : a;
+}
+
+template <typename T>
+const T& max(const T& a, const T& b)
+{
+  return a < b ? b : a;
+}
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long millis);
+
+/**
+ * Stops the clock of millis() and micros() at the given time, from then on it only moves by advanceVirtualClock()
+ * and delay(), so a replay of the traffic runs the same however fast the host is.
+ * @param startMicros
+ */
+void useVirtualClock(uint64_t startMicros);
+void advanceVirtualClock(uint64_t elapsedMicros);
+
+class String
+{
+  public:
+    String(const char* value = "");
+    String(const std::string& value);
+    String(const __FlashStringHelper* value);
+    String(char value);
+    String(int value, unsigned char base = DEC);
+    String(unsigned int value, unsigned char base = DEC);
+    String(long value, unsigned char base = DEC);
+    String(unsigned long value, unsigned char base = DEC);
+    String(long long value, unsigned char base = DEC);
+    String(unsigned long long value, unsigned char base = DEC);
+    String(double value, unsigned char decimalPlaces = 2);
+
+    unsigned int length() const;
+    const char* c_str() const;
+    const std::string& str() const;
+
+    bool reserve(unsigned int size);
+
+    char charAt(unsigned int index) const;
+    void setCharAt(unsigned int index, char value);
+    char operator[](unsigned int index) const;
+    char& operator[](unsigned int index);
+
+    String& operator+=(const String& value);
+    String& operator+=(const char* value);
+    String& operator+=(const __FlashStringHelper* value);
+    String& operator+=(char value);
+    bool concat(const String& value);
+
+    bool operator==(const String& value) const;
+    bool operator==(const char* value) const;
+    bool operator!=(const String& value) const;
+    bool operator!=(const char* value) const;
+    bool operator<(const String& value) const;
+    bool equals(const String& value) const;
+    bool equalsIgnoreCase(const String& value) const;
+    bool startsWith(const String& prefix) const;
+    bool endsWith(const String& suffix) const;
+
+    int indexOf(char value, unsigned int fromIndex = 0) const;
+    int indexOf(const String& value, unsigned int fromIndex = 0) const;
+    int lastIndexOf(char value) const;
+    int lastIndexOf(const String& value) const;
+
+    String substring(unsigned int beginIndex) const;
+    String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+    void remove(unsigned int index);
+    void remove(unsigned int index, unsigned int count);
+    void replace(const String& find, const String& replacement);
+    void replace(char find, char replacement);
+    void trim();
+    void toLowerCase();
+    void toUpperCase();
+
+    long toInt() const;
+    float toFloat() const;
+
+    friend String operator+(const String& left, const String& right);
+    friend String operator+(const String& left, const char* right);
+    friend String operator+(const char* left, const String& right);
+    friend String operator+(const String& left, char right);
+    friend String operator+(const String& left, const __FlashStringHelper* right);
+    friend String operator+(const __FlashStringHelper* left, const String& right);
+
+  private:
+    std::string value;
+};
+
+/**
+ * The log console, Debug writes its lines here when there's no serial queue.
+ */
+class ConsoleSerial
+{
+  public:
+    void print(const String& data);
+    void println(const String& data = "");
+};
+
+extern ConsoleSerial Serial;
+
+#endif
@@ -0,0 +1,8 @@
+#include "ESP8266WiFi.h"
+
+WiFiClass WiFi;
+
+IPAddress WiFiClass::localIP()
+{
+  return IPAddress();
+}
@@ -0,0 +1,22 @@
+#ifndef ESP8266_WIFI_COMPAT_H
+#define ESP8266_WIFI_COMPAT_H
+
+#include "Arduino.h"
+#include "IPAddress.h"
+
+/**
+ * The network of a gateway is the one of the host, it is always connected.
+ */
+class WiFiClass
+{
+  public:
+    /**
+     * Returns 0.0.0.0, the sockets are bound to every interface, and the multicast groups are joined on the default one.
+     * @return IPAddress
+     */
+    IPAddress localIP();
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,56 @@
+#include "IPAddress.h"
+
+IPAddress::IPAddress()
+{
+  memset(bytes, 0, sizeof(bytes));
+}
+
+IPAddress::IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth)
+{
+  bytes[0] = first;
+  bytes[1] = second;
+  bytes[2] = third;
+  bytes[3] = fourth;
+}
+
+IPAddress::IPAddress(uint32_t address)
+{
+  memcpy(bytes, &address, sizeof(bytes));
+}
+
+IPAddress::operator uint32_t() const
+{
+  uint32_t address;
+  memcpy(&address, bytes, sizeof(address));
+  return address;
+}
+
+uint8_t IPAddress::operator[](int index) const
+{
+  return bytes[index];
+}
+
+uint8_t& IPAddress::operator[](int index)
+{
+  return bytes[index];
+}
+
+bool IPAddress::operator==(const IPAddress& other) const
+{
+  return memcmp(bytes, other.bytes, sizeof(bytes)) == 0;
+}
+
+bool IPAddress::operator!=(const IPAddress& other) const
+{
+  return !(*this == other);
+}
+
+bool IPAddress::isSet() const
+{
+  return (uint32_t)*this != 0;
+}
+
+String IPAddress::toString() const
+{
+  return String(bytes[0]) + "." + String(bytes[1]) + "." + String(bytes[2]) + "." + String(bytes[3]);
+}
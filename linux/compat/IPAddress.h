@@ -0,0 +1,30 @@
+#ifndef IP_ADDRESS_COMPAT_H
+#define IP_ADDRESS_COMPAT_H
+
+#include "Arduino.h"
+
+/**
+ * IPv4 address as the one of the ESP8266 core, the bytes in network order, so the uint32_t is the one of the sockets.
+ */
+class IPAddress
+{
+  public:
+    IPAddress();
+    IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth);
+    IPAddress(uint32_t address);
+
+    operator uint32_t() const;
+    uint8_t operator[](int index) const;
+    uint8_t& operator[](int index);
+    bool operator==(const IPAddress& other) const;
+    bool operator!=(const IPAddress& other) const;
+
+    // 0.0.0.0 is not set, as on the ESP8266.
+    bool isSet() const;
+    String toString() const;
+
+  private:
+    uint8_t bytes[4];
+};
+
+#endif
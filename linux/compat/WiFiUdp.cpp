@@ -0,0 +1,140 @@
+#include "WiFiUdp.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+WiFiUDP::~WiFiUDP()
+{
+  stop();
+}
+
+uint8_t WiFiUDP::begin(uint16_t port)
+{
+  stop();
+
+  fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return 0;
+  }
+
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+    stop();
+    return 0;
+  }
+
+  return 1;
+}
+
+uint8_t WiFiUDP::beginMulticast(IPAddress interfaceAddress, IPAddress multicastAddress, uint16_t port)
+{
+  if (!begin(port)) {
+    return 0;
+  }
+
+  struct ip_mreq membership;
+  membership.imr_multiaddr.s_addr = (uint32_t)multicastAddress;
+  membership.imr_interface.s_addr = (uint32_t)interfaceAddress;
+  if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0) {
+    stop();
+    return 0;
+  }
+
+  return 1;
+}
+
+void WiFiUDP::stop()
+{
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+
+  received.clear();
+  readIndex = 0;
+}
+
+int WiFiUDP::parsePacket()
+{
+  received.clear();
+  readIndex = 0;
+  if (fd < 0) {
+    return 0;
+  }
+
+  char buffer[65536];
+  struct sockaddr_in peer;
+  socklen_t peerLength = sizeof(peer);
+  ssize_t length = recvfrom(fd, buffer, sizeof(buffer), 0, (struct sockaddr*)&peer, &peerLength);
+  if (length <= 0) {
+    return 0;
+  }
+
+  received.assign(buffer, length);
+  receivedFrom = IPAddress((uint32_t)peer.sin_addr.s_addr);
+  receivedFromPort = ntohs(peer.sin_port);
+  return length;
+}
+
+int WiFiUDP::read(unsigned char* buffer, size_t length)
+{
+  length = min(length, received.size() - readIndex);
+  memcpy(buffer, received.data() + readIndex, length);
+  readIndex += length;
+  return length;
+}
+
+int WiFiUDP::available()
+{
+  return received.size() - readIndex;
+}
+
+IPAddress WiFiUDP::remoteIP()
+{
+  return receivedFrom;
+}
+
+uint16_t WiFiUDP::remotePort()
+{
+  return receivedFromPort;
+}
+
+int WiFiUDP::beginPacket(IPAddress address, uint16_t port)
+{
+  sending.clear();
+  sendingTo = address;
+  sendingToPort = port;
+  return fd >= 0 ? 1 : 0;
+}
+
+size_t WiFiUDP::write(const uint8_t* buffer, size_t length)
+{
+  sending.append((const char*)buffer, length);
+  return length;
+}
+
+int WiFiUDP::endPacket()
+{
+  if (fd < 0) {
+    return 0;
+  }
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(sendingToPort);
+  address.sin_addr.s_addr = (uint32_t)sendingTo;
+  ssize_t length = sendto(fd, sending.data(), sending.size(), 0, (struct sockaddr*)&address, sizeof(address));
+  sending.clear();
+
+  return length >= 0 ? 1 : 0;
+}
@@ -0,0 +1,56 @@
+#ifndef WIFI_UDP_COMPAT_H
+#define WIFI_UDP_COMPAT_H
+
+#include <string>
+
+#include "Arduino.h"
+#include "IPAddress.h"
+
+/**
+ * The UDP socket of the ESP8266 core on a non-blocking POSIX socket, one datagram at a time as there.
+ */
+class WiFiUDP
+{
+  public:
+    ~WiFiUDP();
+
+    uint8_t begin(uint16_t port);
+
+    /**
+     * Listens on the port, and joins the multicast group.
+     * @param  interfaceAddress 0.0.0.0 for the default interface.
+     * @param  multicastAddress
+     * @param  port
+     * @return uint8_t          1 on success, 0 on failure.
+     */
+    uint8_t beginMulticast(IPAddress interfaceAddress, IPAddress multicastAddress, uint16_t port);
+    void stop();
+
+    /**
+     * Takes the next datagram, the rest of the previous one is dropped.
+     * @return int Its length, 0 if there's none.
+     */
+    int parsePacket();
+    int read(unsigned char* buffer, size_t length);
+    int available();
+    IPAddress remoteIP();
+    uint16_t remotePort();
+
+    int beginPacket(IPAddress address, uint16_t port);
+    size_t write(const uint8_t* buffer, size_t length);
+    int endPacket();
+
+  private:
+    int fd = -1;
+
+    std::string received;
+    size_t readIndex = 0;
+    IPAddress receivedFrom;
+    uint16_t receivedFromPort = 0;
+
+    std::string sending;
+    IPAddress sendingTo;
+    uint16_t sendingToPort = 0;
+};
+
+#endif
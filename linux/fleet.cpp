@@ -0,0 +1,490 @@
+#include <Arduino.h>
+
+#include <errno.h>
+#include <malloc.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+#include "RestApi.h"
+#include "EpollServer.h"
+#include "FakeGpio.h"
+#include "MemorySettingsStore.h"
+#include "TermiosSerialPort.h"
+
+// How long the event loop sleeps at most, and the period of the serial output, the deferred commits and the idle sweeps.
+#define FLEET_LOOP_TIMEOUT_MS 100
+#define FLEET_FLUSH_PERIOD_MS 1000
+
+#define FLEET_MAX_NODES 4000
+
+/**
+ * A virtual node: the REST API of a node with its own pins, EEPROM image, serial port and server.
+ */
+struct FleetNode {
+  RestApi api;
+  FakeGpio gpio;
+  MemorySettingsStore store;
+  TermiosSerialPort serialPort;
+  EpollServer server;
+  uint16_t port = 0;
+  // Whether the server has run in this pass of the event loop.
+  bool served = false;
+
+  FleetNode(const std::string& settingsBytes) : store(settingsBytes) {}
+};
+
+/**
+ * A line of the input script: at the offset the input pin of the nodes is driven to the level.
+ */
+struct FleetInput {
+  uint32_t offsetMillis;
+  uint32_t firstNode;
+  uint32_t lastNode;
+  byte pinNumber;
+  // LOW, HIGH, or FLEET_INPUT_TOGGLE
+  byte level;
+};
+
+#define FLEET_INPUT_TOGGLE 2
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int signalNumber)
+{
+  stopRequested = 1;
+}
+
+static void printUsage(const char* name)
+{
+  fprintf(stderr,
+    "Usage: %s [options]\n"
+    "Runs virtual nodes in one process, every one with its own loopback port, pins in memory, EEPROM image and pseudo terminal.\n"
+    "  --nodes {count}          Number of nodes, default 100.\n"
+    "  --port {port}            Port of the first node, the rest follow it, default 9000.\n"
+    "  --settings {path}        EEPROM image every node starts from, e.g. the settings file of a gateway.\n"
+    "  --script {path}          Input pin activity, lines of \"{millis} {node|first-last|*} {pin} {0|1|toggle}\".\n"
+    "  --script-period {millis} Repeats the script with the period, default 0, played once.\n"
+    "  --latency {millis}       Delay of every segment received, default 0.\n"
+    "  --loss {percent}         Segments lost and retransmitted, default 0.\n"
+    "  --rate {requests}        Requests per second of a client in the long run, 0 for no limit, default %d.\n"
+    "  --burst {requests}       Requests of a client at once, default %d.\n"
+    "  --report {seconds}       Period of the report, default 5.\n"
+    "  --list {path}            Writes the port and the pseudo terminal of every node to the file.\n"
+    "  --no-pty                 No pseudo terminals, /serial reads nothing.\n"
+    "  --verbose                Logs of every node to the stdout.\n",
+    name,
+    RATE_LIMITER_DEFAULT_RATE,
+    RATE_LIMITER_DEFAULT_BURST
+  );
+}
+
+static void raiseFileLimit()
+{
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+static bool readFile(const String& path, std::string* bytes)
+{
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    fprintf(stderr, "Could not open %s: %s\n", path.c_str(), strerror(errno));
+    return false;
+  }
+
+  char buffer[4096];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    bytes->append(buffer, length);
+  }
+  fclose(file);
+
+  return true;
+}
+
+static bool loadScript(const String& path, uint32_t nodeCount, std::vector<FleetInput>* inputs)
+{
+  std::string data;
+  if (!readFile(path, &data)) {
+    return false;
+  }
+
+  String script(data);
+  int lineStart = 0;
+  int lineNumber = 0;
+  while (lineStart < (int)script.length()) {
+    int lineEnd = script.indexOf('\n', lineStart);
+    if (lineEnd < 0) {
+      lineEnd = script.length();
+    }
+
+    String line = script.substring(lineStart, lineEnd);
+    lineStart = lineEnd + 1;
+    lineNumber++;
+
+    line.trim();
+    if (line.length() == 0 || line.charAt(0) == '#') {
+      continue;
+    }
+
+    char nodes[32];
+    char level[16];
+    unsigned long offsetMillis;
+    unsigned int pinNumber;
+    if (sscanf(line.c_str(), "%lu %31s %u %15s", &offsetMillis, nodes, &pinNumber, level) != 4 || pinNumber > 15) {
+      fprintf(stderr, "%s:%d: invalid line: %s\n", path.c_str(), lineNumber, line.c_str());
+      return false;
+    }
+
+    FleetInput input;
+    input.offsetMillis = offsetMillis;
+    input.pinNumber = pinNumber;
+
+    unsigned long firstNode = 0;
+    unsigned long lastNode = nodeCount - 1;
+    int nodeFields = strcmp(nodes, "*") == 0 ? 2 : sscanf(nodes, "%lu-%lu", &firstNode, &lastNode);
+    if (nodeFields == 1) {
+      lastNode = firstNode;
+    }
+    if (nodeFields < 1 || firstNode > lastNode || lastNode >= nodeCount) {
+      fprintf(stderr, "%s:%d: the nodes are out of range: %s\n", path.c_str(), lineNumber, nodes);
+      return false;
+    }
+    input.firstNode = firstNode;
+    input.lastNode = lastNode;
+
+    if (strcmp(level, "toggle") == 0) {
+      input.level = FLEET_INPUT_TOGGLE;
+    }
+    else if (strcmp(level, "0") == 0 || strcmp(level, "1") == 0) {
+      input.level = level[0] == '1' ? HIGH : LOW;
+    }
+    else {
+      fprintf(stderr, "%s:%d: invalid level: %s\n", path.c_str(), lineNumber, level);
+      return false;
+    }
+
+    if (!inputs->empty() && input.offsetMillis < inputs->back().offsetMillis) {
+      fprintf(stderr, "%s:%d: the lines must be in the order of their times\n", path.c_str(), lineNumber);
+      return false;
+    }
+
+    inputs->push_back(input);
+  }
+
+  return true;
+}
+
+/**
+ * @return size_t The resident memory of the process in bytes.
+ */
+static size_t getResidentBytes()
+{
+  FILE* file = fopen("/proc/self/statm", "r");
+  if (!file) {
+    return 0;
+  }
+
+  unsigned long pages = 0;
+  unsigned long residentPages = 0;
+  if (fscanf(file, "%lu %lu", &pages, &residentPages) != 2) {
+    residentPages = 0;
+  }
+  fclose(file);
+
+  return residentPages * sysconf(_SC_PAGESIZE);
+}
+
+static size_t getHeapBytes()
+{
+  return mallinfo2().uordblks;
+}
+
+int main(int argc, char** argv)
+{
+  long nodeCount = 100;
+  long firstPort = 9000;
+  String settingsPath = "";
+  String scriptPath = "";
+  long scriptPeriod = 0;
+  long latency = 0;
+  float lossPercent = 0;
+  long rate = RATE_LIMITER_DEFAULT_RATE;
+  long burst = RATE_LIMITER_DEFAULT_BURST;
+  long reportSeconds = 5;
+  String listPath = "";
+  bool pty = true;
+  bool verbose = false;
+
+  for (int argIndex = 1; argIndex < argc; argIndex++) {
+    String arg = argv[argIndex];
+    bool hasValue = argIndex + 1 < argc;
+
+    if (arg == "--nodes" && hasValue) {
+      nodeCount = String(argv[++argIndex]).toInt();
+    }
+    else if (arg == "--port" && hasValue) {
+      firstPort = String(argv[++argIndex]).toInt();
+    }
+    else if (arg == "--settings" && hasValue) {
+      settingsPath = argv[++argIndex];
+    }
+    else if (arg == "--script" && hasValue) {
+      scriptPath = argv[++argIndex];
+    }
+    else if (arg == "--script-period" && hasValue) {
+      scriptPeriod = String(argv[++argIndex]).toInt();
+    }
+    else if (arg == "--latency" && hasValue) {
+      latency = String(argv[++argIndex]).toInt();
+    }
+    else if (arg == "--loss" && hasValue) {
+      lossPercent = String(argv[++argIndex]).toFloat();
+    }
+    else if (arg == "--rate" && hasValue) {
+      rate = String(argv[++argIndex]).toInt();
+    }
+    else if (arg == "--burst" && hasValue) {
+      burst = String(argv[++argIndex]).toInt();
+    }
+    else if (arg == "--report" && hasValue) {
+      reportSeconds = String(argv[++argIndex]).toInt();
+    }
+    else if (arg == "--list" && hasValue) {
+      listPath = argv[++argIndex];
+    }
+    else if (arg == "--no-pty") {
+      pty = false;
+    }
+    else if (arg == "--verbose") {
+      verbose = true;
+    }
+    else {
+      printUsage(argv[0]);
+      return 2;
+    }
+  }
+
+  if (nodeCount < 1 || nodeCount > FLEET_MAX_NODES) {
+    fprintf(stderr, "The number of nodes is out of range. Range: 1-%d\n", FLEET_MAX_NODES);
+    return 2;
+  }
+
+  if (firstPort < 1 || firstPort + nodeCount - 1 > 65535) {
+    fprintf(stderr, "The ports are out of range. Range: 1-65535\n");
+    return 2;
+  }
+
+  if (rate < 0 || rate > 65535 || burst < 1 || burst > 65535) {
+    fprintf(stderr, "The rate and the burst are out of range. Range: 0-65535, 1-65535\n");
+    return 2;
+  }
+
+  if (latency < 0 || lossPercent < 0 || lossPercent >= 100 || scriptPeriod < 0 || reportSeconds < 1) {
+    fprintf(stderr, "The latency, the loss, the script period or the report period is out of range.\n");
+    return 2;
+  }
+
+  std::string settingsBytes;
+  if (settingsPath.length() > 0 && !readFile(settingsPath, &settingsBytes)) {
+    return 1;
+  }
+
+  std::vector<FleetInput> inputs;
+  if (scriptPath.length() > 0 && !loadScript(scriptPath, nodeCount, &inputs)) {
+    return 1;
+  }
+
+  raiseFileLimit();
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  int fleetFd = epoll_create1(EPOLL_CLOEXEC);
+  if (fleetFd < 0) {
+    fprintf(stderr, "Could not create the epoll instance: %s\n", strerror(errno));
+    return 1;
+  }
+
+  FILE* listFile = nullptr;
+  if (listPath.length() > 0 && !(listFile = fopen(listPath.c_str(), "w"))) {
+    fprintf(stderr, "Could not create %s: %s\n", listPath.c_str(), strerror(errno));
+    return 1;
+  }
+
+  // the footprint of a node is what the process grows by for it, measured once every node is set up
+  size_t startResidentBytes = getResidentBytes();
+  size_t startHeapBytes = getHeapBytes();
+
+  std::vector<FleetNode*> nodes;
+  for (long nodeIndex = 0; nodeIndex < nodeCount; nodeIndex++) {
+    FleetNode* node = new FleetNode(settingsBytes);
+    nodes.push_back(node);
+
+    if (verbose) {
+      node->api.enableDebug(true, false);
+    }
+
+    if (pty && !node->serialPort.beginPty()) {
+      return 1;
+    }
+
+    node->api.setupPlatform(&node->gpio, &node->store, &node->serialPort);
+    node->api.settings.setup();
+    if (node->api.settings.hasDataRestored()) {
+      node->api.pins.restorePinModesAndStates();
+    }
+    node->api.settings.setNodeName("FleetNode" + String(nodeIndex));
+    node->api.settings.deferCommits = true;
+
+    node->port = firstPort + nodeIndex;
+    node->server.setup(&node->api);
+    node->server.pipeline.rateLimiter.setup(rate, burst);
+    node->server.latencyMillis = latency;
+    node->server.lossRate = lossPercent / 100;
+    if (!node->server.begin(node->port, true)) {
+      return 1;
+    }
+
+    // the servers are nested, the epoll instance of a node is readable while any of its sockets is ready
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = nodeIndex;
+    if (epoll_ctl(fleetFd, EPOLL_CTL_ADD, node->server.getFd(), &event) < 0) {
+      fprintf(stderr, "Could not watch node %ld: %s\n", nodeIndex, strerror(errno));
+      return 1;
+    }
+
+    if (listFile) {
+      fprintf(listFile, "%ld %u %s\n", nodeIndex, node->port, pty ? node->serialPort.ptyPath.c_str() : "-");
+    }
+  }
+
+  if (listFile) {
+    fclose(listFile);
+  }
+
+  size_t setupResidentBytes = getResidentBytes();
+  size_t setupHeapBytes = getHeapBytes();
+  fprintf(stderr,
+    "%s %s: %ld nodes on ports %ld-%ld\n"
+    "memory per node: %zu bytes of objects, %zu bytes of heap, %zu bytes resident\n",
+    HTTP_SERVER_ADVANCED_NAME,
+    HTTP_SERVER_ADVANCED_VERSION,
+    nodeCount,
+    firstPort,
+    firstPort + nodeCount - 1,
+    sizeof(FleetNode),
+    (setupHeapBytes - startHeapBytes) / nodeCount,
+    (setupResidentBytes - startResidentBytes) / nodeCount
+  );
+
+  std::vector<struct epoll_event> events(nodeCount);
+  size_t inputIndex = 0;
+  uint32_t scriptStartMillis = millis();
+  uint32_t lastFlushMillis = millis();
+  uint32_t startMillis = millis();
+  uint32_t lastReportMillis = millis();
+  uint64_t lastRequests = 0;
+
+  while (!stopRequested) {
+    // sleeps until a socket is ready, a delayed segment or a line of the script is due
+    int timeoutMillis = FLEET_LOOP_TIMEOUT_MS;
+    for (FleetNode* node : nodes) {
+      timeoutMillis = node->server.getWaitMillis(timeoutMillis);
+    }
+    if (inputIndex < inputs.size()) {
+      int32_t dueMillis = scriptStartMillis + inputs[inputIndex].offsetMillis - (uint32_t)millis();
+      timeoutMillis = max(0, min(timeoutMillis, (int)dueMillis));
+    }
+
+    int eventCount = epoll_wait(fleetFd, events.data(), events.size(), timeoutMillis);
+    for (int eventIndex = 0; eventIndex < eventCount; eventIndex++) {
+      FleetNode* node = nodes[events[eventIndex].data.u32];
+      node->server.loop(0);
+      node->served = true;
+    }
+
+    // the nodes with connections waiting for their turn or delayed segments due, but no socket ready
+    for (FleetNode* node : nodes) {
+      if (!node->served && node->server.getWaitMillis(1) == 0) {
+        node->server.loop(0);
+        node->served = true;
+      }
+
+      if (node->served) {
+        node->api.serialQueue.drain();
+        node->served = false;
+      }
+    }
+
+    uint32_t now = millis();
+    while (inputIndex < inputs.size() && (int32_t)(now - scriptStartMillis - inputs[inputIndex].offsetMillis) >= 0) {
+      FleetInput* input = &inputs[inputIndex++];
+      for (uint32_t nodeIndex = input->firstNode; nodeIndex <= input->lastNode; nodeIndex++) {
+        FakeGpio* gpio = &nodes[nodeIndex]->gpio;
+        byte level = input->level == FLEET_INPUT_TOGGLE ? !gpio->inputs[input->pinNumber] : input->level;
+        gpio->setInput(input->pinNumber, level);
+      }
+    }
+
+    if (inputIndex >= inputs.size() && scriptPeriod > 0 && now - scriptStartMillis >= (uint32_t)scriptPeriod) {
+      scriptStartMillis += scriptPeriod;
+      inputIndex = 0;
+    }
+
+    // the idle nodes are run too, for the sweep of their idle connections
+    if (now - lastFlushMillis >= FLEET_FLUSH_PERIOD_MS) {
+      lastFlushMillis = now;
+      for (FleetNode* node : nodes) {
+        node->server.loop(0);
+        node->api.serialQueue.drain();
+        node->api.settings.flush();
+      }
+    }
+
+    if (now - lastReportMillis >= (uint32_t)reportSeconds * 1000) {
+      uint64_t requests = 0;
+      uint64_t limited = 0;
+      uint64_t lost = 0;
+      size_t connections = 0;
+      for (FleetNode* node : nodes) {
+        requests += node->server.pipeline.requests;
+        limited += node->server.pipeline.rateLimiter.rejected;
+        lost += node->server.lostSegments;
+        connections += node->server.getConnectionCount();
+      }
+
+      size_t residentBytes = getResidentBytes();
+      printf(
+        "%.1fs connections: %zu, requests: %llu, %.1f/s, limited: %llu, lost segments: %llu, resident: %zuKB, per node: %zuB\n",
+        (now - startMillis) / 1000.0,
+        connections,
+        (unsigned long long)requests,
+        (requests - lastRequests) * 1000.0 / (now - lastReportMillis),
+        (unsigned long long)limited,
+        (unsigned long long)lost,
+        residentBytes / 1024,
+        residentBytes > startResidentBytes ? (residentBytes - startResidentBytes) / nodeCount : 0
+      );
+      fflush(stdout);
+
+      lastRequests = requests;
+      lastReportMillis = now;
+    }
+  }
+
+  for (FleetNode* node : nodes) {
+    delete node;
+  }
+  close(fleetFd);
+
+  return 0;
+}
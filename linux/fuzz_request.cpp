@@ -0,0 +1,108 @@
+#include <Arduino.h>
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string>
+#include <sys/stat.h>
+
+#include "RestApi.h"
+#include "HttpPipeline.h"
+#include "FakeGpio.h"
+#include "MemorySettingsStore.h"
+#include "TermiosSerialPort.h"
+
+/**
+ * Fuzz target of the request pipeline: the framing, the parsing of HttpRequest and processRequest().
+ * The first byte of the input splits the rest in two segments, so the requests split between reads are covered too.
+ * Every input starts from blank settings and pins, so a crash reproduces from its input alone.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+  useVirtualClock(0);
+
+  RestApi api;
+  FakeGpio gpio;
+  MemorySettingsStore store;
+  TermiosSerialPort serialPort;
+  api.setupPlatform(&gpio, &store, &serialPort);
+  api.settings.setup();
+
+  HttpPipeline pipeline;
+  pipeline.setup(&api);
+  pipeline.rateLimiter.setup(0, 1);
+
+  size_t splitIndex = size > 0 ? min((size_t)data[0], size - 1) + 1 : 0;
+
+  HttpSession session;
+  session.input.assign((const char*)data + min(size, (size_t)1), splitIndex > 0 ? splitIndex - 1 : 0);
+  while (pipeline.processNext(&session));
+
+  session.input.append((const char*)data + splitIndex, size - splitIndex);
+  while (pipeline.processNext(&session));
+
+  return 0;
+}
+
+#ifndef HSA_LIBFUZZER
+
+static bool runFile(const std::string& path)
+{
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    fprintf(stderr, "Could not open %s\n", path.c_str());
+    return false;
+  }
+
+  std::string input;
+  char buffer[4096];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    input.append(buffer, length);
+  }
+  fclose(file);
+
+  LLVMFuzzerTestOneInput((const uint8_t*)input.data(), input.size());
+  return true;
+}
+
+/**
+ * Without libFuzzer the target runs the files and directories given once, e.g. the corpus or a crash to reproduce.
+ */
+int main(int argc, char** argv)
+{
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s {file or directory}...\n", argv[0]);
+    return 2;
+  }
+
+  uint32_t inputs = 0;
+  for (int argIndex = 1; argIndex < argc; argIndex++) {
+    std::string path = argv[argIndex];
+    struct stat status;
+    if (stat(path.c_str(), &status) < 0) {
+      fprintf(stderr, "Could not open %s\n", path.c_str());
+      return 1;
+    }
+
+    if (!S_ISDIR(status.st_mode)) {
+      inputs += runFile(path);
+      continue;
+    }
+
+    DIR* directory = opendir(path.c_str());
+    struct dirent* entry;
+    while (directory && (entry = readdir(directory))) {
+      if (entry->d_name[0] != '.') {
+        inputs += runFile(path + "/" + entry->d_name);
+      }
+    }
+    if (directory) {
+      closedir(directory);
+    }
+  }
+
+  printf("%u inputs run\n", inputs);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,218 @@
+#include <Arduino.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <sys/resource.h>
+
+#include "RestApi.h"
+#include "EpollServer.h"
+#include "LinuxGpio.h"
+#include "FakeGpio.h"
+#include "TermiosSerialPort.h"
+#include "FileSettingsStore.h"
+#include "TrafficCapture.h"
+
+// How long the event loop sleeps at most, the period of the serial output and the deferred commits.
+#define GATEWAY_LOOP_TIMEOUT_MS 10
+#define GATEWAY_FLUSH_PERIOD_MS 1000
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int signalNumber)
+{
+  stopRequested = 1;
+}
+
+static void printUsage(const char* name)
+{
+  fprintf(stderr,
+    "Usage: %s [options]\n"
+    "  --port {port}            HTTP port, default 8080.\n"
+    "  --settings {path}        File of the settings, default hsa-settings.bin.\n"
+    "  --chip {path}            GPIO chip, default /dev/gpiochip0.\n"
+    "  --pins {lines}           Comma separated line offsets of the digital pins from D0, - for none, e.g. 17,27,-,22\n"
+    "  --fake-gpio              Pins in memory instead of a GPIO chip.\n"
+    "  --serial {path}          Serial port of /serial, e.g. /dev/ttyUSB0.\n"
+    "  --baud {rate}            Baud rate of the serial port, default 115200.\n"
+    "  --rate {requests}        Requests per second of a client in the long run, 0 for no limit, default %d.\n"
+    "  --burst {requests}       Requests of a client at once, default %d.\n"
+    "  --capture {path}         Records the traffic to the file, for hsa-replay.\n"
+    "  --verbose                Logs to the stdout.\n",
+    name,
+    RATE_LIMITER_DEFAULT_RATE,
+    RATE_LIMITER_DEFAULT_BURST
+  );
+}
+
+/**
+ * The connections are file descriptors, the soft limit is raised to the hard limit for the thousands of them.
+ */
+static void raiseFileLimit()
+{
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  long port = 8080;
+  String settingsPath = "hsa-settings.bin";
+  String chipPath = "/dev/gpiochip0";
+  String pinLines = "";
+  bool fakeGpio = false;
+  String serialPath = "";
+  long baudRate = 115200;
+  long rate = RATE_LIMITER_DEFAULT_RATE;
+  long burst = RATE_LIMITER_DEFAULT_BURST;
+  String capturePath = "";
+  bool verbose = false;
+
+  for (int argIndex = 1; argIndex < argc; argIndex++) {
+    String arg = argv[argIndex];
+    bool hasValue = argIndex + 1 < argc;
+
+    if (arg == "--port" && hasValue) {
+      port = String(argv[++argIndex]).toInt();
+    }
+    else if (arg == "--settings" && hasValue) {
+      settingsPath = argv[++argIndex];
+    }
+    else if (arg == "--chip" && hasValue) {
+      chipPath = argv[++argIndex];
+    }
+    else if (arg == "--pins" && hasValue) {
+      pinLines = argv[++argIndex];
+    }
+    else if (arg == "--fake-gpio") {
+      fakeGpio = true;
+    }
+    else if (arg == "--serial" && hasValue) {
+      serialPath = argv[++argIndex];
+    }
+    else if (arg == "--baud" && hasValue) {
+      baudRate = String(argv[++argIndex]).toInt();
+    }
+    else if (arg == "--rate" && hasValue) {
+      rate = String(argv[++argIndex]).toInt();
+    }
+    else if (arg == "--burst" && hasValue) {
+      burst = String(argv[++argIndex]).toInt();
+    }
+    else if (arg == "--capture" && hasValue) {
+      capturePath = argv[++argIndex];
+    }
+    else if (arg == "--verbose") {
+      verbose = true;
+    }
+    else {
+      printUsage(argv[0]);
+      return 2;
+    }
+  }
+
+  if (port < 1 || port > 65535) {
+    fprintf(stderr, "The port is out of range. Range: 1-65535\n");
+    return 2;
+  }
+
+  if (rate < 0 || rate > 65535 || burst < 1 || burst > 65535) {
+    fprintf(stderr, "The rate and the burst are out of range. Range: 0-65535, 1-65535\n");
+    return 2;
+  }
+
+  raiseFileLimit();
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  RestApi api;
+  if (verbose) {
+    api.enableDebug(true, false);
+  }
+
+  FakeGpio memoryGpio;
+  LinuxGpio chipGpio;
+  GpioDriver* gpio = &memoryGpio;
+  if (!fakeGpio) {
+    byte digitalPinNumber = 0;
+    int lineStart = 0;
+    while (lineStart <= (int)pinLines.length() && pinLines.length() > 0 && digitalPinNumber < LINUX_GPIO_PIN_COUNT) {
+      int lineEnd = pinLines.indexOf(',', lineStart);
+      if (lineEnd < 0) {
+        lineEnd = pinLines.length();
+      }
+
+      String line = pinLines.substring(lineStart, lineEnd);
+      line.trim();
+      if (line != "-") {
+        chipGpio.mapPin(digitalPinNumber, line.toInt());
+      }
+
+      digitalPinNumber++;
+      lineStart = lineEnd + 1;
+    }
+
+    if (!chipGpio.begin(chipPath)) {
+      return 1;
+    }
+    gpio = &chipGpio;
+  }
+
+  // without a serial port /serial reads nothing, and its writes are refused once the queue is full
+  TermiosSerialPort serialPort;
+  if (serialPath.length() > 0 && !serialPort.begin(serialPath, baudRate)) {
+    return 1;
+  }
+
+  FileSettingsStore store(settingsPath);
+  api.setupPlatform(gpio, &store, &serialPort);
+  api.settings.setup();
+  if (api.settings.hasDataRestored()) {
+    api.pins.restorePinModesAndStates();
+  }
+
+  if (api.settings.getNodeName().length() == 0) {
+    api.settings.setNodeName("DomGateway");
+  }
+
+  // a burst of requests costs a single write of the file
+  api.settings.deferCommits = true;
+
+  // declared first so it is destroyed after the server, which records the closes of the connections left
+  TrafficCapture capture(capturePath);
+
+  EpollServer server;
+  server.setup(&api);
+  server.pipeline.rateLimiter.setup(rate, burst);
+
+  // the settings and the rate limit at the start are in the capture, the replay starts from the same state
+  if (capturePath.length() > 0) {
+    if (!capture.begin(&store, EEPROM_LENGTH, &server.pipeline.rateLimiter)) {
+      return 1;
+    }
+    server.capture = &capture;
+  }
+
+  if (!server.begin(port)) {
+    return 1;
+  }
+
+  fprintf(stderr, "%s %s listening on port %ld\n", HTTP_SERVER_ADVANCED_NAME, HTTP_SERVER_ADVANCED_VERSION, port);
+
+  uint32_t lastFlushMillis = millis();
+  while (!stopRequested) {
+    server.loop(api.serialQueue.isEmpty() ? GATEWAY_LOOP_TIMEOUT_MS * 10 : GATEWAY_LOOP_TIMEOUT_MS);
+    api.serialQueue.drain();
+
+    if (millis() - lastFlushMillis >= GATEWAY_FLUSH_PERIOD_MS) {
+      lastFlushMillis = millis();
+      api.settings.flush();
+      capture.flush();
+    }
+  }
+
+  api.settings.flush();
+  return 0;
+}
@@ -0,0 +1,258 @@
+#include <Arduino.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+
+#include "RestApi.h"
+#include "HttpPipeline.h"
+#include "TrafficCapture.h"
+#include "FakeGpio.h"
+#include "MemorySettingsStore.h"
+#include "TermiosSerialPort.h"
+
+// Bytes shown around the first difference of a response.
+#define REPLAY_DIFF_CONTEXT 60
+
+struct ReplaySession : HttpSession {
+  // The responses of the capture.
+  std::string expected;
+  bool queued = false;
+};
+
+static uint64_t getMonotonicMicros()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void printUsage(const char* name)
+{
+  fprintf(stderr,
+    "Usage: %s {capture} [options]\n"
+    "Replays the traffic recorded by hsa-gateway --capture, and checks the responses against the recorded ones.\n"
+    "  --corpus {directory}     Writes every request to a file of the directory, the corpus of hsa-fuzz-request.\n"
+    "  --verbose                Logs to the stdout.\n",
+    name
+  );
+}
+
+static std::string escape(const std::string& data, size_t offset)
+{
+  std::string escaped;
+  size_t end = std::min(data.size(), offset + REPLAY_DIFF_CONTEXT);
+  for (size_t index = offset; index < end; index++) {
+    char character = data[index];
+    if (character == '\r') {
+      escaped += "\\r";
+    }
+    else if (character == '\n') {
+      escaped += "\\n";
+    }
+    else if (character < 0x20 || character > 0x7E) {
+      char hex[5];
+      snprintf(hex, sizeof(hex), "\\x%02x", (byte)character);
+      escaped += hex;
+    }
+    else {
+      escaped += character;
+    }
+  }
+
+  return escaped;
+}
+
+/**
+ * Writes the request to the corpus, named by its FNV-1a hash, so the same request is written once.
+ */
+static void writeCorpusFile(const String& directory, const std::string& request)
+{
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t index = 0; index < request.size(); index++) {
+    hash = (hash ^ (byte)request[index]) * 1099511628211ull;
+  }
+
+  char name[17];
+  snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+  String path = directory + "/" + name;
+
+  FILE* file = fopen(path.c_str(), "wb");
+  if (!file) {
+    return;
+  }
+  fwrite(request.data(), 1, request.size(), file);
+  fclose(file);
+}
+
+int main(int argc, char** argv)
+{
+  String capturePath = "";
+  String corpusDirectory = "";
+  bool verbose = false;
+
+  for (int argIndex = 1; argIndex < argc; argIndex++) {
+    String arg = argv[argIndex];
+    bool hasValue = argIndex + 1 < argc;
+
+    if (arg == "--corpus" && hasValue) {
+      corpusDirectory = argv[++argIndex];
+    }
+    else if (arg == "--verbose") {
+      verbose = true;
+    }
+    else if (arg.length() > 0 && arg.charAt(0) != '-' && capturePath.length() == 0) {
+      capturePath = arg;
+    }
+    else {
+      printUsage(argv[0]);
+      return 2;
+    }
+  }
+
+  if (capturePath.length() == 0) {
+    printUsage(argv[0]);
+    return 2;
+  }
+
+  HttpPipeline pipeline;
+  TrafficCapture capture(capturePath);
+  std::string settingsBytes;
+  if (!capture.open(&settingsBytes, &pipeline.rateLimiter)) {
+    return 2;
+  }
+
+  // the same start as the gateway, but the time only moves as recorded
+  useVirtualClock(0);
+
+  RestApi api;
+  if (verbose) {
+    api.enableDebug(true, false);
+  }
+
+  FakeGpio gpio;
+  MemorySettingsStore store(settingsBytes);
+  // not opened, as the gateway without --serial
+  TermiosSerialPort serialPort;
+  api.setupPlatform(&gpio, &store, &serialPort);
+  api.settings.setup();
+  if (api.settings.hasDataRestored()) {
+    api.pins.restorePinModesAndStates();
+  }
+  api.settings.deferCommits = true;
+
+  pipeline.setup(&api);
+
+  std::map<uint32_t, ReplaySession> sessions;
+  std::deque<uint32_t> readyQueue;
+  std::vector<uint32_t> latencies;
+  uint64_t inputBytes = 0;
+  uint64_t virtualMicros = 0;
+  uint64_t busyMicros = 0;
+
+  TrafficRecord record;
+  while (capture.read(&record)) {
+    advanceVirtualClock(record.deltaMicros);
+    virtualMicros += record.deltaMicros;
+
+    ReplaySession* session = &sessions[record.connectionId];
+    switch (record.type) {
+      case TRAFFIC_RECORD_OPEN:
+        session->address = record.address;
+        break;
+      case TRAFFIC_RECORD_INPUT:
+        // as the server, the requests after a "Connection: close" are dropped
+        if (!session->closing) {
+          session->input += record.data;
+          inputBytes += record.data.size();
+        }
+        break;
+      case TRAFFIC_RECORD_OUTPUT:
+        session->expected += record.data;
+        break;
+      case TRAFFIC_RECORD_CLOSE:
+        session->peerClosed = true;
+        break;
+    }
+
+    if (record.type == TRAFFIC_RECORD_INPUT && !session->queued) {
+      session->queued = true;
+      readyQueue.push_back(record.connectionId);
+    }
+
+    // the connections take turns a request each, as in the server, until every whole request is answered
+    while (!readyQueue.empty()) {
+      uint32_t connectionId = readyQueue.front();
+      readyQueue.pop_front();
+
+      ReplaySession* readySession = &sessions[connectionId];
+      readySession->queued = false;
+
+      size_t requestLength = 0;
+      if (corpusDirectory.length() > 0 && HttpPipeline::getRequestLength(readySession->input, &requestLength) && requestLength > 0) {
+        writeCorpusFile(corpusDirectory, readySession->input.substr(0, requestLength));
+      }
+
+      uint32_t requests = pipeline.requests;
+      uint64_t startMicros = getMonotonicMicros();
+      bool more = pipeline.processNext(readySession);
+      uint64_t elapsedMicros = getMonotonicMicros() - startMicros;
+      if (pipeline.requests != requests) {
+        latencies.push_back(elapsedMicros);
+        busyMicros += elapsedMicros;
+      }
+
+      if (more) {
+        readySession->queued = true;
+        readyQueue.push_back(connectionId);
+      }
+    }
+  }
+
+  if (capture.error.length() > 0) {
+    return 2;
+  }
+
+  uint32_t mismatches = 0;
+  uint64_t outputBytes = 0;
+  for (auto& entry : sessions) {
+    ReplaySession* session = &entry.second;
+    outputBytes += session->output.size();
+    if (session->output == session->expected) {
+      continue;
+    }
+
+    size_t offset = 0;
+    while (offset < session->output.size() && offset < session->expected.size() && session->output[offset] == session->expected[offset]) {
+      offset++;
+    }
+
+    mismatches++;
+    printf("connection %u differs at byte %zu\n", entry.first, offset);
+    printf("  recorded: %s\n", escape(session->expected, offset).c_str());
+    printf("  replayed: %s\n", escape(session->output, offset).c_str());
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  size_t count = latencies.size();
+  printf("connections: %zu\n", sessions.size());
+  printf("requests: %zu\n", count);
+  printf("input: %llu bytes, output: %llu bytes\n", (unsigned long long)inputBytes, (unsigned long long)outputBytes);
+  printf("recorded span: %.3fs\n", virtualMicros / 1e6);
+  printf("processing: %.3fms, %.0f requests/s\n", busyMicros / 1e3, busyMicros > 0 ? count * 1e6 / busyMicros : 0.0);
+  if (count > 0) {
+    printf(
+      "latency: p50 %uus, p90 %uus, p99 %uus, max %uus\n",
+      latencies[count / 2],
+      latencies[count * 9 / 10],
+      latencies[count * 99 / 100],
+      latencies[count - 1]
+    );
+  }
+  printf("mismatches: %u\n", mismatches);
+
+  return mismatches > 0 ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+#include <Arduino.h>
+
+#include <stdio.h>
+
+#include "RestApi.h"
+#include "FakeGpio.h"
+#include "MemorySettingsStore.h"
+#include "TermiosSerialPort.h"
+
+/**
+ * Test of the /digital and /batch endpoints on pins in memory: the requests go through processRequest(),
+ * the modes and the levels are checked on the FakeGpio underneath Pins.
+ */
+
+static int failures = 0;
+
+#define CHECK(condition) \
+  if (!(condition)) { \
+    fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #condition); \
+    failures++; \
+  }
+
+static RestApi api;
+static FakeGpio gpio;
+static MemorySettingsStore store;
+static TermiosSerialPort serialPort;
+
+/**
+ * Parses the request from its raw form, with the Content-Length of the data, and processes it.
+ * @param  method
+ * @param  uri
+ * @param  data
+ * @return HttpResponse
+ */
+static HttpResponse request(const char* method, const char* uri, const char* data = "")
+{
+  String raw = String(method) + " " + uri + " HTTP/1.1\r\n" +
+    "Content-Length: " + String(strlen(data)) + "\r\n\r\n" +
+    data;
+
+  HttpRequest httpRequest;
+  httpRequest.parse(raw);
+  return api.processRequest(&httpRequest);
+}
+
+static void testOutput()
+{
+  HttpResponse response = request("PUT", "/digital/5", "output");
+  CHECK(response.code == 200);
+  CHECK(api.settings.isPinInitalized(5));
+  CHECK(gpio.modes[5] == OUTPUT);
+
+  response = request("POST", "/digital/5", "high");
+  CHECK(response.code == 200);
+  CHECK(gpio.outputs[5] == HIGH);
+  CHECK(response.data.indexOf("state: 1\r\n") >= 0);
+
+  response = request("POST", "/digital/5", "0");
+  CHECK(response.code == 200);
+  CHECK(gpio.outputs[5] == LOW);
+
+  response = request("POST", "/digital/5", "maybe");
+  CHECK(response.code == 500);
+  CHECK(gpio.outputs[5] == LOW);
+
+  response = request("PUT", "/digital/5", "input");
+  CHECK(response.code == 406);
+  CHECK(gpio.modes[5] == OUTPUT);
+}
+
+static void testInput()
+{
+  HttpResponse response = request("PUT", "/digital/6", "input_pullup");
+  CHECK(response.code == 200);
+  CHECK(gpio.modes[6] == INPUT_PULLUP);
+
+  // floating, the pullup reads high
+  response = request("GET", "/digital/6");
+  CHECK(response.code == 200);
+  CHECK(response.data.indexOf("state: 1\r\n") >= 0);
+
+  gpio.setInput(6, LOW);
+  response = request("GET", "/digital/6");
+  CHECK(response.data.indexOf("state: 0\r\n") >= 0);
+
+  response = request("POST", "/digital/6", "1");
+  CHECK(response.code == 406);
+
+  response = request("PUT", "/digital/7", "sideways");
+  CHECK(response.code == 400);
+  CHECK(!api.settings.isPinInitalized(7));
+}
+
+static void testErrors()
+{
+  HttpResponse response = request("GET", "/digital/16");
+  CHECK(response.code == 400);
+
+  response = request("GET", "/digital/x");
+  CHECK(response.code == 400);
+
+  response = request("GET", "/digital/8");
+  CHECK(response.code == 200);
+  CHECK(response.data.indexOf("state: ?\r\n") >= 0);
+
+  // a locked pin only reads
+  api.settings.setPinLock(5);
+  response = request("POST", "/digital/5", "1");
+  CHECK(response.code == 406);
+  CHECK(gpio.outputs[5] == LOW);
+
+  response = request("GET", "/digital/5");
+  CHECK(response.code == 200);
+  CHECK(response.data.indexOf("locked: 1\r\n") >= 0);
+  api.settings.unsetPinLock(5);
+}
+
+static void testDelete()
+{
+  HttpResponse response = request("DELETE", "/digital/6");
+  CHECK(response.code == 200);
+  CHECK(!api.settings.isPinInitalized(6));
+
+  response = request("PUT", "/digital/6", "output");
+  CHECK(response.code == 200);
+  CHECK(gpio.modes[6] == OUTPUT);
+}
+
+static void testBatch()
+{
+  HttpResponse response = request("POST", "/batch", "put /digital/9 output\npost /digital/9 1\npost /digital/6 1");
+  CHECK(response.code == 200);
+  CHECK(gpio.modes[9] == OUTPUT);
+  CHECK(gpio.outputs[9] == HIGH && gpio.outputs[6] == HIGH);
+
+  // the second operation fails, the first is rolled back
+  response = request("POST", "/batch", "put /digital/10 output\npost /digital/7 1");
+  CHECK(response.code == 406);
+  CHECK(!api.settings.isPinInitalized(10));
+
+  response = request("POST", "/batch", "delete /digital/9");
+  CHECK(response.code == 400);
+  CHECK(api.settings.isPinInitalized(9));
+
+  // the data cut short of the Content-Length
+  HttpRequest httpRequest;
+  httpRequest.parse("POST /batch HTTP/1.1\r\nContent-Length: 40\r\n\r\npost /digital/9 0");
+  response = api.processRequest(&httpRequest);
+  CHECK(response.code == 400);
+  CHECK(gpio.outputs[9] == HIGH);
+}
+
+int main()
+{
+  api.setupPlatform(&gpio, &store, &serialPort);
+  api.settings.setup();
+
+  testOutput();
+  testInput();
+  testErrors();
+  testDelete();
+  testBatch();
+
+  if (failures > 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+
+  printf("OK\n");
+  return 0;
+}
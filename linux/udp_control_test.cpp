@@ -0,0 +1,250 @@
+#include <Arduino.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "RestApi.h"
+#include "UdpControl.h"
+#include "FakeGpio.h"
+#include "MemorySettingsStore.h"
+#include "TermiosSerialPort.h"
+
+/**
+ * Test of the UDP control protocol over the loopback: the frames are sent from a socket of the test
+ * to UdpControl listening on its own, the acknowledgements are read back from the socket.
+ */
+
+static int failures = 0;
+
+#define CHECK(condition) \
+  if (!(condition)) { \
+    fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #condition); \
+    failures++; \
+  }
+
+static RestApi api;
+static FakeGpio gpio;
+static MemorySettingsStore store;
+static TermiosSerialPort serialPort;
+static UdpControl control;
+static int clientFd = -1;
+
+static void sendFrame(byte opcode, uint16_t sequence, byte flags, byte group, const byte* payload, size_t payloadLength)
+{
+  byte frame[UDP_CONTROL_MAX_FRAME_LENGTH] = {
+    UDP_CONTROL_MAGIC_0, UDP_CONTROL_MAGIC_1, UDP_CONTROL_VERSION, opcode,
+    (byte)(sequence & 0xFF), (byte)(sequence >> 8), flags, group
+  };
+  if (payloadLength > 0) {
+    memcpy(frame + UDP_CONTROL_HEADER_LENGTH, payload, payloadLength);
+  }
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(control.port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sendto(clientFd, frame, UDP_CONTROL_HEADER_LENGTH + payloadLength, 0, (struct sockaddr*)&address, sizeof(address));
+}
+
+/**
+ * Runs the loop of UdpControl until the acknowledgement arrives, or 100ms passed.
+ * @param  ack
+ * @return size_t Length of the acknowledgement, 0 if none arrived.
+ */
+static size_t receiveAck(byte* ack)
+{
+  for (byte attempt = 0; attempt < 100; attempt++) {
+    control.loop(true);
+
+    ssize_t length = recv(clientFd, ack, UDP_CONTROL_MAX_FRAME_LENGTH, MSG_DONTWAIT);
+    if (length > 0) {
+      return length;
+    }
+
+    delay(1);
+  }
+
+  return 0;
+}
+
+static void testInitSetGet()
+{
+  byte ack[UDP_CONTROL_MAX_FRAME_LENGTH];
+
+  byte init[] = {5, 1};
+  sendFrame(UDP_CONTROL_OP_INIT, 1, 0, 0, init, sizeof(init));
+  CHECK(receiveAck(ack) == UDP_CONTROL_HEADER_LENGTH + 1);
+  CHECK(ack[3] == (UDP_CONTROL_OP_INIT | UDP_CONTROL_OP_ACK));
+  CHECK(ack[4] == 1 && ack[5] == 0);
+  CHECK(ack[UDP_CONTROL_HEADER_LENGTH] == UDP_CONTROL_STATUS_OK);
+  CHECK(api.settings.isPinInitalized(5));
+  CHECK(gpio.modes[5] == OUTPUT);
+
+  byte set[] = {5, 1};
+  sendFrame(UDP_CONTROL_OP_SET, 2, 0, 0, set, sizeof(set));
+  CHECK(receiveAck(ack) == UDP_CONTROL_HEADER_LENGTH + 1);
+  CHECK(ack[UDP_CONTROL_HEADER_LENGTH] == UDP_CONTROL_STATUS_OK);
+  CHECK(gpio.outputs[5] == HIGH);
+
+  byte get[] = {5};
+  sendFrame(UDP_CONTROL_OP_GET, 3, 0, 0, get, sizeof(get));
+  CHECK(receiveAck(ack) == UDP_CONTROL_HEADER_LENGTH + 6);
+  CHECK(ack[UDP_CONTROL_HEADER_LENGTH] == UDP_CONTROL_STATUS_OK);
+  CHECK(ack[UDP_CONTROL_HEADER_LENGTH + 1] == 5);
+  CHECK(ack[UDP_CONTROL_HEADER_LENGTH + 2] == 1);
+  CHECK(ack[UDP_CONTROL_HEADER_LENGTH + 4] == HIGH);
+  CHECK(ack[UDP_CONTROL_HEADER_LENGTH + 5] == OUTPUT);
+
+  // the pin is initialized already
+  sendFrame(UDP_CONTROL_OP_INIT, 4, 0, 0, init, sizeof(init));
+  CHECK(receiveAck(ack) == UDP_CONTROL_HEADER_LENGTH + 1);
+  CHECK(ack[UDP_CONTROL_HEADER_LENGTH] == UDP_CONTROL_STATUS_UNACCEPTABLE);
+}
+
+static void testMasks()
+{
+  byte ack[UDP_CONTROL_MAX_FRAME_LENGTH];
+
+  byte init[] = {6, 1};
+  sendFrame(UDP_CONTROL_OP_INIT, 10, 0, 0, init, sizeof(init));
+  CHECK(receiveAck(ack) > 0);
+
+  // pin 5 low, pin 6 high
+  byte setMask[] = {0x60, 0x00, 0x40, 0x00};
+  sendFrame(UDP_CONTROL_OP_SET_MASK, 11, 0, 0, setMask, sizeof(setMask));
+  CHECK(receiveAck(ack) == UDP_CONTROL_HEADER_LENGTH + 1);
+  CHECK(ack[UDP_CONTROL_HEADER_LENGTH] == UDP_CONTROL_STATUS_OK);
+  CHECK(gpio.outputs[5] == LOW && gpio.outputs[6] == HIGH);
+
+  sendFrame(UDP_CONTROL_OP_GET_MASK, 12, 0, 0, nullptr, 0);
+  CHECK(receiveAck(ack) == UDP_CONTROL_HEADER_LENGTH + 5);
+  CHECK(ack[UDP_CONTROL_HEADER_LENGTH + 1] == 0x60 && ack[UDP_CONTROL_HEADER_LENGTH + 2] == 0x00);
+  CHECK(ack[UDP_CONTROL_HEADER_LENGTH + 3] == 0x40 && ack[UDP_CONTROL_HEADER_LENGTH + 4] == 0x00);
+
+  // pin 7 is not an output, nothing changes
+  byte badMask[] = {0xE0, 0x00, 0xE0, 0x00};
+  sendFrame(UDP_CONTROL_OP_SET_MASK, 13, 0, 0, badMask, sizeof(badMask));
+  CHECK(receiveAck(ack) == UDP_CONTROL_HEADER_LENGTH + 1);
+  CHECK(ack[UDP_CONTROL_HEADER_LENGTH] == UDP_CONTROL_STATUS_UNACCEPTABLE);
+  CHECK(gpio.outputs[5] == LOW);
+}
+
+static void testSequence()
+{
+  byte ack[UDP_CONTROL_MAX_FRAME_LENGTH];
+  byte duplicateAck[UDP_CONTROL_MAX_FRAME_LENGTH];
+
+  byte set[] = {6, 0};
+  sendFrame(UDP_CONTROL_OP_SET, 20, 0, 0, set, sizeof(set));
+  size_t ackLength = receiveAck(ack);
+  CHECK(ackLength == UDP_CONTROL_HEADER_LENGTH + 1);
+  CHECK(gpio.outputs[6] == LOW);
+
+  // a retransmission is answered with the same acknowledgement, without running it again
+  api.pins.setState(6, HIGH);
+  uint32_t duplicates = control.framesDuplicate;
+  sendFrame(UDP_CONTROL_OP_SET, 20, 0, 0, set, sizeof(set));
+  CHECK(receiveAck(duplicateAck) == ackLength);
+  CHECK(memcmp(ack, duplicateAck, ackLength) == 0);
+  CHECK(control.framesDuplicate == duplicates + 1);
+  CHECK(gpio.outputs[6] == HIGH);
+
+  // the next sequence number runs
+  sendFrame(UDP_CONTROL_OP_SET, 21, 0, 0, set, sizeof(set));
+  CHECK(receiveAck(ack) == UDP_CONTROL_HEADER_LENGTH + 1);
+  CHECK(ack[4] == 21 && ack[5] == 0);
+  CHECK(gpio.outputs[6] == LOW);
+
+  // the sequence number is 16 bits, little endian
+  sendFrame(UDP_CONTROL_OP_SET, 0x1234, 0, 0, set, sizeof(set));
+  CHECK(receiveAck(ack) == UDP_CONTROL_HEADER_LENGTH + 1);
+  CHECK(ack[4] == 0x34 && ack[5] == 0x12);
+}
+
+static void testNoAck()
+{
+  byte ack[UDP_CONTROL_MAX_FRAME_LENGTH];
+
+  byte set[] = {6, 1};
+  sendFrame(UDP_CONTROL_OP_SET, 30, UDP_CONTROL_FLAG_NO_ACK, 0, set, sizeof(set));
+  CHECK(receiveAck(ack) == 0);
+  CHECK(gpio.outputs[6] == HIGH);
+
+  // a frame of another group is ignored, the own group runs
+  control.group = 3;
+  byte clear[] = {6, 0};
+  sendFrame(UDP_CONTROL_OP_SET, 31, 0, 4, clear, sizeof(clear));
+  CHECK(receiveAck(ack) == 0);
+  CHECK(gpio.outputs[6] == HIGH);
+
+  sendFrame(UDP_CONTROL_OP_SET, 32, 0, 3, clear, sizeof(clear));
+  CHECK(receiveAck(ack) == UDP_CONTROL_HEADER_LENGTH + 1);
+  CHECK(ack[7] == 3);
+  CHECK(gpio.outputs[6] == LOW);
+  control.group = 0;
+}
+
+static void testMalformed()
+{
+  byte ack[UDP_CONTROL_MAX_FRAME_LENGTH];
+
+  uint32_t rejected = control.framesRejected;
+  byte garbage[] = {'X', 'S', UDP_CONTROL_VERSION, UDP_CONTROL_OP_GET, 40, 0, 0, 0, 5};
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(control.port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sendto(clientFd, garbage, sizeof(garbage), 0, (struct sockaddr*)&address, sizeof(address));
+  CHECK(receiveAck(ack) == 0);
+  CHECK(control.framesRejected == rejected + 1);
+
+  sendFrame(0x7F, 41, 0, 0, nullptr, 0);
+  CHECK(receiveAck(ack) == UDP_CONTROL_HEADER_LENGTH + 1);
+  CHECK(ack[UDP_CONTROL_HEADER_LENGTH] == UDP_CONTROL_STATUS_NOT_FOUND);
+
+  byte badPin[] = {16, 1};
+  sendFrame(UDP_CONTROL_OP_SET, 42, 0, 0, badPin, sizeof(badPin));
+  CHECK(receiveAck(ack) == UDP_CONTROL_HEADER_LENGTH + 1);
+  CHECK(ack[UDP_CONTROL_HEADER_LENGTH] == UDP_CONTROL_STATUS_BAD_REQUEST);
+}
+
+int main()
+{
+  api.setupPlatform(&gpio, &store, &serialPort);
+  api.settings.setup();
+
+  // a port of its own, so the tests can run in parallel
+  control.setup(&api.settings, &api.debug, &api.pins);
+  control.enabled = true;
+  control.port = 20000 + getpid() % 20000;
+
+  // the first loop starts listening, the frames sent before would be lost
+  control.loop(true);
+
+  clientFd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (clientFd < 0) {
+    fprintf(stderr, "Could not open the socket.\n");
+    return 1;
+  }
+
+  testInitSetGet();
+  testMasks();
+  testSequence();
+  testNoAck();
+  testMalformed();
+
+  close(clientFd);
+
+  if (failures > 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,52 @@
+#!/bin/sh
+#
+# Prints the RAM and flash used by each module of the library, from the object files of a build.
+#
+# Usage: tools/size-report.sh {build path} [size tool]
+#
+# The build path is the one of arduino-cli compile --build-path, or the one the Arduino IDE prints
+# in verbose mode. The size tool is found in the PATH by default, xtensa-lx106-elf-size of the ESP8266 core
+# if it is there, the size of the host otherwise, e.g. for the build of the linux directory.
+#
+# On the ESP8266 .rodata is copied to RAM at boot, like .data, so a literal not in F() counts twice,
+# once in RAM and once in flash.
+
+if [ $# -lt 1 ] || [ ! -d "$1" ]; then
+  echo "Usage: $0 {build path} [size tool]" >&2
+  exit 2
+fi
+
+buildPath=$1
+sizeTool=$2
+if [ -z "$sizeTool" ]; then
+  if command -v xtensa-lx106-elf-size >/dev/null 2>&1; then
+    sizeTool=xtensa-lx106-elf-size
+  else
+    sizeTool=size
+  fi
+fi
+
+libraryDir=$(cd "$(dirname "$0")/.." && pwd)
+
+printf "%-24s %8s %8s %8s %8s\n" "module" "ram" "data" "iram" "flash"
+
+for source in "$libraryDir"/*.cpp; do
+  module=$(basename "$source" .cpp)
+  object=$(find "$buildPath" -name "$module.cpp.o" -o -name "$module.cpp.obj" | head -n 1)
+  if [ -z "$object" ]; then
+    continue
+  fi
+
+  # ram: .data, .rodata and .bss, data: the part of it with a value, which is stored in flash as well
+  # iram: IRAM_ATTR code, flash: the code, the F() strings and PROGMEM, and the values of data
+  "$sizeTool" -A "$object" | awk -v module="$module" '
+    $1 ~ /^\.(data|rodata)/ { ram += $2; data += $2; flash += $2 }
+    $1 ~ /^\.bss/ { ram += $2 }
+    $1 ~ /^\.iram/ { iram += $2; flash += $2 }
+    $1 ~ /^\.(text|irom|irom0|literal)/ { flash += $2 }
+    END { printf "%-24s %8d %8d %8d %8d\n", module, ram, data, iram, flash }
+  '
+done | sort -k2 -n -r | awk '
+  { print; ram += $2; data += $3; iram += $4; flash += $5 }
+  END { printf "%-24s %8d %8d %8d %8d\n", "total", ram, data, iram, flash }
+'